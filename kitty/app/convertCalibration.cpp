@@ -0,0 +1,102 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Application convertCalibration: background, gain and mask files
+//	(EDF, HDF5, ... raw 2D images) to kitty calibration files, without psana.
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+using std::string;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+#include "kitty/arrayclasses.h"
+#include "kitty/arraydataIO.h"
+#include "kitty/calibrationfile.h"
+#include "kitty/constants.h"
+
+using namespace kitty;
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "convertCalibration";
+
+	void usage( const char *app ){
+		std::cerr << "usage: " << app << " [-m] <input> <output>\n"
+			<< "       " << app << " -i <file>\n"
+			<< "  -m          the input is a mask, written as one bit per pixel (default: float32 values)\n"
+			<< "  -i          check a kitty calibration file and print its header\n";
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+main( int argc, char **argv )
+{
+	int mask = 0;
+	int inspect = 0;
+
+	int c = 0;
+	while ((c = getopt( argc, argv, "mih" )) != -1){
+		switch (c){
+			case 'm': mask = 1; break;
+			case 'i': inspect = 1; break;
+			default: usage( argv[0] ); return 1;
+		}
+	}
+
+	if (inspect){
+		if (argc - optind != 1){
+			usage( argv[0] );
+			return 1;
+		}
+		CalibrationFile file;
+		if (file.open( argv[optind] )){
+			return 2;
+		}
+		std::cout << argv[optind] << ": " << file.size() << " pixels, "
+			<< (file.payload() == CalibrationFile::FLOAT32 ? "float32" : "bit mask")
+			<< ", converted from '" << file.source() << "', checksum ok\n";
+		return 0;
+	}
+
+	if (argc - optind != 2){
+		usage( argv[0] );
+		return 1;
+	}
+	const string input_fn = argv[optind];
+	const string output_fn = argv[optind+1];
+
+	arraydataIO io;
+	array1D<double> *data = 0;
+	if (CalibrationFile::load( input_fn, data, &io ) || !data){
+		MsgLog(logger, error, "could not read '" << input_fn << "'");
+		delete data;
+		return 2;
+	}
+	if (data->size() != (unsigned int)nMaxTotalPx){
+		MsgLog(logger, warning, "'" << input_fn << "' has " << data->size() << " pixels, a full CSPAD has " << nMaxTotalPx);
+	}
+
+	int fail = CalibrationFile::write( output_fn, data, mask ? CalibrationFile::BITMASK : CalibrationFile::FLOAT32, input_fn );
+	delete data;
+	return fail ? 2 : 0;
+}
@@ -0,0 +1,406 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Application correlateArchive: angular correlations from a polar archive
+//	written by the correlate module (archiveOut = 1), without psana.
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdlib>
+#include <unistd.h>
+
+using std::string;
+using std::vector;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+#include "kitty/arrayclasses.h"
+#include "kitty/arraydataIO.h"
+#include "kitty/calibrationfile.h"
+#include "kitty/maskcorrelation.h"
+#include "kitty/polararchive.h"
+#include "kitty/polarremap.h"
+#include "kitty/ringcorrelator.h"
+#include "kitty/ringpairsum.h"
+#include "kitty/workerpool.h"
+
+using namespace kitty;
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "correlateArchive";
+
+	/// polar bins and mask normalization of one geometry generation, for the rings being correlated
+	struct Geometry {
+		PolarRemap remap;					// only its bin counts are used: bins without valid pixels
+		MaskCorrelation maskCorr;
+	};
+
+	/// ring autocorrelations and running sums, split over the q-rings
+	class AutoTask : public WorkerTask {
+	public:
+		array2D<double> *polar;
+		const PolarRemap *bins;				// 0: all bins as archived
+		const MaskCorrelation *maskNorm;	// 0: no normalization for masked bins
+		RingCorrelator *rc;
+		array2D<double> *corr;
+		array2D<double> *polarSum;
+		array2D<double> *corrSum;
+
+		virtual void execute( int part, int nParts ){
+			if (part >= rc->nParts()){
+				return;
+			}
+			int begin = 0;
+			int end = 0;
+			rc->partRange( part, begin, end );
+			//bins without valid pixels under the mask get the ring mean, as PolarRemap does
+			if (bins){
+				const int nPhi = polar->dim2();
+				for (int iq = begin; iq < end; iq++){
+					double sum = 0;
+					for (int iphi = 0; iphi < nPhi; iphi++){
+						if (bins->binPixels( iq, iphi )){
+							sum += polar->get( iq, iphi );
+						}
+					}
+					const double mean = bins->ringBins( iq ) ? sum/bins->ringBins( iq ) : 0;
+					for (int iphi = 0; iphi < nPhi; iphi++){
+						if (!bins->binPixels( iq, iphi )){
+							polar->set( iq, iphi, mean );
+						}
+					}
+				}
+			}
+			rc->autoCorrelate( polar, corr, part );
+			if (maskNorm){
+				maskNorm->normalize( corr, begin, end );
+			}
+			for (int iq = begin; iq < end; iq++){
+				for (unsigned int iphi = 0; iphi < polar->dim2(); iphi++){
+					polarSum->set( iq, iphi, polarSum->get(iq, iphi) + polar->get(iq, iphi) );
+				}
+				for (unsigned int lag = 0; lag < corr->dim2(); lag++){
+					corrSum->set( iq, lag, corrSum->get(iq, lag) + corr->get(iq, lag) );
+				}
+			}
+		}
+	};
+
+	void usage( const char *app ){
+		std::cerr << "usage: " << app << " [options] <archive.h5> <outputPrefix>\n"
+			<< "  -b <ring>   first ring to correlate (default 0)\n"
+			<< "  -e <ring>   end of the ring range, exclusive (default: all rings)\n"
+			<< "  -t <n>      number of threads (default 1)\n"
+			<< "  -n <n>      use only the first n events (default: all)\n"
+			<< "  -x          cross-correlations of all ring pairs (XCCA) to <outputPrefix>_avg_xcca.h5\n"
+			<< "  -m <MB>     memory for the XCCA sums, spill file above (default 2048)\n"
+			<< "  -B <n>      events per XCCA batch (default 16)\n"
+			<< "  -c <level>  deflate level of the XCCA output (default 0)\n"
+			<< "  -N          normalize the correlations for masked polar bins (maskNormalization of correlate)\n"
+			<< "  -k <file>   additional pixel mask (kitty calibration file or raw image), on top of the archived one;\n"
+			<< "              polar bins left without valid pixels are set to their ring mean (partially masked bins\n"
+			<< "              keep the pixels that were archived)\n"
+			<< "  -s <PV>=<min>:<max>  only events with the archived PV in [min, max], may be repeated\n";
+	}
+
+	/// event selection by an archived PV
+	struct PVRange {
+		string name;
+		int column;
+		double min;
+		double max;
+	};
+
+	/// polar bins and mask normalization of 'generation' for rings [firstRing, endRing), from the archived geometry
+	Geometry* createGeometry( PolarArchive &archive, int generation, const array1D<double> *extraMask, bool maskNorm,
+		int firstRing, int endRing ){
+		array1D<double> *pix1 = 0;
+		array1D<double> *pix2 = 0;
+		array1D<double> *mask = 0;
+		if (archive.readGeometry( generation, pix1, pix2, mask )){
+			return 0;
+		}
+		if (extraMask){
+			if (extraMask->size() != pix1->size()){
+				MsgLog(logger, error, "mask has " << extraMask->size() << " pixels, geometry generation " << generation
+					<< " has " << pix1->size());
+				delete pix1;
+				delete pix2;
+				delete mask;
+				return 0;
+			}
+			if (!mask){
+				mask = new array1D<double>( extraMask );
+			}else{
+				mask->multiplyByArrayElementwise( extraMask );
+			}
+		}
+		const double dq = (archive.stopQ() - archive.startQ())/archive.nQ();
+		Geometry *g = new Geometry();
+		int fail = g->remap.create( pix1, pix2, mask, endRing - firstRing, archive.nPhi(),
+			archive.startQ() + firstRing*dq, archive.startQ() + endRing*dq, generation, archive.units() );
+		if (!fail && maskNorm){
+			fail = g->maskCorr.create( g->remap );
+		}
+		delete pix1;
+		delete pix2;
+		delete mask;
+		if (fail){
+			MsgLog(logger, error, "could not rebuild the polar bins of geometry generation " << generation);
+			delete g;
+			return 0;
+		}
+		return g;
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+main( int argc, char **argv )
+{
+	int firstRing = 0;
+	int endRing = -1;
+	int nThreads = 1;
+	int maxEvents = -1;
+	int xcca = 0;
+	double xccaMemory = 2048;
+	int xccaBatch = 16;
+	int xccaCompression = 0;
+	int maskNormalization = 0;
+	string mask_fn = "";
+	vector<PVRange> ranges;
+
+	int c = 0;
+	while ((c = getopt( argc, argv, "b:e:t:n:xm:B:c:Nk:s:h" )) != -1){
+		switch (c){
+			case 'b': firstRing = atoi( optarg ); break;
+			case 'e': endRing = atoi( optarg ); break;
+			case 't': nThreads = atoi( optarg ); break;
+			case 'n': maxEvents = atoi( optarg ); break;
+			case 'x': xcca = 1; break;
+			case 'm': xccaMemory = atof( optarg ); break;
+			case 'B': xccaBatch = atoi( optarg ); break;
+			case 'c': xccaCompression = atoi( optarg ); break;
+			case 'N': maskNormalization = 1; break;
+			case 'k': mask_fn = optarg; break;
+			case 's': {
+				string arg = optarg;
+				string::size_type eq = arg.find( '=' );
+				string::size_type colon = arg.find( ':', (eq == string::npos) ? 0 : eq );
+				if (eq == string::npos || colon == string::npos){
+					usage( argv[0] );
+					return 1;
+				}
+				PVRange r;
+				r.name = arg.substr( 0, eq );
+				r.column = -1;
+				r.min = atof( arg.substr( eq+1, colon-eq-1 ).c_str() );
+				r.max = atof( arg.substr( colon+1 ).c_str() );
+				ranges.push_back( r );
+				break;
+			}
+			default: usage( argv[0] ); return 1;
+		}
+	}
+	if (argc - optind != 2){
+		usage( argv[0] );
+		return 1;
+	}
+	const string archive_fn = argv[optind];
+	const string prefix = argv[optind+1];
+
+	PolarArchive archive;
+	if (archive.open( archive_fn )){
+		return 2;
+	}
+	if (endRing < 0 || endRing > archive.nQ()){
+		endRing = archive.nQ();
+	}
+	const int nQ = endRing - firstRing;
+	const int nPhi = archive.nPhi();
+	unsigned int nEvents = archive.nEvents();
+	if (maxEvents >= 0 && (unsigned int)maxEvents < nEvents){
+		nEvents = maxEvents;
+	}
+	if (firstRing < 0 || nQ <= 0 || nEvents == 0){
+		MsgLog(logger, error, "nothing to correlate: rings " << firstRing << "..." << endRing << ", " << nEvents << " events");
+		return 2;
+	}
+	MsgLog(logger, info, "correlating rings " << firstRing << "..." << endRing << " of " << nEvents << " events");
+
+	//event selection by the PVs archived with every event
+	for (unsigned int r = 0; r < ranges.size(); r++){
+		const vector<string> &names = archive.pvNames();
+		for (unsigned int k = 0; k < names.size(); k++){
+			if (names[k] == ranges[r].name){
+				ranges[r].column = k;
+			}
+		}
+		if (ranges[r].column < 0){
+			MsgLog(logger, error, "PV '" << ranges[r].name << "' is not in '" << archive_fn << "'");
+			return 2;
+		}
+		MsgLog(logger, info, "only events with " << ranges[r].name << " in [" << ranges[r].min << ", " << ranges[r].max << "]");
+	}
+
+	//the archived geometries are needed for an additional mask or the mask normalization
+	arraydataIO io;
+	array1D<double> *extraMask = 0;
+	if (mask_fn != "" && CalibrationFile::load( mask_fn, extraMask, &io )){
+		MsgLog(logger, error, "could not load mask '" << mask_fn << "'");
+		return 2;
+	}
+	const bool needGeometry = (extraMask || maskNormalization);
+	std::map<int, Geometry*> geometries;
+	const MaskCorrelation *xccaNorm = 0;		// of the first geometry, for the XCCA output and the correlation of the average
+
+	WorkerPool pool;
+	pool.create( nThreads );
+	RingCorrelator rc;
+	if (rc.create( nQ, nPhi, pool.nThreads() )){
+		return 2;
+	}
+	const int nLag = rc.nLag();
+	RingPairSum pairSum;
+	if (xcca && pairSum.create( nQ, nPhi, xccaMemory*1048576., prefix+"_xcca_spill.bin", xccaBatch )){
+		return 2;
+	}
+
+	array2D<double> *polar = new array2D<double>( nQ, nPhi );
+	array2D<double> *corr = new array2D<double>( nQ, nLag );
+	array2D<double> *polarAvg = new array2D<double>( nQ, nPhi );
+	array2D<double> *corrAvg = new array2D<double>( nQ, nLag );
+
+	AutoTask task;
+	task.polar = polar;
+	task.bins = 0;
+	task.maskNorm = 0;
+	task.rc = &rc;
+	task.corr = corr;
+	task.polarSum = polarAvg;
+	task.corrSum = corrAvg;
+
+	PolarArchiveEvent event;
+	vector<double> pvValues;
+	unsigned int count = 0;
+	unsigned int skipped = 0;
+	for (unsigned int i = 0; i < nEvents; i++){
+		if (!ranges.empty()){
+			archive.readPVs( i, pvValues );
+			bool selected = true;
+			for (unsigned int r = 0; r < ranges.size(); r++){
+				const double v = pvValues[ranges[r].column];
+				selected = selected && (v >= ranges[r].min && v <= ranges[r].max);		// NaN is never selected
+			}
+			if (!selected){
+				skipped++;
+				continue;
+			}
+		}
+		if (archive.read( i, polar, event, firstRing, endRing )){
+			continue;
+		}
+		if (needGeometry){
+			std::map<int, Geometry*>::iterator it = geometries.find( event.generation );
+			if (it == geometries.end()){
+				Geometry *g = createGeometry( archive, event.generation, extraMask, maskNormalization != 0, firstRing, endRing );
+				it = geometries.insert( std::make_pair( event.generation, g ) ).first;
+				if (g && !xccaNorm && maskNormalization){
+					xccaNorm = &g->maskCorr;
+				}
+			}
+			if (!it->second){
+				continue;					// events of a geometry that could not be rebuilt
+			}
+			task.bins = extraMask ? &it->second->remap : 0;
+			task.maskNorm = maskNormalization ? &it->second->maskCorr : 0;
+		}
+		pool.run( task );
+		if (xcca){
+			pairSum.add( rc, pool );
+		}
+		count++;
+		if (count % 1000 == 0){
+			MsgLog(logger, info, count << " events");
+		}
+	}
+	if (skipped){
+		MsgLog(logger, info, skipped << " events outside the PV ranges skipped");
+	}
+	if (geometries.size() > 1 && xccaNorm){
+		MsgLog(logger, warning, geometries.size() << " geometry generations, the XCCA output and the correlation of the average "
+			"are normalized with the masked bins of the first one");
+	}
+	if (count == 0){
+		MsgLog(logger, error, "none of the " << nEvents << " events could be read from '" << archive_fn << "' or selected");
+		for (std::map<int, Geometry*>::iterator it = geometries.begin(); it != geometries.end(); it++){
+			delete it->second;
+		}
+		delete extraMask;
+		delete polar;
+		delete corr;
+		delete polarAvg;
+		delete corrAvg;
+		return 2;
+	}
+	polarAvg->divideByValue( count );
+	corrAvg->divideByValue( count );
+
+	//the same outputs as the correlate module
+	array2D<double> *corrOfAvg = new array2D<double>( nQ, nLag );
+	rc.autoCorrelate( polarAvg, corrOfAvg );
+	if (xccaNorm){
+		xccaNorm->normalize( corrOfAvg, 0, nQ );
+	}
+	array2D<double> *diff = new array2D<double>( corrAvg );
+	diff->subtractArrayElementwise( corrOfAvg );
+
+	array1D<double> *q = new array1D<double>( nQ );
+	const double dq = (archive.stopQ() - archive.startQ())/archive.nQ();
+	for (int iq = 0; iq < nQ; iq++){
+		q->set( iq, archive.startQ() + (firstRing + iq + 0.5)*dq );
+	}
+
+	io.writeToFile( prefix+"_avg_polar.h5", polarAvg );
+	io.writeToFile( prefix+"_avg_xaca.h5", corrAvg );
+	io.writeToFile( prefix+"_xacaOfAvg.h5", corrOfAvg );
+	io.writeToFile( prefix+"_xacaDiff.h5", diff );
+	io.writeToFile( prefix+"_avg_qAvg.h5", q );
+	if (xcca){
+		pairSum.flush( pool );
+		pairSum.write( prefix+"_avg_xcca.h5", q, xccaCompression, xccaNorm );
+	}
+	MsgLog(logger, info, count << " events correlated, output written to " << prefix << "_*.h5");
+
+	delete polar;
+	delete corr;
+	delete polarAvg;
+	delete corrAvg;
+	delete corrOfAvg;
+	delete diff;
+	delete q;
+	for (std::map<int, Geometry*>::iterator it = geometries.begin(); it != geometries.end(); it++){
+		delete it->second;
+	}
+	delete extraMask;
+	return 0;
+}
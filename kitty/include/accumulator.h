@@ -0,0 +1,155 @@
+#ifndef KITTY_ACCUMULATOR_H
+#define KITTY_ACCUMULATOR_H
+
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Classes PixelAccumulator and AccumulatorService.
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "kitty/arrayclasses.h"
+#include "kitty/checkpoint.h"
+
+
+//		---------------------
+// 		-- Class Interface --
+//		---------------------
+
+namespace kitty {
+
+//stages at which the CSPAD data can be accumulated
+const std::string STAGE_RAW = "raw";						// as read by discriminate, before any kitty corrections
+const std::string STAGE_CORRECTED = "corrected";			// after the kitty.correct module
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Per-pixel streaming statistics over all events of one stage
+ *
+ *  Keeps count, mean and sum of squared deviations (Welford's algorithm),
+ *  minimum, maximum and the number of events above a threshold for every
+ *  pixel, all updated in a single pass per event. Two accumulators of the
+ *  same size can be merged exactly (Chan et al.), e.g. partial results of
+ *  several threads or jobs.
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+class PixelAccumulator {
+public:
+	PixelAccumulator( unsigned int size );
+	~PixelAccumulator();
+
+	/// add one event
+	void add( const array1D<double> *data );
+
+	/// combine with the state of another accumulator of the same size (and threshold)
+	int merge( const PixelAccumulator &other );
+
+	/// values above this threshold are counted by countAbove(), must be set before the first event
+	void setThreshold( double threshold );
+	double threshold() const;
+
+	unsigned int size() const;
+	unsigned int count() const;
+
+	/// new arrays holding the per-pixel results of all events added so far
+	shared_ptr<array1D<double> > sum() const;
+	shared_ptr<array1D<double> > mean() const;
+	shared_ptr<array1D<double> > variance() const;
+	shared_ptr<array1D<double> > stddev() const;
+	shared_ptr<array1D<double> > min() const;
+	shared_ptr<array1D<double> > max() const;
+	shared_ptr<array1D<double> > countAbove() const;
+
+	/// add the complete state to a checkpoint (block names start with 'prefix'), or restore it from one
+	void save( Checkpoint &cp, const std::string &prefix ) const;
+	int restore( const Checkpoint &cp, const std::string &prefix );
+
+private:
+	std::vector<double> p_mean;
+	std::vector<double> p_m2;			// sum of squared deviations from the mean
+	std::vector<double> p_min;
+	std::vector<double> p_max;
+	std::vector<unsigned int> p_above;
+	double p_threshold;
+	bool p_thresholdSet;
+	unsigned int p_count;
+};
+
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Job-wide accumulation of CSPAD data, shared by all kitty modules
+ *
+ *  Modules subscribe by name to a stage and get that stage's accumulator.
+ *  Every module that produces a stage passes its event data to accumulate(),
+ *  but the data of a stage is added only once per event, no matter how many
+ *  modules have subscribed to it. At endJob, each module reads the statistics it
+ *  needs from the shared accumulator.
+ *
+ *  The raw stage is fed by kitty.discriminate only, before kitty.correct
+ *  changes the data in place. Modules downstream of kitty.correct never
+ *  pass their (corrected) data to the raw stage, they only read from it.
+ *
+ *  Checkpoints hold the complete accumulator state, so a job resumed from
+ *  a checkpoint ends with exactly the result of an uninterrupted job.
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+class AccumulatorService {
+public:
+	static AccumulatorService& instance();
+
+	/// register 'module' as a user of 'stage', returns the accumulator for that stage
+	shared_ptr<PixelAccumulator> subscribe( const std::string &module, const std::string &stage );
+
+	/// true, if at least one module is subscribed to 'stage'
+	bool hasSubscribers( const std::string &stage ) const;
+
+	/// add data of event 'eventname' to 'stage', unless this was already done for this event
+	void accumulate( const std::string &stage, const std::string &eventname, const array1D<double> *data );
+
+	/// write the state of 'stage' after event 'eventname' to 'filename', unless this was already done for this event
+	int checkpoint( const std::string &stage, const std::string &filename, const std::string &eventname );
+
+	/// restore 'stage' from 'filename' (once per stage), events up to the checkpoint's last event are then ignored
+	int resume( const std::string &stage, const std::string &filename );
+
+	/// add the state of 'stage' in a checkpoint of another job (once per file), e.g. of another part of the run
+	int merge( const std::string &stage, const std::string &filename );
+
+private:
+	AccumulatorService();
+	AccumulatorService( const AccumulatorService& );
+	AccumulatorService& operator=( const AccumulatorService& );
+
+	std::map<std::string, shared_ptr<PixelAccumulator> > p_accumulators;
+	std::map<std::string, std::set<std::string> > p_subscribers;
+	std::map<std::string, std::string> p_lastEvent;			// last event added to each stage
+	std::map<std::string, std::string> p_lastCheckpoint;	// last event written to a checkpoint for each stage
+	std::map<std::string, int> p_resumeEvent;				// last event contained in the checkpoint each stage was resumed from
+	std::map<std::string, std::set<std::string> > p_merged;	// checkpoint files merged into each stage
+};
+
+} // namespace kitty
+
+#endif // KITTY_ACCUMULATOR_H
@@ -24,6 +24,10 @@
 //-------------------------------
 #include "kitty/arrayclasses.h"
 #include "kitty/arraydataIO.h"
+#include "kitty/accumulator.h"
+#include "kitty/eventstack.h"
+#include "kitty/assemblyplan.h"
+#include "kitty/previewring.h"
 
 //------------------------------------
 // Collaborating Class Declarations --
@@ -90,6 +94,9 @@ public:
 	/// Method which is called once at the end of the job
 	virtual void endJob(Event& evt, Env& env);
 
+	//re-read the pixel arrays and fetch the assembly plan of the event's geometry generation
+	void updateAssemblyPlan(Event& evt);
+
 
 		
 protected:
@@ -102,13 +109,33 @@ private:
 	
 	shared_ptr<array1D<double> > p_pixX_sp;
 	shared_ptr<array1D<double> > p_pixY_sp;
+	int p_geometryGeneration;					// of the pixel arrays above
+	shared_ptr<AssemblyPlan> p_plan_sp;		// full-resolution assembly, shared with makegain via the GeometryCache
 	
-	shared_ptr<array1D<double> > p_sum_sp;	// keep a running sum of all event
+	std::string p_stage;						// stage of the data to accumulate (raw or corrected)
+	shared_ptr<PixelAccumulator> p_acc_sp;	// running sum of all events, shared with other modules
+	Checkpoint p_checkpoint;					// periodic dump of the accumulator state
+	int p_checkpointEvents;
+	double p_checkpointSeconds;
+	int p_resume;
 
 	int p_tifOut;
 	int p_edfOut;
 	int p_h5Out;
 	int p_singleOutput;
+	int p_stackOut;
+	int p_stackCompression;
+	
+	EventStack *p_stack;		// container for single event output (if stackOut is on)
+	
+	int p_previewOut;
+	int p_previewBinning;
+	double p_previewInterval;
+	int p_previewSlots;
+	int p_previewNQ;
+	std::string p_previewFile;
+	AssemblyPlan p_previewPlan;		// binned assembly (and SAXS profile) of the live preview
+	PreviewRing p_preview;			// where the viewer picks up the preview (if previewOut is on)
 
 	int p_count;
 };
@@ -0,0 +1,102 @@
+#ifndef KITTY_ASSEMBLYPLAN_H
+#define KITTY_ASSEMBLYPLAN_H
+
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class AssemblyPlan.
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <vector>
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "kitty/arrayclasses.h"
+#include "kitty/geometrycache.h"
+
+
+//		---------------------
+// 		-- Class Interface --
+//		---------------------
+
+namespace kitty {
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Precomputed map from detector pixels to a (binned) assembled image
+ *
+ *  Built once from the integer pixel coordinates (IDSTRING_PX_X_int/Y_int).
+ *  Every pixel gets the index of its image bin, every bin the inverse number
+ *  of pixels that fall into it, so an image (average of the pixels in each
+ *  bin) is made in one pass over the data without any coordinate arithmetic.
+ *  With setRadialBins(), the same pass also fills a radial (SAXS) profile.
+ *
+ *  Images are filled row by row, i.e. index = y*nx() + x.
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+class AssemblyPlan {
+public:
+	AssemblyPlan();
+	~AssemblyPlan();
+
+	/// map pixel coordinates to an image binned by 'binning' in x and y (1: full resolution)
+	int create( const array1D<double> *pixX, const array1D<double> *pixY, unsigned int binning = 1 );
+
+	/// nBins linear |q| bins from 0 to qMax (qMax <= 0: largest |q| of any pixel)
+	int setRadialBins( const array1D<double> *qX, const array1D<double> *qY, unsigned int nBins, double qMax = 0 );
+
+	bool valid() const;
+	unsigned int nx() const;
+	unsigned int ny() const;
+	unsigned int binning() const;
+	unsigned int nRadialBins() const;
+	double radialBinWidth() const;
+
+	/// fill image (nx*ny) and, if given and radial bins are set, profile (nRadialBins)
+	void apply( const array1D<double> *data, float *image, float *profile = 0 ) const;
+
+	/// same, but into newly allocated arrays (image is nx by ny)
+	int apply( const array1D<double> *data, array2D<double> *&image, array1D<double> *&profile ) const;
+
+private:
+	unsigned int p_nx;
+	unsigned int p_ny;
+	unsigned int p_binning;
+	std::vector<int> p_bin;				// image bin of each pixel, -1 if outside
+	std::vector<float> p_invCount;		// 1/(number of pixels) of each image bin, 0 if empty
+
+	unsigned int p_nRadial;
+	double p_radialBinWidth;
+	std::vector<int> p_radialBin;		// radial bin of each pixel, -1 if outside
+	std::vector<float> p_radialInvCount;
+
+	mutable std::vector<double> p_imageSum;		// scratch for apply()
+	mutable std::vector<double> p_profileSum;
+};
+
+
+/// plan of the GeometryCache (product "assemblyPlan", parameter "binning"), without radial bins
+class AssemblyPlanBuilder : public GeometryBuilder<AssemblyPlan> {
+public:
+	AssemblyPlanBuilder() : pixX(0), pixY(0), binning(1) {}
+	virtual boost::shared_ptr<AssemblyPlan> build();
+
+	const array1D<double> *pixX;
+	const array1D<double> *pixY;
+	unsigned int binning;
+};
+
+} // namespace kitty
+
+#endif // KITTY_ASSEMBLYPLAN_H
@@ -0,0 +1,107 @@
+#ifndef KITTY_BADPIXELFINDER_H
+#define KITTY_BADPIXELFINDER_H
+
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class BadPixelFinder.
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <string>
+#include <vector>
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "kitty/arrayclasses.h"
+#include "kitty/checkpoint.h"
+
+
+//		---------------------
+// 		-- Class Interface --
+//		---------------------
+
+namespace kitty {
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Streaming bad pixel detection with robust per-ASIC thresholds
+ *
+ *  add() updates compact per-pixel counters in a single pass per event:
+ *  how often the pixel was above the hot pixel threshold, and the current
+ *  and longest run of events in which its value did not change (within a
+ *  tolerance). Together with the per-pixel standard deviation of the
+ *  PixelAccumulator, classify() compares every pixel to the median and
+ *  the median absolute deviation (MAD) of its ASIC, so no thresholds in
+ *  ADU have to be tuned for each experiment. Pixels already bad in the
+ *  mask are left out of the ASIC statistics.
+ *
+ *  Flags of the classification (may be combined):
+ *  DEAD (standard deviation far below the ASIC's), NOISY (far above),
+ *  HOT (above the threshold far more often than the ASIC's pixels) and
+ *  STUCK (longest constant run far longer than the ASIC's, and at least
+ *  the given number of events).
+ *
+ *  About 12 bytes per pixel: last value (float), current and longest run
+ *  (16 bit, saturating), hits (32 bit).
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+class BadPixelFinder {
+public:
+	enum { DEAD = 1, NOISY = 2, HOT = 4, STUCK = 8 };
+
+	BadPixelFinder();
+	~BadPixelFinder();
+
+	/// hotThreshold: values above count as hits (0: no hot pixels), stuckTolerance: largest change of a stuck value
+	void create( unsigned int size, double hotThreshold, double stuckTolerance );
+	bool isCreated() const;
+
+	/// add one event
+	void add( const array1D<double> *data );
+	unsigned int count() const;
+
+	/// flags for each pixel: outside median +/- nMAD*MAD of its ASIC, only GOOD pixels of 'mask' (!= 0) are used
+	/// for the statistics, a stuck pixel needs a run of at least stuckMinEvents (0: no stuck pixels)
+	/// a hot pixel is above the threshold in at least a fraction of hotMinFraction of the events
+	void classify( const array1D<double> *stddev, const array1D<double> *mask, double nMAD,
+		double hotMinFraction, unsigned int stuckMinEvents, array1D<double> *flags ) const;
+
+	/// per-pixel results, for output
+	shared_ptr<array1D<double> > hitFraction() const;
+	shared_ptr<array1D<double> > longestRun() const;
+
+	/// add the complete state to a checkpoint (block names start with 'prefix'), or restore it from one
+	void save( Checkpoint &cp, const std::string &prefix ) const;
+	int restore( const Checkpoint &cp, const std::string &prefix );
+
+private:
+	BadPixelFinder( const BadPixelFinder& );
+	BadPixelFinder& operator=( const BadPixelFinder& );
+
+	/// flag pixels of one ASIC whose value is outside median +/- nMAD*MAD of the good pixels in 'pixels'
+	void flagOutliers( const std::vector<unsigned int> &pixels, const std::vector<double> &value,
+		const array1D<double> *mask, double nMAD, bool low, bool high, double minValue, int flag, array1D<double> *flags ) const;
+
+	std::vector<float> p_last;
+	std::vector<unsigned short> p_run;			// events in a row with the same value (so far)
+	std::vector<unsigned short> p_longest;		// longest of those runs
+	std::vector<unsigned int> p_hits;
+	double p_hotThreshold;
+	double p_stuckTolerance;
+	unsigned int p_count;
+};
+
+} // namespace kitty
+
+#endif // KITTY_BADPIXELFINDER_H
@@ -0,0 +1,89 @@
+#ifndef KITTY_BLOCKACCUMULATOR_H
+#define KITTY_BLOCKACCUMULATOR_H
+
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class BlockAccumulator.
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <string>
+#include <vector>
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "kitty/arrayclasses.h"
+#include "kitty/checkpoint.h"
+
+
+//		---------------------
+// 		-- Class Interface --
+//		---------------------
+
+namespace kitty {
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Running sums in blocks of consecutive events, for standard errors of the mean
+ *
+ *  Keeps the sums of K blocks of consecutive events and the sum of squares
+ *  over all events. The number of events is not known in advance, so the
+ *  blocks start with one event each. When all K blocks are full, neighbouring
+ *  blocks are merged and the block length doubles, so memory stays at K+1
+ *  arrays and the blocks always cover the events in order. K must be even.
+ *
+ *  result() gives the mean and its standard error from the blocks, either
+ *  by the jackknife (leaving out one block at a time) or by batch means. As
+ *  the blocks are consecutive, slow drifts and correlations between nearby
+ *  events show up in the error, unlike in the per-event standard deviation
+ *  (also available from result()) divided by sqrt(N).
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+class BlockAccumulator {
+public:
+	enum ErrorMethod { JACKKNIFE = 0, BATCH_MEANS = 1 };
+
+	BlockAccumulator();
+	~BlockAccumulator();
+
+	/// values of 'size' elements, in 'nBlocks' blocks (rounded up to an even number, at least 2)
+	void create( unsigned int size, unsigned int nBlocks );
+	bool isCreated() const;
+
+	void add( const arraydata<double> *values );
+
+	unsigned int count() const;
+	unsigned int blocksUsed() const;
+
+	/// mean, standard error of the mean and (optional) per-event standard deviation, arrays of 'size' elements
+	int result( arraydata<double> *mean, arraydata<double> *error, int method, arraydata<double> *stddev = 0 ) const;
+
+	/// add to or restore from a checkpoint (block names start with 'prefix')
+	void save( Checkpoint &cp, const std::string &prefix ) const;
+	int restore( const Checkpoint &cp, const std::string &prefix );
+
+private:
+	unsigned int p_size;
+	unsigned int p_nBlocks;
+	std::vector<double> p_blockSum;			// nBlocks x size
+	std::vector<double> p_blockCount;		// events per block
+	std::vector<double> p_sumSq;			// over all events
+	unsigned int p_blockLength;				// events in a full block
+	unsigned int p_current;					// block that is filled
+	unsigned int p_count;
+};
+
+} // namespace kitty
+
+#endif // KITTY_BLOCKACCUMULATOR_H
@@ -0,0 +1,103 @@
+#ifndef KITTY_CALIBRATIONFILE_H
+#define KITTY_CALIBRATIONFILE_H
+
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class CalibrationFile.
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <string>
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "kitty/arrayclasses.h"
+#include "kitty/arraydataIO.h"
+
+
+//		---------------------
+// 		-- Class Interface --
+//		---------------------
+
+namespace kitty {
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Calibration constants (background, gain, mask) in kitty's own binary format, read with mmap
+ *
+ *  A file holds one value per pixel in detector-1D order (the order of
+ *  IDSTRING_CSPAD_DATA), so it is used without any conversion:
+ *    a 256 byte header (magic, version, payload type, number of pixels,
+ *    payload size, FNV-1a checksum of the payload, name of the file it was
+ *    converted from), followed by the payload, either
+ *    FLOAT32  one float per pixel (background, gain), or
+ *    BITMASK  one bit per pixel, bit i%8 of byte i/8, set for good pixels.
+ *
+ *  open() maps the file read-only and checks header, size and checksum. The
+ *  mapping is shared through the page cache, so parallel jobs on one node
+ *  keep a single copy of the constants. write() goes through a temporary
+ *  file and a rename, like the lookup tables.
+ *
+ *  load() reads a calibration file of either kind into an array1D: a
+ *  kitty file in one pass, anything else through arraydataIO as a 2D raw
+ *  image (EDF, HDF5, ...) that is converted to detector-1D order. The
+ *  application convertCalibration converts such files once.
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+class CalibrationFile {
+public:
+	enum Payload { FLOAT32 = 1, BITMASK = 2 };
+
+	CalibrationFile();
+	~CalibrationFile();
+
+	int open( const std::string &filename );
+	void close();
+	bool isOpen() const;
+
+	Payload payload() const;
+	unsigned int size() const;
+	std::string source() const;
+
+	/// the mapped payload, 0 if the file has the other payload type
+	const float *values() const;
+	const unsigned char *bits() const;
+
+	/// value of pixel i, 1 or 0 for a BITMASK
+	double get( unsigned int i ) const;
+
+	/// the values into 'dest', which is (re)allocated to size()
+	void copyTo( array1D<double> *&dest ) const;
+
+	/// true if the file starts with the magic of a kitty calibration file
+	static bool isCalibrationFile( const std::string &filename );
+
+	/// 'data' in detector-1D order, for a BITMASK every value != 0 is a good pixel
+	static int write( const std::string &filename, const array1D<double> *data, Payload payload, const std::string &source );
+
+	/// a kitty calibration file, or a 2D raw image read by 'io', into 'dest' in detector-1D order
+	static int load( const std::string &filename, array1D<double> *&dest, arraydataIO *io );
+
+private:
+	CalibrationFile( const CalibrationFile& );
+	CalibrationFile& operator=( const CalibrationFile& );
+
+	void *p_map;
+	size_t p_mapBytes;
+	std::string p_filename;
+};
+
+} // namespace kitty
+
+#endif // KITTY_CALIBRATIONFILE_H
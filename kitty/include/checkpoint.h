@@ -0,0 +1,89 @@
+#ifndef KITTY_CHECKPOINT_H
+#define KITTY_CHECKPOINT_H
+
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class Checkpoint.
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <string>
+#include <vector>
+#include <map>
+#include <ctime>
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "kitty/arrayclasses.h"
+
+
+//		---------------------
+// 		-- Class Interface --
+//		---------------------
+
+namespace kitty {
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Checkpoint file for running sums and counters
+ *
+ *  Decides when a checkpoint is due (every N events and/or T seconds) and
+ *  writes named blocks of doubles to a small binary file. The file is
+ *  written under a temporary name and renamed when complete, so a job that
+ *  is killed while writing leaves the previous checkpoint intact.
+ *  load() reads a checkpoint back for resuming.
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+class Checkpoint {
+public:
+	Checkpoint();
+	~Checkpoint();
+
+	/// 0 for everyEvents or everySeconds switch that criterion off
+	void configure( const std::string &filename, int everyEvents, double everySeconds );
+	bool enabled() const;
+	std::string filename() const;
+
+	/// true, if a checkpoint should be written after 'count' events
+	bool due( unsigned int count );
+
+	/// collect blocks to write, commit() writes the file
+	void begin( unsigned int lastEvent );
+	void add( const std::string &block, const std::vector<double> &values );
+	void add( const std::string &block, const arraydata<double> *values );
+	void add( const std::string &block, double value );
+	int commit();
+
+	/// read the file given in configure(), the blocks are then available through get()
+	int load();
+	unsigned int lastEvent() const;
+	bool get( const std::string &block, std::vector<double> &values ) const;
+	bool get( const std::string &block, arraydata<double> *values ) const;
+	bool get( const std::string &block, double &value ) const;
+
+private:
+	std::string p_filename;
+	int p_everyEvents;
+	double p_everySeconds;
+
+	unsigned int p_lastCount;			// event count at the last checkpoint
+	time_t p_lastTime;					// time of the last checkpoint
+
+	unsigned int p_lastEvent;			// index of the last event contained in the checkpoint
+	std::map<std::string, std::vector<double> > p_blocks;
+};
+
+} // namespace kitty
+
+#endif // KITTY_CHECKPOINT_H
@@ -43,6 +43,7 @@ namespace kitty {
 	const std::string IDSTRING_CUSTOM_EVENTNAME = "CUSTOM_EVENTNAME";
 	const std::string IDSTRING_OUTPUT_PREFIX = "OUTPUT_PREFIX";
 	const std::string IDSTRING_PV_CHANGED = "CRITICAL_PV_CHANGED";
+	const std::string IDSTRING_GEOMETRY_GENERATION = "CSPAD_GEOMETRY_GENERATION";	// incremented whenever the pixel arrays are recalculated
 	const std::string IDSTRING_CALIBRATED = "calibrated";					// CSPAD data has been calibrated previously (e.g. by cspad_mod)
 	const std::string IDSTRING_NO_CALIB = "";
 	
@@ -24,6 +24,8 @@
 //-------------------------------
 #include "kitty/arrayclasses.h"
 #include "kitty/arraydataIO.h"
+#include "kitty/calibrationfile.h"
+#include "kitty/geometrycache.h"
 
 //------------------------------------
 // Collaborating Class Declarations --
@@ -83,6 +85,9 @@ public:
 
 	/// Method which is called once at the end of the job
 	virtual void endJob(Event& evt, Env& env);
+	
+	//get the polarization correction for the event's geometry (rebuilt only when the pixel arrays changed)
+	void updatePolarization(Event& evt);
 		
 protected:
 
@@ -102,7 +107,10 @@ private:
 	array1D<double> *p_back;
 	array1D<double> *p_gain;
 	array1D<double> *p_mask;
-	array1D<double> *p_pol;
+	CalibrationFile p_backFile;					// kitty calibration files are applied from the mapping,
+	CalibrationFile p_gainFile;					// p_back, p_gain, p_mask are then not used
+	CalibrationFile p_maskFile;
+	shared_ptr<array1D<double> > p_pol_sp;		// polarization correction, shared through the GeometryCache
 
 	int p_count;
 };
@@ -13,6 +13,7 @@
 //-----------------
 // C/C++ Headers --
 //-----------------
+#include <vector>
 
 //----------------------
 // Base Class Headers --
@@ -25,6 +26,21 @@
 #include "kitty/arrayclasses.h"
 #include "kitty/arraydataIO.h"
 #include "kitty/crosscorrelator.h"
+#include "kitty/eventstack.h"
+#include "kitty/checkpoint.h"
+#include "kitty/polarremap.h"
+#include "kitty/polarsplitremap.h"
+#include "kitty/ringcorrelator.h"
+#include "kitty/ringpairsum.h"
+#include "kitty/maskcorrelation.h"
+#include "kitty/polarspill.h"
+#include "kitty/polararchive.h"
+#include "kitty/workerpool.h"
+#include "kitty/blockaccumulator.h"
+#include "kitty/radialintegrator.h"
+#include "kitty/correlatetuner.h"
+#include "kitty/lookuptablecache.h"
+#include "kitty/geometrycache.h"
 
 //------------------------------------
 // Collaborating Class Declarations --
@@ -88,6 +104,31 @@ public:
 
 	//update the internal pixel arrays with information from the event object
 	void updatePixelArrays(Event& evt);
+	
+	//rebuild the polar remap matrix, if the geometry or the polar grid changed
+	void updatePolarRemap(Event& evt);
+	
+	//rebuild the radial bins of the SAXS profile, if the geometry or the binning changed
+	void updateRadialIntegrator(Event& evt);
+	
+	//key of a product in the GeometryCache that depends on the geometry, the mask and the q-range
+	GeometryKey geometryKey(const std::string &product, Event& evt) const;
+	
+	//hand a finished lookup table (algorithm 2 and 4) to the cross-correlator, true if it is current
+	bool updateLookupTable();
+	
+	//write or read the running sums to/from p_checkpoint
+	int writeCheckpoint( const std::string &eventname );
+	int readCheckpoint();
+	
+	//ringFFT path for the polar image in p_cc (remapped from 'data' first, if remap is on and data is given)
+	void runRingTask( const array1D<double> *data, bool singleOutputDue, bool addPolar );
+	
+	//correlations of all polar images spilled in this run, against the run's grand average (twoPass)
+	void runSecondPass();
+	
+	//single event output of the polar image in p_cc and its correlation
+	void writeSingleOutput( const std::string &eventname, const PolarSpillRecord &record, array2D<double> *corr );
 
 protected:
 
@@ -97,6 +138,8 @@ private:
 	int p_edfOut;
 	int p_h5Out;
 	int p_singleOutput;
+	int p_stackOut;
+	int p_stackCompression;
 	std::string p_outputPrefix;
 	
 	std::string p_mask_fn;
@@ -107,21 +150,52 @@ private:
 	int p_nQ2;
 	int p_nLag;
 	
-	int p_alg;
+	int p_alg;						// in use for the current run (from p_configured or autotune)
 	int p_autoCorrelateOnly;
+	int p_remap;					// in use for the current run
+	double p_pixelSize;
+	int p_ringFFT;					// in use for the current run
+	int p_fourierAccumulate;		// in use for the current run (off, if ringFFT is off)
+	int p_nThreads;
+	double p_xccaMemory;
+	int p_xccaBatch;
+	int p_xccaCompression;
+	int p_maskNormalization;		// in use for the current run (off, if remap or ringFFT is off)
+	int p_twoPass;					// in use for the current run (off, if the spill file cannot be opened)
+	std::string p_spillDir;
+	int p_archiveOut;
+	int p_archiveBits;
+	int p_archiveCompression;
+	std::string p_archiveDir;
+	std::vector<std::string> p_archivePVs;		// PVs stored with every archived event
+	std::vector<double> p_archivePVValues;		// their values in the current event
+	int p_errorBlocks;
+	int p_errorMethod;
+	int p_saxsBinning;
+	int p_autotune;
+	double p_autotuneTolerance;
+	int p_autotuneFrames;
+	std::string p_autotuneCache;
 	
 	double p_startQ;
 	double p_stopQ;
 	int p_units;
 	
-	int p_LUTx;
+	int p_LUTx;						// in use for the current run
 	int p_LUTy;
+	CorrelateStrategy p_configured;	// algorithm, remap, ringFFT and LUT as configured, autotune starts from it in every run
+	int p_configuredFourierAccumulate;
+	int p_configuredMaskNormalization;
+	int p_configuredTwoPass;
+	int p_lutCache;
+	std::string p_lutCacheDir;
 	
 	bool p_useGrandAvgPolar;
 	std::string p_grandAvgPolarDir;
 	std::string p_grandAvgPolarExt;
 	
 	arraydataIO *io;
+	EventStack *p_stack;		// container for single event output (if stackOut is on)
 	
 	shared_ptr<array1D<double> > p_pix1_sp;		//input vectors for crosscorrelator
 	shared_ptr<array1D<double> > p_pix2_sp;
@@ -135,6 +209,32 @@ private:
 	shared_ptr<array1D<double> > p_iAvg_sp;
 	
 	CrossCorrelator *p_cc;
+	shared_ptr<PolarRemap> p_polarRemap_sp;		// pixel to polar grid mapping (if remap is on, PolarSplitRemap for remap = 2), from the GeometryCache
+	RingCorrelator *p_ringCorrelator;				// batched ring FFTs (if ringFFT is on)
+	shared_ptr<array2D<double> > p_ringCorr_sp;		// its result for the current event
+	RingPowerSum *p_powerSum;						// running sum in Fourier space (if fourierAccumulate is on)
+	RingPairSum *p_pairSum;							// cross power spectra of all ring pairs (if autoCorrelateOnly is off)
+	shared_ptr<MaskCorrelation> p_maskCorrelation_sp;	// normalization for masked polar bins (if maskNormalization is on), from the GeometryCache
+	shared_ptr<RadialIntegrator> p_radial_sp;		// SAXS profile directly from the pixels (if saxsBinning is on), from the GeometryCache
+	PolarSpill p_polarSpill;						// polar images of the run for the second pass (if twoPass is on)
+	shared_ptr<array2D<double> > p_grandAvg_sp;		// average polar image of the run during the second pass
+	std::vector<double> p_grandAvgMean;				// its ring means (ringFFT)
+	shared_ptr<array2D<double> > p_polarScratch_sp;	// polar image minus the average's angular structure (ringFFT)
+	PolarArchive p_archive;							// polar images of the run (if archiveOut is on)
+	LookupTableCache p_lutCacheStore;				// lookup tables on disk, rebuilt in the background
+	bool p_useLUT;									// the cross-correlator's run() uses a lookup table
+	bool p_lutReady;								// ... and it matches the current pixel arrays
+	CorrelateTuner p_tuner;							// choice of algorithm, remap and ringFFT per run (if autotune is on)
+	WorkerPool p_pool;								// threads for the ringFFT path, split over q-rings
+	BlockAccumulator p_polarBlocks;					// block sums for the standard errors (if errorBlocks is on)
+	BlockAccumulator p_corrBlocks;
+	BlockAccumulator p_iBlocks;
+	
+	Checkpoint p_checkpoint;		// periodic dump of the running sums
+	int p_checkpointEvents;
+	double p_checkpointSeconds;
+	int p_resume;
+	int p_resumeEvent;				// events up to this one are already contained in the running sums
 	
 	int p_count;
 };
@@ -0,0 +1,98 @@
+#ifndef KITTY_CORRELATETUNER_H
+#define KITTY_CORRELATETUNER_H
+
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class CorrelateTuner.
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <string>
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "kitty/arrayclasses.h"
+#include "kitty/workerpool.h"
+
+
+//		---------------------
+// 		-- Class Interface --
+//		---------------------
+
+namespace kitty {
+
+/// a combination of polar image and correlation methods of the correlate module
+struct CorrelateStrategy {
+	int alg;						// algorithm of the cross-correlator (remap = 0, ringFFT = 0)
+	int remap;						// 0: cross-correlator, 1: PolarRemap, 2: PolarSplitRemap
+	int ringFFT;
+	int LUTx;						// lookup table for algorithm 2 and 4
+	int LUTy;
+	double seconds;					// per frame
+	double error;					// relative rms difference of the correlation to the reference
+};
+
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Choice of the fastest polar image and correlation methods for a geometry
+ *
+ *  tune() runs every candidate strategy on a few synthetic frames (rings
+ *  with angular structure and noise on the real pixel arrays), with the
+ *  thread count of the pool. The reference is algorithm 1 (direct
+ *  coordinates and correlation). The compared quantity is the normalized
+ *  angular autocorrelation C(q,lag)/C(q,0) of each ring, so that paths that
+ *  divide by <I>^2 (ringFFT) and paths that do not are compared alike.
+ *  Candidates whose normalized correlations differ from the reference by
+ *  more than the tolerance (relative rms over the lags both have) are
+ *  rejected, the fastest of the others is chosen. Setup costs
+ *  (lookup tables, remap matrices, FFT plans) are paid once per geometry
+ *  and are logged, but not counted.
+ *
+ *  The choice is appended to a text cache, one line per key. The key
+ *  contains nQ, nPhi, the q-range, units, mask use, threads, tolerance and
+ *  a hash of the pixel arrays, so a later run with the same parameters
+ *  skips the timing.
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+class CorrelateTuner {
+public:
+	CorrelateTuner();
+	~CorrelateTuner();
+
+	/// cache file ("" for none), accuracy tolerance, frames per candidate, pixel size for remap = 2
+	void configure( const std::string &cacheFilename, double tolerance, int nFrames, double pixelSize );
+
+	/// fastest accurate strategy for this geometry into 'best', 'configured' supplies the LUT size and the fallback
+	int tune( array1D<double> *pix1, array1D<double> *pix2, array1D<double> *mask,
+		int nQ, int nPhi, double startQ, double stopQ, int units,
+		bool needRingFFT, bool needRemap, WorkerPool &pool,
+		const CorrelateStrategy &configured, CorrelateStrategy &best );
+
+private:
+	CorrelateTuner( const CorrelateTuner& );
+	CorrelateTuner& operator=( const CorrelateTuner& );
+
+	bool readCache( const std::string &key, CorrelateStrategy &strategy ) const;
+	void writeCache( const std::string &key, const CorrelateStrategy &strategy ) const;
+
+	std::string p_cacheFilename;
+	double p_tolerance;
+	int p_nFrames;
+	double p_pixelSize;
+};
+
+} // namespace kitty
+
+#endif // KITTY_CORRELATETUNER_H
@@ -0,0 +1,96 @@
+#ifndef KITTY_EVENTPROFILER_H
+#define KITTY_EVENTPROFILER_H
+
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class EventProfiler.
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <string>
+#include <map>
+#include <boost/weak_ptr.hpp>
+
+//----------------------
+// Base Class Headers --
+//----------------------
+#include "psana/Module.h"
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+
+
+//		---------------------
+// 		-- Class Interface --
+//		---------------------
+
+namespace kitty {
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Content and estimated memory footprint of the event store
+ *
+ *  sample() looks at every key of an event: its type, source and key
+ *  string, and the size of the object, for the types whose size is known
+ *  (kitty arrays, strings, CSPAD data; others are listed with size 0).
+ *  Objects that are the same as in the previous sample (e.g. the pixel
+ *  arrays, put into every event by kitty.discriminate) are counted as
+ *  shared, all others as new in this event, so several copies of the
+ *  CSPAD data show up as several new objects. The previous object is
+ *  only observed through a weak_ptr, so a new object at the address of
+ *  a freed one still counts as new.
+ *
+ *  report() lists the keys by their largest size, with the peak footprint
+ *  per event (all objects and new objects only) and the peak resident
+ *  memory of the process.
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+class EventProfiler {
+public:
+	EventProfiler();
+	~EventProfiler();
+
+	void sample( Event &evt );
+	unsigned int samples() const;
+
+	/// summary of all samples, with the 'top' largest keys
+	std::string report( unsigned int top ) const;
+
+	/// peak resident memory of this process in bytes (0 if unknown)
+	static unsigned long peakResidentBytes();
+
+private:
+	EventProfiler( const EventProfiler& );
+	EventProfiler& operator=( const EventProfiler& );
+
+	struct Entry {
+		std::string type;
+		std::string source;
+		std::string key;
+		unsigned int samples;
+		double sumBytes;
+		unsigned long maxBytes;
+		unsigned int newObjects;			// samples in which the object was not the one of the previous sample
+		boost::weak_ptr<void> lastObject;	// object of the previous sample, not kept alive
+	};
+
+	std::map<std::string, Entry> p_entries;		// by type, source and key
+	unsigned int p_samples;
+	unsigned long p_peakBytes;					// all objects of an event
+	unsigned long p_peakNewBytes;				// objects new in an event
+};
+
+} // namespace kitty
+
+#endif // KITTY_EVENTPROFILER_H
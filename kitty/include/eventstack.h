@@ -0,0 +1,104 @@
+#ifndef KITTY_EVENTSTACK_H
+#define KITTY_EVENTSTACK_H
+
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class EventStack.
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <string>
+#include <map>
+#include <vector>
+
+#include "hdf5/hdf5.h"
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "kitty/arrayclasses.h"
+#include "PSEvt/EventId.h"
+
+
+//		---------------------
+// 		-- Class Interface --
+//		---------------------
+
+namespace kitty {
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Multi-event HDF5 container for per-event output
+ *
+ *  Instead of writing one small file per event and product, every event
+ *  becomes one slice of an extendible, chunked (one event per chunk) and
+ *  optionally deflate-compressed dataset in a single file.
+ *  The dataset 'event' runs in parallel and holds event index and timestamp,
+ *  so that entry n of every product dataset belongs to entry n of 'event'.
+ *
+ *  Usage per event: appendEvent() once, then append() for each product.
+ *  Products missing in an event leave a zero-filled slice, also in the last
+ *  events before close(), which extends every product dataset to the
+ *  length of 'event'.
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+
+typedef struct {
+	unsigned int index;			// kitty event index (as in IDSTRING_CUSTOM_EVENTNAME)
+	unsigned int sec;			// event time, seconds
+	unsigned int nsec;			// event time, nanoseconds
+	unsigned int fiducials;
+} EventStackInfo;
+
+class EventStack {
+public:
+
+	EventStack();
+	~EventStack();
+
+	/// create (truncate) the container file, compression is the deflate level (0: off)
+	int open( const std::string &filename, int compression = 4 );
+	void close();
+	bool isOpen() const;
+
+	/// start a new event slice
+	int appendEvent( unsigned int index, unsigned int sec, unsigned int nsec, unsigned int fiducials );
+	int appendEvent( const std::string &eventname, const shared_ptr<EventId> &eventId );
+
+	/// write a product into the current event slice, dataset is created on first use
+	int append( const std::string &dsname, const array2D<double> *img );
+	int append( const std::string &dsname, const array1D<double> *vec );
+
+	unsigned int nEvents() const;
+	std::string filename() const;
+
+private:
+	hid_t createDataset( const std::string &dsname, hid_t type, const std::vector<hsize_t> &entryDims, hsize_t chunkEvents, int compression );
+	int writeEntry( hid_t dataset, hid_t memtype, const void *buf, hsize_t entry );
+	int appendFloat( const std::string &dsname, const std::vector<hsize_t> &entryDims, const std::vector<float> &buf );
+
+	hid_t p_file;
+	hid_t p_eventType;
+	hid_t p_eventDataset;
+	std::map<std::string, hid_t> p_datasets;
+
+	std::string p_filename;
+	int p_compression;
+	unsigned int p_nEvents;
+
+	std::vector<float> p_buffer;		// conversion buffer, double --> float
+};
+
+} // namespace kitty
+
+#endif // KITTY_EVENTSTACK_H
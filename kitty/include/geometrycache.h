@@ -0,0 +1,163 @@
+#ifndef KITTY_GEOMETRYCACHE_H
+#define KITTY_GEOMETRYCACHE_H
+
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class GeometryCache.
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <map>
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+
+
+//		---------------------
+// 		-- Class Interface --
+//		---------------------
+
+namespace kitty {
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Name, inputs and parameters of a product in the GeometryCache
+ *
+ *  Inputs are versioned things the product is derived from (e.g. "geometry"
+ *  with the generation of the pixel arrays, "mask" with a mask version),
+ *  parameters are configuration values. Products with the same name and
+ *  parameters are the same product, whose inputs may change.
+ */
+class GeometryKey {
+public:
+	explicit GeometryKey( const std::string &product );
+	GeometryKey( const std::string &product, const GeometryKey &other );	// same inputs and parameters as 'other'
+
+	GeometryKey& input( const std::string &name, long version );
+	GeometryKey& parameter( const std::string &name, double value );
+	GeometryKey& parameter( const std::string &name, const std::string &value );
+
+	const std::string &product() const;
+	std::string id() const;										// product and parameters
+	const std::map<std::string, long> &inputs() const;
+	std::string describe() const;								// for log messages
+
+private:
+	std::string p_product;
+	std::map<std::string, std::string> p_parameters;
+	std::map<std::string, long> p_inputs;
+};
+
+
+/// computes a product of the GeometryCache (only called when an input changed)
+template <class T>
+class GeometryBuilder {
+public:
+	virtual ~GeometryBuilder() {}
+	virtual boost::shared_ptr<T> build() = 0;
+};
+
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Job-wide cache of products derived from the detector geometry, shared by all kitty modules
+ *
+ *  Each product (polarization map, polar remap matrix, radial bins, ...)
+ *  is requested with a GeometryKey that declares its inputs and
+ *  parameters, and a builder. get() returns the cached product, if it was
+ *  built for the same inputs, otherwise it calls the builder (once, for
+ *  all modules asking for the same product) and keeps the result. When a
+ *  PV change brings a new geometry generation, only products with a
+ *  "geometry" input are rebuilt, and only when they are asked for.
+ *
+ *  One product per name and parameters is kept, with the inputs it was
+ *  built for, so memory does not grow with the number of geometry changes.
+ *  Products are shared: users must not modify them.
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+class GeometryCache {
+public:
+	static GeometryCache& instance();
+
+	/// product for 'key', built by 'builder' if it is missing or its inputs changed, 0 if the builder failed
+	template <class T>
+	boost::shared_ptr<T> get( const GeometryKey &key, GeometryBuilder<T> &builder );
+
+	/// product for 'key', if it exists for exactly these inputs, 0 otherwise (never builds)
+	template <class T>
+	boost::shared_ptr<T> current( const GeometryKey &key ) const;
+
+	/// true, if the product for 'key' exists for exactly these inputs
+	bool isCurrent( const GeometryKey &key ) const;
+
+	/// number of times products were built (all products)
+	unsigned int builds() const;
+
+	/// drop all products
+	void clear();
+
+private:
+	GeometryCache();
+	GeometryCache( const GeometryCache& );
+	GeometryCache& operator=( const GeometryCache& );
+
+	struct Entry {
+		std::map<std::string, long> inputs;
+		boost::shared_ptr<void> product;
+	};
+
+	const Entry *find( const GeometryKey &key ) const;
+	void store( const GeometryKey &key, boost::shared_ptr<void> product );
+
+	std::map<std::string, Entry> p_entries;		// by GeometryKey::id()
+	unsigned int p_builds;
+};
+
+
+/// ------------------------------------------------------------------------------------------------
+template <class T>
+boost::shared_ptr<T>
+GeometryCache::current( const GeometryKey &key ) const
+{
+	const Entry *entry = find( key );
+	if (entry && entry->inputs == key.inputs()){
+		return boost::static_pointer_cast<T>( entry->product );
+	}
+	return boost::shared_ptr<T>();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+template <class T>
+boost::shared_ptr<T>
+GeometryCache::get( const GeometryKey &key, GeometryBuilder<T> &builder )
+{
+	boost::shared_ptr<T> product = current<T>( key );
+	if (product){
+		return product;
+	}
+	product = builder.build();
+	if (product){
+		store( key, product );
+	}
+	return product;
+}
+
+} // namespace kitty
+
+#endif // KITTY_GEOMETRYCACHE_H
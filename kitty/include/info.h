@@ -13,7 +13,6 @@
 //-----------------
 // C/C++ Headers --
 //-----------------
-#include <fstream>
 #include <vector>
 
 //----------------------
@@ -27,6 +26,8 @@
 
 //headers must be available through symbolic links or copies in the kitty include directory
 #include "kitty/constants.h"
+#include "kitty/pvrecorder.h"
+#include "kitty/eventprofiler.h"
 
 //------------------------------------
 // Collaborating Class Declarations --
@@ -92,13 +93,23 @@ public:
 protected:
 
 private:
-	std::string	p_outputPrefix;
-	int p_count;
-	bool p_stopflag;
+	/// give every PV of the EPICS store that is not recorded yet a handle
+	void addStorePVs( Env& env );
 	
-	std::ofstream fout;
+	std::string	p_outputPrefix;
+	int p_recordAllPVs;								// record every PV of the EPICS store, not only p_pvs
+	int p_count;									// events in the current run, the event index of the PV records
+	int p_run;
 	
 	std::map<std::string, pv> p_pvs;					// container for list of PVs
+	std::vector<std::string> p_recordedNames;		// PV of each handle of p_recorder
+	unsigned int p_nStorePVs;						// PVs in the EPICS store when it was last checked for new ones
+	PvRecorder p_recorder;							// changes of the PVs of the current run
+	
+	int p_profileEvents;							// sample the event store every n-th event (0: off)
+	int p_profileTop;								// number of keys in the profile report
+	unsigned int p_nEvents;							// events of the job
+	EventProfiler p_profiler;
 
 };
 
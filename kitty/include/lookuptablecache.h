@@ -0,0 +1,117 @@
+#ifndef KITTY_LOOKUPTABLECACHE_H
+#define KITTY_LOOKUPTABLECACHE_H
+
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class LookupTableCache.
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <string>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "kitty/arrayclasses.h"
+
+
+//		---------------------
+// 		-- Class Interface --
+//		---------------------
+
+namespace kitty {
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Lookup tables of the cross-correlator (algorithm 2 and 4), on disk and built in the background
+ *
+ *  A table depends on the pixel arrays and its size only. It is kept in
+ *  <directory>lut_<geometry hash>_<LUTx>x<LUTy>.bin: a header (magic, size,
+ *  geometry hash) followed by the table as doubles, row by row. Files are
+ *  written to a temporary name and renamed, so concurrent jobs never see a
+ *  partial table, and they are read with mmap.
+ *
+ *  request() loads the table from disk, if it exists, otherwise it starts
+ *  building it on a background thread with its own CrossCorrelator and a
+ *  copy of the pixel arrays. take() returns the table of the latest request
+ *  once it is ready. A request during a build is queued (only the latest is
+ *  kept), tables of outdated requests are discarded.
+ *
+ *  geometryHash() is a FNV-1a hash of the values of the pixel arrays (and
+ *  mask), used as key for anything derived from a geometry.
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+class LookupTableCache {
+public:
+	LookupTableCache();
+	~LookupTableCache();
+
+	/// directory of the table files, including the trailing '/', persistent = false: build only, no files
+	void configure( const std::string &directory, bool persistent );
+
+	/// table for these pixel arrays and size, true if it was loaded from disk (take() returns it right away)
+	bool request( const array1D<double> *pix1, const array1D<double> *pix2, int nPhi, int nQ, int LUTx, int LUTy );
+
+	/// the finished table of the latest request (the caller owns it), 0 while it is built
+	array2D<double> *take();
+
+	bool isBuilding() const;
+
+	/// wait for the current build (and a queued one) to finish
+	void wait();
+
+	static unsigned long geometryHash( const array1D<double> *pix1, const array1D<double> *pix2, const array1D<double> *mask = 0 );
+
+private:
+	LookupTableCache( const LookupTableCache& );
+	LookupTableCache& operator=( const LookupTableCache& );
+
+	struct Job {
+		std::vector<double> pix1;
+		std::vector<double> pix2;
+		int nPhi;
+		int nQ;
+		int LUTx;
+		int LUTy;
+		unsigned long hash;
+		std::string filename;
+	};
+
+	void start( const Job &job );		// with p_mutex held
+	void build( Job job );				// on the background thread
+
+	std::string filename( unsigned long hash, int LUTx, int LUTy ) const;
+	array2D<double> *load( const std::string &filename, int LUTx, int LUTy, unsigned long hash ) const;
+	int save( const std::string &filename, const array2D<double> *table, unsigned long hash ) const;
+
+	std::string p_directory;
+	bool p_persistent;
+
+	mutable boost::mutex p_mutex;
+	boost::thread *p_thread;
+	bool p_building;
+	std::string p_buildingKey;
+	bool p_hasPending;
+	Job p_pending;						// latest request during a build
+	std::string p_wanted;				// file name (key) of the latest request
+	std::string p_readyKey;
+	array2D<double> *p_ready;
+};
+
+} // namespace kitty
+
+#endif // KITTY_LOOKUPTABLECACHE_H
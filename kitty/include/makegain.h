@@ -24,6 +24,10 @@
 //-------------------------------
 #include "kitty/arrayclasses.h"
 #include "kitty/arraydataIO.h"
+#include "kitty/accumulator.h"
+#include "kitty/pixelhistogram.h"
+#include "kitty/workerpool.h"
+#include "kitty/assemblyplan.h"
 
 //------------------------------------
 // Collaborating Class Declarations --
@@ -87,9 +91,29 @@ public:
 protected:
 
 private:
+
+	//gain map from the zero- and one-photon peaks of the per-pixel histograms (gainMethod = 1)
+	void writePhotonGain();
+	
+	//raw and assembled image of 'data' to <outputPrefix><suffix>_raw2D.h5 and _asm2D.h5
+	void writeImages( array1D<double> *data, const std::string &suffix );
 	
+	int p_gainMethod;						// 0: mean image / scaled model, 1: single-photon peaks
 	std::string p_model_fn;
 	double p_modelDelta;
+	int p_saxsBins;							// angular average of the data, for the model scaling
+	double p_saxsStartQ;
+	double p_saxsStopQ;
+	int p_saxsBinning;
+	
+	double p_histogramMinADU;				// ADU window of the per-pixel histograms (gainMethod = 1)
+	double p_histogramBinWidth;
+	int p_histogramBins;
+	double p_photonMinSeparation;
+	int p_photonMinCounts;
+	int p_nThreads;
+	PixelHistogram p_histogram;
+	WorkerPool p_pool;						// fills and fits the histograms, split over the pixels
 	
 	std::string p_outputPrefix;
 	
@@ -100,8 +124,14 @@ private:
 	shared_ptr<array1D<double> > p_pixY_q_sp;
 	shared_ptr<array1D<double> > p_pixX_int_sp;
 	shared_ptr<array1D<double> > p_pixY_int_sp;
+	int p_geometryGeneration;					// of the pixel arrays above
 	
-	shared_ptr<array1D<double> > p_sum_sp;
+	std::string p_stage;						// stage of the data to accumulate (raw or corrected)
+	shared_ptr<PixelAccumulator> p_acc_sp;	// running sum of all events, shared with other modules
+	Checkpoint p_checkpoint;					// periodic dump of the accumulator state
+	int p_checkpointEvents;
+	double p_checkpointSeconds;
+	int p_resume;
 	
 	int p_count;
 };
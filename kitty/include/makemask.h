@@ -24,6 +24,8 @@
 //-------------------------------
 #include "kitty/arrayclasses.h"
 #include "kitty/arraydataIO.h"
+#include "kitty/accumulator.h"
+#include "kitty/badpixelfinder.h"
 
 //------------------------------------
 // Collaborating Class Declarations --
@@ -90,6 +92,8 @@ private:
 	
 	double p_badPixelLowerBoundary;
 	double p_badPixelUpperBoundary;
+	double p_deadPixelMaxStdDev;
+	double p_noisyPixelMinStdDev;
 	std::string p_outputPrefix;
 	std::string p_mask_fn;
 	int p_useMask;
@@ -97,10 +101,28 @@ private:
 	int p_takeOutASICFrame;
 	int p_takeOutWholeSection;
 	
+	int p_robustBadPixels;						// classify pixels with per-ASIC median/MAD thresholds
+	double p_badPixelNMAD;
+	double p_hotPixelThreshold;
+	double p_hotPixelMinFraction;
+	double p_stuckPixelTolerance;
+	int p_stuckPixelMinEvents;
+	BadPixelFinder p_finder;					// per-pixel hit and stuck-run counters (if robustBadPixels is on)
+	Checkpoint p_finderCheckpoint;				// its state, written along with the accumulator's
+	int p_resumeEvent;							// last event contained in the resumed checkpoint
+	
 	arraydataIO *io;
 	array1D<double> *p_mask;		//mask read from file
 	
-	shared_ptr<array1D<double> > p_sum_sp;	// keep a running sum of all event	
+	std::string p_stage;						// stage of the data to accumulate (raw or corrected)
+	shared_ptr<PixelAccumulator> p_acc_sp;	// running sum of all events, shared with other modules
+	Checkpoint p_checkpoint;					// periodic dump of the accumulator state
+	int p_checkpointEvents;
+	double p_checkpointSeconds;
+	int p_resume;
+	double p_hitThreshold;						// values above are counted per pixel by the accumulator
+	double p_hitMaxFraction;					// pixels above hitThreshold in more events than this are BAD
+	std::string p_mergeCheckpoints;				// accumulator checkpoints of other jobs, added at endJob
 
 	int p_count;
 };
@@ -0,0 +1,98 @@
+#ifndef KITTY_MASKCORRELATION_H
+#define KITTY_MASKCORRELATION_H
+
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class MaskCorrelation.
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <vector>
+#include <fftw3.h>
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "kitty/arrayclasses.h"
+#include "kitty/polarremap.h"
+
+
+//		---------------------
+// 		-- Class Interface --
+//		---------------------
+
+namespace kitty {
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Normalization of ring correlations for masked polar bins
+ *
+ *  Bins without valid pixels carry no fluctuation (PolarRemap sets them to
+ *  the ring mean), so the correlation sum at a given lag only runs over the
+ *  M(lag) pairs of bins that are both valid,
+ *      M(q1, q2, lag) = sum_phi m1(phi) m2(phi + lag)
+ *  with the binary masks m of the rings. Multiplying the correlation by
+ *  nPhi/M(lag) makes it the average over the valid pairs only.
+ *
+ *  M depends on the mask and the geometry only, so create() computes the
+ *  ring autocorrelations of the mask (as factors nQ by nLag) and the mask
+ *  spectra for the ring pairs once per geometry generation. Per event,
+ *  normalize() is one multiply per value. Lags without any valid pair of
+ *  bins are set to 0.
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+class MaskCorrelation {
+public:
+	MaskCorrelation();
+	~MaskCorrelation();
+
+	/// masks of the rings from the bins of 'remap' that contain pixels
+	int create( const PolarRemap &remap );
+	void destroy();
+
+	/// true, if created for this remap matrix
+	bool isCurrent( const PolarRemap &remap ) const;
+
+	int nQ() const;
+	int nLag() const;
+
+	/// multiply rows [begin, end) of 'corr' (nQ by nLag autocorrelations) by nPhi/M(lag)
+	void normalize( array2D<double> *corr, int begin, int end ) const;
+
+	/// nPhi/M(q1, q2, lag) for all nPhi lags of a ring pair (not thread-safe)
+	void pairFactors( int q1, int q2, double *factors ) const;
+
+	/// number of valid bins of ring iq
+	int ringBins( int iq ) const;
+
+private:
+	MaskCorrelation( const MaskCorrelation& );
+	MaskCorrelation& operator=( const MaskCorrelation& );
+
+	int p_nQ;
+	int p_nPhi;
+	int p_nLag;
+	int p_generation;
+
+	std::vector<double> p_factors;		// nQ x nLag, nPhi/M(iq, iq, lag)
+	std::vector<double> p_spec;			// nQ x nLag complex, spectra of the ring masks
+	std::vector<int> p_ringBins;
+
+	fftw_complex *p_in;					// inverse transform for pairFactors()
+	double *p_out;
+	fftw_plan p_plan;
+};
+
+} // namespace kitty
+
+#endif // KITTY_MASKCORRELATION_H
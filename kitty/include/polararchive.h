@@ -0,0 +1,139 @@
+#ifndef KITTY_POLARARCHIVE_H
+#define KITTY_POLARARCHIVE_H
+
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class PolarArchive.
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <string>
+#include <vector>
+
+#include "hdf5/hdf5.h"
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "kitty/arrayclasses.h"
+
+
+//		---------------------
+// 		-- Class Interface --
+//		---------------------
+
+namespace kitty {
+
+/// per-event information of a PolarArchive
+struct PolarArchiveEvent {
+	unsigned int index;				// event index (number in the custom event name)
+	unsigned int sec;
+	unsigned int nsec;
+	unsigned int fiducials;
+	int generation;					// geometry generation of the polar image
+	int pvChanged;					// a critical PV changed with this event
+};
+
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief HDF5 archive of the polar images of a run, for repeated analysis
+ *
+ *  File layout:
+ *    polar                   nEvents x nQ x nPhi, float16 or float32, chunked by events
+ *    event                   nEvents entries of PolarArchiveEvent
+ *    pv                      nEvents x nPVs values of the PVs set by setPVs() (NaN: not available)
+ *    pvName                  nPVs names, fixed-length strings
+ *    geometry_<generation>/  pix1, pix2 (pixel arrays), mask, one group per geometry generation
+ *  and the attributes nQ, nPhi, startQ, stopQ, units and bits of the root group.
+ *  With the PV values of every event, a sweep can select the events of one
+ *  detector position or wavelength, and with the pixel arrays and mask of each
+ *  geometry, the polar remap and mask normalization can be made again.
+ *
+ *  float16 halves the size at a relative precision of 1e-3, which is below
+ *  the shot noise of a single event for most pixels. read() can select a
+ *  range of rings, for sweeps over q-subranges.
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+class PolarArchive {
+public:
+	PolarArchive();
+	~PolarArchive();
+
+	/// new archive for polar images of nQ by nPhi, 'bits' is 16 or 32
+	int create( const std::string &filename, int nQ, int nPhi, double startQ, double stopQ, int units,
+		int bits, int compression, unsigned int chunkEvents = 16 );
+
+	/// existing archive for reading
+	int open( const std::string &filename );
+	void close();
+	bool isOpen() const;
+	std::string filename() const;
+
+	/// pixel arrays and mask (may be 0) of a geometry generation, once per generation
+	int writeGeometry( int generation, const array1D<double> *pix1, const array1D<double> *pix2, const array1D<double> *mask );
+	bool hasGeometry( int generation ) const;
+
+	/// PVs whose values are stored with every event, once before the first append()
+	int setPVs( const std::vector<std::string> &names );
+	const std::vector<std::string>& pvNames() const;
+
+	/// 'pvValues' holds one value per PV of setPVs() (0: all NaN)
+	int append( const array2D<double> *polar, const PolarArchiveEvent &event, const double *pvValues = 0 );
+
+	unsigned int nEvents() const;
+	int nQ() const;
+	int nPhi() const;
+	double startQ() const;
+	double stopQ() const;
+	int units() const;
+	int bits() const;
+
+	/// polar image of event i, rings [iqBegin, iqEnd) into 'polar' ((iqEnd-iqBegin) x nPhi), iqEnd < 0: all rings
+	int read( unsigned int i, array2D<double> *polar, PolarArchiveEvent &event, int iqBegin = 0, int iqEnd = -1 );
+
+	/// values of the PVs of pvNames() in event i
+	int readPVs( unsigned int i, std::vector<double> &values );
+
+	/// pixel arrays and mask of a geometry generation into new arrays, mask is 0 if none was stored
+	int readGeometry( int generation, array1D<double> *&pix1, array1D<double> *&pix2, array1D<double> *&mask );
+
+private:
+	PolarArchive( const PolarArchive& );
+	PolarArchive& operator=( const PolarArchive& );
+
+	void writeAttribute( const char *name, double value );
+	double readAttribute( const char *name ) const;
+
+	std::string p_filename;
+	hid_t p_file;
+	hid_t p_polar;					// datasets
+	hid_t p_event;
+	hid_t p_eventType;
+	hid_t p_pv;						// -1: no PVs
+
+	int p_nQ;
+	int p_nPhi;
+	double p_startQ;
+	double p_stopQ;
+	int p_units;
+	int p_bits;
+	unsigned int p_nEvents;
+	std::vector<int> p_generations;		// geometries in the file
+	std::vector<std::string> p_pvNames;
+	std::vector<float> p_buffer;
+};
+
+} // namespace kitty
+
+#endif // KITTY_POLARARCHIVE_H
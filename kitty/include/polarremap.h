@@ -0,0 +1,108 @@
+#ifndef KITTY_POLARREMAP_H
+#define KITTY_POLARREMAP_H
+
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class PolarRemap.
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <vector>
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "kitty/arrayclasses.h"
+
+
+//		---------------------
+// 		-- Class Interface --
+//		---------------------
+
+namespace kitty {
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Pixel to polar grid mapping as a sparse (CSR) matrix
+ *
+ *  Row r = iq*nPhi + iphi of the matrix holds the pixels whose centers fall
+ *  into ring iq (startQ + iq*dq <= |q| < startQ + (iq+1)*dq, dq = (stopQ-startQ)/nQ)
+ *  and angular bin iphi (iphi*2pi/nPhi <= phi < (iphi+1)*2pi/nPhi), each with
+ *  the weight 1/(number of pixels in the bin). Masked pixels are left out
+ *  when the matrix is built, so one sparse matrix-vector product per event
+ *  gives the polar image. Polar bins without any valid pixel are set to the
+ *  mean of their ring, so they do not contribute to the angular fluctuations.
+ *
+ *  The number of pixels per bin and ring and the number of valid bins per ring
+ *  are kept with the matrix, so the ring means need no counting per event.
+ *
+ *  The matrix depends on the pixel arrays (geometry generation), nQ, nPhi,
+ *  startQ, stopQ and the units of the pixel arrays, see isCurrent().
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+class PolarRemap {
+public:
+	PolarRemap();
+	virtual ~PolarRemap();
+
+	/// build the matrix, mask may be 0 (values of 0 mark bad pixels)
+	virtual int create( const array1D<double> *pix1, const array1D<double> *pix2, const array1D<double> *mask,
+		int nQ, int nPhi, double startQ, double stopQ, int generation, int units );
+
+	/// true, if the matrix was built for exactly these parameters
+	bool isCurrent( int nQ, int nPhi, double startQ, double stopQ, int generation, int units ) const;
+
+	/// polar image (nQ by nPhi), and per ring the center |q| and mean intensity (nQ)
+	int apply( const array1D<double> *data, array2D<double> *polar, array1D<double> *qAvg, array1D<double> *iAvg ) const;
+
+	/// the same for rings [iqBegin, iqEnd) only, calls for disjoint ranges may run in parallel
+	int apply( const array1D<double> *data, array2D<double> *polar, array1D<double> *qAvg, array1D<double> *iAvg,
+		int iqBegin, int iqEnd ) const;
+
+	int nQ() const;
+	int nPhi() const;
+	int generation() const;
+	unsigned int nonZeros() const;
+
+	/// number of pixels in bin (iq, iphi) and in ring iq, 0 for bins that are masked or outside the detector
+	unsigned int binPixels( int iq, int iphi ) const;
+	unsigned int ringPixels( int iq ) const;
+	int ringBins( int iq ) const;
+
+protected:
+	/// per-ring counts from the CSR storage, called after the matrix was built
+	void updateRingCounts();
+	
+	/// CSR storage, also filled by derived mappings with different weights
+	std::vector<unsigned int> p_rowStart;		// nQ*nPhi+1 offsets into p_col and p_weight
+	std::vector<unsigned int> p_col;			// pixel index
+	std::vector<float> p_weight;
+
+	int p_nQ;
+	int p_nPhi;
+	double p_startQ;
+	double p_stopQ;
+	int p_generation;
+	int p_units;
+	unsigned int p_nPixels;
+
+	std::vector<unsigned int> p_ringPixels;		// pixels per ring
+	std::vector<int> p_ringBins;				// non-empty bins per ring
+	std::vector<double> p_ringInvBins;			// 1/p_ringBins, 0 for empty rings
+
+	mutable std::vector<double> p_polar;		// scratch for apply(), nQ*nPhi
+};
+
+} // namespace kitty
+
+#endif // KITTY_POLARREMAP_H
@@ -0,0 +1,92 @@
+#ifndef KITTY_POLARSPILL_H
+#define KITTY_POLARSPILL_H
+
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class PolarSpill.
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <string>
+#include <cstddef>
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "kitty/arrayclasses.h"
+
+
+//		---------------------
+// 		-- Class Interface --
+//		---------------------
+
+namespace kitty {
+
+/// event information stored with every polar image of a PolarSpill
+struct PolarSpillRecord {
+	unsigned int index;				// event index (number in the custom event name)
+	unsigned int sec;
+	unsigned int nsec;
+	unsigned int fiducials;
+};
+
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Memory-mapped scratch file of the polar images of one run
+ *
+ *  Each record is a PolarSpillRecord followed by nQ*nPhi floats. The file is
+ *  mapped and grows in steps of 'growRecords' records, so appending an event
+ *  is a copy into memory, the kernel writes it back in the background. The
+ *  file is a scratch file for a second pass over the same run and is
+ *  removed by close().
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+class PolarSpill {
+public:
+	PolarSpill();
+	~PolarSpill();
+
+	int open( const std::string &filename, int nQ, int nPhi, unsigned int growRecords = 1024 );
+	void close();
+	bool isOpen() const;
+	std::string filename() const;
+
+	int append( const array2D<double> *polar, const PolarSpillRecord &record );
+	unsigned int count() const;
+
+	/// polar image and event information of record i
+	int read( unsigned int i, array2D<double> *polar, PolarSpillRecord &record ) const;
+
+private:
+	PolarSpill( const PolarSpill& );
+	PolarSpill& operator=( const PolarSpill& );
+
+	int grow();
+
+	std::string p_filename;
+	int p_fd;
+	char *p_map;
+	size_t p_mapBytes;
+
+	int p_nQ;
+	int p_nPhi;
+	size_t p_recordBytes;
+	unsigned int p_growRecords;
+	unsigned int p_capacity;
+	unsigned int p_count;
+};
+
+} // namespace kitty
+
+#endif // KITTY_POLARSPILL_H
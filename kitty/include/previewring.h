@@ -0,0 +1,105 @@
+#ifndef KITTY_PREVIEWRING_H
+#define KITTY_PREVIEWRING_H
+
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class PreviewRing.
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <string>
+#include <stdint.h>
+#include <sys/time.h>
+
+
+//		---------------------
+// 		-- Class Interface --
+//		---------------------
+
+namespace kitty {
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Memory-mapped ring buffer of preview images for online monitoring
+ *
+ *  A fixed-size file (put it on /dev/shm for shared memory) holding a header,
+ *  the q axis of the profiles and nSlots slots of (binned image, profile).
+ *  The writer fills the slots round robin. A viewer polls 'written' in the
+ *  header and reads slot (written-1) % nSlots; the slot's sequence number is
+ *  odd while it is being written and equals 2*written when it is complete.
+ *
+ *  Layout (native byte order):
+ *    PreviewRingHeader, float q[nq],
+ *    nSlots x { PreviewSlotHeader, float image[ny][nx], float profile[nq] }
+ *  headerBytes and slotBytes are rounded up to multiples of 8, so that the
+ *  64 bit fields of every slot header are aligned in the mapping.
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+
+typedef struct {
+	char magic[8];					// "KTYPRVW1"
+	uint32_t nSlots;
+	uint32_t nx;
+	uint32_t ny;
+	uint32_t nq;
+	uint32_t binning;
+	uint32_t headerBytes;			// offset of the first slot
+	uint64_t slotBytes __attribute__((aligned(8)));
+	volatile uint64_t written __attribute__((aligned(8)));		// number of completed slots since open()
+} PreviewRingHeader;
+
+typedef struct {
+	volatile uint64_t sequence __attribute__((aligned(8)));
+	uint32_t index;					// kitty event index
+	uint32_t sec;
+	uint32_t nsec;
+	uint32_t reserved;
+} PreviewSlotHeader;
+
+class PreviewRing {
+public:
+	PreviewRing();
+	~PreviewRing();
+
+	/// create (truncate) and map the ring buffer file
+	int open( const std::string &filename, unsigned int nSlots, unsigned int nx, unsigned int ny,
+		unsigned int nq, unsigned int binning, const float *q = 0 );
+	void close();
+	bool isOpen() const;
+	std::string filename() const;
+
+	/// rate cap: true, if at least 'interval' seconds passed since the last accepted call
+	bool due( double interval );
+
+	/// begin() returns the next slot to fill via image() and profile(), commit() publishes it
+	void begin( unsigned int index, unsigned int sec, unsigned int nsec );
+	float *image();
+	float *profile();
+	void commit();
+
+private:
+	PreviewSlotHeader *slot();
+
+	std::string p_filename;
+	int p_fd;
+	char *p_map;
+	size_t p_mapBytes;
+	PreviewRingHeader *p_header;
+
+	struct timeval p_lastTime;
+	bool p_first;
+};
+
+} // namespace kitty
+
+#endif // KITTY_PREVIEWRING_H
@@ -0,0 +1,106 @@
+#ifndef KITTY_PVRECORDER_H
+#define KITTY_PVRECORDER_H
+
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class PvRecorder.
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <string>
+#include <vector>
+
+#include "hdf5/hdf5.h"
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+
+
+//		---------------------
+// 		-- Class Interface --
+//		---------------------
+
+namespace kitty {
+
+/// one stored change of a PV
+struct PvRecord {
+	unsigned int index;				// event in the run, counted by the recording module (not the kitty event name)
+	unsigned int sec;
+	unsigned int nsec;
+	double value;					// NaN: PV not available from this event on
+};
+
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Change-only time series of EPICS PVs, one HDF5 file per run
+ *
+ *  Every PV of a run gets a handle (its position in the list given to
+ *  begin(), followed by the PVs given to add() during the run). record() is called for every PV in every event, but a value
+ *  is only kept when it differs from the PV's last kept value, so slow
+ *  PVs cost a few records per run. write() stores the records sorted by
+ *  PV, so that the series of one PV is contiguous:
+ *    pv/name, pv/description  fixed-length strings, by handle
+ *    index/offset, index/count  first record and number of records of each PV
+ *    record/index, record/sec, record/nsec, record/value  one column each
+ *  and the attributes run and nEvents of the root group. The event index
+ *  is the caller's count of the events of the run, starting at 0.
+ *
+ *  read() loads the series of one PV with one hyperslab per column,
+ *  valueAt() gives the value of a PV in any event of the run.
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+class PvRecorder {
+public:
+	PvRecorder();
+	~PvRecorder();
+
+	/// start a run with these PVs (descriptions may be empty), drops the records of the previous run
+	void begin( const std::vector<std::string> &names, const std::vector<std::string> &descriptions );
+
+	/// PV that first appeared during the run, returns its handle (no records before this event)
+	unsigned int add( const std::string &name, const std::string &description );
+
+	/// value of PV 'handle' in event 'index', kept only if it changed
+	void record( unsigned int handle, double value, unsigned int index, unsigned int sec, unsigned int nsec );
+	/// PV 'handle' could not be read in this event
+	void recordMissing( unsigned int handle, unsigned int index, unsigned int sec, unsigned int nsec );
+	/// count an event
+	void endEvent();
+
+	unsigned int nPVs() const;
+	unsigned int nEvents() const;
+	unsigned long nRecords() const;
+
+	int write( const std::string &filename, int run ) const;
+
+	/// series of the PV 'name' stored in 'filename'
+	static int read( const std::string &filename, const std::string &name, std::vector<PvRecord> &series );
+	/// value of a series in event 'index' (NaN before its first record)
+	static double valueAt( const std::vector<PvRecord> &series, unsigned int index );
+
+private:
+	PvRecorder( const PvRecorder& );
+	PvRecorder& operator=( const PvRecorder& );
+
+	std::vector<std::string> p_names;
+	std::vector<std::string> p_descriptions;
+	std::vector< std::vector<PvRecord> > p_records;		// by handle
+	unsigned int p_nEvents;
+	unsigned long p_nRecords;
+};
+
+} // namespace kitty
+
+#endif // KITTY_PVRECORDER_H
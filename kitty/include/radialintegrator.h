@@ -0,0 +1,92 @@
+#ifndef KITTY_RADIALINTEGRATOR_H
+#define KITTY_RADIALINTEGRATOR_H
+
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class RadialIntegrator.
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <vector>
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "kitty/arrayclasses.h"
+
+
+//		---------------------
+// 		-- Class Interface --
+//		---------------------
+
+namespace kitty {
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Angular average (SAXS profile) with precomputed bin indices
+ *
+ *  create() assigns every pixel to one of nQ bins in |q| and counts the
+ *  pixels per bin, once per geometry generation and mask. The bins are
+ *  linear (startQ + iq*dq) or logarithmic (startQ*(stopQ/startQ)^(iq/nQ),
+ *  startQ > 0). Masked pixels and pixels outside [startQ, stopQ) go to an
+ *  extra overflow bin, so integrate() is a single branch-free pass over the
+ *  frame, followed by one multiply per bin.
+ *
+ *  Unlike the ring means of PolarRemap (mean of the angular bins), the
+ *  intensity of a bin is the mean over all its pixels.
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+class RadialIntegrator {
+public:
+	enum Binning { LINEAR = 0, LOGARITHMIC = 1 };
+
+	RadialIntegrator();
+	~RadialIntegrator();
+
+	/// bin indices for the pixels at (pix1, pix2), mask may be 0 (values of 0 mark bad pixels)
+	int create( const array1D<double> *pix1, const array1D<double> *pix2, const array1D<double> *mask,
+		int nQ, double startQ, double stopQ, int binning, int generation, int units );
+
+	/// true, if the bins were made for exactly these parameters
+	bool isCurrent( int nQ, double startQ, double stopQ, int binning, int generation, int units ) const;
+
+	/// center |q| and mean intensity of the bins (nQ each, either may be 0)
+	int integrate( const array1D<double> *data, array1D<double> *qAvg, array1D<double> *iAvg ) const;
+
+	int nQ() const;
+	int generation() const;
+	double binCenter( int iq ) const;
+	unsigned int binPixels( int iq ) const;
+
+private:
+	RadialIntegrator( const RadialIntegrator& );
+	RadialIntegrator& operator=( const RadialIntegrator& );
+
+	std::vector<unsigned int> p_bin;			// bin of every pixel, nQ for unused pixels
+	std::vector<unsigned int> p_binPixels;		// pixels per bin
+	std::vector<double> p_invPixels;			// 1/p_binPixels, 0 for empty bins
+	std::vector<double> p_center;
+
+	int p_nQ;
+	double p_startQ;
+	double p_stopQ;
+	int p_binning;
+	int p_generation;
+	int p_units;
+
+	mutable std::vector<double> p_sum;			// scratch for integrate(), nQ+1
+};
+
+} // namespace kitty
+
+#endif // KITTY_RADIALINTEGRATOR_H
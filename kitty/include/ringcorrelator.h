@@ -0,0 +1,151 @@
+#ifndef KITTY_RINGCORRELATOR_H
+#define KITTY_RINGCORRELATOR_H
+
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Classes RingCorrelator and RingPowerSum.
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <vector>
+#include <fftw3.h>
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "kitty/arrayclasses.h"
+#include "kitty/checkpoint.h"
+
+
+//		---------------------
+// 		-- Class Interface --
+//		---------------------
+
+namespace kitty {
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Angular autocorrelation of all q-rings with batched real-to-complex FFTs
+ *
+ *  create() allocates aligned buffers and makes FFTW plans that transform
+ *  all nQ rings of a polar image in one call (and back). The plans are
+ *  reused for every event.
+ *
+ *  The rings can be split into nParts contiguous blocks with their own
+ *  plans, so that the blocks can be processed by different threads
+ *  (part = -1 processes all blocks). Each block only touches its own rings
+ *  in all buffers, the result does not depend on the number of parts.
+ *
+ *  For ring iq with mean intensity <I> and fluctuations f = I - <I>,
+ *      C(iq, lag) = < f(phi) f(phi + lag) >_phi / <I>^2
+ *  computed as the inverse transform of |F(f)|^2. C is symmetric in the lag,
+ *  so only lags 0...nPhi/2 (nLag() = nPhi/2+1 values) are kept.
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+class RingCorrelator {
+public:
+	RingCorrelator();
+	~RingCorrelator();
+
+	/// allocate buffers and plan the transforms for polar images of nQ by nPhi
+	int create( int nQ, int nPhi, int nParts = 1 );
+	void destroy();
+
+	int nQ() const;
+	int nPhi() const;
+	int nLag() const;
+	int nParts() const;
+
+	/// rings [begin, end) of a part
+	void partRange( int part, int &begin, int &end ) const;
+
+	/// fluctuations of each ring to Fourier space, the spectra are then available via spectrum()
+	int forward( const array2D<double> *polar, int part = -1 );
+
+	/// spectrum of ring iq (nLag() complex values) and the ring mean used for normalization
+	const fftw_complex *spectrum( int iq ) const;
+	double ringMean( int iq ) const;
+
+	/// autocorrelation of every ring of 'polar' (nQ by nPhi) into 'corr' (nQ by nLag)
+	int autoCorrelate( const array2D<double> *polar, array2D<double> *corr, int part = -1 );
+
+	/// inverse transform of power spectra (nQ by nLag values, row by row) into 'corr', divided by 'norm' per ring
+	int inverse( const double *power, const std::vector<double> &norm, array2D<double> *corr );
+
+private:
+	RingCorrelator( const RingCorrelator& );
+	RingCorrelator& operator=( const RingCorrelator& );
+
+	int backward( const std::vector<double> &norm, array2D<double> *corr, int part );
+
+	int p_nQ;
+	int p_nPhi;
+	int p_nLag;
+
+	double *p_real;					// nQ x nPhi
+	fftw_complex *p_spec;			// nQ x nLag, forward result
+	fftw_complex *p_power;			// nQ x nLag, input of the backward transform (destroyed by it)
+	std::vector<int> p_partBegin;	// first ring of each part, nParts+1 entries
+	std::vector<fftw_plan> p_forwardPlans;		// one per part, 0 for empty parts
+	std::vector<fftw_plan> p_backwardPlans;
+
+	std::vector<double> p_mean;		// ring means of the last forward()
+};
+
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Sum of ring power spectra over many events
+ *
+ *  The inverse transform is linear, so the average of the per-event
+ *  autocorrelations equals one inverse transform of the summed power
+ *  spectra, each normalized by its ring mean squared. Per event, only the
+ *  forward transform and nQ*nLag multiply-adds remain.
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+class RingPowerSum {
+public:
+	RingPowerSum();
+	~RingPowerSum();
+
+	void create( int nQ, int nLag );
+
+	/// add the spectra of the last RingCorrelator::forward()
+	void add( const RingCorrelator &rc );
+	unsigned int count() const;
+
+	/// the same in pieces (e.g. one per thread): addRings() for rings [begin, end), then addEvent() once
+	void addRings( const RingCorrelator &rc, int begin, int end );
+	void addEvent();
+
+	/// average autocorrelation of all events added so far (nQ by nLag)
+	int correlation( RingCorrelator &rc, array2D<double> *corr ) const;
+
+	/// add to or restore from a checkpoint (block names start with 'prefix')
+	void save( Checkpoint &cp, const std::string &prefix ) const;
+	int restore( const Checkpoint &cp, const std::string &prefix );
+
+private:
+	int p_nQ;
+	int p_nLag;
+	std::vector<double> p_sum;		// nQ x nLag
+	unsigned int p_count;
+};
+
+} // namespace kitty
+
+#endif // KITTY_RINGCORRELATOR_H
@@ -0,0 +1,128 @@
+#ifndef KITTY_RINGPAIRSUM_H
+#define KITTY_RINGPAIRSUM_H
+
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class RingPairSum.
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <string>
+#include <vector>
+#include <fftw3.h>
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "kitty/arrayclasses.h"
+#include "kitty/ringcorrelator.h"
+#include "kitty/maskcorrelation.h"
+#include "kitty/workerpool.h"
+
+
+//		---------------------
+// 		-- Class Interface --
+//		---------------------
+
+namespace kitty {
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Running sum of the angular cross-correlations of all ring pairs (XCCA)
+ *
+ *  For rings q1, q2 with means <I1>, <I2> and fluctuations f1, f2,
+ *      C(q1, q2, lag) = < f1(phi) f2(phi + lag) >_phi / (<I1> <I2>)
+ *  is the inverse transform of conj(F1) F2, so the cross power spectra
+ *  (nLag complex values per pair) are summed and transformed back only once
+ *  at the end. C(q2, q1, lag) = C(q1, q2, -lag), so only the pairs q1 <= q2
+ *  are kept, in the order (0,0), (0,1), ... (0,nQ-1), (1,1), (1,2), ...
+ *
+ *  Every value is kept as a float sum plus a float that holds the rounding
+ *  error of the last addition (the addition itself is done in double), so
+ *  the accuracy does not degrade with the number of events.
+ *
+ *  The spectra of the events are collected in batches. When a batch is full,
+ *  the sums are updated pair by pair, split over the threads of a
+ *  WorkerPool. If the sums need more memory than allowed, they are kept in
+ *  a spill file and updated tile by tile, so each tile is read and written
+ *  once per batch.
+ *
+ *  write() stores the average correlations in a HDF5 file: the diagonal
+ *  q1 = q2 with the non-redundant lags 0...nPhi/2 and the pairs q1 < q2 with
+ *  all nPhi lags, as chunked datasets, see write().
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+class RingPairSum {
+public:
+	RingPairSum();
+	~RingPairSum();
+
+	/// memoryBytes: limit for the sums, above that they go to 'spillFilename'; batchEvents: events per update
+	int create( int nQ, int nPhi, double memoryBytes, const std::string &spillFilename, int batchEvents );
+	void destroy();
+
+	int nQ() const;
+	unsigned int nPairs() const;
+	unsigned int count() const;
+	bool spilled() const;
+
+	/// add the spectra of the last RingCorrelator::forward(), the sums are updated when the batch is full
+	void add( const RingCorrelator &rc, WorkerPool &pool );
+
+	/// update the sums with the events of an incomplete batch
+	void flush( WorkerPool &pool );
+
+	/// average correlations to 'filename' (flush() first), with the ring centers 'q' (may be 0),
+	/// normalized for masked bins, if 'mask' is given
+	int write( const std::string &filename, const array1D<double> *q, int compression, const MaskCorrelation *mask = 0 );
+
+	/// index of the pair (q1, q2), q1 <= q2
+	unsigned int pairIndex( int q1, int q2 ) const;
+
+	/// the per-pair work of a batch for pairs [begin, end) of the tile in memory
+	void updatePairs( unsigned int begin, unsigned int end );
+
+private:
+	RingPairSum( const RingPairSum& );
+	RingPairSum& operator=( const RingPairSum& );
+
+	int loadTile( unsigned int tile );
+	int storeTile( unsigned int tile );
+
+	int p_nQ;
+	int p_nPhi;
+	int p_nLag;
+	unsigned int p_nPairs;
+	unsigned int p_nValues;				// floats per pair (2*nLag)
+
+	std::vector<int> p_q1;				// ring indices of each pair
+	std::vector<int> p_q2;
+
+	std::vector<float> p_sum;			// (sum, error) per value for the pairs of the tile in memory
+	unsigned int p_tilePairs;			// pairs per tile
+	unsigned int p_nTiles;
+	unsigned int p_tile;				// tile currently in p_sum
+
+	std::string p_spillFilename;
+	int p_spillFile;					// -1 if everything fits into memory
+
+	std::vector<double> p_batch;		// normalized spectra, batch x nQ x nLag complex
+	int p_batchEvents;
+	int p_batchCount;
+
+	unsigned int p_count;
+};
+
+} // namespace kitty
+
+#endif // KITTY_RINGPAIRSUM_H
@@ -0,0 +1,94 @@
+#ifndef KITTY_WORKERPOOL_H
+#define KITTY_WORKERPOOL_H
+
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class WorkerPool.
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+
+//		---------------------
+// 		-- Class Interface --
+//		---------------------
+
+namespace kitty {
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Work split into a fixed number of parts, see WorkerPool
+ */
+class WorkerTask {
+public:
+	virtual ~WorkerTask() {}
+	virtual void execute( int part, int nParts ) = 0;
+};
+
+
+/**
+ *  @ingroup kitty
+ *
+ *  @brief Persistent threads for intra-event parallelism
+ *
+ *  run() executes part i of a task on thread i (part 0 on the calling
+ *  thread) and returns when all parts are done. The assignment of parts to
+ *  threads never changes, so results that each part writes to its own
+ *  range of the output are identical for any number of threads, as long as
+ *  the task splits its work the same way. The threads wait on a condition
+ *  variable between tasks, so they are started only once per job.
+ *
+ *  split() gives the contiguous range [begin, end) of n items that belongs
+ *  to a part.
+ *
+ *  @version \$Id$
+ *
+ *  @author Jan Moritz Feldkamp
+ */
+class WorkerPool {
+public:
+	WorkerPool();
+	~WorkerPool();
+
+	/// start nThreads-1 worker threads (the caller is the first thread), 0 or 1: run everything on the caller
+	void create( int nThreads );
+	void destroy();
+	int nThreads() const;
+
+	void run( WorkerTask &task );
+
+	static void split( int n, int part, int nParts, int &begin, int &end );
+
+private:
+	WorkerPool( const WorkerPool& );
+	WorkerPool& operator=( const WorkerPool& );
+
+	void work( int part, unsigned int generation );
+
+	int p_nThreads;
+	std::vector<boost::thread*> p_threads;
+
+	boost::mutex p_mutex;
+	boost::condition_variable p_start;
+	boost::condition_variable p_done;
+	WorkerTask *p_task;
+	unsigned int p_generation;		// incremented for every task, wakes the workers
+	int p_pending;					// parts of the current task that are not finished
+	bool p_quit;
+};
+
+} // namespace kitty
+
+#endif // KITTY_WORKERPOOL_H
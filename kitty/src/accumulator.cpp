@@ -0,0 +1,440 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Classes PixelAccumulator and AccumulatorService...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/accumulator.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdlib>
+
+using std::string;
+using std::vector;
+using std::map;
+using std::set;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+#include "kitty/constants.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.AccumulatorService";
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+PixelAccumulator::PixelAccumulator( unsigned int size )
+	: p_mean(size, 0.)
+	, p_m2(size, 0.)
+	, p_min(size, std::numeric_limits<double>::max())
+	, p_max(size, -std::numeric_limits<double>::max())
+	, p_above(size, 0)
+	, p_threshold(std::numeric_limits<double>::max())
+	, p_thresholdSet(false)
+	, p_count(0)
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+PixelAccumulator::~PixelAccumulator()
+{
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+PixelAccumulator::add( const array1D<double> *data )
+{
+	const unsigned int n = std::min( (unsigned int)p_mean.size(), data->size() );
+	p_count++;
+	
+	//all pixels share the same count, so the loop body is free of divisions and branches
+	const double invCount = 1./p_count;
+	const double thresh = p_threshold;
+	const double *d = data->data();
+	double *mean = &p_mean[0];
+	double *m2 = &p_m2[0];
+	double *mn = &p_min[0];
+	double *mx = &p_max[0];
+	unsigned int *above = &p_above[0];
+	for (unsigned int i = 0; i < n; i++){
+		const double x = d[i];
+		const double delta = x - mean[i];
+		mean[i] += delta * invCount;
+		m2[i] += delta * (x - mean[i]);
+		mn[i] = std::min( mn[i], x );
+		mx[i] = std::max( mx[i], x );
+		above[i] += (x > thresh);
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PixelAccumulator::merge( const PixelAccumulator &other )
+{
+	if (other.size() != size()){
+		MsgLog(logger, error, "cannot merge accumulators of different size (" << size() << " and " << other.size() << ")");
+		return 1;
+	}
+	if (other.p_thresholdSet && p_thresholdSet && other.p_threshold != p_threshold){
+		MsgLog(logger, warning, "merging accumulators with different thresholds (" << p_threshold << " and " << other.p_threshold 
+			<< "), counts above threshold will be meaningless");
+	}
+	if (other.p_count == 0){
+		return 0;
+	}
+	
+	const double na = p_count;
+	const double nb = other.p_count;
+	const double n = na + nb;
+	for (unsigned int i = 0; i < size(); i++){
+		const double delta = other.p_mean[i] - p_mean[i];
+		p_mean[i] += delta * nb/n;
+		p_m2[i] += other.p_m2[i] + delta*delta * na*nb/n;
+		p_min[i] = std::min( p_min[i], other.p_min[i] );
+		p_max[i] = std::max( p_max[i], other.p_max[i] );
+		p_above[i] += other.p_above[i];
+	}
+	p_count += other.p_count;
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+PixelAccumulator::setThreshold( double threshold )
+{
+	if (p_thresholdSet && threshold != p_threshold){
+		MsgLog(logger, warning, "threshold of shared accumulator changed from " << p_threshold << " to " << threshold 
+			<< ", modules subscribed to the same stage should use the same threshold");
+	}
+	if (p_count != 0){
+		MsgLog(logger, warning, "threshold set after " << p_count << " events, counts above threshold are incomplete");
+	}
+	p_threshold = threshold;
+	p_thresholdSet = true;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+double
+PixelAccumulator::threshold() const
+{
+	return p_threshold;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+PixelAccumulator::size() const
+{
+	return p_mean.size();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+PixelAccumulator::count() const
+{
+	return p_count;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+shared_ptr<array1D<double> >
+PixelAccumulator::sum() const
+{
+	shared_ptr<array1D<double> > sum_sp = mean();
+	sum_sp->multiplyByValue( p_count );
+	return sum_sp;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+shared_ptr<array1D<double> >
+PixelAccumulator::mean() const
+{
+	return shared_ptr<array1D<double> >( new array1D<double>( &p_mean[0], p_mean.size() ) );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+shared_ptr<array1D<double> >
+PixelAccumulator::variance() const
+{
+	shared_ptr<array1D<double> > var_sp( new array1D<double>( &p_m2[0], p_m2.size() ) );
+	if (p_count > 1){
+		var_sp->divideByValue( p_count-1 );			// unbiased estimate
+	}else{
+		var_sp->multiplyByValue( 0. );
+	}
+	return var_sp;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+shared_ptr<array1D<double> >
+PixelAccumulator::stddev() const
+{
+	shared_ptr<array1D<double> > sd_sp = variance();
+	double *sd = sd_sp->data();
+	for (unsigned int i = 0; i < sd_sp->size(); i++){
+		sd[i] = sqrt( sd[i] );
+	}
+	return sd_sp;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+shared_ptr<array1D<double> >
+PixelAccumulator::min() const
+{
+	return shared_ptr<array1D<double> >( new array1D<double>( &p_min[0], p_min.size() ) );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+shared_ptr<array1D<double> >
+PixelAccumulator::max() const
+{
+	return shared_ptr<array1D<double> >( new array1D<double>( &p_max[0], p_max.size() ) );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+shared_ptr<array1D<double> >
+PixelAccumulator::countAbove() const
+{
+	shared_ptr<array1D<double> > above_sp( new array1D<double>( p_above.size() ) );
+	for (unsigned int i = 0; i < p_above.size(); i++){
+		above_sp->set( i, p_above[i] );
+	}
+	return above_sp;
+}
+
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+PixelAccumulator::save( Checkpoint &cp, const string &prefix ) const
+{
+	cp.add( prefix+"count", (double)p_count );
+	cp.add( prefix+"threshold", p_threshold );
+	cp.add( prefix+"thresholdSet", (double)p_thresholdSet );
+	cp.add( prefix+"mean", p_mean );
+	cp.add( prefix+"m2", p_m2 );
+	cp.add( prefix+"min", p_min );
+	cp.add( prefix+"max", p_max );
+	cp.add( prefix+"above", vector<double>( p_above.begin(), p_above.end() ) );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PixelAccumulator::restore( const Checkpoint &cp, const string &prefix )
+{
+	double count = 0;
+	double threshold = 0;
+	double thresholdSet = 0;
+	vector<double> mean, m2, mn, mx, above;
+	bool ok = cp.get( prefix+"count", count )
+		&& cp.get( prefix+"threshold", threshold )
+		&& cp.get( prefix+"thresholdSet", thresholdSet )
+		&& cp.get( prefix+"mean", mean )
+		&& cp.get( prefix+"m2", m2 )
+		&& cp.get( prefix+"min", mn )
+		&& cp.get( prefix+"max", mx )
+		&& cp.get( prefix+"above", above );
+	const size_t n = p_mean.size();
+	if (!ok || mean.size() != n || m2.size() != n || mn.size() != n || mx.size() != n || above.size() != n){
+		return 1;
+	}
+	p_count = (unsigned int)count;
+	p_threshold = threshold;
+	p_thresholdSet = (thresholdSet != 0);
+	p_mean.swap( mean );
+	p_m2.swap( m2 );
+	p_min.swap( mn );
+	p_max.swap( mx );
+	p_above.assign( above.begin(), above.end() );
+	return 0;
+}
+
+
+
+//----------------
+// Constructors --
+//----------------
+AccumulatorService::AccumulatorService()
+	: p_accumulators()
+	, p_subscribers()
+	, p_lastEvent()
+	, p_lastCheckpoint()
+	, p_resumeEvent()
+	, p_merged()
+{
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+AccumulatorService&
+AccumulatorService::instance()
+{
+	static AccumulatorService service;
+	return service;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+shared_ptr<PixelAccumulator>
+AccumulatorService::subscribe( const string &module, const string &stage )
+{
+	shared_ptr<PixelAccumulator> &acc_sp = p_accumulators[stage];
+	if (!acc_sp){
+		acc_sp = shared_ptr<PixelAccumulator>( new PixelAccumulator(nMaxTotalPx) );
+		MsgLog(logger, info, "created accumulator for stage '" << stage << "'");
+	}
+	p_subscribers[stage].insert( module );
+	MsgLog(logger, info, "'" << module << "' subscribed to stage '" << stage << "' ("
+		<< p_subscribers[stage].size() << " subscribers)");
+	return acc_sp;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+AccumulatorService::hasSubscribers( const string &stage ) const
+{
+	map<string, set<string> >::const_iterator it = p_subscribers.find( stage );
+	return (it != p_subscribers.end() && !it->second.empty());
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+AccumulatorService::accumulate( const string &stage, const string &eventname, const array1D<double> *data )
+{
+	map<string, shared_ptr<PixelAccumulator> >::iterator it = p_accumulators.find( stage );
+	if (it == p_accumulators.end() || !data){
+		return;
+	}
+
+	//the first subscriber that sees this event does the work, all others find it done
+	string &last = p_lastEvent[stage];
+	if (last == eventname){
+		return;
+	}
+	last = eventname;
+	
+	//events already contained in a checkpoint that this stage was resumed from
+	map<string, int>::const_iterator resume_it = p_resumeEvent.find( stage );
+	if (resume_it != p_resumeEvent.end() && atoi(eventname.c_str()) <= resume_it->second){
+		return;
+	}
+	it->second->add( data );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+AccumulatorService::checkpoint( const string &stage, const string &filename, const string &eventname )
+{
+	map<string, shared_ptr<PixelAccumulator> >::iterator it = p_accumulators.find( stage );
+	if (it == p_accumulators.end()){
+		return 1;
+	}
+	string &last = p_lastCheckpoint[stage];
+	if (last == eventname){
+		return 0;
+	}
+	last = eventname;
+	
+	Checkpoint cp;
+	cp.configure( filename, 0, 0 );
+	cp.begin( atoi(eventname.c_str()) );
+	it->second->save( cp, stage+"_" );
+	return cp.commit();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+AccumulatorService::resume( const string &stage, const string &filename )
+{
+	map<string, shared_ptr<PixelAccumulator> >::iterator it = p_accumulators.find( stage );
+	if (it == p_accumulators.end()){
+		return 1;
+	}
+	if (p_resumeEvent.count( stage )){
+		return 0;				// another subscriber did this already
+	}
+	
+	Checkpoint cp;
+	cp.configure( filename, 0, 0 );
+	if ( cp.load() || it->second->restore( cp, stage+"_" ) ){
+		MsgLog(logger, warning, "could not resume stage '" << stage << "' from '" << filename << "', starting from scratch");
+		return 1;
+	}
+	p_resumeEvent[stage] = cp.lastEvent();
+	MsgLog(logger, info, "stage '" << stage << "' resumed with " << it->second->count() << " events");
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+AccumulatorService::merge( const string &stage, const string &filename )
+{
+	map<string, shared_ptr<PixelAccumulator> >::iterator it = p_accumulators.find( stage );
+	if (it == p_accumulators.end()){
+		return 1;
+	}
+	if (!p_merged[stage].insert( filename ).second){
+		return 0;				// another subscriber did this already
+	}
+	
+	Checkpoint cp;
+	cp.configure( filename, 0, 0 );
+	PixelAccumulator other( it->second->size() );
+	if ( cp.load() || other.restore( cp, stage+"_" ) || it->second->merge( other ) ){
+		MsgLog(logger, warning, "could not merge '" << filename << "' into stage '" << stage << "'");
+		return 1;
+	}
+	MsgLog(logger, info, "merged " << other.count() << " events of '" << filename << "' into stage '" << stage 
+		<< "', " << it->second->count() << " events in total");
+	return 0;
+}
+
+
+} // namespace kitty
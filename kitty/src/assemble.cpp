@@ -18,6 +18,8 @@
 //-----------------
 // C/C++ Headers --
 //-----------------
+#include <vector>
+#include <cstdlib>
 
 //-------------------------------
 // Collaborating Class Headers --
@@ -28,7 +30,6 @@
 #include "kitty/constants.h"
 #include "kitty/util.h"
 using ns_cspad_util::create1DFromRawImageCSPAD;
-using ns_cspad_util::createAssembledImageCSPAD;
 using ns_cspad_util::createRawImageCSPAD;
 
 
@@ -56,22 +57,52 @@ assemble::assemble (const std::string& name)
 	, io(0)
 	, p_pixX_sp()
 	, p_pixY_sp()
-	, p_sum_sp()
+	, p_geometryGeneration(0)
+	, p_plan_sp()
+	, p_stage("")
+	, p_acc_sp()
+	, p_checkpoint()
+	, p_checkpointEvents(0)
+	, p_checkpointSeconds(0)
+	, p_resume(0)
 	, p_tifOut(0)
 	, p_edfOut(0)
 	, p_h5Out(0)
 	, p_singleOutput(0)
+	, p_stackOut(0)
+	, p_stackCompression(0)
+	, p_stack(0)
+	, p_previewOut(0)
+	, p_previewBinning(0)
+	, p_previewInterval(0)
+	, p_previewSlots(0)
+	, p_previewNQ(0)
+	, p_previewFile("")
+	, p_previewPlan()
+	, p_preview()
 	, p_count(0)
 {	
 	p_tifOut 				= config   ("tifOut", 				0);
 	p_edfOut 				= config   ("edfOut", 				1);
 	p_h5Out 				= config   ("h5Out", 				0);
 	p_singleOutput			= config   ("singleOutput",			0);
+	p_stackOut				= config   ("stackOut",				0);
+	p_stackCompression		= config   ("stackCompression",		4);
 	p_useNormalization 		= config   ("useNormalization", 	0);
+	p_stage					= configStr("accumulateStage",		STAGE_CORRECTED);
+	p_checkpointEvents		= config   ("checkpointEvents",		0);
+	p_checkpointSeconds		= config   ("checkpointSeconds",	0);
+	p_resume				= config   ("resume",					0);
+	p_previewOut			= config   ("previewOut",				0);
+	p_previewBinning		= config   ("previewBinning",			4);
+	p_previewInterval		= config   ("previewInterval",			1.);
+	p_previewSlots			= config   ("previewSlots",				8);
+	p_previewNQ				= config   ("previewNQ",				200);
+	p_previewFile			= configStr("previewFile",				"");
 	
 
 	io = new arraydataIO();
-	p_sum_sp = shared_ptr<array1D<double> >( new array1D<double>(nMaxTotalPx) );
+	p_stack = new EventStack();
 }
 
 //--------------
@@ -80,6 +111,7 @@ assemble::assemble (const std::string& name)
 assemble::~assemble ()
 {
 	delete io;
+	delete p_stack;
 }
 
 
@@ -93,7 +125,21 @@ assemble::beginJob(Event& evt, Env& env)
 	MsgLog(name(), info, "edfOut            = '" << p_edfOut << "'" );
 	MsgLog(name(), info, "h5Out             = '" << p_h5Out << "'" );
 	MsgLog(name(), info, "singleOutput      = '" << p_singleOutput << "'" );
+	MsgLog(name(), info, "stackOut          = '" << p_stackOut << "'" );
+	MsgLog(name(), info, "stackCompression  = '" << p_stackCompression << "'" );
 	MsgLog(name(), info, "use normalization = '" << p_useNormalization << "'" );
+	MsgLog(name(), info, "accumulateStage   = '" << p_stage << "'" );
+	MsgLog(name(), info, "checkpointEvents  = '" << p_checkpointEvents << "'" );
+	MsgLog(name(), info, "checkpointSeconds = '" << p_checkpointSeconds << "'" );
+	MsgLog(name(), info, "resume            = '" << p_resume << "'" );
+	MsgLog(name(), info, "previewOut        = '" << p_previewOut << "'" );
+	MsgLog(name(), info, "previewBinning    = '" << p_previewBinning << "'" );
+	MsgLog(name(), info, "previewInterval   = '" << p_previewInterval << "'" );
+	MsgLog(name(), info, "previewSlots      = '" << p_previewSlots << "'" );
+	MsgLog(name(), info, "previewNQ         = '" << p_previewNQ << "'" );
+	MsgLog(name(), info, "previewFile       = '" << p_previewFile << "'" );
+	
+	p_acc_sp = AccumulatorService::instance().subscribe( name(), p_stage );
 }
 
 
@@ -106,13 +152,39 @@ assemble::beginRun(Event& evt, Env& env)
 	
 	p_outputPrefix = *( (shared_ptr<std::string>) evt.get(IDSTRING_OUTPUT_PREFIX) ).get();
 	
-	p_pixX_sp = evt.get(IDSTRING_PX_X_int); 
-	p_pixY_sp = evt.get(IDSTRING_PX_Y_int); 
-
-	if (p_pixX_sp && p_pixY_sp){
-		MsgLog(name(), info, "read data for pixX(n=" << p_pixX_sp->size() << "), pixY(n=" << p_pixY_sp->size() << ")" );
-	}else{
-		MsgLog(name(), warning, "could not get data from pixX(addr=" << p_pixX_sp.get() << ") or pixY(addr=" << p_pixY_sp.get() << ")" );
+	//all subscribers of a stage use the same file, so each checkpoint is written only once
+	p_checkpoint.configure( p_outputPrefix+"_checkpoint_"+p_stage+".bin", p_checkpointEvents, p_checkpointSeconds );
+	if (p_resume){
+		AccumulatorService::instance().resume( p_stage, p_checkpoint.filename() );
+	}
+	
+	updateAssemblyPlan(evt);
+	
+	//one file per run for all single event output
+	if (p_singleOutput && p_stackOut){
+		p_stack->open( p_outputPrefix+"_evtstack_assemble.h5", p_stackCompression );
+	}
+	
+	//binned live preview: the binning map is made once here, the event data is then binned on the fly
+	if (p_previewOut && p_pixX_sp && p_pixY_sp){
+		if (p_previewPlan.create( p_pixX_sp.get(), p_pixY_sp.get(), p_previewBinning )){
+			MsgLog(name(), warning, "could not create the binning map of the preview, continuing without preview");
+			p_previewOut = 0;
+			p_preview.close();
+		}else{
+			shared_ptr<array1D<double> > qX_sp = evt.get(IDSTRING_PX_X_q);
+			shared_ptr<array1D<double> > qY_sp = evt.get(IDSTRING_PX_Y_q);
+			std::vector<float> q;
+			if (qX_sp && qY_sp && p_previewNQ > 0 && !p_previewPlan.setRadialBins( qX_sp.get(), qY_sp.get(), p_previewNQ )){
+				for (unsigned int b = 0; b < p_previewPlan.nRadialBins(); b++){
+					q.push_back( (b+0.5)*p_previewPlan.radialBinWidth() );
+				}
+			}
+			
+			string fn = (p_previewFile != "") ? p_previewFile : p_outputPrefix+"_preview.bin";
+			p_preview.open( fn, p_previewSlots, p_previewPlan.nx(), p_previewPlan.ny(), 
+				p_previewPlan.nRadialBins(), p_previewPlan.binning(), q.empty() ? 0 : &q[0] );
+		}
 	}
 }
 
@@ -141,34 +213,61 @@ assemble::event(Event& evt, Env& env)
 		MsgLog(name(), debug, "read event data of size " << data_sp->size() );	
 		p_count++;	
 		
+		//a critical PV changed the geometry, the plan of the new generation is shared with the other modules
+		//(the preview keeps the binning map of the run's first geometry, its image size is fixed by the viewer)
+		shared_ptr<int> generation_sp = evt.get(IDSTRING_GEOMETRY_GENERATION);
+		if ( (generation_sp ? *generation_sp : 0) != p_geometryGeneration ){
+			updateAssemblyPlan(evt);
+		}
+		
 		if ( p_singleOutput && !(p_count%p_singleOutput) ){
 			array2D<double> *asm2D = 0;
 			array2D<double> *raw2D = 0;
-			int fail_asm = createAssembledImageCSPAD( data_sp.get(), p_pixX_sp.get(), p_pixY_sp.get(), asm2D );
+			array1D<double> *profile = 0;
+			int fail_asm = p_plan_sp ? p_plan_sp->apply( data_sp.get(), asm2D, profile ) : 1;
 			int fail_raw = createRawImageCSPAD( data_sp.get(), raw2D );
 
-			if (p_edfOut){
+			if (p_stack->isOpen()){
+				p_stack->appendEvent( eventname_str, (shared_ptr<EventId>) evt.get() );
+				if (!fail_asm) p_stack->append( "asm2D", asm2D );
+				if (!fail_raw) p_stack->append( "raw2D", raw2D );
+			}else if (p_edfOut){
 				if (!fail_asm) io->writeToEDF( p_outputPrefix+"_evt"+eventname_str+"_asm2D.edf", asm2D );
 				if (!fail_raw) io->writeToEDF( p_outputPrefix+"_evt"+eventname_str+"_raw2D.edf", raw2D );
 			}
-			if (p_h5Out){
+			if (p_h5Out && !p_stack->isOpen()){
 				if (!fail_asm) io->writeToHDF5( p_outputPrefix+"_evt"+eventname_str+"_asm2D.h5", asm2D );
 				if (!fail_raw) io->writeToHDF5( p_outputPrefix+"_evt"+eventname_str+"_raw2D.h5", raw2D );
 			}
-			if (p_tifOut){
+			if (p_tifOut && !p_stack->isOpen()){
 				if (!fail_asm) io->writeToTiff( p_outputPrefix+"_evt"+eventname_str+"_asm2D.tif", asm2D );
 				if (!fail_raw) io->writeToTiff( p_outputPrefix+"_evt"+eventname_str+"_raw2D.tif", raw2D );
 			}
 
 			delete asm2D;
 			delete raw2D;
+			delete profile;
 
 			//MsgLog(name(), debug, "\n---histogram of event data used in assembly---\n" 
 			//	<< data_sp->getHistogramASCII(50) );
 		}//if singleOutput
 	
-		// add to running sum
-		p_sum_sp->addArrayElementwise( data_sp.get() );
+		//live preview, at most one event every previewInterval seconds
+		if ( p_preview.isOpen() && p_preview.due( p_previewInterval ) ){
+			shared_ptr<EventId> eventId = evt.get();
+			p_preview.begin( atoi(eventname_str.c_str()), eventId ? eventId->time().sec() : 0, eventId ? eventId->time().nsec() : 0 );
+			p_previewPlan.apply( data_sp.get(), p_preview.image(), p_preview.profile() );
+			p_preview.commit();
+		}
+	
+		// add to running sum (done only once per event for all subscribers to this stage)
+		// the raw stage is fed by kitty.discriminate only, this module's data is already corrected
+		if (p_stage != STAGE_RAW){
+			AccumulatorService::instance().accumulate( p_stage, eventname_str, data_sp.get() );
+		}
+		if (p_checkpoint.due( p_count )){
+			AccumulatorService::instance().checkpoint( p_stage, p_checkpoint.filename(), eventname_str );
+		}
 		
 	}else{
 		MsgLog(name(), warning, "could not get CSPAD data" );
@@ -191,6 +290,9 @@ void
 assemble::endRun(Event& evt, Env& env)
 {
 	MsgLog(name(), debug,  "assemble::endRun()" );
+	
+	p_stack->close();
+	p_preview.close();
 }
 
 
@@ -202,16 +304,16 @@ assemble::endJob(Event& evt, Env& env)
 	MsgLog(name(), debug,  "assemble::endJob()" );
 
 	//create average out of raw sum
-	p_sum_sp->divideByValue( p_count );
+	shared_ptr<array1D<double> > avg_sp = p_acc_sp->mean();
 
 	//optional normalization		
 	if (p_useNormalization == 1){
-		double mean = p_sum_sp->calcAvg();
-		p_sum_sp->divideByValue( mean );
+		double mean = avg_sp->calcAvg();
+		avg_sp->divideByValue( mean );
 		MsgLog(name(), info, "normalizing by mean value " << mean );
 	} else if (p_useNormalization == 2){
-		double max = p_sum_sp->calcMax();
-		p_sum_sp->divideByValue( max );
+		double max = avg_sp->calcMax();
+		avg_sp->divideByValue( max );
 		MsgLog(name(), info, "normalizing by max value " << max );
 	} else {
 		MsgLog(name(), info, "no normalization" );
@@ -219,11 +321,13 @@ assemble::endJob(Event& evt, Env& env)
 
 	//assemble ASICs
 	array2D<double> *asm2D = 0;
-	int fail_asm = createAssembledImageCSPAD( p_sum_sp.get(), p_pixX_sp.get(), p_pixY_sp.get(), asm2D );
+	array1D<double> *profile = 0;
+	int fail_asm = p_plan_sp ? p_plan_sp->apply( avg_sp.get(), asm2D, profile ) : 1;
+	delete profile;
 		
 	//output of 2D raw image (cheetah-style)
 	array2D<double> *raw2D = 0;
-	int fail_raw = createRawImageCSPAD( p_sum_sp.get(), raw2D );
+	int fail_raw = createRawImageCSPAD( avg_sp.get(), raw2D );
 	
 	string ext = "";
 	if (p_edfOut){
@@ -249,5 +353,36 @@ assemble::endJob(Event& evt, Env& env)
 }
 
 
+/// ------------------------------------------------------------------------------------------------
+void
+assemble::updateAssemblyPlan(Event& evt)
+{
+	p_pixX_sp = evt.get(IDSTRING_PX_X_int); 
+	p_pixY_sp = evt.get(IDSTRING_PX_Y_int); 
+
+	if (p_pixX_sp && p_pixY_sp){
+		MsgLog(name(), info, "read data for pixX(n=" << p_pixX_sp->size() << "), pixY(n=" << p_pixY_sp->size() << ")" );
+	}else{
+		MsgLog(name(), warning, "could not get data from pixX(addr=" << p_pixX_sp.get() << ") or pixY(addr=" << p_pixY_sp.get() << ")" );
+	}
+	shared_ptr<int> generation_sp = evt.get(IDSTRING_GEOMETRY_GENERATION);
+	p_geometryGeneration = generation_sp ? *generation_sp : 0;
+	
+	//the full-resolution plan is shared with all modules that assemble at full resolution
+	AssemblyPlanBuilder builder;
+	builder.pixX = p_pixX_sp.get();
+	builder.pixY = p_pixY_sp.get();
+	builder.binning = 1;
+	GeometryKey key( "assemblyPlan" );
+	key.input( "geometry", p_geometryGeneration );
+	key.parameter( "binning", 1 );
+	p_plan_sp = GeometryCache::instance().get( key, builder );
+	if (!p_plan_sp){
+		MsgLog(name(), warning, "could not create the assembly plan of geometry generation " << p_geometryGeneration 
+			<< ", no assembled images will be written" );
+	}
+}
+
+
 
 } // namespace kitty
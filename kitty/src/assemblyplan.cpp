@@ -0,0 +1,284 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class AssemblyPlan...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/assemblyplan.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <algorithm>
+#include <cmath>
+
+using std::vector;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.AssemblyPlan";
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+AssemblyPlan::AssemblyPlan()
+	: p_nx(0)
+	, p_ny(0)
+	, p_binning(1)
+	, p_bin()
+	, p_invCount()
+	, p_nRadial(0)
+	, p_radialBinWidth(0)
+	, p_radialBin()
+	, p_radialInvCount()
+	, p_imageSum()
+	, p_profileSum()
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+AssemblyPlan::~AssemblyPlan()
+{
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+AssemblyPlan::create( const array1D<double> *pixX, const array1D<double> *pixY, unsigned int binning )
+{
+	p_nx = 0;
+	p_ny = 0;
+	p_bin.clear();
+	p_invCount.clear();
+	p_nRadial = 0;
+	p_radialBin.clear();
+	p_radialInvCount.clear();
+
+	if (!pixX || !pixY || pixX->size() != pixY->size() || binning == 0){
+		MsgLog(logger, error, "cannot create assembly plan, invalid pixel coordinates or binning " << binning);
+		return 1;
+	}
+	p_binning = binning;
+
+	const unsigned int n = pixX->size();
+	int maxX = 0;
+	int maxY = 0;
+	for (unsigned int i = 0; i < n; i++){
+		maxX = std::max( maxX, (int)pixX->get(i) );
+		maxY = std::max( maxY, (int)pixY->get(i) );
+	}
+	p_nx = maxX/binning + 1;
+	p_ny = maxY/binning + 1;
+
+	p_bin.assign( n, -1 );
+	vector<unsigned int> count( p_nx*p_ny, 0 );
+	for (unsigned int i = 0; i < n; i++){
+		int x = (int)pixX->get(i);
+		int y = (int)pixY->get(i);
+		if (x >= 0 && y >= 0){
+			p_bin[i] = (y/binning)*p_nx + x/binning;
+			count[p_bin[i]]++;
+		}
+	}
+	p_invCount.assign( p_nx*p_ny, 0.f );
+	for (unsigned int b = 0; b < count.size(); b++){
+		if (count[b]){
+			p_invCount[b] = 1.f/count[b];
+		}
+	}
+	p_imageSum.assign( p_nx*p_ny, 0. );
+
+	MsgLog(logger, info, "assembly plan for " << n << " pixels: " << p_nx << " x " << p_ny << " image, binning " << binning);
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+AssemblyPlan::setRadialBins( const array1D<double> *qX, const array1D<double> *qY, unsigned int nBins, double qMax )
+{
+	p_nRadial = 0;
+	p_radialBin.clear();
+	p_radialInvCount.clear();
+	if (!qX || !qY || qX->size() != p_bin.size() || qY->size() != p_bin.size() || nBins == 0){
+		MsgLog(logger, warning, "no radial bins, q arrays do not match the assembly plan");
+		return 1;
+	}
+
+	const unsigned int n = p_bin.size();
+	vector<double> q( n );
+	for (unsigned int i = 0; i < n; i++){
+		q[i] = sqrt( qX->get(i)*qX->get(i) + qY->get(i)*qY->get(i) );
+	}
+	if (qMax <= 0){
+		qMax = *std::max_element( q.begin(), q.end() );
+	}
+	p_nRadial = nBins;
+	p_radialBinWidth = qMax/nBins;
+
+	p_radialBin.assign( n, -1 );
+	vector<unsigned int> count( nBins, 0 );
+	for (unsigned int i = 0; i < n; i++){
+		int b = (int)(q[i]/p_radialBinWidth);
+		if (b >= 0 && b < (int)nBins){
+			p_radialBin[i] = b;
+			count[b]++;
+		}
+	}
+	p_radialInvCount.assign( nBins, 0.f );
+	for (unsigned int b = 0; b < nBins; b++){
+		if (count[b]){
+			p_radialInvCount[b] = 1.f/count[b];
+		}
+	}
+	p_profileSum.assign( nBins, 0. );
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+AssemblyPlan::valid() const
+{
+	return !p_bin.empty();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+AssemblyPlan::nx() const
+{
+	return p_nx;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+AssemblyPlan::ny() const
+{
+	return p_ny;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+AssemblyPlan::binning() const
+{
+	return p_binning;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+AssemblyPlan::nRadialBins() const
+{
+	return p_nRadial;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+double
+AssemblyPlan::radialBinWidth() const
+{
+	return p_radialBinWidth;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+AssemblyPlan::apply( const array1D<double> *data, float *image, float *profile ) const
+{
+	const unsigned int n = std::min( (unsigned int)p_bin.size(), data->size() );
+	const double *d = data->data();
+	const int *bin = &p_bin[0];
+	double *imgSum = &p_imageSum[0];
+	std::fill( p_imageSum.begin(), p_imageSum.end(), 0. );
+
+	//image and profile are filled in the same pass over the pixels
+	if (profile && p_nRadial){
+		const int *rbin = &p_radialBin[0];
+		double *profSum = &p_profileSum[0];
+		std::fill( p_profileSum.begin(), p_profileSum.end(), 0. );
+		for (unsigned int i = 0; i < n; i++){
+			if (bin[i] >= 0) imgSum[bin[i]] += d[i];
+			if (rbin[i] >= 0) profSum[rbin[i]] += d[i];
+		}
+		for (unsigned int b = 0; b < p_nRadial; b++){
+			profile[b] = profSum[b] * p_radialInvCount[b];
+		}
+	}else{
+		for (unsigned int i = 0; i < n; i++){
+			if (bin[i] >= 0) imgSum[bin[i]] += d[i];
+		}
+	}
+	for (unsigned int b = 0; b < p_imageSum.size(); b++){
+		image[b] = imgSum[b] * p_invCount[b];
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+AssemblyPlan::apply( const array1D<double> *data, array2D<double> *&image, array1D<double> *&profile ) const
+{
+	if (!valid() || !data){
+		return 1;
+	}
+	vector<float> img( p_nx*p_ny );
+	vector<float> prof( std::max(p_nRadial, 1u) );
+	apply( data, &img[0], &prof[0] );
+
+	delete image;
+	image = new array2D<double>( p_nx, p_ny );
+	for (unsigned int y = 0; y < p_ny; y++){
+		for (unsigned int x = 0; x < p_nx; x++){
+			image->set( x, y, img[y*p_nx + x] );
+		}
+	}
+	delete profile;
+	profile = new array1D<double>( p_nRadial );
+	for (unsigned int b = 0; b < p_nRadial; b++){
+		profile->set( b, prof[b] );
+	}
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+boost::shared_ptr<AssemblyPlan>
+AssemblyPlanBuilder::build()
+{
+	boost::shared_ptr<AssemblyPlan> plan_sp( new AssemblyPlan() );
+	if ( plan_sp->create( pixX, pixY, binning ) ){
+		return boost::shared_ptr<AssemblyPlan>();
+	}
+	return plan_sp;
+}
+
+
+} // namespace kitty
@@ -0,0 +1,292 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class BadPixelFinder...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/badpixelfinder.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <algorithm>
+#include <cmath>
+
+using std::string;
+using std::vector;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+#include "kitty/constants.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.BadPixelFinder";
+
+	const unsigned short maxRun = 65535;
+
+	/// ASIC of a pixel in detector-1D order (two ASICs per 2x1 section)
+	unsigned int asicOf( unsigned int i ){
+		unsigned int section = i / kitty::nPxPer2x1;
+		unsigned int row = (i % kitty::nPxPer2x1) % kitty::nRowsPer2x1;
+		return 2*section + (row >= (unsigned int)kitty::nRowsPerASIC ? 1 : 0);
+	}
+
+	/// median of 'values' (reorders them)
+	double median( vector<double> &values ){
+		vector<double>::iterator mid = values.begin() + values.size()/2;
+		std::nth_element( values.begin(), mid, values.end() );
+		return *mid;
+	}
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+BadPixelFinder::BadPixelFinder()
+	: p_last()
+	, p_run()
+	, p_longest()
+	, p_hits()
+	, p_hotThreshold(0)
+	, p_stuckTolerance(0)
+	, p_count(0)
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+BadPixelFinder::~BadPixelFinder()
+{
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+BadPixelFinder::create( unsigned int size, double hotThreshold, double stuckTolerance )
+{
+	p_last.assign( size, 0 );
+	p_run.assign( size, 0 );
+	p_longest.assign( size, 0 );
+	p_hits.assign( size, 0 );
+	p_hotThreshold = hotThreshold;
+	p_stuckTolerance = stuckTolerance;
+	p_count = 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+BadPixelFinder::isCreated() const
+{
+	return !p_last.empty();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+BadPixelFinder::add( const array1D<double> *data )
+{
+	if (!data || data->size() != p_last.size()){
+		MsgLog(logger, error, "data size does not match, event not added");
+		return;
+	}
+	const double *d = data->data();
+	const unsigned int n = p_last.size();
+	const bool hot = (p_hotThreshold > 0);
+	for (unsigned int i = 0; i < n; i++){
+		if (hot && d[i] > p_hotThreshold){
+			p_hits[i]++;
+		}
+		//the first event starts a run of length one, values are compared at the precision they are kept in
+		if (p_count && std::fabs( (float)d[i] - p_last[i] ) <= p_stuckTolerance){
+			if (p_run[i] < maxRun){
+				p_run[i]++;
+			}
+		}else{
+			p_run[i] = 1;
+		}
+		if (p_run[i] > p_longest[i]){
+			p_longest[i] = p_run[i];
+		}
+		p_last[i] = (float)d[i];
+	}
+	p_count++;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+BadPixelFinder::count() const
+{
+	return p_count;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+BadPixelFinder::classify( const array1D<double> *stddev, const array1D<double> *mask, double nMAD,
+	double hotMinFraction, unsigned int stuckMinEvents, array1D<double> *flags ) const
+{
+	const unsigned int n = p_last.size();
+	flags->zeros();
+	if (!p_count || !stddev || stddev->size() != n || flags->size() != n || (mask && mask->size() != n)){
+		MsgLog(logger, error, "cannot classify pixels, no events or sizes do not match");
+		return;
+	}
+
+	vector< vector<unsigned int> > asics( asicOf( n-1 ) + 1 );
+	for (unsigned int i = 0; i < n; i++){
+		asics[asicOf(i)].push_back( i );
+	}
+
+	vector<double> sd( stddev->data(), stddev->data() + n );
+	vector<double> hits( n );
+	for (unsigned int i = 0; i < n; i++){
+		hits[i] = p_hits[i] / (double)p_count;
+	}
+	vector<double> longest( p_longest.begin(), p_longest.end() );
+
+	for (unsigned int a = 0; a < asics.size(); a++){
+		flagOutliers( asics[a], sd, mask, nMAD, true, false, 0, DEAD, flags );
+		flagOutliers( asics[a], sd, mask, nMAD, false, true, 0, NOISY, flags );
+		if (p_hotThreshold > 0){
+			flagOutliers( asics[a], hits, mask, nMAD, false, true, hotMinFraction, HOT, flags );
+		}
+		if (stuckMinEvents > 0){
+			flagOutliers( asics[a], longest, mask, nMAD, false, true, stuckMinEvents, STUCK, flags );
+		}
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+shared_ptr<array1D<double> >
+BadPixelFinder::hitFraction() const
+{
+	shared_ptr<array1D<double> > result( new array1D<double>( p_hits.size() ) );
+	for (unsigned int i = 0; i < p_hits.size(); i++){
+		result->set( i, p_count ? p_hits[i] / (double)p_count : 0 );
+	}
+	return result;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+shared_ptr<array1D<double> >
+BadPixelFinder::longestRun() const
+{
+	shared_ptr<array1D<double> > result( new array1D<double>( p_longest.size() ) );
+	for (unsigned int i = 0; i < p_longest.size(); i++){
+		result->set( i, p_longest[i] );
+	}
+	return result;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+BadPixelFinder::save( Checkpoint &cp, const string &prefix ) const
+{
+	vector<double> last( p_last.begin(), p_last.end() );
+	vector<double> run( p_run.begin(), p_run.end() );
+	vector<double> longest( p_longest.begin(), p_longest.end() );
+	vector<double> hits( p_hits.begin(), p_hits.end() );
+	cp.add( prefix+"count", (double)p_count );
+	cp.add( prefix+"last", last );
+	cp.add( prefix+"run", run );
+	cp.add( prefix+"longest", longest );
+	cp.add( prefix+"hits", hits );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+BadPixelFinder::restore( const Checkpoint &cp, const string &prefix )
+{
+	double count = 0;
+	vector<double> last, run, longest, hits;
+	bool ok = cp.get( prefix+"count", count )
+		&& cp.get( prefix+"last", last )
+		&& cp.get( prefix+"run", run )
+		&& cp.get( prefix+"longest", longest )
+		&& cp.get( prefix+"hits", hits );
+	const unsigned int n = p_last.size();
+	if (!ok || last.size() != n || run.size() != n || longest.size() != n || hits.size() != n){
+		MsgLog(logger, error, "checkpoint does not match the bad pixel counters");
+		return 1;
+	}
+	p_count = (unsigned int)count;
+	for (unsigned int i = 0; i < n; i++){
+		p_last[i] = (float)last[i];
+		p_run[i] = (unsigned short)run[i];
+		p_longest[i] = (unsigned short)longest[i];
+		p_hits[i] = (unsigned int)hits[i];
+	}
+	return 0;
+}
+
+
+//		-----------------------------------------
+// 		-- Private Function Member Definitions --
+//		-----------------------------------------
+
+/// ------------------------------------------------------------------------------------------------
+void
+BadPixelFinder::flagOutliers( const vector<unsigned int> &pixels, const vector<double> &value,
+	const array1D<double> *mask, double nMAD, bool low, bool high, double minValue, int flag, array1D<double> *flags ) const
+{
+	vector<double> good;
+	good.reserve( pixels.size() );
+	for (unsigned int k = 0; k < pixels.size(); k++){
+		if (!mask || mask->get(pixels[k]) != 0){
+			good.push_back( value[pixels[k]] );
+		}
+	}
+	if (good.empty()){
+		return;
+	}
+	const double med = median( good );
+	for (unsigned int k = 0; k < good.size(); k++){
+		good[k] = std::fabs( good[k] - med );
+	}
+	const double mad = 1.4826 * median( good );		// scaled to the standard deviation of a normal distribution
+
+	//without any spread in the ASIC, only values above an explicit minimum are outliers
+	if (mad <= 0 && minValue <= 0){
+		return;
+	}
+	const double lowCut = med - nMAD*mad;
+	const double highCut = med + nMAD*mad;
+	for (unsigned int k = 0; k < pixels.size(); k++){
+		const unsigned int i = pixels[k];
+		const double v = value[i];
+		if ( (low && v < lowCut) || (high && v > highCut && v >= minValue) ){
+			flags->set( i, (int)flags->get(i) | flag );
+		}
+	}
+}
+
+
+} // namespace kitty
@@ -0,0 +1,245 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class BlockAccumulator...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/blockaccumulator.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <algorithm>
+#include <cmath>
+
+using std::string;
+using std::vector;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.BlockAccumulator";
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+BlockAccumulator::BlockAccumulator()
+	: p_size(0)
+	, p_nBlocks(0)
+	, p_blockSum()
+	, p_blockCount()
+	, p_sumSq()
+	, p_blockLength(1)
+	, p_current(0)
+	, p_count(0)
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+BlockAccumulator::~BlockAccumulator()
+{
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+BlockAccumulator::create( unsigned int size, unsigned int nBlocks )
+{
+	if (nBlocks < 2){
+		nBlocks = 2;
+	}
+	nBlocks += nBlocks % 2;
+	p_size = size;
+	p_nBlocks = nBlocks;
+	p_blockSum.assign( (size_t)nBlocks*size, 0. );
+	p_blockCount.assign( nBlocks, 0. );
+	p_sumSq.assign( size, 0. );
+	p_blockLength = 1;
+	p_current = 0;
+	p_count = 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+BlockAccumulator::isCreated() const
+{
+	return p_nBlocks > 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+BlockAccumulator::add( const arraydata<double> *values )
+{
+	if (!values || values->size() != p_size || p_nBlocks == 0){
+		MsgLog(logger, error, "values do not match the block accumulator (size " << p_size << ")");
+		return;
+	}
+	if (p_blockCount[p_current] == p_blockLength){
+		p_current++;
+		if (p_current == p_nBlocks){
+			//all blocks full: merge neighbours, the second half is free again
+			for (unsigned int j = 0; j < p_nBlocks/2; j++){
+				double *dst = &p_blockSum[(size_t)j*p_size];
+				const double *a = &p_blockSum[(size_t)2*j*p_size];
+				const double *b = &p_blockSum[(size_t)(2*j+1)*p_size];
+				for (unsigned int i = 0; i < p_size; i++){
+					dst[i] = a[i] + b[i];
+				}
+				p_blockCount[j] = p_blockCount[2*j] + p_blockCount[2*j+1];
+			}
+			for (unsigned int j = p_nBlocks/2; j < p_nBlocks; j++){
+				std::fill( p_blockSum.begin() + (size_t)j*p_size, p_blockSum.begin() + (size_t)(j+1)*p_size, 0. );
+				p_blockCount[j] = 0;
+			}
+			p_blockLength *= 2;
+			p_current = p_nBlocks/2;
+		}
+	}
+	double *sum = &p_blockSum[(size_t)p_current*p_size];
+	for (unsigned int i = 0; i < p_size; i++){
+		const double v = values->get_atIndex(i);
+		sum[i] += v;
+		p_sumSq[i] += v*v;
+	}
+	p_blockCount[p_current]++;
+	p_count++;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+BlockAccumulator::count() const
+{
+	return p_count;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+BlockAccumulator::blocksUsed() const
+{
+	return p_count ? p_current+1 : 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+BlockAccumulator::result( arraydata<double> *mean, arraydata<double> *error, int method, arraydata<double> *stddev ) const
+{
+	if (!mean || !error || mean->size() != p_size || error->size() != p_size || (stddev && stddev->size() != p_size)){
+		MsgLog(logger, error, "result arrays do not match the block accumulator (size " << p_size << ")");
+		return 1;
+	}
+	const unsigned int nUsed = blocksUsed();
+	const double n = p_count;
+	if (nUsed < 2){
+		MsgLog(logger, warning, "standard errors need at least two blocks, " << p_count << " event(s) so far");
+	}
+	for (unsigned int i = 0; i < p_size; i++){
+		double s = 0;
+		for (unsigned int j = 0; j < nUsed; j++){
+			s += p_blockSum[(size_t)j*p_size + i];
+		}
+		const double m = n ? s/n : 0;
+		mean->set_atIndex( i, m );
+
+		double var = 0;
+		if (nUsed >= 2 && method == BATCH_MEANS){
+			//variance of the block means, weighted by the block sizes (the last block may be incomplete)
+			for (unsigned int j = 0; j < nUsed; j++){
+				const double nj = p_blockCount[j];
+				const double d = p_blockSum[(size_t)j*p_size + i] - nj*m;
+				var += d*d;
+			}
+			var *= nUsed/((nUsed - 1.)*n*n);
+		}else if (nUsed >= 2){
+			//jackknife: means of all events but one block
+			double avg = 0;
+			vector<double> theta( nUsed );
+			for (unsigned int j = 0; j < nUsed; j++){
+				theta[j] = (s - p_blockSum[(size_t)j*p_size + i])/(n - p_blockCount[j]);
+				avg += theta[j]/nUsed;
+			}
+			for (unsigned int j = 0; j < nUsed; j++){
+				var += (theta[j] - avg)*(theta[j] - avg);
+			}
+			var *= (nUsed - 1.)/nUsed;
+		}
+		error->set_atIndex( i, sqrt(var) );
+
+		if (stddev){
+			const double v = n ? p_sumSq[i]/n - m*m : 0;
+			stddev->set_atIndex( i, v > 0 ? sqrt(v) : 0 );
+		}
+	}
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+BlockAccumulator::save( Checkpoint &cp, const string &prefix ) const
+{
+	cp.add( prefix+"count", (double)p_count );
+	cp.add( prefix+"blockLength", (double)p_blockLength );
+	cp.add( prefix+"current", (double)p_current );
+	cp.add( prefix+"blockSum", p_blockSum );
+	cp.add( prefix+"blockCount", p_blockCount );
+	cp.add( prefix+"sumSq", p_sumSq );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+BlockAccumulator::restore( const Checkpoint &cp, const string &prefix )
+{
+	double count = 0;
+	double blockLength = 0;
+	double current = 0;
+	vector<double> blockSum, blockCount, sumSq;
+	bool ok = cp.get( prefix+"count", count )
+		&& cp.get( prefix+"blockLength", blockLength )
+		&& cp.get( prefix+"current", current )
+		&& cp.get( prefix+"blockSum", blockSum )
+		&& cp.get( prefix+"blockCount", blockCount )
+		&& cp.get( prefix+"sumSq", sumSq );
+	if (!ok || blockSum.size() != p_blockSum.size() || blockCount.size() != p_blockCount.size() || sumSq.size() != p_sumSq.size()){
+		return 1;
+	}
+	p_count = (unsigned int)count;
+	p_blockLength = (unsigned int)blockLength;
+	p_current = (unsigned int)current;
+	p_blockSum.swap( blockSum );
+	p_blockCount.swap( blockCount );
+	p_sumSq.swap( sumSq );
+	return 0;
+}
+
+
+} // namespace kitty
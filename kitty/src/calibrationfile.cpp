@@ -0,0 +1,355 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class CalibrationFile...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/calibrationfile.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using std::string;
+using std::vector;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+#include "kitty/util.h"
+using ns_cspad_util::create1DFromRawImageCSPAD;
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.CalibrationFile";
+
+	const char magic[8] = {'K','T','Y','C','A','L','B','1'};
+	const unsigned int version = 1;
+
+	/// file header (256 bytes), followed by the payload
+	struct CalibHeader {
+		char magic[8];
+		unsigned int version;
+		unsigned int payload;
+		unsigned int nPixels;
+		unsigned int reserved;
+		unsigned long payloadBytes;
+		unsigned long checksum;			// FNV-1a of the payload
+		char source[216];				// file the constants were converted from
+	};
+
+	unsigned long payloadBytes( unsigned int payload, unsigned int nPixels ){
+		if (payload == kitty::CalibrationFile::FLOAT32){
+			return (unsigned long)nPixels*sizeof(float);
+		}else if (payload == kitty::CalibrationFile::BITMASK){
+			return ((unsigned long)nPixels + 7)/8;
+		}
+		return 0;
+	}
+
+	unsigned long checksum( const unsigned char *b, unsigned long n ){
+		unsigned long hash = 14695981039346656037UL;
+		for (unsigned long k = 0; k < n; k++){
+			hash = (hash ^ b[k]) * 1099511628211UL;
+		}
+		return hash;
+	}
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+CalibrationFile::CalibrationFile()
+	: p_map(0)
+	, p_mapBytes(0)
+	, p_filename("")
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+CalibrationFile::~CalibrationFile()
+{
+	close();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+CalibrationFile::open( const string &filename )
+{
+	close();
+	int fd = ::open( filename.c_str(), O_RDONLY );
+	if (fd < 0){
+		MsgLog(logger, error, "could not open calibration file '" << filename << "'");
+		return 1;
+	}
+	struct stat st;
+	void *map = MAP_FAILED;
+	if (fstat( fd, &st ) == 0 && st.st_size >= (off_t)sizeof(CalibHeader)){
+		map = mmap( 0, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	}
+	::close( fd );
+	if (map == MAP_FAILED){
+		MsgLog(logger, error, "could not map calibration file '" << filename << "'");
+		return 1;
+	}
+
+	const CalibHeader *header = static_cast<const CalibHeader*>( map );
+	const unsigned long bytes = payloadBytes( header->payload, header->nPixels );
+	const unsigned char *data = reinterpret_cast<const unsigned char*>( header + 1 );
+	string problem;
+	if (memcmp( header->magic, magic, sizeof(magic) ) != 0){
+		problem = "not a kitty calibration file";
+	}else if (header->version != version){
+		problem = "unsupported version";
+	}else if (bytes == 0 || header->payloadBytes != bytes || (size_t)st.st_size != sizeof(CalibHeader) + bytes){
+		problem = "inconsistent size";
+	}else if (checksum( data, bytes ) != header->checksum){
+		problem = "checksum does not match";
+	}
+	if (!problem.empty()){
+		MsgLog(logger, error, "'" << filename << "': " << problem);
+		munmap( map, st.st_size );
+		return 1;
+	}
+
+	p_map = map;
+	p_mapBytes = st.st_size;
+	p_filename = filename;
+	MsgLog(logger, info, "mapped '" << filename << "': " << header->nPixels << " pixels, "
+		<< (header->payload == FLOAT32 ? "float32" : "bit mask") << ", converted from '" << source() << "'");
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+CalibrationFile::close()
+{
+	if (p_map){
+		munmap( p_map, p_mapBytes );
+	}
+	p_map = 0;
+	p_mapBytes = 0;
+	p_filename = "";
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+CalibrationFile::isOpen() const
+{
+	return p_map != 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+CalibrationFile::Payload
+CalibrationFile::payload() const
+{
+	return p_map ? (Payload)static_cast<const CalibHeader*>( p_map )->payload : FLOAT32;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+CalibrationFile::size() const
+{
+	return p_map ? static_cast<const CalibHeader*>( p_map )->nPixels : 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+string
+CalibrationFile::source() const
+{
+	if (!p_map){
+		return "";
+	}
+	const CalibHeader *header = static_cast<const CalibHeader*>( p_map );
+	return string( header->source, strnlen( header->source, sizeof(header->source) ) );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+const float *
+CalibrationFile::values() const
+{
+	if (!p_map || payload() != FLOAT32){
+		return 0;
+	}
+	return reinterpret_cast<const float*>( static_cast<const CalibHeader*>( p_map ) + 1 );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+const unsigned char *
+CalibrationFile::bits() const
+{
+	if (!p_map || payload() != BITMASK){
+		return 0;
+	}
+	return reinterpret_cast<const unsigned char*>( static_cast<const CalibHeader*>( p_map ) + 1 );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+double
+CalibrationFile::get( unsigned int i ) const
+{
+	if (i >= size()){
+		return 0;
+	}
+	if (payload() == FLOAT32){
+		return values()[i];
+	}
+	return (bits()[i/8] >> (i%8)) & 1;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+CalibrationFile::copyTo( array1D<double> *&dest ) const
+{
+	const unsigned int n = size();
+	if (!dest || dest->size() != n){
+		delete dest;
+		dest = new array1D<double>( n );
+	}
+	double *d = dest->data();
+	if (payload() == FLOAT32){
+		const float *v = values();
+		for (unsigned int i = 0; i < n; i++){
+			d[i] = v[i];
+		}
+	}else{
+		const unsigned char *b = bits();
+		for (unsigned int i = 0; i < n; i++){
+			d[i] = (b[i/8] >> (i%8)) & 1;
+		}
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+CalibrationFile::isCalibrationFile( const string &filename )
+{
+	char header[sizeof(magic)];
+	FILE *f = fopen( filename.c_str(), "rb" );
+	if (!f){
+		return false;
+	}
+	bool ok = (fread( header, sizeof(header), 1, f ) == 1);
+	fclose( f );
+	return ok && memcmp( header, magic, sizeof(magic) ) == 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+CalibrationFile::write( const string &filename, const array1D<double> *data, Payload payload, const string &source )
+{
+	if (!data || data->size() == 0 || payloadBytes( payload, data->size() ) == 0){
+		MsgLog(logger, error, "nothing to write to calibration file '" << filename << "'");
+		return 1;
+	}
+	const unsigned int n = data->size();
+	vector<unsigned char> buffer( payloadBytes( payload, n ), 0 );
+	if (payload == FLOAT32){
+		float *v = reinterpret_cast<float*>( &buffer[0] );
+		for (unsigned int i = 0; i < n; i++){
+			v[i] = data->get(i);
+		}
+	}else{
+		for (unsigned int i = 0; i < n; i++){
+			if (data->get(i) != 0){
+				buffer[i/8] |= (1 << (i%8));
+			}
+		}
+	}
+
+	CalibHeader header;
+	memset( &header, 0, sizeof(header) );
+	memcpy( header.magic, magic, sizeof(magic) );
+	header.version = version;
+	header.payload = payload;
+	header.nPixels = n;
+	header.payloadBytes = buffer.size();
+	header.checksum = checksum( &buffer[0], buffer.size() );
+	strncpy( header.source, source.c_str(), sizeof(header.source)-1 );
+
+	//write to a temporary file, then rename, so that readers only see complete files
+	std::ostringstream tmp;
+	tmp << filename << ".tmp" << getpid();
+	FILE *f = fopen( tmp.str().c_str(), "wb" );
+	if (!f){
+		MsgLog(logger, error, "could not write calibration file '" << filename << "'");
+		return 1;
+	}
+	bool ok = (fwrite( &header, sizeof(header), 1, f ) == 1);
+	ok = ok && (fwrite( &buffer[0], 1, buffer.size(), f ) == buffer.size());
+	ok = (fclose( f ) == 0) && ok;
+	if (!ok || rename( tmp.str().c_str(), filename.c_str() ) != 0){
+		MsgLog(logger, error, "could not write calibration file '" << filename << "'");
+		remove( tmp.str().c_str() );
+		return 1;
+	}
+	MsgLog(logger, info, "wrote " << n << " pixels (" << (payload == FLOAT32 ? "float32" : "bit mask") << ") to '" << filename << "'");
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+CalibrationFile::load( const string &filename, array1D<double> *&dest, arraydataIO *io )
+{
+	if (isCalibrationFile( filename )){
+		CalibrationFile file;
+		if (file.open( filename )){
+			return 1;
+		}
+		file.copyTo( dest );
+		return 0;
+	}
+
+	array2D<double> *img2D = 0;
+	int fail = io->readFromFile( filename, img2D );
+	if (!fail){
+		create1DFromRawImageCSPAD( img2D, dest );
+	}
+	delete img2D;
+	return fail;
+}
+
+
+} // namespace kitty
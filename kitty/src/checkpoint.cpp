@@ -0,0 +1,298 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class Checkpoint...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/checkpoint.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+using std::string;
+using std::vector;
+using std::map;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.Checkpoint";
+	const char magic[8] = {'K','T','Y','C','K','P','T','1'};
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+Checkpoint::Checkpoint()
+	: p_filename("")
+	, p_everyEvents(0)
+	, p_everySeconds(0)
+	, p_lastCount(0)
+	, p_lastTime(time(0))
+	, p_lastEvent(0)
+	, p_blocks()
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+Checkpoint::~Checkpoint()
+{
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+Checkpoint::configure( const string &filename, int everyEvents, double everySeconds )
+{
+	p_filename = filename;
+	p_everyEvents = everyEvents;
+	p_everySeconds = everySeconds;
+	p_lastCount = 0;
+	p_lastTime = time(0);
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+Checkpoint::enabled() const
+{
+	return (p_filename != "" && (p_everyEvents > 0 || p_everySeconds > 0));
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+string
+Checkpoint::filename() const
+{
+	return p_filename;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+Checkpoint::due( unsigned int count )
+{
+	if (!enabled() || count == p_lastCount){
+		return false;
+	}
+	bool isDue = false;
+	if (p_everyEvents > 0 && count - p_lastCount >= (unsigned int)p_everyEvents){
+		isDue = true;
+	}
+	if (p_everySeconds > 0 && difftime( time(0), p_lastTime ) >= p_everySeconds){
+		isDue = true;
+	}
+	if (isDue){
+		p_lastCount = count;
+		p_lastTime = time(0);
+	}
+	return isDue;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+Checkpoint::begin( unsigned int lastEvent )
+{
+	p_lastEvent = lastEvent;
+	p_blocks.clear();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+Checkpoint::add( const string &block, const vector<double> &values )
+{
+	p_blocks[block] = values;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+Checkpoint::add( const string &block, const arraydata<double> *values )
+{
+	if (values){
+		p_blocks[block] = vector<double>( values->data(), values->data() + values->size() );
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+Checkpoint::add( const string &block, double value )
+{
+	p_blocks[block] = vector<double>(1, value);
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+Checkpoint::commit()
+{
+	string tmp_fn = p_filename + ".tmp";
+	std::ofstream out( tmp_fn.c_str(), std::ios::binary );
+	if (out.fail()){
+		MsgLog(logger, error, "could not open checkpoint file '" << tmp_fn << "'");
+		return 1;
+	}
+
+	unsigned int nBlocks = p_blocks.size();
+	out.write( magic, sizeof(magic) );
+	out.write( (const char*)&p_lastEvent, sizeof(p_lastEvent) );
+	out.write( (const char*)&nBlocks, sizeof(nBlocks) );
+	for (map<string, vector<double> >::const_iterator it = p_blocks.begin(); it != p_blocks.end(); it++){
+		unsigned int nameLength = it->first.size();
+		unsigned int n = it->second.size();
+		out.write( (const char*)&nameLength, sizeof(nameLength) );
+		out.write( it->first.data(), nameLength );
+		out.write( (const char*)&n, sizeof(n) );
+		if (n > 0){
+			out.write( (const char*)&(it->second[0]), n*sizeof(double) );
+		}
+	}
+	out.close();
+	if (out.fail()){
+		MsgLog(logger, error, "could not write checkpoint file '" << tmp_fn << "'");
+		return 1;
+	}
+
+	//replace the previous checkpoint only when the new one is complete
+	if (rename( tmp_fn.c_str(), p_filename.c_str() ) != 0){
+		MsgLog(logger, error, "could not rename '" << tmp_fn << "' to '" << p_filename << "'");
+		return 1;
+	}
+	MsgLog(logger, info, "checkpoint written to '" << p_filename << "' after event " << p_lastEvent);
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+Checkpoint::load()
+{
+	p_blocks.clear();
+	p_lastEvent = 0;
+
+	std::ifstream in( p_filename.c_str(), std::ios::binary );
+	if (in.fail()){
+		MsgLog(logger, warning, "no checkpoint file '" << p_filename << "' found");
+		return 1;
+	}
+
+	char header[sizeof(magic)];
+	unsigned int nBlocks = 0;
+	in.read( header, sizeof(header) );
+	in.read( (char*)&p_lastEvent, sizeof(p_lastEvent) );
+	in.read( (char*)&nBlocks, sizeof(nBlocks) );
+	if (in.fail() || memcmp( header, magic, sizeof(magic) ) != 0){
+		MsgLog(logger, error, "'" << p_filename << "' is not a kitty checkpoint file");
+		return 1;
+	}
+
+	for (unsigned int b = 0; b < nBlocks; b++){
+		unsigned int nameLength = 0;
+		unsigned int n = 0;
+		in.read( (char*)&nameLength, sizeof(nameLength) );
+		string block(nameLength, ' ');
+		if (nameLength > 0){
+			in.read( &block[0], nameLength );
+		}
+		in.read( (char*)&n, sizeof(n) );
+		vector<double> &values = p_blocks[block];
+		values.resize(n);
+		if (n > 0){
+			in.read( (char*)&values[0], n*sizeof(double) );
+		}
+		if (in.fail()){
+			MsgLog(logger, error, "checkpoint file '" << p_filename << "' is truncated");
+			p_blocks.clear();
+			return 1;
+		}
+	}
+	MsgLog(logger, info, "checkpoint '" << p_filename << "' loaded, resuming after event " << p_lastEvent);
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+Checkpoint::lastEvent() const
+{
+	return p_lastEvent;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+Checkpoint::get( const string &block, vector<double> &values ) const
+{
+	map<string, vector<double> >::const_iterator it = p_blocks.find( block );
+	if (it == p_blocks.end()){
+		MsgLog(logger, error, "block '" << block << "' not found in checkpoint '" << p_filename << "'");
+		return false;
+	}
+	values = it->second;
+	return true;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+Checkpoint::get( const string &block, arraydata<double> *values ) const
+{
+	vector<double> v;
+	if (!values || !get( block, v )){
+		return false;
+	}
+	if (v.size() != values->size()){
+		MsgLog(logger, error, "block '" << block << "' has " << v.size() << " entries, expected " << values->size());
+		return false;
+	}
+	for (unsigned int i = 0; i < v.size(); i++){
+		values->set_atIndex( i, v[i] );
+	}
+	return true;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+Checkpoint::get( const string &block, double &value ) const
+{
+	vector<double> v;
+	if (!get( block, v ) || v.empty()){
+		return false;
+	}
+	value = v[0];
+	return true;
+}
+
+
+} // namespace kitty
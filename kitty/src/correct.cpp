@@ -35,6 +35,98 @@ using ns_cspad_util::create1DFromRawImageCSPAD;
 //-----------------------------------------------------------------------
 // Local Macros, Typedefs, Structures, Unions and Forward Declarations --
 //-----------------------------------------------------------------------
+namespace {
+	/// map a kitty calibration file, false if it cannot be used (wrong size, or a bit mask where values are needed)
+	bool mapCalibration( kitty::CalibrationFile &file, const std::string &fn, bool needValues, const std::string &module ){
+		if (file.open( fn )){
+			return false;
+		}
+		if (file.size() != (unsigned int)kitty::nMaxTotalPx || (needValues && !file.values())){
+			MsgLog(module, warning, "'" << fn << "' has " << file.size() << " pixels"
+				<< (file.values() ? "" : " in a bit mask") << ", expected " << kitty::nMaxTotalPx << " values");
+			file.close();
+			return false;
+		}
+		return true;
+	}
+
+	int subtractMapped( array1D<double> *data, const kitty::CalibrationFile &file ){
+		if (data->size() != file.size()){
+			return 1;
+		}
+		double *d = data->data();
+		const float *v = file.values();
+		for (unsigned int i = 0; i < file.size(); i++){
+			d[i] -= v[i];
+		}
+		return 0;
+	}
+
+	/// pixels with a gain of 0 are left as they are
+	int divideMapped( array1D<double> *data, const kitty::CalibrationFile &file ){
+		if (data->size() != file.size()){
+			return 1;
+		}
+		double *d = data->data();
+		const float *v = file.values();
+		for (unsigned int i = 0; i < file.size(); i++){
+			if (v[i] != 0){
+				d[i] /= v[i];
+			}
+		}
+		return 0;
+	}
+
+	/// bad pixels (0 in the mask) are set to 0
+	int maskMapped( array1D<double> *data, const kitty::CalibrationFile &file ){
+		if (data->size() != file.size()){
+			return 1;
+		}
+		double *d = data->data();
+		if (file.values()){
+			const float *v = file.values();
+			for (unsigned int i = 0; i < file.size(); i++){
+				d[i] *= v[i];
+			}
+		}else{
+			const unsigned char *b = file.bits();
+			for (unsigned int i = 0; i < file.size(); i++){
+				if (!((b[i/8] >> (i%8)) & 1)){
+					d[i] = 0;
+				}
+			}
+		}
+		return 0;
+	}
+
+	/// polarization correction for each pixel (from Hura et al JCP 2000), from the pixel maps of the event
+	class PolarizationBuilder : public kitty::GeometryBuilder<array1D<double> > {
+	public:
+		Event *evt;
+		std::string module;
+		double horzPol;
+
+		virtual shared_ptr<array1D<double> > build(){
+			shared_ptr<array1D<double> > pixPhi_sp = evt->get(kitty::IDSTRING_PX_PHI);
+			shared_ptr<array1D<double> > pixTwoTheta_sp = evt->get(kitty::IDSTRING_PX_TWOTHETA);
+			if (!pixPhi_sp || !pixTwoTheta_sp) {
+				MsgLog(module, warning, "could not get pixel maps of phi (address=" << pixPhi_sp.get() << ") and/or 2theta (address=" << pixTwoTheta_sp.get() << ")");
+				return shared_ptr<array1D<double> >();
+			}
+			MsgLog(module, debug, "read event pixel map of phi of size " << pixPhi_sp->size());
+			MsgLog(module, debug, "read event pixel map of 2theta of size " << pixTwoTheta_sp->size());
+			
+			shared_ptr<array1D<double> > pol_sp( new array1D<double>(kitty::nMaxTotalPx) );
+			for (int i = 0; i < kitty::nMaxTotalPx; i++) {
+				double sinPhi = sin(pixPhi_sp->get(i));
+				double cosPhi = cos(pixPhi_sp->get(i));
+				double sinTwoTheta = sin(pixTwoTheta_sp->get(i));
+				pol_sp->set(i, horzPol*(1 - sinPhi*sinPhi*sinTwoTheta*sinTwoTheta) + (1 - horzPol)*(1 - cosPhi*cosPhi*sinTwoTheta*sinTwoTheta));
+			}
+			return pol_sp;
+		}
+	};
+}
 
 // This declares this class as psana module
 using namespace kitty;
@@ -64,7 +156,10 @@ correct::correct (const std::string& name)
 	, p_back(0)
 	, p_gain(0)
 	, p_mask(0)
-	, p_pol(0)
+	, p_backFile()
+	, p_gainFile()
+	, p_maskFile()
+	, p_pol_sp()
 	, p_count(0)
 {
   // get the values from configuration or use defaults
@@ -89,7 +184,6 @@ correct::~correct ()
 	delete p_back;
 	delete p_gain;
 	delete p_mask;
-	delete p_pol;
 }
 
 
@@ -110,7 +204,14 @@ correct::beginJob(Event& evt, Env& env)
 	
 	//read background, if a file was specified
 	if (p_useBack){
-		if (p_back_fn != ""){
+		if (p_back_fn != "" && CalibrationFile::isCalibrationFile( p_back_fn )){
+			//kitty calibration file, in detector-1D order already
+			if (!mapCalibration( p_backFile, p_back_fn, true, name() )){
+				MsgLog(name(), warning, "Could not use background, continuing without background subtraction!");
+				WAIT;
+				p_useBack = 0;
+			}
+		}else if (p_back_fn != ""){
 			delete p_back;
 			p_back = new array1D<double>(nMaxTotalPx);
 			
@@ -135,7 +236,14 @@ correct::beginJob(Event& evt, Env& env)
 
 	//read gainmap, if a file was specified
 	if (p_useGain){
-		if (p_gain_fn != ""){
+		if (p_gain_fn != "" && CalibrationFile::isCalibrationFile( p_gain_fn )){
+			//kitty calibration file, in detector-1D order already
+			if (!mapCalibration( p_gainFile, p_gain_fn, true, name() )){
+				MsgLog(name(), warning, "Could not use gainmap, continuing without gain correction!");
+				WAIT;
+				p_useGain = 0;
+			}
+		}else if (p_gain_fn != ""){
 			delete p_gain;
 			p_gain = new array1D<double>(nMaxTotalPx);
 
@@ -160,7 +268,14 @@ correct::beginJob(Event& evt, Env& env)
 	
 	//read mask, if a file was specified
 	if (p_useMask){
-		if (p_mask_fn != ""){
+		if (p_mask_fn != "" && CalibrationFile::isCalibrationFile( p_mask_fn )){
+			//kitty calibration file, in detector-1D order already
+			if (!mapCalibration( p_maskFile, p_mask_fn, false, name() )){
+				MsgLog(name(), warning, "Could not use mask, continuing without mask correction!");
+				WAIT;
+				p_useMask = 0;
+			}
+		}else if (p_mask_fn != ""){
 			delete p_mask;
 			p_mask = new array1D<double>(nMaxTotalPx);
 
@@ -195,9 +310,6 @@ correct::beginRun(Event& evt, Env& env)
 	
 	// create polarization correction array
 	if (p_usePol) {
-		delete p_pol;
-		p_pol = new array1D<double>(nMaxTotalPx);
-		
 		// make sure the degree of horizontal polarization is between 0 and 1 (inclusive)
 		if (p_horzPol > 1) {
 			p_horzPol = 1;
@@ -206,21 +318,7 @@ correct::beginRun(Event& evt, Env& env)
 			p_horzPol = 0;
 			MsgLog(name(), warning, "the degree of horizontal polarization was above 0%, raised to minimum value (0)");
 		}
-		
-		shared_ptr<array1D<double> >	pixPhi_sp = evt.get(IDSTRING_PX_PHI);
-		shared_ptr<array1D<double> > pixTwoTheta_sp = evt.get(IDSTRING_PX_TWOTHETA);
-		
-		if (pixPhi_sp && pixTwoTheta_sp) {
-			MsgLog(name(), debug, "read event pixel map of phi of size " << pixPhi_sp->size());
-			MsgLog(name(), debug, "read event pixel map of 2theta of size " << pixTwoTheta_sp->size());
-			
-			// calculate polarization correction for each pixel (from Hura et al JCP 2000)
-			for (int i = 0; i < nMaxTotalPx; i++) {
-				p_pol->set(i, p_horzPol*(1 - sin(pixPhi_sp->get(i))*sin(pixPhi_sp->get(i))*sin(pixTwoTheta_sp->get(i))*sin(pixTwoTheta_sp->get(i))) + (1 - p_horzPol)*(1 - cos(pixPhi_sp->get(i))*cos(pixPhi_sp->get(i))*sin(pixTwoTheta_sp->get(i))*sin(pixTwoTheta_sp->get(i))));
-			}
-		} else {
-			MsgLog(name(), warning, "could not get pixel maps of phi (address=" << pixPhi_sp.get() << ") and/or 2theta (address=" << pixTwoTheta_sp.get() << ")");
-		}
+		updatePolarization(evt);
 	}
 	
 }
@@ -254,22 +352,25 @@ correct::event(Event& evt, Env& env)
 		int fail = 0;
 		//-------------------------------------------------background
 		if (p_useBack){
-			fail += data_sp->subtractArrayElementwise( p_back );
+			fail += p_backFile.isOpen() ? subtractMapped( data_sp.get(), p_backFile ) : data_sp->subtractArrayElementwise( p_back );
 		}
 
 		//-------------------------------------------------gain		
 		if (p_useGain){
-			fail += data_sp->divideByArrayElementwise( p_gain );
+			fail += p_gainFile.isOpen() ? divideMapped( data_sp.get(), p_gainFile ) : data_sp->divideByArrayElementwise( p_gain );
 		}
 		
 		//-------------------------------------------------polarization
 		if (p_usePol){
-			fail += data_sp->divideByArrayElementwise( p_pol );
+			updatePolarization(evt);
+			if (p_pol_sp){
+				fail += data_sp->divideByArrayElementwise( p_pol_sp.get() );
+			}
 		}
 		
 		//-------------------------------------------------mask
 		if (p_useMask){
-			fail += data_sp->applyMask( p_mask );
+			fail += p_maskFile.isOpen() ? maskMapped( data_sp.get(), p_maskFile ) : data_sp->applyMask( p_mask );
 		}
 		
 		if (fail){
@@ -315,4 +416,21 @@ correct::endJob(Event& evt, Env& env)
 
 
 
+/// ------------------------------------------------------------------------------------------------
+void
+correct::updatePolarization(Event& evt)
+{
+	shared_ptr<int> generation_sp = evt.get(IDSTRING_GEOMETRY_GENERATION);
+	GeometryKey key( "polarization" );
+	key.input( "geometry", generation_sp ? *generation_sp : 0 );
+	key.parameter( "horzPolarization", p_horzPol );
+	
+	PolarizationBuilder builder;
+	builder.evt = &evt;
+	builder.module = name();
+	builder.horzPol = p_horzPol;
+	p_pol_sp = GeometryCache::instance().get( key, builder );
+}
+
+
 } // namespace kitty
@@ -19,6 +19,10 @@
 // C/C++ Headers --
 //-----------------
 #include <iomanip>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <limits>
 
 //-------------------------------
 // Collaborating Class Headers --
@@ -27,9 +31,9 @@
 #include "PSEvt/EventId.h"
 #include "PSCalib/CSPadCalibPars.h"
 
+#include "kitty/calibrationfile.h"
 #include "kitty/constants.h"
 #include "kitty/util.h"
-using ns_cspad_util::create1DFromRawImageCSPAD;
 
 //-----------------------------------------------------------------------
 // Local Macros, Typedefs, Structures, Unions and Forward Declarations --
@@ -39,6 +43,132 @@ using ns_cspad_util::create1DFromRawImageCSPAD;
 using namespace kitty;
 PSANA_MODULE_FACTORY(correlate)
 
+namespace {
+	/// per-event work of the ringFFT path for the rings of one part: remap, ring FFTs and running sums,
+	/// every part writes only to its own rows, so the result is the same for any number of threads
+	class RingTask : public WorkerTask {
+	public:
+		const PolarRemap *remap;			// 0: polar image was already calculated
+		const array1D<double> *data;
+		array2D<double> *polar;
+		array1D<double> *qAvg;
+		array1D<double> *iAvg;
+		const array2D<double> *reference;	// 0: correlate 'polar' as it is
+		const double *referenceMean;		// ring means of 'reference'
+		array2D<double> *scratch;			// polar - reference + referenceMean
+		RingCorrelator *rc;
+		RingPowerSum *powerSum;				// 0: accumulate correlations instead of power spectra
+		const MaskCorrelation *maskNorm;	// 0: no normalization for masked bins
+		array2D<double> *corr;
+		bool correlate;						// correlations needed for this event
+		array2D<double> *polarSum;			// 0: polar image already added
+		array2D<double> *corrSum;
+
+		virtual void execute( int part, int nParts ){
+			if (part >= rc->nParts()){
+				return;						// fewer rings than threads
+			}
+			int begin = 0;
+			int end = 0;
+			rc->partRange( part, begin, end );
+			if (remap){
+				remap->apply( data, polar, qAvg, iAvg, begin, end );
+			}
+			const int nPhi = polar->dim2();
+			const array2D<double> *in = polar;
+			if (reference){
+				for (int iq = begin; iq < end; iq++){
+					for (int iphi = 0; iphi < nPhi; iphi++){
+						scratch->set( iq, iphi, polar->get(iq, iphi) - reference->get(iq, iphi) + referenceMean[iq] );
+					}
+				}
+				in = scratch;
+			}
+			if (powerSum){
+				rc->forward( in, part );
+				powerSum->addRings( *rc, begin, end );
+			}
+			if (correlate){
+				rc->autoCorrelate( in, corr, part );
+				if (maskNorm){
+					maskNorm->normalize( corr, begin, end );
+				}
+			}
+			const int nLag = corr->dim2();
+			for (int iq = begin; iq < end; iq++){
+				for (int iphi = 0; polarSum && iphi < nPhi; iphi++){
+					polarSum->set( iq, iphi, polarSum->get(iq, iphi) + polar->get(iq, iphi) );
+				}
+				if (!powerSum){
+					for (int lag = 0; lag < nLag; lag++){
+						corrSum->set( iq, lag, corrSum->get(iq, lag) + corr->get(iq, lag) );
+					}
+				}
+			}
+		}
+	};	
+	/// polar remap matrix of the GeometryCache
+	class PolarRemapBuilder : public GeometryBuilder<PolarRemap> {
+	public:
+		const array1D<double> *pix1;
+		const array1D<double> *pix2;
+		const array1D<double> *mask;
+		int kind;							// 1: PolarRemap, 2: PolarSplitRemap
+		double pixelSize;
+		int nQ;
+		int nPhi;
+		double startQ;
+		double stopQ;
+		int generation;
+		int units;
+
+		virtual shared_ptr<PolarRemap> build(){
+			shared_ptr<PolarRemap> remap_sp( (kind == 2) ? new PolarSplitRemap( pixelSize ) : new PolarRemap() );
+			if ( remap_sp->create( pix1, pix2, mask, nQ, nPhi, startQ, stopQ, generation, units ) ){
+				return shared_ptr<PolarRemap>();
+			}
+			return remap_sp;
+		}
+	};
+	
+	/// mask correlation of a remap matrix of the GeometryCache
+	class MaskCorrelationBuilder : public GeometryBuilder<MaskCorrelation> {
+	public:
+		const PolarRemap *remap;
+
+		virtual shared_ptr<MaskCorrelation> build(){
+			shared_ptr<MaskCorrelation> maskCorr_sp( new MaskCorrelation() );
+			if ( maskCorr_sp->create( *remap ) ){
+				return shared_ptr<MaskCorrelation>();
+			}
+			return maskCorr_sp;
+		}
+	};
+	
+	/// radial bins of the GeometryCache
+	class RadialIntegratorBuilder : public GeometryBuilder<RadialIntegrator> {
+	public:
+		const array1D<double> *pix1;
+		const array1D<double> *pix2;
+		const array1D<double> *mask;
+		int nQ;
+		double startQ;
+		double stopQ;
+		int binning;
+		int generation;
+		int units;
+
+		virtual shared_ptr<RadialIntegrator> build(){
+			shared_ptr<RadialIntegrator> radial_sp( new RadialIntegrator() );
+			if ( radial_sp->create( pix1, pix2, mask, nQ, startQ, stopQ, binning, generation, units ) ){
+				return shared_ptr<RadialIntegrator>();
+			}
+			return radial_sp;
+		}
+	};
+
+}
+
 //		----------------------------------------
 // 		-- Public Function Member Definitions --
 //		----------------------------------------
@@ -54,6 +184,8 @@ correlate::correlate (const std::string& name)
 	, p_edfOut(0)
 	, p_h5Out(0)
 	, p_singleOutput(0)
+	, p_stackOut(0)
+	, p_stackCompression(0)
 	, p_outputPrefix("")
 	, p_mask_fn("")
 	, p_useMask(0)
@@ -63,15 +195,46 @@ correlate::correlate (const std::string& name)
 	, p_nLag(0)
 	, p_alg(0)
 	, p_autoCorrelateOnly(0)
+	, p_remap(0)
+	, p_pixelSize(0)
+	, p_ringFFT(0)
+	, p_fourierAccumulate(0)
+	, p_nThreads(1)
+	, p_xccaMemory(0)
+	, p_xccaBatch(0)
+	, p_xccaCompression(0)
+	, p_maskNormalization(0)
+	, p_twoPass(0)
+	, p_spillDir("")
+	, p_archiveOut(0)
+	, p_archiveBits(0)
+	, p_archiveCompression(0)
+	, p_archiveDir("")
+	, p_archivePVs()
+	, p_archivePVValues()
+	, p_errorBlocks(0)
+	, p_errorMethod(0)
+	, p_saxsBinning(0)
+	, p_autotune(0)
+	, p_autotuneTolerance(0)
+	, p_autotuneFrames(0)
+	, p_autotuneCache("")
 	, p_startQ(0)
 	, p_stopQ(0)
 	, p_units(0)
 	, p_LUTx(0)
 	, p_LUTy(0)
+	, p_configured()
+	, p_configuredFourierAccumulate(0)
+	, p_configuredMaskNormalization(0)
+	, p_configuredTwoPass(0)
+	, p_lutCache(0)
+	, p_lutCacheDir("")
 	, p_useGrandAvgPolar(0)
 	, p_grandAvgPolarDir("")
 	, p_grandAvgPolarExt("")
 	, io(0)
+	, p_stack(0)
 	, p_pix1_sp()
 	, p_pix2_sp()
 	, p_mask(0)
@@ -80,12 +243,39 @@ correlate::correlate (const std::string& name)
 	, p_qAvg_sp()
 	, p_iAvg_sp()
 	, p_cc(0)
+	, p_polarRemap_sp()
+	, p_ringCorrelator(0)
+	, p_ringCorr_sp()
+	, p_powerSum(0)
+	, p_pairSum(0)
+	, p_maskCorrelation_sp()
+	, p_radial_sp()
+	, p_polarSpill()
+	, p_grandAvg_sp()
+	, p_grandAvgMean()
+	, p_polarScratch_sp()
+	, p_archive()
+	, p_lutCacheStore()
+	, p_useLUT(false)
+	, p_lutReady(false)
+	, p_tuner()
+	, p_pool()
+	, p_polarBlocks()
+	, p_corrBlocks()
+	, p_iBlocks()
+	, p_checkpoint()
+	, p_checkpointEvents(0)
+	, p_checkpointSeconds(0)
+	, p_resume(0)
+	, p_resumeEvent(-1)
 	, p_count(0)
 {
 	p_tifOut 			= config   ("tifOut", 				0);
 	p_edfOut 			= config   ("edfOut", 				1);
 	p_h5Out 			= config   ("h5Out", 				0);
 	p_singleOutput		= config   ("singleOutput",			0);
+	p_stackOut			= config   ("stackOut",				0);
+	p_stackCompression	= config   ("stackCompression",		4);
 	
 	p_mask_fn			= configStr("mask", 				"");	
 	p_useMask			= config   ("useMask", 				0);
@@ -96,6 +286,33 @@ correlate::correlate (const std::string& name)
 	
 	p_alg				= config   ("algorithm",			1);
 	p_autoCorrelateOnly = config   ("autoCorrelateOnly",	1);
+	p_remap				= config   ("remap",				0);
+	p_pixelSize			= config   ("pixelSize",			0);
+	p_ringFFT			= config   ("ringFFT",				0);
+	p_fourierAccumulate	= config   ("fourierAccumulate",	0);
+	p_nThreads			= config   ("nThreads",				1);
+	p_xccaMemory		= config   ("xccaMemory",			2048);
+	p_xccaBatch			= config   ("xccaBatch",			16);
+	p_xccaCompression	= config   ("xccaCompression",		0);
+	p_maskNormalization	= config   ("maskNormalization",	0);
+	p_twoPass			= config   ("twoPass",				0);
+	p_spillDir			= configStr("spillDir",				"");
+	p_archiveOut		= config   ("archiveOut",			0);
+	p_archiveBits		= config   ("archiveBits",			16);
+	p_archiveCompression = config   ("archiveCompression",	0);
+	p_archiveDir		= configStr("archiveDir",			"");
+	std::istringstream archivePVs( configStr("archivePVs", "CXI:DS1:MMS:06 SIOC:SYS0:ML00:AO192 SIOC:SYS0:ML00:AO541") );
+	string pvName;
+	while (archivePVs >> pvName){
+		p_archivePVs.push_back( pvName );
+	}
+	p_errorBlocks		= config   ("errorBlocks",			0);
+	p_errorMethod		= config   ("errorMethod",			0);
+	p_saxsBinning		= config   ("saxsBinning",			0);
+	p_autotune			= config   ("autotune",				0);
+	p_autotuneTolerance	= config   ("autotuneTolerance",	0.01);
+	p_autotuneFrames	= config   ("autotuneFrames",		3);
+	p_autotuneCache		= configStr("autotuneCache",		"correlate_autotune.txt");
 	
 	p_startQ			= config   ("startQ",				0);
 	p_stopQ				= config   ("stopQ",				0);	
@@ -103,13 +320,19 @@ correlate::correlate (const std::string& name)
 
 	p_LUTx				= config   ("LUTx",					1000);
 	p_LUTy				= config   ("LUTy",					1000);
+	p_lutCache			= config   ("lutCache",				0);
+	p_lutCacheDir		= configStr("lutCacheDir",			"");
 	
 	p_useGrandAvgPolar	= config   ("useGrandAvgPolar", 	0);	
 	p_grandAvgPolarDir	= configStr("grandAvgPolarDir", 	"");	
 	p_grandAvgPolarExt	= configStr("grandAvgPolarExt", 	"");
 	
+	p_checkpointEvents	= config   ("checkpointEvents",		0);
+	p_checkpointSeconds	= config   ("checkpointSeconds",	0);
+	p_resume			= config   ("resume",				0);
+	
 	io = new arraydataIO();
-
+	p_stack = new EventStack();
 }
 
 //--------------
@@ -118,8 +341,12 @@ correlate::correlate (const std::string& name)
 correlate::~correlate ()
 {
 	delete io;
+	delete p_stack;
 	delete p_mask;
 	delete p_cc;
+	delete p_ringCorrelator;
+	delete p_powerSum;
+	delete p_pairSum;
 }
 
 
@@ -134,9 +361,34 @@ correlate::beginJob(Event& evt, Env& env)
 	MsgLog(name(), info, "h5Out             = '" << p_h5Out << "'" );
 	MsgLog(name(), info, "algorithm         = '" << p_alg << "'" );
 	MsgLog(name(), info, "autoCorrelateOnly = '" << p_autoCorrelateOnly << "'" );
+	MsgLog(name(), info, "remap             = '" << p_remap << "'" );
+	MsgLog(name(), info, "pixelSize         = '" << p_pixelSize << "'" );
+	MsgLog(name(), info, "ringFFT           = '" << p_ringFFT << "'" );
+	MsgLog(name(), info, "fourierAccumulate = '" << p_fourierAccumulate << "'" );
+	MsgLog(name(), info, "nThreads          = '" << p_nThreads << "'" );
+	MsgLog(name(), info, "xccaMemory        = '" << p_xccaMemory << "'" );
+	MsgLog(name(), info, "xccaBatch         = '" << p_xccaBatch << "'" );
+	MsgLog(name(), info, "xccaCompression   = '" << p_xccaCompression << "'" );
+	MsgLog(name(), info, "maskNormalization = '" << p_maskNormalization << "'" );
+	MsgLog(name(), info, "twoPass           = '" << p_twoPass << "'" );
+	MsgLog(name(), info, "spillDir          = '" << p_spillDir << "'" );
+	MsgLog(name(), info, "archiveOut        = '" << p_archiveOut << "'" );
+	MsgLog(name(), info, "archiveBits       = '" << p_archiveBits << "'" );
+	MsgLog(name(), info, "archiveCompression = '" << p_archiveCompression << "'" );
+	MsgLog(name(), info, "archiveDir        = '" << p_archiveDir << "'" );
+	MsgLog(name(), info, "archivePVs        = " << p_archivePVs.size() << " PVs" );
+	MsgLog(name(), info, "errorBlocks       = '" << p_errorBlocks << "'" );
+	MsgLog(name(), info, "errorMethod       = '" << p_errorMethod << "'" );
+	MsgLog(name(), info, "saxsBinning       = '" << p_saxsBinning << "'" );
+	MsgLog(name(), info, "autotune          = '" << p_autotune << "'" );
+	MsgLog(name(), info, "autotuneTolerance = '" << p_autotuneTolerance << "'" );
+	MsgLog(name(), info, "autotuneFrames    = '" << p_autotuneFrames << "'" );
+	MsgLog(name(), info, "autotuneCache     = '" << p_autotuneCache << "'" );
 	MsgLog(name(), info, "useMask           = '" << p_useMask << "'" );
 	MsgLog(name(), info, "mask file name    = '" << p_mask_fn << "'" );
 	MsgLog(name(), info, "singleOutput      = '" << p_singleOutput << "'" );
+	MsgLog(name(), info, "stackOut          = '" << p_stackOut << "'" );
+	MsgLog(name(), info, "stackCompression  = '" << p_stackCompression << "'" );
 	MsgLog(name(), info, "nPhi              = '" << p_nPhi << "'" );
 	MsgLog(name(), info, "nQ1               = '" << p_nQ1 << "'" );
 	MsgLog(name(), info, "nQ2               = '" << p_nQ2 << "'" );
@@ -145,24 +397,50 @@ correlate::beginJob(Event& evt, Env& env)
 	MsgLog(name(), info, "units             = '" << p_units << "'" );
 	MsgLog(name(), info, "LUTx              = '" << p_LUTx << "'" );
 	MsgLog(name(), info, "LUTy              = '" << p_LUTy << "'" );
+	MsgLog(name(), info, "lutCache          = '" << p_lutCache << "'" );
+	MsgLog(name(), info, "lutCacheDir       = '" << p_lutCacheDir << "'" );
 	MsgLog(name(), info, "useGrandAvgPolar  = '" << p_useGrandAvgPolar << "'" );
 	MsgLog(name(), info, "grandAvgPolarDir  = '" << p_grandAvgPolarDir << "'" );
 	MsgLog(name(), info, "grandAvgPolarExt  = '" << p_grandAvgPolarExt << "'" );
+	MsgLog(name(), info, "checkpointEvents  = '" << p_checkpointEvents << "'" );
+	MsgLog(name(), info, "checkpointSeconds = '" << p_checkpointSeconds << "'" );
+	MsgLog(name(), info, "resume            = '" << p_resume << "'" );
 
 
-	//load bad pixel mask
-	array2D<double> *img2D = 0;
-	int fail = io->readFromFile( p_mask_fn, img2D );
+	//load bad pixel mask (kitty calibration file or raw 2D image)
+	int fail = CalibrationFile::load( p_mask_fn, p_mask, io );
 	if (!fail){
-		create1DFromRawImageCSPAD( img2D, p_mask );
 		MsgLog(name(), info, "correlation mask loaded successfully" );
 	}else{
 		MsgLog(name(), info, "correlation mask NOT loaded" );		
 		WAIT;
 	}
-	delete img2D;
 	
+	//the cross-correlation of ring pairs is done in Fourier space as well
+	if (!p_autoCorrelateOnly && !p_ringFFT){
+		MsgLog(name(), info, "autoCorrelateOnly = 0 uses ring FFTs, setting ringFFT = 1" );
+		p_ringFFT = 1;
+	}
+	
+	//threads are started once and wait for work between events
+	if (p_nThreads > 1 && !p_ringFFT && !p_autotune){
+		MsgLog(name(), warning, "nThreads > 1 is only used with ringFFT = 1" );
+	}
+	p_pool.create( (p_ringFFT || p_autotune) ? p_nThreads : 1 );
+	p_lutCacheStore.configure( p_lutCacheDir, p_lutCache != 0 );
+	p_tuner.configure( p_autotuneCache, p_autotuneTolerance, p_autotuneFrames, p_pixelSize );
 	
+	//beginRun() starts from these in every run, so one run's choice does not carry over to the next
+	p_configured.alg = p_alg;
+	p_configured.remap = p_remap;
+	p_configured.ringFFT = p_ringFFT;
+	p_configured.LUTx = p_LUTx;
+	p_configured.LUTy = p_LUTy;
+	p_configured.seconds = 0;
+	p_configured.error = 0;
+	p_configuredFourierAccumulate = p_fourierAccumulate;
+	p_configuredMaskNormalization = p_maskNormalization;
+	p_configuredTwoPass = p_twoPass;
 }
 
 
@@ -195,19 +473,81 @@ correlate::beginRun(Event& evt, Env& env)
 	p_cc = new CrossCorrelator(p_pix1_sp.get(), p_pix1_sp.get(), p_pix2_sp.get(), p_nPhi, p_nQ1);
 	p_nLag = p_cc->nLag();
 	
+	//the configured strategy, unless autotune finds a faster accurate one for this geometry
+	p_alg = p_configured.alg;
+	p_remap = p_configured.remap;
+	p_ringFFT = p_configured.ringFFT;
+	p_LUTx = p_configured.LUTx;
+	p_LUTy = p_configured.LUTy;
+	p_fourierAccumulate = p_configuredFourierAccumulate;
+	p_maskNormalization = p_configuredMaskNormalization;
+	if (p_autotune){
+		CorrelateStrategy best;
+		bool needRingFFT = ( !p_autoCorrelateOnly || p_fourierAccumulate || p_maskNormalization );
+		p_tuner.tune( p_pix1_sp.get(), p_pix2_sp.get(), p_useMask ? p_mask : 0, p_nQ1, p_nPhi, p_startQ, p_stopQ, p_units,
+			needRingFFT, p_maskNormalization != 0, p_pool, p_configured, best );
+		p_alg = best.alg;
+		p_remap = best.remap;
+		p_ringFFT = best.ringFFT;
+		p_LUTx = best.LUTx;
+		p_LUTy = best.LUTy;
+		MsgLog(name(), info, "autotune: algorithm = " << p_alg << ", remap = " << p_remap << ", ringFFT = " << p_ringFFT
+			<< ", LUTx = " << p_LUTx << ", LUTy = " << p_LUTy );
+	}
+	
+	//batched ring FFTs replace the cross-correlator's correlation, plans are made once here
+	if (p_ringFFT){
+		if (!p_ringCorrelator){
+			p_ringCorrelator = new RingCorrelator();
+		}
+		p_ringCorrelator->create( p_nQ1, p_nPhi, p_pool.nThreads() );
+		p_nLag = p_ringCorrelator->nLag();
+		p_ringCorr_sp = shared_ptr<array2D<double> >( new array2D<double>(p_nQ1, p_nLag) );
+	}
+	if (p_fourierAccumulate && !p_ringFFT){
+		MsgLog(name(), warning, "fourierAccumulate needs ringFFT = 1, accumulating correlations instead" );
+		p_fourierAccumulate = 0;
+	}
+	if (p_fourierAccumulate){
+		if (!p_powerSum){
+			p_powerSum = new RingPowerSum();
+		}
+		p_powerSum->create( p_nQ1, p_nLag );
+	}
+	
+	//sums of the cross power spectra of all ring pairs q1 <= q2, spilled to disk, if larger than xccaMemory
+	if (!p_autoCorrelateOnly){
+		if (!p_pairSum){
+			p_pairSum = new RingPairSum();
+		}
+		p_pairSum->create( p_nQ1, p_nPhi, p_xccaMemory*1048576., p_outputPrefix+"_xcca_spill.bin", p_xccaBatch );
+	}
+	
+	//mask correlations for the normalization are made along with the remap matrix, see updatePolarRemap()
+	if (p_maskNormalization && !(p_remap && p_ringFFT)){
+		MsgLog(name(), warning, "maskNormalization needs remap = 1 or 2 and ringFFT = 1, switched off" );
+		p_maskNormalization = 0;
+	}
+	
+	//SAXS profile in one pass over the pixels, instead of the ring means of the polar image
+	if (p_saxsBinning == 2 && p_startQ <= 0){
+		MsgLog(name(), warning, "saxsBinning = 2 (logarithmic) needs startQ > 0, using linear bins" );
+		p_saxsBinning = 1;
+	}
+	if (!p_saxsBinning){
+		p_radial_sp.reset();
+	}
+	
 	//set some properties of the cross correlator		
-	if (p_useMask) {			
+	if (p_useMask && !p_remap) {			
 		p_cc->setMask( p_mask );
 		p_cc->setMaskEnable ( true );
 	}else{
-		p_cc->setMaskEnable( false );
+		p_cc->setMaskEnable( false );		// with remap on, the mask is part of the remap matrix
 	}
 	
-	if (p_autoCorrelateOnly) {
-		p_cc->setXccaEnable( false );
-	}else{
-		p_cc->setXccaEnable( true );
-	}
+	//never the cross-correlator's own dense XCCA, ring pairs are handled by p_pairSum
+	p_cc->setXccaEnable( false );
 	
 	//check psana's debug level, set a debug flag for cc, if it's at least 'trace'
 	MsgLogger::MsgLogLevel lvl(MsgLogger::MsgLogLevel::trace);
@@ -215,15 +555,48 @@ correlate::beginRun(Event& evt, Env& env)
 		p_cc->setDebug(1);
 	}
 	
-	//prepare lookup table, if necessary
-	if ( p_alg == 2 || p_alg == 4 ){
+	//prepare polar remap matrix or lookup table, if necessary
+	//(the kind of remap is part of its key, a change by autotune gets the other product)
+	if (p_remap){
+		updatePolarRemap(evt);
+	}else{
+		p_polarRemap_sp.reset();
+		p_maskCorrelation_sp.reset();
+	}
+	
+	//in two-pass mode, the grand average is made from this run's polar images in endRun(),
+	//without a spill file this run is done in one pass
+	p_twoPass = p_configuredTwoPass;
+	if (p_twoPass && p_polarSpill.open( p_spillDir + p_outputPrefix + "_polar_spill.bin", p_nQ1, p_nPhi )){
+		MsgLog(name(), warning, "could not open the polar spill file in '" << p_spillDir << "', twoPass switched off for this run" );
+		p_twoPass = 0;
+	}
+	if (p_twoPass && p_useGrandAvgPolar){
+		MsgLog(name(), warning, "twoPass = 1 makes its own grand average, useGrandAvgPolar is ignored in this run" );
+	}
+	
+	//lookup table for the cross-correlator's fast coordinates, from the cache or built now
+	p_useLUT = ( !p_remap && !p_ringFFT && !p_twoPass && (p_alg == 2 || p_alg == 4) );
+	p_lutReady = false;
+	if (p_useLUT){
 		MsgLog(name(), info, "creating lookup table");
-		p_cc->createLookupTable(p_LUTy, p_LUTx);
+		p_lutCacheStore.request( p_pix1_sp.get(), p_pix2_sp.get(), p_nPhi, p_nQ1, p_LUTx, p_LUTy );
+		p_lutCacheStore.wait();
+		updateLookupTable();
+	}
+	
+	//polar images of the run for later analysis with correlateArchive, without re-reading the XTC
+	if (p_archiveOut){
+		if ( !p_archive.create( p_archiveDir + p_outputPrefix + "_polar_archive.h5", p_nQ1, p_nPhi, p_startQ, p_stopQ, p_units,
+				p_archiveBits, p_archiveCompression ) ){
+			p_archive.setPVs( p_archivePVs );
+			p_archivePVValues.resize( p_archivePVs.size() );
+		}
 	}
 	
 	//construct a file name to read the grand average polar image, e.g., something like
 	//   reg/neh/home/feldkamp/scratch_cxi35711/runs_2012_03_07_gaincorr/r0084/r0084_avg_polar.h5
-	if (p_useGrandAvgPolar){
+	if (p_useGrandAvgPolar && !p_twoPass){
 		string fn_grandAvgPolar = p_grandAvgPolarDir + p_outputPrefix + "/" + p_outputPrefix + p_grandAvgPolarExt;
 		MsgLog(	name(), info, "grand average (polar): " << fn_grandAvgPolar );
 		array2D<double> *img2D = 0;
@@ -252,6 +625,34 @@ correlate::beginRun(Event& evt, Env& env)
 	p_corrAvg_sp = shared_ptr<array2D<double> >( new array2D<double>(p_nQ1,p_nLag) );
 	p_qAvg_sp = shared_ptr<array1D<double> >( new array1D<double>(p_nQ1) );
 	p_iAvg_sp = shared_ptr<array1D<double> >( new array1D<double>(p_nQ1) );
+	
+	//block sums of consecutive events for the standard errors of the averages, restarted with the running sums
+	if (p_errorBlocks){
+		p_polarBlocks.create( p_nQ1*p_nPhi, p_errorBlocks );
+		p_iBlocks.create( p_nQ1, p_errorBlocks );
+		if (p_fourierAccumulate){
+			MsgLog(name(), warning, "errorBlocks needs the correlation of every event, no errors for the correlations with fourierAccumulate = 1" );
+		}else{
+			p_corrBlocks.create( p_nQ1*p_nLag, p_errorBlocks );
+		}
+	}
+	
+	//continue the running sums of an interrupted job
+	if ((p_pairSum || p_twoPass) && (p_checkpointEvents || p_checkpointSeconds || p_resume)){
+		MsgLog(name(), warning, "checkpoints do not contain the ring pair sums or polar spill files, "
+			"switched off for autoCorrelateOnly = 0 and twoPass = 1" );
+		p_checkpoint.configure( p_outputPrefix+"_checkpoint_correlate.bin", 0, 0 );
+	}else{
+		p_checkpoint.configure( p_outputPrefix+"_checkpoint_correlate.bin", p_checkpointEvents, p_checkpointSeconds );
+		if (p_resume){
+			readCheckpoint();
+		}
+	}
+	
+	//one file per run for all single event output
+	if (p_singleOutput && p_stackOut){
+		p_stack->open( p_outputPrefix+"_evtstack_correlate.h5", p_stackCompression );
+	}
 }
 
 
@@ -287,45 +688,120 @@ correlate::event(Event& evt, Env& env)
 			updatePixelArrays(evt);
 			p_cc->setQx( p_pix1_sp.get() );
 			p_cc->setQy( p_pix2_sp.get() );
+			
+			//the lookup table of the old pixel arrays is not valid anymore, the new one is built in the background
+			if (p_useLUT){
+				p_lutReady = false;
+				p_lutCacheStore.request( p_pix1_sp.get(), p_pix2_sp.get(), p_nPhi, p_nQ1, p_LUTx, p_LUTy );
+			}
 		}
 		
-		MsgLog(name(), trace, "calling CrossCorrelator::run"
-			<< "( startQ=" << p_startQ << ", stopQ=" << p_stopQ << ", alg=" << p_alg << " )");
-		p_cc->setData( data_sp.get() );
-		p_cc->run(p_startQ, p_stopQ, p_alg);
+		//events already in the checkpoint are not accumulated again, but their geometry changes are kept
+		if (atoi(eventname_str.c_str()) <= p_resumeEvent){
+			MsgLog(name(), debug, "event " << eventname_str << " is already contained in the checkpoint, skipping");
+			return;
+		}
 		
-		MsgLog(name(), debug, "updating running sums.");
-		p_polarAvg_sp->addArrayElementwise( p_cc->polar() );
-		p_corrAvg_sp->addArrayElementwise( p_cc->autoCorr() );
-		p_qAvg_sp->addArrayElementwise( p_cc->qAvg() );
-		p_iAvg_sp->addArrayElementwise( p_cc->iAvg() );
+		if (p_useLUT && !p_lutReady){
+			updateLookupTable();
+		}
 		
-		MsgLog(name(), debug, "cc->polar dims: rows,cols=(" << p_cc->polar()->dim1() << ", " << p_cc->polar()->dim2() << ")"  );
-		MsgLog(name(), debug, "p_polarAvg dims: rows,cols=(" << p_polarAvg_sp->dim1() << ", " << p_polarAvg_sp->dim2() << ")"  );
-		MsgLog(name(), debug, "cc->autoCorr dims: rows,cols=(" << p_cc->autoCorr()->dim1() << ", " << p_cc->autoCorr()->dim2() << ")"  );
-		MsgLog(name(), debug, "p_corrAvg dims: rows,cols=(" << p_corrAvg_sp->dim1() << ", " << p_corrAvg_sp->dim2() << ")"  );
+		bool singleOutputDue = ( p_singleOutput && !(p_count%p_singleOutput) );
+		shared_ptr<EventId> eventId = evt.get();
+		PolarSpillRecord record;
+		record.index = atoi( eventname_str.c_str() );
+		record.sec = eventId ? eventId->time().sec() : 0;
+		record.nsec = eventId ? eventId->time().nsec() : 0;
+		record.fiducials = eventId ? eventId->fiducials() : 0;
 		
-		if ( p_singleOutput && !(p_count%p_singleOutput) ){
-			MsgLog(name(), debug, "writing (single event) files.");
-			string ext = "";
-			if (p_h5Out){
-				ext = ".h5";
-			}else if (p_edfOut){
-				ext = ".edf";
-			}else if (p_tifOut){
-				ext = ".tif";
+		if (p_twoPass){
+			//first pass: polar images only, they are correlated in endRun(), when the run's average is known
+			if (p_remap){
+				updatePolarRemap(evt);
+				p_polarRemap_sp->apply( data_sp.get(), p_cc->polar(), p_cc->qAvg(), p_cc->iAvg() );
+			}else{
+				p_cc->setData( data_sp.get() );
+				p_cc->calculatePolarCoordinates( p_startQ, p_stopQ );
+			}
+			p_polarAvg_sp->addArrayElementwise( p_cc->polar() );
+			p_polarSpill.append( p_cc->polar(), record );
+		}else if (p_ringFFT){
+			if (p_remap){
+				updatePolarRemap(evt);
+			}else{
+				p_cc->setData( data_sp.get() );
+				p_cc->calculatePolarCoordinates( p_startQ, p_stopQ );
+			}
+			runRingTask( data_sp.get(), singleOutputDue, true );
+		}else{
+			if (p_remap){
+				//polar image as one sparse matrix-vector product
+				updatePolarRemap(evt);
+				p_polarRemap_sp->apply( data_sp.get(), p_cc->polar(), p_cc->qAvg(), p_cc->iAvg() );
+				p_cc->calculateFluctuations();
+				p_cc->calculateXCCA( p_startQ, p_stopQ );
+			}else{
+				//direct coordinates until the lookup table for the current geometry is ready
+				int alg = p_alg;
+				if (p_useLUT && !p_lutReady){
+					alg = (p_alg == 2) ? 3 : 1;
+				}
+				MsgLog(name(), trace, "calling CrossCorrelator::run"
+					<< "( startQ=" << p_startQ << ", stopQ=" << p_stopQ << ", alg=" << alg << " )");
+				p_cc->setData( data_sp.get() );
+				p_cc->run(p_startQ, p_stopQ, alg);
 			}
-			io->writeToFile( p_outputPrefix+"_evt"+eventname_str+"_xaca"+ext, p_cc->autoCorr() );
-			io->writeToFile( p_outputPrefix+"_evt"+eventname_str+"_polar"+ext, p_cc->polar() );
-			io->writeToFile( p_outputPrefix+"_evt"+eventname_str+"_q"+ext, p_cc->qAvg() );
-			io->writeToFile( p_outputPrefix+"_evt"+eventname_str+"_i"+ext, p_cc->iAvg() );
 			
-			//some additional debugging output
-			//io->writeToFile( p_outputPrefix+"_evt"+eventname_str+"_fluct"+ext, p_cc->fluctuations() );
-			//io->writeToFile( p_outputPrefix+"_evt"+eventname_str+"_pxCnt"+ext, p_cc->pixelCount() );
-		}//if singleout
+			MsgLog(name(), debug, "updating running sums.");
+			p_polarAvg_sp->addArrayElementwise( p_cc->polar() );
+			p_corrAvg_sp->addArrayElementwise( p_cc->autoCorr() );
+		}
+		if (p_saxsBinning){
+			//replaces the ring means of the polar image
+			updateRadialIntegrator(evt);
+			p_radial_sp->integrate( data_sp.get(), p_cc->qAvg(), p_cc->iAvg() );
+		}
+		p_qAvg_sp->addArrayElementwise( p_cc->qAvg() );
+		p_iAvg_sp->addArrayElementwise( p_cc->iAvg() );
+		if (p_errorBlocks){
+			p_polarBlocks.add( p_cc->polar() );
+			p_iBlocks.add( p_cc->iAvg() );
+			if ( p_corrBlocks.isCreated() && !p_twoPass ){
+				p_corrBlocks.add( p_ringFFT ? p_ringCorr_sp.get() : p_cc->autoCorr() );
+			}
+		}
+		
+		if ( p_archive.isOpen() ){
+			shared_ptr<int> generation_sp = evt.get(IDSTRING_GEOMETRY_GENERATION);
+			PolarArchiveEvent archiveEvent;
+			archiveEvent.index = record.index;
+			archiveEvent.sec = record.sec;
+			archiveEvent.nsec = record.nsec;
+			archiveEvent.fiducials = record.fiducials;
+			archiveEvent.generation = generation_sp ? *generation_sp : 0;
+			archiveEvent.pvChanged = pvChanged;
+			if ( !p_archive.hasGeometry(archiveEvent.generation) ){
+				p_archive.writeGeometry( archiveEvent.generation, p_pix1_sp.get(), p_pix2_sp.get(), p_useMask ? p_mask : 0 );
+			}
+			for (unsigned int i = 0; i < p_archivePVs.size(); i++){
+				try{
+					p_archivePVValues[i] = env.epicsStore().value( p_archivePVs[i] );
+				}catch(...){
+					p_archivePVValues[i] = std::numeric_limits<double>::quiet_NaN();
+				}
+			}
+			p_archive.append( p_cc->polar(), archiveEvent, p_archivePVValues.empty() ? 0 : &p_archivePVValues[0] );
+		}
+		
+		if ( singleOutputDue && !p_twoPass ){
+			writeSingleOutput( eventname_str, record, p_ringFFT ? p_ringCorr_sp.get() : p_cc->autoCorr() );
+		}
 		
 		p_count++;
+		
+		if (p_checkpoint.due( p_count )){
+			writeCheckpoint( eventname_str );
+		}
 	}else{
 		MsgLog(name(), warning, "could not get CSPAD data" );
 	}
@@ -348,6 +824,12 @@ void
 correlate::endRun(Event& evt, Env& env)
 {
 	MsgLog(name(), debug,  "correlate::endRun()" );
+	
+	if (p_twoPass){
+		runSecondPass();
+	}
+	p_archive.close();
+	p_stack->close();
 }
 
 
@@ -360,17 +842,34 @@ correlate::endJob(Event& evt, Env& env)
 
 	//normalize the running sums to get averages
 	p_polarAvg_sp->divideByValue( p_count );
-	p_corrAvg_sp->divideByValue( p_count );
+	if (p_fourierAccumulate){
+		//one inverse transform of the summed power spectra gives the average of the correlations
+		p_powerSum->correlation( *p_ringCorrelator, p_corrAvg_sp.get() );
+		if (p_maskNormalization){
+			p_maskCorrelation_sp->normalize( p_corrAvg_sp.get(), 0, p_nQ1 );
+		}
+	}else{
+		p_corrAvg_sp->divideByValue( p_count );
+	}
 	p_qAvg_sp->divideByValue( p_count );
 	p_iAvg_sp->divideByValue( p_count );
 	
 	//compute the 'correlation of the average' in addition to the 'average of correlations'
-	for (unsigned int i = 0; i < p_cc->polar()->size(); i++){
-		p_cc->polar()->set_atIndex(i, p_polarAvg_sp->get_atIndex(i));			//feed the average polar coordinate map to cc
+	array2D<double> *corrOfAvg = 0;
+	if (p_ringFFT){
+		p_ringCorrelator->autoCorrelate( p_polarAvg_sp.get(), p_ringCorr_sp.get() );
+		if (p_maskNormalization){
+			p_maskCorrelation_sp->normalize( p_ringCorr_sp.get(), 0, p_nQ1 );
+		}
+		corrOfAvg = p_ringCorr_sp.get();
+	}else{
+		for (unsigned int i = 0; i < p_cc->polar()->size(); i++){
+			p_cc->polar()->set_atIndex(i, p_polarAvg_sp->get_atIndex(i));			//feed the average polar coordinate map to cc
+		}
+		p_cc->calculateFluctuations();
+		p_cc->calculateXCCA( p_startQ, p_stopQ );									//run correlation on average
+		corrOfAvg = p_cc->autoCorr();
 	}
-	p_cc->calculateFluctuations();
-	p_cc->calculateXCCA( p_startQ, p_stopQ );									//run correlation on average
-	array2D<double> *corrOfAvg = p_cc->autoCorr();
 
 	//compute the difference between the average of the correlations and the correlation of the average
 	array2D<double> *diff = new array2D<double>( p_corrAvg_sp.get() );
@@ -397,16 +896,70 @@ correlate::endJob(Event& evt, Env& env)
 	}
 	
 	//write to file, file type is based on the extension
-	if (p_autoCorrelateOnly){
-		io->writeToFile( p_outputPrefix+"_avg_polar"+ext, p_polarAvg_sp.get() );
-		io->writeToFile( p_outputPrefix+"_avg_xaca"+ext, p_corrAvg_sp.get() );
-		io->writeToFile( p_outputPrefix+"_xacaOfAvg"+ext, corrOfAvg );
-		io->writeToFile( p_outputPrefix+"_xacaDiff"+ext, diff );
-	}else{
-		MsgLog(name(), warning, "WARNING. No HDF5 output for 3D cross-correlation case implemented, yet!" );
+	io->writeToFile( p_outputPrefix+"_avg_polar"+ext, p_polarAvg_sp.get() );
+	io->writeToFile( p_outputPrefix+"_avg_xaca"+ext, p_corrAvg_sp.get() );
+	io->writeToFile( p_outputPrefix+"_xacaOfAvg"+ext, corrOfAvg );
+	io->writeToFile( p_outputPrefix+"_xacaDiff"+ext, diff );
+	
+	//cross-correlations of all ring pairs, always HDF5 (chunked, too large for the other formats)
+	if (p_pairSum){
+		//logarithmic SAXS bins are not the polar rings, label the ring pairs by the ring centers then
+		array1D<double> *ringQ = p_qAvg_sp.get();
+		if (p_saxsBinning == 2){
+			ringQ = new array1D<double>( p_nQ1 );
+			for (int iq = 0; iq < p_nQ1; iq++){
+				ringQ->set( iq, p_startQ + (iq+0.5)*(p_stopQ - p_startQ)/p_nQ1 );
+			}
+		}
+		p_pairSum->flush( p_pool );
+		p_pairSum->write( p_outputPrefix+"_avg_xcca.h5", ringQ, p_xccaCompression, 
+			p_maskNormalization ? p_maskCorrelation_sp.get() : 0 );
+		if (ringQ != p_qAvg_sp.get()){
+			delete ringQ;
+		}
 	}
 	io->writeToFile( p_outputPrefix+"_avg_qAvg"+ext, p_qAvg_sp.get() );
 	io->writeToFile( p_outputPrefix+"_avg_iAvg"+ext, p_iAvg_sp.get() );	
+	
+	//standard errors of the averages from the block sums, and the event-to-event standard deviations
+	if (p_errorBlocks){
+		MsgLog(name(), info, (p_errorMethod ? "batch means" : "jackknife") << " errors from " 
+			<< p_polarBlocks.blocksUsed() << " blocks of " << p_polarBlocks.count() << " events" );
+		array2D<double> *mean = new array2D<double>( p_nQ1, p_nPhi );
+		array2D<double> *err = new array2D<double>( p_nQ1, p_nPhi );
+		array2D<double> *stddev = new array2D<double>( p_nQ1, p_nPhi );
+		if ( !p_polarBlocks.result( mean, err, p_errorMethod, stddev ) ){
+			io->writeToFile( p_outputPrefix+"_err_polar"+ext, err );
+			io->writeToFile( p_outputPrefix+"_std_polar"+ext, stddev );
+		}
+		delete mean;
+		delete err;
+		delete stddev;
+		
+		if ( p_corrBlocks.isCreated() ){
+			mean = new array2D<double>( p_nQ1, p_nLag );
+			err = new array2D<double>( p_nQ1, p_nLag );
+			stddev = new array2D<double>( p_nQ1, p_nLag );
+			if ( !p_corrBlocks.result( mean, err, p_errorMethod, stddev ) ){
+				io->writeToFile( p_outputPrefix+"_err_xaca"+ext, err );
+				io->writeToFile( p_outputPrefix+"_std_xaca"+ext, stddev );
+			}
+			delete mean;
+			delete err;
+			delete stddev;
+		}
+		
+		array1D<double> *mean1D = new array1D<double>( p_nQ1 );
+		array1D<double> *err1D = new array1D<double>( p_nQ1 );
+		array1D<double> *stddev1D = new array1D<double>( p_nQ1 );
+		if ( !p_iBlocks.result( mean1D, err1D, p_errorMethod, stddev1D ) ){
+			io->writeToFile( p_outputPrefix+"_err_iAvg"+ext, err1D );
+			io->writeToFile( p_outputPrefix+"_std_iAvg"+ext, stddev1D );
+		}
+		delete mean1D;
+		delete err1D;
+		delete stddev1D;
+	}
 
 	/*
 	//HDF5 output
@@ -485,8 +1038,300 @@ void correlate::updatePixelArrays(Event& evt)
 	}else{
 		MsgLog(name(), error, "Could not retrieve new pixel arrays from event. "
 			<< "pix1_sp=" << p_pix1_sp.get() << ", pix2_sp=" << p_pix2_sp.get() << "");
-		throw;
+		throw std::runtime_error( name() + ": could not retrieve the pixel arrays from the event" );
+	}
+}
+
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+correlate::updatePolarRemap(Event& evt)
+{
+	GeometryKey key = geometryKey( "polarRemap", evt );
+	key.parameter( "nPhi", p_nPhi );
+	key.parameter( "remap", p_remap );
+	if (p_remap == 2){
+		key.parameter( "pixelSize", p_pixelSize );
+	}
+	if ( p_polarRemap_sp && GeometryCache::instance().current<PolarRemap>( key ) == p_polarRemap_sp ){
+		return;
+	}
+	
+	//new geometry (or one built by another module): pixel arrays of this generation
+	updatePixelArrays(evt);
+	p_cc->setQx( p_pix1_sp.get() );
+	p_cc->setQy( p_pix2_sp.get() );
+	PolarRemapBuilder builder;
+	builder.pix1 = p_pix1_sp.get();
+	builder.pix2 = p_pix2_sp.get();
+	builder.mask = p_useMask ? p_mask : 0;
+	builder.kind = p_remap;
+	builder.pixelSize = p_pixelSize;
+	builder.nQ = p_nQ1;
+	builder.nPhi = p_nPhi;
+	builder.startQ = p_startQ;
+	builder.stopQ = p_stopQ;
+	builder.generation = key.inputs().find("geometry")->second;
+	builder.units = p_units;
+	p_polarRemap_sp = GeometryCache::instance().get( key, builder );
+	if (!p_polarRemap_sp){
+		std::ostringstream osst;
+		osst << name() << ": could not build the polar remap matrix (remap=" << p_remap << ", nQ=" << p_nQ1 << ", nPhi=" << p_nPhi
+			<< ", startQ=" << p_startQ << ", stopQ=" << p_stopQ << ", mask='" << (p_useMask ? p_mask_fn : std::string("none")) << "')";
+		MsgLog(name(), error, osst.str());
+		throw std::runtime_error( osst.str() );
+	}
+	
+	//the mask correlation depends on the same inputs and parameters, it is rebuilt along with the remap matrix
+	if (p_maskNormalization){
+		MaskCorrelationBuilder maskBuilder;
+		maskBuilder.remap = p_polarRemap_sp.get();
+		p_maskCorrelation_sp = GeometryCache::instance().get( GeometryKey("maskCorrelation", key), maskBuilder );
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+correlate::updateRadialIntegrator(Event& evt)
+{
+	GeometryKey key = geometryKey( "radialBins", evt );
+	key.parameter( "binning", p_saxsBinning );
+	if ( p_radial_sp && GeometryCache::instance().current<RadialIntegrator>( key ) == p_radial_sp ){
+		return;
+	}
+	
+	updatePixelArrays(evt);
+	RadialIntegratorBuilder builder;
+	builder.pix1 = p_pix1_sp.get();
+	builder.pix2 = p_pix2_sp.get();
+	builder.mask = p_useMask ? p_mask : 0;
+	builder.nQ = p_nQ1;
+	builder.startQ = p_startQ;
+	builder.stopQ = p_stopQ;
+	builder.binning = (p_saxsBinning == 2) ? RadialIntegrator::LOGARITHMIC : RadialIntegrator::LINEAR;
+	builder.generation = key.inputs().find("geometry")->second;
+	builder.units = p_units;
+	p_radial_sp = GeometryCache::instance().get( key, builder );
+	if (!p_radial_sp){
+		std::ostringstream osst;
+		osst << name() << ": could not build the radial bins (saxsBinning=" << p_saxsBinning << ", nQ=" << p_nQ1
+			<< ", startQ=" << p_startQ << ", stopQ=" << p_stopQ << ", mask='" << (p_useMask ? p_mask_fn : std::string("none")) << "')";
+		MsgLog(name(), error, osst.str());
+		throw std::runtime_error( osst.str() );
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+GeometryKey
+correlate::geometryKey(const std::string &product, Event& evt) const
+{
+	shared_ptr<int> generation_sp = evt.get(IDSTRING_GEOMETRY_GENERATION);
+	GeometryKey key( product );
+	key.input( "geometry", generation_sp ? *generation_sp : 0 );
+	key.parameter( "mask", p_useMask ? p_mask_fn : std::string("none") );
+	key.parameter( "nQ", p_nQ1 );
+	key.parameter( "startQ", p_startQ );
+	key.parameter( "stopQ", p_stopQ );
+	key.parameter( "units", p_units );
+	return key;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+correlate::updateLookupTable()
+{
+	array2D<double> *table = p_lutCacheStore.take();
+	if (table){
+		p_cc->setLookupTable( table );
+		delete table;
+		p_lutReady = true;
+		MsgLog(name(), info, "lookup table " << p_LUTx << "x" << p_LUTy << " in use" );
+	}
+	return p_lutReady;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+correlate::runRingTask( const array1D<double> *data, bool singleOutputDue, bool addPolar )
+{
+	//remap, correlations and running sums of polar and correlation, split over the q-rings
+	//with fourierAccumulate, only the forward transforms are needed for the running sum
+	RingTask task;
+	task.remap = (p_remap && data) ? p_polarRemap_sp.get() : 0;
+	task.data = data;
+	task.polar = p_cc->polar();
+	task.qAvg = p_cc->qAvg();
+	task.iAvg = p_cc->iAvg();
+	task.reference = p_grandAvg_sp.get();
+	task.referenceMean = p_grandAvgMean.empty() ? 0 : &p_grandAvgMean[0];
+	task.scratch = p_polarScratch_sp.get();
+	task.rc = p_ringCorrelator;
+	task.powerSum = p_fourierAccumulate ? p_powerSum : 0;
+	task.maskNorm = p_maskNormalization ? p_maskCorrelation_sp.get() : 0;
+	task.corr = p_ringCorr_sp.get();
+	task.correlate = ( !p_fourierAccumulate || singleOutputDue );
+	task.polarSum = addPolar ? p_polarAvg_sp.get() : 0;
+	task.corrSum = p_corrAvg_sp.get();
+	p_pool.run( task );
+	if (p_fourierAccumulate){
+		p_powerSum->addEvent();
+	}
+	if (p_pairSum){
+		p_pairSum->add( *p_ringCorrelator, p_pool );
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+correlate::runSecondPass()
+{
+	const unsigned int n = p_polarSpill.count();
+	MsgLog(name(), info, "second pass over " << n << " polar images in " << p_polarSpill.filename() );
+	if (n == 0){
+		p_polarSpill.close();
+		return;
+	}
+	
+	//grand average of this run (the polar sum starts at zero in every beginRun)
+	p_grandAvg_sp = shared_ptr<array2D<double> >( new array2D<double>( p_polarAvg_sp.get() ) );
+	p_grandAvg_sp->divideByValue( n );
+	if (p_ringFFT){
+		//the average's angular structure is subtracted from every image, its ring means are kept
+		p_grandAvgMean.assign( p_nQ1, 0. );
+		for (int iq = 0; iq < p_nQ1; iq++){
+			for (int iphi = 0; iphi < p_nPhi; iphi++){
+				p_grandAvgMean[iq] += p_grandAvg_sp->get( iq, iphi )/p_nPhi;
+			}
+		}
+		p_polarScratch_sp = shared_ptr<array2D<double> >( new array2D<double>(p_nQ1, p_nPhi) );
+	}else{
+		p_cc->setGrandAvgPolar( p_grandAvg_sp.get() );
+	}
+	
+	PolarSpillRecord record;
+	for (unsigned int i = 0; i < n; i++){
+		p_polarSpill.read( i, p_cc->polar(), record );
+		bool singleOutputDue = ( p_singleOutput && !(i%p_singleOutput) );
+		if (p_ringFFT){
+			runRingTask( 0, singleOutputDue, false );
+		}else{
+			p_cc->calculateFluctuations();
+			p_cc->calculateXCCA( p_startQ, p_stopQ );
+			p_corrAvg_sp->addArrayElementwise( p_cc->autoCorr() );
+		}
+		if ( p_corrBlocks.isCreated() ){
+			p_corrBlocks.add( p_ringFFT ? p_ringCorr_sp.get() : p_cc->autoCorr() );
+		}
+		if (singleOutputDue){
+			std::ostringstream osst;
+			osst << std::setfill('0') << std::setw(10) << record.index;
+			writeSingleOutput( osst.str(), record, p_ringFFT ? p_ringCorr_sp.get() : p_cc->autoCorr() );
+		}
+	}
+	
+	p_polarSpill.close();
+	p_grandAvg_sp.reset();
+	p_grandAvgMean.clear();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+correlate::writeSingleOutput( const string &eventname, const PolarSpillRecord &record, array2D<double> *corr )
+{
+	if ( p_stack->isOpen() ){
+		MsgLog(name(), debug, "appending single event output to " << p_stack->filename() );
+		p_stack->appendEvent( record.index, record.sec, record.nsec, record.fiducials );
+		p_stack->append( "xaca", corr );
+		p_stack->append( "polar", p_cc->polar() );
+		p_stack->append( "q", p_cc->qAvg() );
+		p_stack->append( "i", p_cc->iAvg() );
+	}else{
+		MsgLog(name(), debug, "writing (single event) files.");
+		string ext = "";
+		if (p_h5Out){
+			ext = ".h5";
+		}else if (p_edfOut){
+			ext = ".edf";
+		}else if (p_tifOut){
+			ext = ".tif";
+		}
+		io->writeToFile( p_outputPrefix+"_evt"+eventname+"_xaca"+ext, corr );
+		io->writeToFile( p_outputPrefix+"_evt"+eventname+"_polar"+ext, p_cc->polar() );
+		io->writeToFile( p_outputPrefix+"_evt"+eventname+"_q"+ext, p_cc->qAvg() );
+		io->writeToFile( p_outputPrefix+"_evt"+eventname+"_i"+ext, p_cc->iAvg() );
+		
+		//some additional debugging output
+		//io->writeToFile( p_outputPrefix+"_evt"+eventname+"_fluct"+ext, p_cc->fluctuations() );
+		//io->writeToFile( p_outputPrefix+"_evt"+eventname+"_pxCnt"+ext, p_cc->pixelCount() );
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+correlate::writeCheckpoint( const string &eventname )
+{
+	p_checkpoint.begin( atoi(eventname.c_str()) );
+	p_checkpoint.add( "count", (double)p_count );
+	p_checkpoint.add( "polarSum", p_polarAvg_sp.get() );
+	p_checkpoint.add( "corrSum", p_corrAvg_sp.get() );
+	p_checkpoint.add( "qSum", p_qAvg_sp.get() );
+	p_checkpoint.add( "iSum", p_iAvg_sp.get() );
+	if (p_fourierAccumulate){
+		p_powerSum->save( p_checkpoint, "power_" );
+	}
+	if (p_errorBlocks){
+		p_polarBlocks.save( p_checkpoint, "polarBlocks_" );
+		p_iBlocks.save( p_checkpoint, "iBlocks_" );
+		if ( p_corrBlocks.isCreated() ){
+			p_corrBlocks.save( p_checkpoint, "corrBlocks_" );
+		}
+	}
+	return p_checkpoint.commit();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+correlate::readCheckpoint()
+{
+	double count = 0;
+	if ( p_checkpoint.load() 
+		|| !p_checkpoint.get( "count", count )
+		|| !p_checkpoint.get( "polarSum", p_polarAvg_sp.get() )
+		|| !p_checkpoint.get( "corrSum", p_corrAvg_sp.get() )
+		|| !p_checkpoint.get( "qSum", p_qAvg_sp.get() )
+		|| !p_checkpoint.get( "iSum", p_iAvg_sp.get() )
+		|| (p_fourierAccumulate && p_powerSum->restore( p_checkpoint, "power_" ))
+		|| (p_errorBlocks && p_polarBlocks.restore( p_checkpoint, "polarBlocks_" ))
+		|| (p_errorBlocks && p_iBlocks.restore( p_checkpoint, "iBlocks_" ))
+		|| (p_corrBlocks.isCreated() && p_corrBlocks.restore( p_checkpoint, "corrBlocks_" )) ){
+		MsgLog(name(), warning, "could not resume from '" << p_checkpoint.filename() << "' (different nQ1, nPhi or nLag?), starting from scratch" );
+		p_polarAvg_sp->multiplyByValue( 0. );
+		p_corrAvg_sp->multiplyByValue( 0. );
+		p_qAvg_sp->multiplyByValue( 0. );
+		p_iAvg_sp->multiplyByValue( 0. );
+		if (p_errorBlocks){
+			p_polarBlocks.create( p_nQ1*p_nPhi, p_errorBlocks );
+			p_iBlocks.create( p_nQ1, p_errorBlocks );
+			if ( p_corrBlocks.isCreated() ){
+				p_corrBlocks.create( p_nQ1*p_nLag, p_errorBlocks );
+			}
+		}
+		return 1;
 	}
+	p_count = (int)count;
+	p_resumeEvent = p_checkpoint.lastEvent();
+	MsgLog(name(), info, "resumed with " << p_count << " events, continuing after event " << p_resumeEvent );
+	return 0;
 }
 
+
 } // namespace kitty
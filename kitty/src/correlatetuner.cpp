@@ -0,0 +1,374 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class CorrelateTuner...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/correlatetuner.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <sys/time.h>
+
+using std::string;
+using std::vector;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+#include "kitty/crosscorrelator.h"
+#include "kitty/lookuptablecache.h"
+#include "kitty/polarremap.h"
+#include "kitty/polarsplitremap.h"
+#include "kitty/ringcorrelator.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.CorrelateTuner";
+
+	using namespace kitty;
+
+	double wallTime(){
+		timeval tv;
+		gettimeofday( &tv, 0 );
+		return tv.tv_sec + 1e-6*tv.tv_usec;
+	}
+
+	/// remap (if any) and ring correlations, split over the q-rings
+	class TuneTask : public WorkerTask {
+	public:
+		const PolarRemap *remap;
+		const array1D<double> *data;
+		array2D<double> *polar;
+		RingCorrelator *rc;
+		array2D<double> *corr;
+
+		virtual void execute( int part, int nParts ){
+			if (part >= rc->nParts()){
+				return;
+			}
+			int begin = 0;
+			int end = 0;
+			rc->partRange( part, begin, end );
+			if (remap){
+				remap->apply( data, polar, 0, 0, begin, end );
+			}
+			rc->autoCorrelate( polar, corr, part );
+		}
+	};
+
+	/// squared differences of 'corr' to 'ref' (nQ by refLag) and squared 'ref', over the lags both have,
+	/// each ring divided by its value at lag 0, so that the normalization of the path (by <I>^2, nPhi or none) drops out
+	void compare( const array2D<double> *corr, const vector<double> &ref, int nQ, int refLag, double &diff, double &norm ){
+		int nLag = std::min( (int)corr->dim2(), refLag );
+		for (int iq = 0; iq < nQ; iq++){
+			double c0 = corr->get( iq, 0 );
+			double r0 = ref[iq*refLag];
+			if (r0 == 0){
+				continue;					// ring without fluctuations (e.g. masked), nothing to compare
+			}
+			if (c0 == 0){
+				diff += nLag;				// the candidate lost the ring
+				norm += nLag;
+				continue;
+			}
+			for (int lag = 0; lag < nLag; lag++){
+				double r = ref[iq*refLag + lag]/r0;
+				double d = corr->get( iq, lag )/c0 - r;
+				diff += d*d;
+				norm += r*r;
+			}
+		}
+	}
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+CorrelateTuner::CorrelateTuner()
+	: p_cacheFilename("")
+	, p_tolerance(0.01)
+	, p_nFrames(3)
+	, p_pixelSize(0)
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+CorrelateTuner::~CorrelateTuner()
+{
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+CorrelateTuner::configure( const string &cacheFilename, double tolerance, int nFrames, double pixelSize )
+{
+	p_cacheFilename = cacheFilename;
+	p_tolerance = tolerance;
+	p_nFrames = std::max( nFrames, 1 );
+	p_pixelSize = pixelSize;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+CorrelateTuner::tune( array1D<double> *pix1, array1D<double> *pix2, array1D<double> *mask,
+	int nQ, int nPhi, double startQ, double stopQ, int units,
+	bool needRingFFT, bool needRemap, WorkerPool &pool,
+	const CorrelateStrategy &configured, CorrelateStrategy &best )
+{
+	best = configured;
+	if (!pix1 || !pix2 || pix1->size() != pix2->size() || nQ <= 0 || nPhi <= 0 || stopQ <= startQ){
+		MsgLog(logger, error, "cannot tune without pixel arrays and a valid polar grid");
+		return 1;
+	}
+	const unsigned int n = pix1->size();
+
+	//parameters and geometry of the choice
+	unsigned long hash = LookupTableCache::geometryHash( pix1, pix2, mask );
+	std::ostringstream osst;
+	osst << "nQ=" << nQ << "_nPhi=" << nPhi << "_startQ=" << startQ << "_stopQ=" << stopQ << "_units=" << units
+		<< "_mask=" << (mask ? 1 : 0) << "_ringFFT=" << needRingFFT << "_remap=" << needRemap
+		<< "_threads=" << pool.nThreads() << "_tolerance=" << p_tolerance << "_LUT=" << configured.LUTx << "x" << configured.LUTy
+		<< "_geometry=" << std::hex << hash;
+	const string key = osst.str();
+	if ( readCache( key, best ) ){
+		MsgLog(logger, info, "cached choice: algorithm=" << best.alg << ", remap=" << best.remap << ", ringFFT=" << best.ringFFT
+			<< ", LUT=" << best.LUTx << "x" << best.LUTy << " (" << 1e3*best.seconds << " ms per frame)");
+		return 0;
+	}
+
+	//synthetic frames: rings with a sixfold angular modulation and noise
+	vector<array1D<double>*> frames( p_nFrames );
+	unsigned int seed = 12345;
+	for (int f = 0; f < p_nFrames; f++){
+		frames[f] = new array1D<double>( n );
+		for (unsigned int i = 0; i < n; i++){
+			double x = pix1->get(i);
+			double y = pix2->get(i);
+			double q = sqrt( x*x + y*y );
+			double phi = atan2( y, x );
+			seed = seed*1103515245 + 12345;
+			double noise = ((seed >> 16) & 0x7fff)/32768. - 0.5;
+			frames[f]->set( i, 1000.*exp( -q/stopQ )*(1. + 0.3*cos( 6*phi + 0.1*f )) * (1. + 0.1*noise) );
+		}
+	}
+
+	//candidates for the constraints, each compared to the reference (algorithm 1), which is run first
+	vector<CorrelateStrategy> candidates;
+	CorrelateStrategy c = configured;
+	c.seconds = 0;
+	c.error = 0;
+	if (!needRingFFT && !needRemap){
+		for (int alg = 1; alg <= 4; alg++){
+			c.alg = alg;
+			c.remap = 0;
+			c.ringFFT = 0;
+			c.LUTx = configured.LUTx;
+			c.LUTy = configured.LUTy;
+			candidates.push_back( c );
+			if (alg == 2 || alg == 4){
+				c.LUTx = 2*configured.LUTx;
+				c.LUTy = 2*configured.LUTy;
+				candidates.push_back( c );
+			}
+		}
+	}
+	c.alg = configured.alg;
+	c.LUTx = configured.LUTx;
+	c.LUTy = configured.LUTy;
+	for (int remap = (needRemap ? 1 : 0); remap <= 2; remap++){
+		for (int ringFFT = (needRingFFT ? 1 : 0); ringFFT <= 1; ringFFT++){
+			if (remap == 0 && ringFFT == 0){
+				continue;
+			}
+			c.remap = remap;
+			c.ringFFT = ringFFT;
+			candidates.push_back( c );
+		}
+	}
+
+	CorrelateStrategy reference = configured;
+	reference.alg = 1;
+	reference.remap = 0;
+	reference.ringFFT = 0;
+	vector< vector<double> > refCorr( p_nFrames );
+	int refLag = 0;
+	bool found = false;
+	for (int k = -1; k < (int)candidates.size(); k++){
+		CorrelateStrategy &s = (k < 0) ? reference : candidates[k];
+
+		//setup, not counted
+		double t0 = wallTime();
+		CrossCorrelator cc( pix1, pix1, pix2, nPhi, nQ );
+		cc.setXccaEnable( false );
+		if (mask && !s.remap){
+			cc.setMask( mask );
+			cc.setMaskEnable( true );
+		}else{
+			cc.setMaskEnable( false );
+		}
+		if (!s.remap && !s.ringFFT && (s.alg == 2 || s.alg == 4)){
+			cc.createLookupTable( s.LUTy, s.LUTx );
+		}
+		PolarRemap *remap = 0;
+		if (s.remap){
+			remap = (s.remap == 2) ? new PolarSplitRemap( p_pixelSize ) : new PolarRemap();
+			remap->create( pix1, pix2, mask, nQ, nPhi, startQ, stopQ, 0, units );
+		}
+		RingCorrelator rc;
+		array2D<double> *corr = 0;
+		if (s.ringFFT){
+			rc.create( nQ, nPhi, pool.nThreads() );
+			corr = new array2D<double>( nQ, rc.nLag() );
+		}
+		double setup = wallTime() - t0;
+
+		//one untimed frame to warm up caches, then all frames
+		double diff = 0;
+		double norm = 0;
+		double seconds = 0;
+		for (int f = -1; f < p_nFrames; f++){
+			array1D<double> *frame = frames[std::max( f, 0 )];
+			t0 = wallTime();
+			array2D<double> *result = corr;
+			if (s.ringFFT){
+				if (!remap){
+					cc.setData( frame );
+					cc.calculatePolarCoordinates( startQ, stopQ );
+				}
+				TuneTask task;
+				task.remap = remap;
+				task.data = frame;
+				task.polar = cc.polar();
+				task.rc = &rc;
+				task.corr = corr;
+				pool.run( task );
+			}else if (remap){
+				remap->apply( frame, cc.polar(), cc.qAvg(), cc.iAvg() );
+				cc.calculateFluctuations();
+				cc.calculateXCCA( startQ, stopQ );
+				result = cc.autoCorr();
+			}else{
+				cc.setData( frame );
+				cc.run( startQ, stopQ, s.alg );
+				result = cc.autoCorr();
+			}
+			if (f < 0){
+				continue;
+			}
+			seconds += wallTime() - t0;
+
+			if (k < 0){
+				refLag = result->dim2();
+				refCorr[f].resize( nQ*refLag );
+				for (int iq = 0; iq < nQ; iq++){
+					for (int lag = 0; lag < refLag; lag++){
+						refCorr[f][iq*refLag + lag] = result->get( iq, lag );
+					}
+				}
+			}else{
+				compare( result, refCorr[f], nQ, refLag, diff, norm );
+			}
+		}
+		delete remap;
+		delete corr;
+
+		s.seconds = seconds/p_nFrames;
+		s.error = (norm > 0) ? sqrt( diff/norm ) : (diff > 0 ? 1. : 0.);
+		if (k < 0){
+			MsgLog(logger, info, "reference (algorithm 1): " << 1e3*s.seconds << " ms per frame");
+			continue;
+		}
+		bool accepted = (s.error <= p_tolerance);
+		MsgLog(logger, info, "algorithm=" << s.alg << ", remap=" << s.remap << ", ringFFT=" << s.ringFFT
+			<< ", LUT=" << s.LUTx << "x" << s.LUTy << ": " << 1e3*s.seconds << " ms per frame, setup " << setup << " s"
+			<< ", error " << s.error << (accepted ? "" : " (rejected)"));
+		if (accepted && (!found || s.seconds < best.seconds)){
+			best = s;
+			found = true;
+		}
+	}
+	for (int f = 0; f < p_nFrames; f++){
+		delete frames[f];
+	}
+
+	if (!found){
+		MsgLog(logger, warning, "no strategy within the tolerance " << p_tolerance << ", keeping the configuration");
+		best = configured;
+		return 1;
+	}
+	MsgLog(logger, info, "chosen: algorithm=" << best.alg << ", remap=" << best.remap << ", ringFFT=" << best.ringFFT
+		<< ", LUT=" << best.LUTx << "x" << best.LUTy << " (" << 1e3*best.seconds << " ms per frame, error " << best.error << ")");
+	writeCache( key, best );
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+CorrelateTuner::readCache( const string &key, CorrelateStrategy &strategy ) const
+{
+	if (p_cacheFilename == ""){
+		return false;
+	}
+	std::ifstream fin( p_cacheFilename.c_str() );
+	bool found = false;
+	string line;
+	while ( std::getline( fin, line ) ){
+		std::istringstream iss( line );
+		string k;
+		CorrelateStrategy s;
+		if ( (iss >> k >> s.alg >> s.remap >> s.ringFFT >> s.LUTx >> s.LUTy >> s.seconds >> s.error) && k == key ){
+			strategy = s;
+			found = true;		// the last entry of a key counts
+		}
+	}
+	return found;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+CorrelateTuner::writeCache( const string &key, const CorrelateStrategy &strategy ) const
+{
+	if (p_cacheFilename == ""){
+		return;
+	}
+	std::ofstream fout( p_cacheFilename.c_str(), std::ios::app );
+	fout << key << " " << strategy.alg << " " << strategy.remap << " " << strategy.ringFFT << " "
+		<< strategy.LUTx << " " << strategy.LUTy << " " << strategy.seconds << " " << strategy.error << "\n";
+	if (!fout){
+		MsgLog(logger, warning, "could not write the choice to '" << p_cacheFilename << "'");
+	}
+}
+
+
+} // namespace kitty
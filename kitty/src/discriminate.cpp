@@ -39,6 +39,7 @@ using std::string;
 #include "PSEvt/EventId.h"
 
 #include "kitty/constants.h"
+#include "kitty/accumulator.h"
 
 #include "kitty/util.h"
 using ns_cspad_util::create1DFromRawImageCSPAD;
@@ -550,6 +551,11 @@ discriminate::event(Event& evt, Env& env)
 			*updatedPV_sp = true;				// tell other modules to update their PV-dependent properties
 			p_criticalPVchange = false;			// reset the module-internal flag
 		}
+		
+		// accumulate the uncorrected data, if any module asked for it
+		if ( AccumulatorService::instance().hasSubscribers(STAGE_RAW) ){
+			AccumulatorService::instance().accumulate( STAGE_RAW, *eventname_sp, raw1D_sp.get() );
+		}
 	}else{
 		evtinfo << " xxxxx REJECT xxxxx";
 		p_skipcount++;
@@ -844,6 +850,10 @@ discriminate::addPixelArraysToEvent( Event &evt ){
 	evt.put( p_pixY_q_sp, IDSTRING_PX_Y_q);
 	evt.put( p_pixTwoTheta_sp, IDSTRING_PX_TWOTHETA);
 	evt.put( p_pixPhi_sp, IDSTRING_PX_PHI);	
+	
+	//modules that precompute anything from the pixel arrays compare this to know when to redo it
+	shared_ptr<int> generation_sp( new int(p_makePixelArrays_count) );
+	evt.put( generation_sp, IDSTRING_GEOMETRY_GENERATION );
 }	
 
 
@@ -0,0 +1,233 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class EventProfiler...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/eventprofiler.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <cxxabi.h>
+
+using std::string;
+using std::vector;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+#include "psddl_psana/cspad.ddl.h"
+
+#include "kitty/arrayclasses.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.EventProfiler";
+
+	string demangle( const char *name ){
+		int status = 0;
+		char *readable = abi::__cxa_demangle( name, 0, 0, &status );
+		string result = (status == 0 && readable) ? readable : name;
+		free( readable );
+		return result;
+	}
+
+	template <class D>
+	unsigned long cspadBytes( const D &data ){
+		unsigned long bytes = 0;
+		const int nQuads = data.quads_shape().at(0);
+		for (int q = 0; q < nQuads; q++){
+			bytes += data.quads(q).data().size() * sizeof(int16_t);
+		}
+		return bytes;
+	}
+
+	/// estimated size of the object of 'key' and the object itself, 0 bytes for unknown types
+	unsigned long objectBytes( Event &evt, const EventKey &key, shared_ptr<void> &object ){
+		const std::type_info &type = *key.typeinfo();
+		object.reset();
+		if (type == typeid(array1D<double>)){
+			shared_ptr<array1D<double> > sp = evt.get( key.src(), key.key() );
+			object = sp;
+			return sp ? sp->size()*sizeof(double) : 0;
+		}else if (type == typeid(array2D<double>)){
+			shared_ptr<array2D<double> > sp = evt.get( key.src(), key.key() );
+			object = sp;
+			return sp ? sp->size()*sizeof(double) : 0;
+		}else if (type == typeid(string)){
+			shared_ptr<string> sp = evt.get( key.src(), key.key() );
+			object = sp;
+			return sp ? sp->size() : 0;
+		}else if (type == typeid(int)){
+			shared_ptr<int> sp = evt.get( key.src(), key.key() );
+			object = sp;
+			return sizeof(int);
+		}else if (type == typeid(bool)){
+			shared_ptr<bool> sp = evt.get( key.src(), key.key() );
+			object = sp;
+			return sizeof(bool);
+		}else if (type == typeid(Psana::CsPad::DataV1)){
+			shared_ptr<Psana::CsPad::DataV1> sp = evt.get( key.src(), key.key() );
+			object = sp;
+			return sp ? cspadBytes( *sp ) : 0;
+		}else if (type == typeid(Psana::CsPad::DataV2)){
+			shared_ptr<Psana::CsPad::DataV2> sp = evt.get( key.src(), key.key() );
+			object = sp;
+			return sp ? cspadBytes( *sp ) : 0;
+		}
+		return 0;
+	}
+
+	string megabytes( double bytes ){
+		std::ostringstream osst;
+		osst << std::fixed << std::setprecision(2) << bytes/1048576. << " MB";
+		return osst.str();
+	}
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+EventProfiler::EventProfiler()
+	: p_entries()
+	, p_samples(0)
+	, p_peakBytes(0)
+	, p_peakNewBytes(0)
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+EventProfiler::~EventProfiler()
+{
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+EventProfiler::sample( Event &evt )
+{
+	unsigned long bytes = 0;
+	unsigned long newBytes = 0;
+	std::list<EventKey> keys = evt.keys();
+	for (std::list<EventKey>::const_iterator it = keys.begin(); it != keys.end(); it++){
+		std::ostringstream src;
+		src << it->src();
+		const string type = demangle( it->typeinfo()->name() );
+		Entry &e = p_entries[type + "|" + src.str() + "|" + it->key()];
+		if (e.samples == 0){
+			e.type = type;
+			e.source = src.str();
+			e.key = it->key();
+			e.sumBytes = 0;
+			e.maxBytes = 0;
+			e.newObjects = 0;
+			e.lastObject.reset();
+		}
+
+		shared_ptr<void> object;
+		unsigned long b = objectBytes( evt, *it, object );
+		e.samples++;
+		e.sumBytes += b;
+		e.maxBytes = std::max( e.maxBytes, b );
+		bytes += b;
+		if (!object || object != e.lastObject.lock()){
+			e.newObjects++;
+			newBytes += b;
+		}
+		e.lastObject = object;
+	}
+	p_peakBytes = std::max( p_peakBytes, bytes );
+	p_peakNewBytes = std::max( p_peakNewBytes, newBytes );
+	p_samples++;
+	MsgLog(logger, debug, keys.size() << " keys, " << megabytes(bytes) << " (" << megabytes(newBytes) << " new in this event)");
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+EventProfiler::samples() const
+{
+	return p_samples;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+string
+EventProfiler::report( unsigned int top ) const
+{
+	vector< std::pair<unsigned long, const Entry*> > bySize;
+	for (std::map<string, Entry>::const_iterator it = p_entries.begin(); it != p_entries.end(); it++){
+		bySize.push_back( std::make_pair( it->second.maxBytes, &it->second ) );
+	}
+	std::sort( bySize.rbegin(), bySize.rend() );
+
+	std::ostringstream osst;
+	osst << p_samples << " events sampled, " << p_entries.size() << " different keys\n";
+	osst << "peak per event: " << megabytes(p_peakBytes) << " in the event store, "
+		<< megabytes(p_peakNewBytes) << " of it new in that event (not shared with the previous sample)\n";
+	unsigned long rss = peakResidentBytes();
+	if (rss){
+		osst << "peak resident memory of the process: " << megabytes(rss) << "\n";
+	}
+	osst << "largest keys (max size, mean size, events in which the object was new / events present):\n";
+	for (unsigned int i = 0; i < bySize.size() && i < top; i++){
+		const Entry &e = *bySize[i].second;
+		osst << std::setw(10) << megabytes(e.maxBytes) << std::setw(12) << megabytes(e.sumBytes/e.samples)
+			<< std::setw(8) << e.newObjects << "/" << e.samples
+			<< "  " << e.type << ", source '" << e.source << "', key '" << e.key << "'"
+			<< (e.maxBytes == 0 ? " (size unknown)" : "") << "\n";
+	}
+	return osst.str();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned long
+EventProfiler::peakResidentBytes()
+{
+	FILE *f = fopen( "/proc/self/status", "r" );
+	if (!f){
+		return 0;
+	}
+	char line[256];
+	unsigned long kB = 0;
+	while (fgets( line, sizeof(line), f )){
+		if (strncmp( line, "VmHWM:", 6 ) == 0){
+			kB = strtoul( line + 6, 0, 10 );
+			break;
+		}
+	}
+	fclose( f );
+	return kB*1024;
+}
+
+
+} // namespace kitty
@@ -0,0 +1,338 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class EventStack...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/eventstack.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <cstdlib>
+
+using std::string;
+using std::vector;
+using std::map;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.EventStack";
+	const hsize_t eventInfoChunk = 1024;		// event info entries are tiny, chunk many of them together
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+EventStack::EventStack()
+	: p_file(-1)
+	, p_eventType(-1)
+	, p_eventDataset(-1)
+	, p_datasets()
+	, p_filename("")
+	, p_compression(0)
+	, p_nEvents(0)
+	, p_buffer()
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+EventStack::~EventStack()
+{
+	close();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+EventStack::open( const string &filename, int compression )
+{
+	close();
+
+	p_file = H5Fcreate( filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT );
+	if (p_file < 0){
+		MsgLog(logger, error, "could not create event stack file '" << filename << "'");
+		p_file = -1;
+		return 1;
+	}
+	p_filename = filename;
+	p_compression = compression;
+	p_nEvents = 0;
+
+	p_eventType = H5Tcreate( H5T_COMPOUND, sizeof(EventStackInfo) );
+	H5Tinsert( p_eventType, "index", HOFFSET(EventStackInfo, index), H5T_NATIVE_UINT );
+	H5Tinsert( p_eventType, "sec", HOFFSET(EventStackInfo, sec), H5T_NATIVE_UINT );
+	H5Tinsert( p_eventType, "nsec", HOFFSET(EventStackInfo, nsec), H5T_NATIVE_UINT );
+	H5Tinsert( p_eventType, "fiducials", HOFFSET(EventStackInfo, fiducials), H5T_NATIVE_UINT );
+
+	p_eventDataset = createDataset( "event", p_eventType, vector<hsize_t>(), eventInfoChunk, 0 );
+	if (p_eventDataset < 0){
+		close();
+		return 1;
+	}
+
+	MsgLog(logger, info, "writing per-event output to '" << p_filename << "' (deflate level " << p_compression << ")");
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+EventStack::close()
+{
+	//products missing in the last events: extend them (zero-filled) to the length of 'event'
+	for (map<string, hid_t>::iterator it = p_datasets.begin(); it != p_datasets.end(); it++){
+		hid_t space = H5Dget_space( it->second );
+		int rank = H5Sget_simple_extent_ndims( space );
+		vector<hsize_t> dims(rank);
+		H5Sget_simple_extent_dims( space, &dims[0], NULL );
+		H5Sclose( space );
+		if (dims[0] < p_nEvents){
+			dims[0] = p_nEvents;
+			if (H5Dset_extent( it->second, &dims[0] ) < 0){
+				MsgLog(logger, error, "could not extend dataset '" << it->first << "' in '" << p_filename << "' to " << p_nEvents << " entries");
+			}
+		}
+		H5Dclose( it->second );
+	}
+	p_datasets.clear();
+
+	if (p_eventDataset >= 0){
+		H5Dclose( p_eventDataset );
+		p_eventDataset = -1;
+	}
+	if (p_eventType >= 0){
+		H5Tclose( p_eventType );
+		p_eventType = -1;
+	}
+	if (p_file >= 0){
+		H5Fclose( p_file );
+		p_file = -1;
+		MsgLog(logger, info, "closed '" << p_filename << "' after " << p_nEvents << " events");
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+EventStack::isOpen() const
+{
+	return (p_file >= 0);
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+EventStack::appendEvent( unsigned int index, unsigned int sec, unsigned int nsec, unsigned int fiducials )
+{
+	if (!isOpen()){
+		return 1;
+	}
+	EventStackInfo evtinfo;
+	evtinfo.index = index;
+	evtinfo.sec = sec;
+	evtinfo.nsec = nsec;
+	evtinfo.fiducials = fiducials;
+
+	int fail = writeEntry( p_eventDataset, p_eventType, &evtinfo, p_nEvents );
+	if (!fail){
+		p_nEvents++;
+	}
+	return fail;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+EventStack::appendEvent( const string &eventname, const shared_ptr<EventId> &eventId )
+{
+	unsigned int sec = 0;
+	unsigned int nsec = 0;
+	unsigned int fiducials = 0;
+	if (eventId){
+		sec = eventId->time().sec();
+		nsec = eventId->time().nsec();
+		fiducials = eventId->fiducials();
+	}
+	return appendEvent( (unsigned int) atoi(eventname.c_str()), sec, nsec, fiducials );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+EventStack::append( const string &dsname, const array2D<double> *img )
+{
+	if (!img){
+		return 1;
+	}
+	//same memory layout as the '/data/data' datasets written by arraydataIO
+	vector<hsize_t> dims(2);
+	dims[0] = img->dim2();
+	dims[1] = img->dim1();
+
+	p_buffer.resize( img->size() );
+	for (unsigned int i = 0; i < img->size(); i++){
+		p_buffer[i] = (float) img->get_atIndex(i);
+	}
+	return appendFloat( dsname, dims, p_buffer );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+EventStack::append( const string &dsname, const array1D<double> *vec )
+{
+	if (!vec){
+		return 1;
+	}
+	vector<hsize_t> dims(1, vec->size());
+
+	p_buffer.resize( vec->size() );
+	for (unsigned int i = 0; i < vec->size(); i++){
+		p_buffer[i] = (float) vec->get(i);
+	}
+	return appendFloat( dsname, dims, p_buffer );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+EventStack::nEvents() const
+{
+	return p_nEvents;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+string
+EventStack::filename() const
+{
+	return p_filename;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+EventStack::appendFloat( const string &dsname, const vector<hsize_t> &entryDims, const vector<float> &buf )
+{
+	if (!isOpen() || p_nEvents == 0){
+		MsgLog(logger, error, "append('" << dsname << "') called without an open event slice");
+		return 1;
+	}
+
+	hid_t dataset = -1;
+	map<string, hid_t>::iterator it = p_datasets.find( dsname );
+	if (it == p_datasets.end()){
+		dataset = createDataset( dsname, H5T_NATIVE_FLOAT, entryDims, 1, p_compression );
+		if (dataset < 0){
+			return 1;
+		}
+		p_datasets[dsname] = dataset;
+	}else{
+		dataset = it->second;
+	}
+
+	//products always go to the slice of the current event, so that all datasets stay parallel to 'event'
+	return writeEntry( dataset, H5T_NATIVE_FLOAT, &buf[0], p_nEvents-1 );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+hid_t
+EventStack::createDataset( const string &dsname, hid_t type, const vector<hsize_t> &entryDims, hsize_t chunkEvents, int compression )
+{
+	int rank = entryDims.size() + 1;
+	vector<hsize_t> dims(rank, 0);
+	vector<hsize_t> maxdims(rank, H5S_UNLIMITED);
+	vector<hsize_t> chunk(rank, chunkEvents);
+	for (unsigned int i = 0; i < entryDims.size(); i++){
+		dims[i+1] = entryDims[i];
+		maxdims[i+1] = entryDims[i];
+		chunk[i+1] = entryDims[i];
+	}
+
+	hid_t space = H5Screate_simple( rank, &dims[0], &maxdims[0] );
+	hid_t plist = H5Pcreate( H5P_DATASET_CREATE );
+	H5Pset_chunk( plist, rank, &chunk[0] );
+	if (compression > 0){
+		H5Pset_shuffle( plist );
+		H5Pset_deflate( plist, compression );
+	}
+
+	hid_t dataset = H5Dcreate2( p_file, dsname.c_str(), type, space, H5P_DEFAULT, plist, H5P_DEFAULT );
+	if (dataset < 0){
+		MsgLog(logger, error, "could not create dataset '" << dsname << "' in '" << p_filename << "'");
+	}
+
+	H5Pclose( plist );
+	H5Sclose( space );
+	return dataset;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+EventStack::writeEntry( hid_t dataset, hid_t memtype, const void *buf, hsize_t entry )
+{
+	hid_t space = H5Dget_space( dataset );
+	int rank = H5Sget_simple_extent_ndims( space );
+	vector<hsize_t> dims(rank);
+	H5Sget_simple_extent_dims( space, &dims[0], NULL );
+	H5Sclose( space );
+
+	//grow the dataset along the event axis, if needed
+	if (dims[0] <= entry){
+		dims[0] = entry+1;
+		if (H5Dset_extent( dataset, &dims[0] ) < 0){
+			MsgLog(logger, error, "could not extend dataset in '" << p_filename << "' to " << entry+1 << " entries");
+			return 1;
+		}
+	}
+
+	vector<hsize_t> start(rank, 0);
+	vector<hsize_t> count(dims);
+	start[0] = entry;
+	count[0] = 1;
+
+	space = H5Dget_space( dataset );
+	H5Sselect_hyperslab( space, H5S_SELECT_SET, &start[0], NULL, &count[0], NULL );
+	hid_t memspace = H5Screate_simple( rank, &count[0], NULL );
+
+	herr_t status = H5Dwrite( dataset, memtype, memspace, space, H5P_DEFAULT, buf );
+
+	H5Sclose( memspace );
+	H5Sclose( space );
+
+	if (status < 0){
+		MsgLog(logger, error, "could not write entry " << entry << " to '" << p_filename << "'");
+		return 1;
+	}
+	return 0;
+}
+
+
+} // namespace kitty
@@ -0,0 +1,200 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class GeometryCache...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/geometrycache.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <sstream>
+
+using std::map;
+using std::string;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.GeometryCache";
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+GeometryKey::GeometryKey( const string &product )
+	: p_product(product)
+	, p_parameters()
+	, p_inputs()
+{
+}
+
+
+GeometryKey::GeometryKey( const string &product, const GeometryKey &other )
+	: p_product(product)
+	, p_parameters(other.p_parameters)
+	, p_inputs(other.p_inputs)
+{
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+GeometryKey&
+GeometryKey::input( const string &name, long version )
+{
+	p_inputs[name] = version;
+	return *this;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+GeometryKey&
+GeometryKey::parameter( const string &name, double value )
+{
+	std::ostringstream osst;
+	osst.precision( 17 );
+	osst << value;
+	p_parameters[name] = osst.str();
+	return *this;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+GeometryKey&
+GeometryKey::parameter( const string &name, const string &value )
+{
+	p_parameters[name] = value;
+	return *this;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+const string &
+GeometryKey::product() const
+{
+	return p_product;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+string
+GeometryKey::id() const
+{
+	string id = p_product;
+	for (map<string, string>::const_iterator it = p_parameters.begin(); it != p_parameters.end(); it++){
+		id += "|" + it->first + "=" + it->second;
+	}
+	return id;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+const map<string, long> &
+GeometryKey::inputs() const
+{
+	return p_inputs;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+string
+GeometryKey::describe() const
+{
+	std::ostringstream osst;
+	osst << "'" << p_product << "' (";
+	for (map<string, long>::const_iterator it = p_inputs.begin(); it != p_inputs.end(); it++){
+		osst << (it == p_inputs.begin() ? "" : ", ") << it->first << " " << it->second;
+	}
+	osst << ")";
+	return osst.str();
+}
+
+
+//----------------
+// Constructors --
+//----------------
+GeometryCache::GeometryCache()
+	: p_entries()
+	, p_builds(0)
+{
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+GeometryCache&
+GeometryCache::instance()
+{
+	static GeometryCache cache;
+	return cache;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+GeometryCache::isCurrent( const GeometryKey &key ) const
+{
+	const Entry *entry = find( key );
+	return entry && entry->inputs == key.inputs();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+GeometryCache::builds() const
+{
+	return p_builds;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+GeometryCache::clear()
+{
+	p_entries.clear();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+const GeometryCache::Entry *
+GeometryCache::find( const GeometryKey &key ) const
+{
+	map<string, Entry>::const_iterator it = p_entries.find( key.id() );
+	return (it != p_entries.end()) ? &it->second : 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+GeometryCache::store( const GeometryKey &key, boost::shared_ptr<void> product )
+{
+	Entry &entry = p_entries[key.id()];
+	MsgLog(logger, info, (entry.product ? "rebuilt " : "built ") << key.describe() );
+	entry.inputs = key.inputs();
+	entry.product = product;
+	p_builds++;
+}
+
+
+} // namespace kitty
@@ -18,6 +18,7 @@
 //-----------------
 // C/C++ Headers --
 //-----------------
+#include <algorithm>
 #include <iomanip>
 using std::setw;
 
@@ -58,12 +59,22 @@ namespace kitty {
 info::info (const std::string& name)
 	: Module(name)
 	, p_outputPrefix("")
+	, p_recordAllPVs(0)
 	, p_count(0)
-	, p_stopflag(false)
-	, fout()
+	, p_run(0)
 	, p_pvs()
+	, p_recordedNames()
+	, p_nStorePVs(0)
+	, p_recorder()
+	, p_profileEvents(0)
+	, p_profileTop(0)
+	, p_nEvents(0)
+	, p_profiler()
 {
 	p_outputPrefix				= configStr("outputPrefix", 		"out");
+	p_recordAllPVs				= config   ("recordAllPVs", 		0);
+	p_profileEvents				= config   ("profileEvents", 		0);
+	p_profileTop				= config   ("profileTop", 			20);
 }
 
 //--------------
@@ -80,6 +91,10 @@ void
 info::beginJob(Event& evt, Env& env)
 {
 	MsgLog(name(), debug, "beginJob()" );
+	MsgLog(name(), info, "outputPrefix = '" << p_outputPrefix << "'" );
+	MsgLog(name(), info, "recordAllPVs = '" << p_recordAllPVs << "'" );
+	MsgLog(name(), info, "profileEvents = '" << p_profileEvents << "'" );
+	MsgLog(name(), info, "profileTop = '" << p_profileTop << "'" );
 	
 	p_pvs[pvDetPos].name = "CXI:DS1:MMS:06";
 	p_pvs[pvDetPos].desc = "detector position";
@@ -117,22 +132,6 @@ info::beginJob(Event& evt, Env& env)
 		it->second.valid = false;
 		it->second.changed = false;
 	} 
-
-	ostringstream header;
-	header << "run ";
-	map<string,pv>::iterator it;
-	for(it = p_pvs.begin(); it != p_pvs.end(); it++){
-		header << it->second.name << " ";
-	}
-	header << endl;
-	header << "run ";
-	for(it = p_pvs.begin(); it != p_pvs.end(); it++){
-		header << it->second.desc << " ";
-	}
-	header << endl;
-			
-	std::ofstream headerfile("header.txt");
-	headerfile << header.str() << endl;
 }
 
 
@@ -145,40 +144,16 @@ info::beginRun(Event& evt, Env& env)
 {
 	MsgLog(name(), debug,  "beginRun()" );
 
-	bool displayAllAvailablePVs = true;
-
-	ostringstream runinfo;
-
 	//get run rumber for this run
 	shared_ptr<EventId> eventId = evt.get();
-	int runNumber = 0;
+	p_run = 0;
     if (eventId.get()) {
-		runNumber = eventId->run();
-		MsgLog(name(), trace, name() << ": Using run number " << runNumber);
-		runinfo << runNumber << " ";
+		p_run = eventId->run();
+		MsgLog(name(), trace, name() << ": Using run number " << p_run);
     } else {
 		MsgLog(name(), warning, name() << ": Cannot get eventId.");
     }	
 
-	ostringstream fnosst;
-	fnosst << p_outputPrefix << "_r" << runNumber << ".txt";
-	fout.open(fnosst.str().c_str());
-	if (fout.fail()){
-		MsgLog(name(), error,  "could not open output file " << fnosst.str());
-	}
-	
-	if (displayAllAvailablePVs){		
-		const vector<string>& all_pvNames = env.epicsStore().pvNames();
-		if (all_pvNames.size() == 0){
-			MsgLog(name(), info, " --- no stored PVs --- " );
-		}else{
-			MsgLog(name(), info, "------list of stored PVs------" );
-			for (unsigned int i = 0; i < all_pvNames.size(); i++){
-				MsgLog(name(), info, all_pvNames.at(i) );
-			}
-		}
-	}
-
 	//try to get the PV values
 	map<string,pv>::iterator it;
 	ostringstream osst;
@@ -194,40 +169,29 @@ info::beginRun(Event& evt, Env& env)
 		}
 		osst << " (" << it->second.desc << ")" << endl;
 	}
-	
 	MsgLog(name(), info, "------list of read out PVs in beginRun------\n" << osst.str() );
-	//use the values
-	MsgLog(name(), info, "run no " << runNumber);
+	
+	//handles: the PVs of p_pvs first, then all others of the EPICS store
+	p_recordedNames.clear();
+	vector<string> descriptions;
 	for (it = p_pvs.begin(); it != p_pvs.end(); it++){
-		runinfo << it->first << " ";
+		p_recordedNames.push_back( it->second.name );
+		descriptions.push_back( it->second.desc );
 	}
-	runinfo << endl;
-	
-	fout << runinfo.str();
-	
-	
-//	MsgLog(name(), info, "------quantities derived from selected PVs------" );
-//	unsigned int detZ_no = 0;
-//	unsigned int lambda_no = 11;	
-//	double detZ = 0; 
-//	if (runPVvalid.at(detZ_no) ){
-//		detZ = detOffset + runVals.at(detZ_no);
-//	}
-//	double lambda = 0;
-//	if (runPVvalid.at(lambda_no) ){
-//		lambda = runVals.at(lambda_no);
-//	}
-//	double two_k = 2*2*M_PI/lambda;								//in units of inv. nanometers
-//	MsgLog(name(), info, "detZ = " << detZ << " mm");				
-//	MsgLog(name(), info, "2*k = " << two_k << "nm^-1" );
-//	MsgLog(name(), info, " ");
+	p_recorder.begin( p_recordedNames, descriptions );
+	p_count = 0;
+	p_nStorePVs = 0;
+	if (p_recordAllPVs){
+		addStorePVs( env );
+	}
+	MsgLog(name(), info, "recording changes of " << p_recordedNames.size() << " PVs in run " << p_run );
 	
 	std::list<EventKey> keys = evt.keys();
-	MsgLog(name(), info, "------" << keys.size() << " keys in event------");
+	MsgLog(name(), debug, "------" << keys.size() << " keys in event------");
 	for ( std::list<EventKey>::iterator it = keys.begin(); it != keys.end(); it++ ){
 		ostringstream out;
 		it->print(out);
-		MsgLog(name(), info, out.str() << ", key: '" << it->key() << "'");
+		MsgLog(name(), debug, out.str() << ", key: '" << it->key() << "'");
 	}
 }
 
@@ -249,35 +213,52 @@ info::event(Event& evt, Env& env)
 {
 	MsgLog(name(), debug,  "event()" );
 
-	if (p_stopflag){
-		stop();
-		return;
-	}
+	shared_ptr<EventId> eventId = evt.get();
+	unsigned int sec = eventId ? eventId->time().sec() : 0;
+	unsigned int nsec = eventId ? eventId->time().nsec() : 0;
 
-	//try to get the PV values
-	map<string,pv>::iterator it;
-	ostringstream osst;
-	for (it = p_pvs.begin(); it != p_pvs.end(); it++){
-		osst << setw(20) << it->first << " " << setw(26) << it->second.name; 
+	//PVs that first show up during the run are recorded from this event on
+	if (p_recordAllPVs && env.epicsStore().pvNames().size() != p_nStorePVs){
+		addStorePVs( env );
+	}
+	
+	//every PV is read, but only changes are stored
+	for (unsigned int h = 0; h < p_recordedNames.size(); h++){
 		try{
-			it->second.value = env.epicsStore().value(it->second.name);
-			it->second.valid = true;
-			osst << " = " << setw(12) << it->second.value;
+			double value = env.epicsStore().value( p_recordedNames[h] );
+			p_recorder.record( h, value, p_count, sec, nsec );
 		}catch(...){
-			it->second.valid = false;
-			osst << setw(12) << " ---- ";
+			p_recorder.recordMissing( h, p_count, sec, nsec );
 		}
-		osst << " (" << it->second.desc << ")" << endl;
 	}
-	MsgLog(name(), info, "------list of read out PVs in event #" << p_count << "------\n" << osst.str() );
-
-	//stop after a few events
-	if (p_count >= 10){
-		p_stopflag = true;
+	p_recorder.endEvent();
+	
+	//the store holds what the modules before this one have put into it
+	if (p_profileEvents > 0 && p_nEvents % p_profileEvents == 0){
+		p_profiler.sample( evt );
 	}
 		
-	// increment event counter
+	// increment event counters
 	p_count++;
+	p_nEvents++;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+info::addStorePVs( Env& env )
+{
+	const vector<string>& all_pvNames = env.epicsStore().pvNames();
+	for (unsigned int i = 0; i < all_pvNames.size(); i++){
+		if ( std::find( p_recordedNames.begin(), p_recordedNames.end(), all_pvNames.at(i) ) == p_recordedNames.end() ){
+			p_recordedNames.push_back( all_pvNames.at(i) );
+			p_recorder.add( all_pvNames.at(i), "" );
+			if (p_count > 0){
+				MsgLog(name(), info, "PV '" << all_pvNames.at(i) << "' appeared in event " << p_count << " of run " << p_run );
+			}
+		}
+	}
+	p_nStorePVs = all_pvNames.size();
 }
 
 
@@ -296,6 +277,10 @@ void
 info::endRun(Event& evt, Env& env)
 {
 	MsgLog(name(), debug,  "endRun()" );
+	
+	ostringstream fnosst;
+	fnosst << p_outputPrefix << "_r" << p_run << "_pv.h5";
+	p_recorder.write( fnosst.str(), p_run );
 }
 
 
@@ -305,8 +290,10 @@ void
 info::endJob(Event& evt, Env& env)
 {
 	MsgLog(name(), debug,  "endJob()" );
-
-	fout.close();
+	
+	if (p_profiler.samples() > 0){
+		MsgLog(name(), info, "------event store profile------\n" << p_profiler.report( p_profileTop ) );
+	}
 }
 
 
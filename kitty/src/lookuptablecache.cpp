@@ -0,0 +1,380 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class LookupTableCache...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/lookuptablecache.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <boost/bind.hpp>
+
+using std::string;
+using std::vector;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+#include "kitty/crosscorrelator.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.LookupTableCache";
+
+	const char magic[8] = { 'K', 'I', 'T', 'T', 'Y', 'L', 'U', 'T' };
+	const unsigned int version = 1;
+
+	/// file header, followed by rows x cols doubles
+	struct LutHeader {
+		char magic[8];
+		unsigned int version;
+		unsigned int rows;
+		unsigned int cols;
+		unsigned int reserved;
+		unsigned long hash;
+	};
+
+	void hashArray( const array1D<double> *a, unsigned long &hash ){
+		if (!a){
+			return;
+		}
+		for (unsigned int i = 0; i < a->size(); i++){
+			double v = a->get(i);
+			const unsigned char *b = reinterpret_cast<const unsigned char*>( &v );
+			for (unsigned int k = 0; k < sizeof(double); k++){
+				hash = (hash ^ b[k]) * 1099511628211UL;
+			}
+		}
+	}
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+LookupTableCache::LookupTableCache()
+	: p_directory("")
+	, p_persistent(false)
+	, p_mutex()
+	, p_thread(0)
+	, p_building(false)
+	, p_buildingKey("")
+	, p_hasPending(false)
+	, p_pending()
+	, p_wanted("")
+	, p_readyKey("")
+	, p_ready(0)
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+LookupTableCache::~LookupTableCache()
+{
+	wait();
+	delete p_thread;
+	delete p_ready;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+LookupTableCache::configure( const string &directory, bool persistent )
+{
+	p_directory = directory;
+	p_persistent = persistent;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+LookupTableCache::request( const array1D<double> *pix1, const array1D<double> *pix2, int nPhi, int nQ, int LUTx, int LUTy )
+{
+	if (!pix1 || !pix2 || pix1->size() != pix2->size()){
+		MsgLog(logger, error, "cannot request a lookup table without matching pixel arrays");
+		return false;
+	}
+	const unsigned long hash = geometryHash( pix1, pix2 );
+	const string fn = filename( hash, LUTx, LUTy );
+	{
+		boost::mutex::scoped_lock lock( p_mutex );
+		p_wanted = fn;
+		if (p_ready && p_readyKey == fn){
+			return true;
+		}
+		if (p_building && p_buildingKey == fn){
+			p_hasPending = false;		// the current build is the latest request again
+			return false;
+		}
+	}
+
+	if (p_persistent){
+		array2D<double> *table = load( fn, LUTx, LUTy, hash );
+		if (table){
+			MsgLog(logger, info, "lookup table " << LUTx << "x" << LUTy << " loaded from '" << fn << "'");
+			boost::mutex::scoped_lock lock( p_mutex );
+			delete p_ready;
+			p_ready = table;
+			p_readyKey = fn;
+			return true;
+		}
+	}
+
+	Job job;
+	job.pix1.resize( pix1->size() );
+	job.pix2.resize( pix2->size() );
+	for (unsigned int i = 0; i < pix1->size(); i++){
+		job.pix1[i] = pix1->get(i);
+		job.pix2[i] = pix2->get(i);
+	}
+	job.nPhi = nPhi;
+	job.nQ = nQ;
+	job.LUTx = LUTx;
+	job.LUTy = LUTy;
+	job.hash = hash;
+	job.filename = fn;
+
+	boost::mutex::scoped_lock lock( p_mutex );
+	if (p_building){
+		p_pending = job;
+		p_hasPending = true;
+	}else{
+		start( job );
+	}
+	MsgLog(logger, info, "building lookup table " << LUTx << "x" << LUTy << " for geometry " << std::hex << hash << " in the background");
+	return false;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+array2D<double> *
+LookupTableCache::take()
+{
+	boost::mutex::scoped_lock lock( p_mutex );
+	if (p_ready && p_readyKey == p_wanted){
+		array2D<double> *table = p_ready;
+		p_ready = 0;
+		p_readyKey = "";
+		return table;
+	}
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+LookupTableCache::isBuilding() const
+{
+	boost::mutex::scoped_lock lock( p_mutex );
+	return p_building;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+LookupTableCache::wait()
+{
+	boost::thread *thread = 0;
+	{
+		boost::mutex::scoped_lock lock( p_mutex );
+		thread = p_thread;
+	}
+	if (thread && thread->joinable()){
+		thread->join();		// a queued request is built on the same thread
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned long
+LookupTableCache::geometryHash( const array1D<double> *pix1, const array1D<double> *pix2, const array1D<double> *mask )
+{
+	unsigned long hash = 14695981039346656037UL;
+	hashArray( pix1, hash );
+	hashArray( pix2, hash );
+	hashArray( mask, hash );
+	return hash;
+}
+
+
+//		-----------------------------------------
+// 		-- Private Function Member Definitions --
+//		-----------------------------------------
+
+/// ------------------------------------------------------------------------------------------------
+void
+LookupTableCache::start( const Job &job )
+{
+	if (p_thread){
+		if (p_thread->joinable()){
+			p_thread->join();		// finished, as p_building is false
+		}
+		delete p_thread;
+	}
+	p_building = true;
+	p_buildingKey = job.filename;
+	p_thread = new boost::thread( boost::bind( &LookupTableCache::build, this, job ) );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+LookupTableCache::build( Job job )
+{
+	while (true){
+		//a cross-correlator of its own, the module's one is in use by the events meanwhile
+		const unsigned int n = job.pix1.size();
+		array1D<double> *pix1 = new array1D<double>( n );
+		array1D<double> *pix2 = new array1D<double>( n );
+		for (unsigned int i = 0; i < n; i++){
+			pix1->set( i, job.pix1[i] );
+			pix2->set( i, job.pix2[i] );
+		}
+		CrossCorrelator *cc = new CrossCorrelator( pix1, pix1, pix2, job.nPhi, job.nQ );
+		cc->createLookupTable( job.LUTy, job.LUTx );
+		array2D<double> *table = new array2D<double>( cc->lookupTable() );
+		delete cc;
+		delete pix1;
+		delete pix2;
+		if (p_persistent){
+			save( job.filename, table, job.hash );
+		}
+
+		boost::mutex::scoped_lock lock( p_mutex );
+		if (job.filename == p_wanted){
+			delete p_ready;
+			p_ready = table;
+			p_readyKey = job.filename;
+		}else{
+			delete table;		// the geometry changed again during the build
+		}
+		if (!p_hasPending){
+			p_building = false;
+			p_buildingKey = "";
+			return;
+		}
+		job = p_pending;
+		p_hasPending = false;
+		p_buildingKey = job.filename;
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+string
+LookupTableCache::filename( unsigned long hash, int LUTx, int LUTy ) const
+{
+	std::ostringstream osst;
+	osst << p_directory << "lut_" << std::hex << hash << std::dec << "_" << LUTx << "x" << LUTy << ".bin";
+	return osst.str();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+array2D<double> *
+LookupTableCache::load( const string &filename, int LUTx, int LUTy, unsigned long hash ) const
+{
+	int fd = open( filename.c_str(), O_RDONLY );
+	if (fd < 0){
+		return 0;
+	}
+	struct stat st;
+	void *map = MAP_FAILED;
+	if (fstat( fd, &st ) == 0 && st.st_size >= (off_t)sizeof(LutHeader)){
+		map = mmap( 0, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	}
+	close( fd );
+	if (map == MAP_FAILED){
+		MsgLog(logger, warning, "could not map '" << filename << "'");
+		return 0;
+	}
+
+	array2D<double> *table = 0;
+	const LutHeader *header = static_cast<const LutHeader*>( map );
+	const size_t bytes = sizeof(LutHeader) + (size_t)header->rows*header->cols*sizeof(double);
+	if (memcmp( header->magic, magic, sizeof(magic) ) != 0 || header->version != version || header->hash != hash
+		|| (long)header->rows*header->cols != (long)LUTx*LUTy || (size_t)st.st_size != bytes){
+		MsgLog(logger, warning, "'" << filename << "' is not a lookup table for this geometry, rebuilding it");
+	}else{
+		const double *values = reinterpret_cast<const double*>( header + 1 );
+		table = new array2D<double>( header->rows, header->cols );
+		for (unsigned int i = 0; i < header->rows; i++){
+			for (unsigned int j = 0; j < header->cols; j++){
+				table->set( i, j, values[(size_t)i*header->cols + j] );
+			}
+		}
+	}
+	munmap( map, st.st_size );
+	return table;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+LookupTableCache::save( const string &filename, const array2D<double> *table, unsigned long hash ) const
+{
+	LutHeader header;
+	memset( &header, 0, sizeof(header) );
+	memcpy( header.magic, magic, sizeof(magic) );
+	header.version = version;
+	header.rows = table->dim1();
+	header.cols = table->dim2();
+	header.hash = hash;
+
+	//write to a temporary file, then rename, so that readers only see complete tables
+	std::ostringstream tmp;
+	tmp << filename << ".tmp" << getpid();
+	FILE *f = fopen( tmp.str().c_str(), "wb" );
+	if (!f){
+		MsgLog(logger, warning, "could not write lookup table to '" << filename << "'");
+		return 1;
+	}
+	bool ok = (fwrite( &header, sizeof(header), 1, f ) == 1);
+	vector<double> row( header.cols );
+	for (unsigned int i = 0; ok && i < header.rows; i++){
+		for (unsigned int j = 0; j < header.cols; j++){
+			row[j] = table->get( i, j );
+		}
+		ok = (fwrite( &row[0], sizeof(double), header.cols, f ) == header.cols);
+	}
+	ok = (fclose( f ) == 0) && ok;
+	if (!ok || rename( tmp.str().c_str(), filename.c_str() ) != 0){
+		MsgLog(logger, warning, "could not write lookup table to '" << filename << "'");
+		remove( tmp.str().c_str() );
+		return 1;
+	}
+	MsgLog(logger, info, "lookup table written to '" << filename << "'");
+	return 0;
+}
+
+
+} // namespace kitty
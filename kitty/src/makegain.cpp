@@ -19,6 +19,8 @@
 // C/C++ Headers --
 //-----------------
 #include <cmath>
+#include <algorithm>
+#include <vector>
 
 //-------------------------------
 // Collaborating Class Headers --
@@ -29,9 +31,8 @@
 #include "kitty/constants.h"
 #include "kitty/util.h"
 using ns_cspad_util::create1DFromRawImageCSPAD;
-using ns_cspad_util::createAssembledImageCSPAD;
 using ns_cspad_util::createRawImageCSPAD;
-#include "kitty/crosscorrelator.h"
+#include "kitty/radialintegrator.h"
 
 
 //-----------------------------------------------------------------------
@@ -53,8 +54,21 @@ namespace kitty {
 //----------------
 makegain::makegain (const std::string& name)
 	: Module(name)
+	, p_gainMethod(0)
 	, p_model_fn("")
 	, p_modelDelta(0.)
+	, p_saxsBins(0)
+	, p_saxsStartQ(0.)
+	, p_saxsStopQ(0.)
+	, p_saxsBinning(0)
+	, p_histogramMinADU(0.)
+	, p_histogramBinWidth(0.)
+	, p_histogramBins(0)
+	, p_photonMinSeparation(0.)
+	, p_photonMinCounts(0)
+	, p_nThreads(1)
+	, p_histogram()
+	, p_pool()
 	, p_outputPrefix("")
 	, io(0)
 	, p_model(0)
@@ -62,14 +76,34 @@ makegain::makegain (const std::string& name)
 	, p_pixY_q_sp()
 	, p_pixX_int_sp()
 	, p_pixY_int_sp()
-	, p_sum_sp()
+	, p_geometryGeneration(0)
+	, p_stage("")
+	, p_acc_sp()
+	, p_checkpoint()
+	, p_checkpointEvents(0)
+	, p_checkpointSeconds(0)
+	, p_resume(0)
 	, p_count(0)
 {
+	p_gainMethod			= config   ("gainMethod",				0);
 	p_model_fn				= configStr("model", 					"");
 	p_modelDelta			= config   ("modelDelta",				1.);
+	p_saxsBins				= config   ("saxsBins",					500);
+	p_saxsStartQ			= config   ("saxsStartQ",				0.);
+	p_saxsStopQ				= config   ("saxsStopQ",				1000.);
+	p_saxsBinning			= config   ("saxsBinning",				0);
+	p_histogramMinADU		= config   ("histogramMinADU",			-50.);
+	p_histogramBinWidth		= config   ("histogramBinWidth",		1.);
+	p_histogramBins			= config   ("histogramBins",			250);
+	p_photonMinSeparation	= config   ("photonMinSeparation",		15.);
+	p_photonMinCounts		= config   ("photonMinCounts",			20);
+	p_nThreads				= config   ("nThreads",					1);
+	p_stage					= configStr("accumulateStage",			STAGE_CORRECTED);
+	p_checkpointEvents		= config   ("checkpointEvents",			0);
+	p_checkpointSeconds		= config   ("checkpointSeconds",		0);
+	p_resume				= config   ("resume",						0);
 		
 	io = new arraydataIO();
-	p_sum_sp = shared_ptr<array1D<double> >( new array1D<double>(nMaxTotalPx) );
 }
 
 //--------------
@@ -88,8 +122,36 @@ void
 makegain::beginJob(Event& evt, Env& env)
 {
 	MsgLog(name(), debug, "beginJob()" );
+	MsgLog(name(), info, "gainMethod = '" << p_gainMethod << "'" );
 	MsgLog(name(), info, "model file = '" << p_model_fn << "'" );
 	MsgLog(name(), info, "model delta = '" << p_modelDelta << "'" );
+	MsgLog(name(), info, "saxsBins = '" << p_saxsBins << "'" );
+	MsgLog(name(), info, "saxsStartQ = '" << p_saxsStartQ << "'" );
+	MsgLog(name(), info, "saxsStopQ = '" << p_saxsStopQ << "'" );
+	MsgLog(name(), info, "saxsBinning = '" << p_saxsBinning << "'" );
+	MsgLog(name(), info, "histogramMinADU = '" << p_histogramMinADU << "'" );
+	MsgLog(name(), info, "histogramBinWidth = '" << p_histogramBinWidth << "'" );
+	MsgLog(name(), info, "histogramBins = '" << p_histogramBins << "'" );
+	MsgLog(name(), info, "photonMinSeparation = '" << p_photonMinSeparation << "'" );
+	MsgLog(name(), info, "photonMinCounts = '" << p_photonMinCounts << "'" );
+	MsgLog(name(), info, "nThreads = '" << p_nThreads << "'" );
+	MsgLog(name(), info, "accumulateStage = '" << p_stage << "'" );
+	MsgLog(name(), info, "checkpointEvents = '" << p_checkpointEvents << "'" );
+	MsgLog(name(), info, "checkpointSeconds = '" << p_checkpointSeconds << "'" );
+	MsgLog(name(), info, "resume = '" << p_resume << "'" );
+	
+	p_acc_sp = AccumulatorService::instance().subscribe( name(), p_stage );
+	
+	//single-photon peaks need no model, only the histograms
+	if (p_gainMethod == 1){
+		p_pool.create( p_nThreads );
+		if ( p_histogram.create( nMaxTotalPx, p_histogramMinADU, p_histogramBinWidth, p_histogramBins ) ){
+			MsgLog(name(), error, "Could not create the pixel histograms, falling back to the model." );
+			p_gainMethod = 0;
+		}else{
+			return;
+		}
+	}
 	
 	if (p_model_fn != ""){
 		int fail = io->readFromASCII( p_model_fn, p_model );
@@ -118,8 +180,16 @@ makegain::beginRun(Event& evt, Env& env)
 	p_pixY_q_sp = evt.get(IDSTRING_PX_Y_q);
 	p_pixX_int_sp = evt.get(IDSTRING_PX_X_int);
 	p_pixY_int_sp = evt.get(IDSTRING_PX_Y_int);
+	shared_ptr<int> generation_sp = evt.get(IDSTRING_GEOMETRY_GENERATION);
+	p_geometryGeneration = generation_sp ? *generation_sp : 0;
 	
 	p_outputPrefix = *( (shared_ptr<std::string>) evt.get(IDSTRING_OUTPUT_PREFIX) ).get();
+	
+	//all subscribers of a stage use the same file, so each checkpoint is written only once
+	p_checkpoint.configure( p_outputPrefix+"_checkpoint_"+p_stage+".bin", p_checkpointEvents, p_checkpointSeconds );
+	if (p_resume){
+		AccumulatorService::instance().resume( p_stage, p_checkpoint.filename() );
+	}
 }
 
 
@@ -140,10 +210,20 @@ makegain::event(Event& evt, Env& env)
 {
 	MsgLog(name(), debug, "event()" );
 	shared_ptr<array1D<double> > data_sp = evt.get(IDSTRING_CSPAD_DATA);
+	string eventname_str = *( (shared_ptr<string>) evt.get(IDSTRING_CUSTOM_EVENTNAME) ).get();
 	
 	if (data_sp){
-		p_sum_sp->addArrayElementwise( data_sp.get() );	
+		// the raw stage is fed by kitty.discriminate only, this module's data is already corrected
+		if (p_stage != STAGE_RAW){
+			AccumulatorService::instance().accumulate( p_stage, eventname_str, data_sp.get() );
+		}
+		if (p_gainMethod == 1){
+			p_histogram.add( data_sp.get(), p_pool );
+		}
 		p_count++;
+		if (p_checkpoint.due( p_count )){
+			AccumulatorService::instance().checkpoint( p_stage, p_checkpoint.filename(), eventname_str );
+		}
 	}else{
 		MsgLog(name(), warning, "could not get CSPAD data" );
 	}
@@ -174,24 +254,29 @@ void
 makegain::endJob(Event& evt, Env& env)
 {
 	MsgLog(name(), debug, "endJob()" );
+	
+	if (p_gainMethod == 1){
+		writePhotonGain();
+		return;
+	}
 
 	//create average out of raw sum
-	p_sum_sp->divideByValue( p_count );
-	
-	//find out maximum of angular average (by using that function from cross correlator)
-	int nPhi = 1024;
-	int nQ1 = 500;
-	int startQ = 0;
-	int stopQ = 1000;
-	
-	CrossCorrelator *cc = new CrossCorrelator( p_sum_sp.get(), p_pixX_int_sp.get(), p_pixY_int_sp.get(), nPhi, nQ1 );
-	cc->calculatePolarCoordinates(startQ, stopQ);
+	shared_ptr<array1D<double> > avg_sp = p_acc_sp->mean();
 	
-	array1D<double> *SAXS = 0;
-	cc->polar()->calcAvgCol( SAXS );
+	//find out maximum of angular average (in detector pixels, one pass over the average)
+	RadialIntegrator saxs;
+	array1D<double> *SAXS = new array1D<double>( p_saxsBins );
+	array1D<double> *saxsQ = new array1D<double>( p_saxsBins );
+	if ( saxs.create( p_pixX_int_sp.get(), p_pixY_int_sp.get(), 0, p_saxsBins, p_saxsStartQ, p_saxsStopQ, p_saxsBinning, 0, 1 )
+		|| saxs.integrate( avg_sp.get(), saxsQ, SAXS ) ){
+		MsgLog(name(), error, "Could not calculate the angular average. Aborting...");
+		delete SAXS;
+		delete saxsQ;
+		return;
+	}
 	
 	io->writeToHDF5( p_outputPrefix+"_saxs_1D.h5", SAXS );
-	io->writeToHDF5( p_outputPrefix+"_saxs_2D.h5", cc->polar() );
+	io->writeToHDF5( p_outputPrefix+"_saxs_q.h5", saxsQ );
 	double datamax = SAXS->calcMax();
 	
 	//scale model to the intensity found in the scattering data
@@ -206,58 +291,127 @@ makegain::endJob(Event& evt, Env& env)
 	}
 	io->writeToHDF5( p_outputPrefix+"_model_1D.h5", p_model );
 	
+	//expected signal: the model, linearly interpolated at each pixel's |q|, and the gain from the
+	//discrepancy, in one pass over the pixels
+	//pixels beyond the model's range (or where it is not positive) keep a gain of 1
+	const unsigned int n = avg_sp->size();
+	const int nModel = p_model->size();
+	const double *qx = p_pixX_q_sp->data();
+	const double *qy = p_pixY_q_sp->data();
+	const double *avg = avg_sp->data();
+	const double *model = p_model->data();
+	const double invDelta = 1./p_modelDelta;
 	array1D<double> *gain = new array1D<double>(nMaxTotalPx);
 	array1D<double> *expected = new array1D<double>(nMaxTotalPx);
+	double *g = gain->data();
+	double *e = expected->data();
+	unsigned int nOutside = 0;
+	for (unsigned int i = 0; i < n; i++){
+		const double x = sqrt( qx[i]*qx[i] + qy[i]*qy[i] ) * invDelta;
+		const int k = (int)x;
+		if (k < nModel-1){
+			const double f = x - k;
+			e[i] = (1-f)*model[k] + f*model[k+1];
+		}else{
+			e[i] = (k == nModel-1 && x == k) ? model[k] : 0;
+		}
+		if (e[i] > 0){
+			g[i] = avg[i] / e[i];
+		}else{
+			g[i] = 1;
+			nOutside++;
+		}
+	}
+	if (nOutside){
+		MsgLog(name(), warning, nOutside << " pixels outside the range of the model (|q| > " << (nModel-1)*p_modelDelta 
+			<< ") or with a model value <= 0, their gain is 1" );
+	}
 	
-	//calculate the expected signal for each q-value
-	//and create a gainmap from the discrepancy
-	for (unsigned int i=0; i < p_sum_sp->size(); i++){
-		//find absolute q-value for this data point
-		double qx = p_pixX_q_sp->get(i);
-		double qy = p_pixY_q_sp->get(i);
-		double q_abs = sqrt( qx*qx + qy*qy );
-		//compare to model
-		int q_model_index = (int) floor( q_abs/p_modelDelta ); 
-		double correction = p_sum_sp->get(i) / p_model->get(q_model_index);
-		gain->set(i, correction);
-		
-		expected->set(i, p_model->get(q_model_index));
-		if (i > 10000 && i < 10010){
-			cout << "example: i=" << i << ", qx=" << qx << ", qy=" << qy << ", |q|=" << q_abs 
-				<< ", avg_sp(i)=" << p_sum_sp->get(i) << endl;
-			cout << "   model index=" << q_model_index << ", p_model->get(index)=" << p_model->get(q_model_index) 
-				<< ", correction=" << correction << endl;
+	writeImages( expected, "_model" );
+	writeImages( gain, "_gain" );
+	
+	delete SAXS;
+	delete saxsQ;
+	delete gain;
+	delete expected;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+makegain::writeImages( array1D<double> *data, const std::string &suffix )
+{
+	array2D<double> *raw2D = 0;
+	createRawImageCSPAD( data, raw2D );
+	io->writeToHDF5( p_outputPrefix+suffix+"_raw2D.h5", raw2D );
+	delete raw2D;
+	
+	//the assembled image comes from the plan shared with all modules that assemble at full resolution
+	AssemblyPlanBuilder builder;
+	builder.pixX = p_pixX_int_sp.get();
+	builder.pixY = p_pixY_int_sp.get();
+	builder.binning = 1;
+	GeometryKey key( "assemblyPlan" );
+	key.input( "geometry", p_geometryGeneration );
+	key.parameter( "binning", 1 );
+	shared_ptr<AssemblyPlan> plan_sp = GeometryCache::instance().get( key, builder );
+	array2D<double> *asm2D = 0;
+	array1D<double> *profile = 0;
+	if ( !plan_sp || plan_sp->apply( data, asm2D, profile ) ){
+		MsgLog(name(), warning, "could not assemble " << p_outputPrefix+suffix+"_asm2D.h5" );
+	}else{
+		io->writeToHDF5( p_outputPrefix+suffix+"_asm2D.h5", asm2D );
+	}
+	delete asm2D;
+	delete profile;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+makegain::writePhotonGain()
+{
+	if ( p_histogram.count() == 0 ){
+		MsgLog(name(), warning, "No events. No gain map from photon peaks possible." );
+		return;
+	}
+	MsgLog(name(), info, p_histogram.count() << " events in the pixel histograms, " << p_histogram.outside() 
+		<< " values outside the window, " << p_histogram.halved() << " histograms halved because a bin was full" );
+	
+	array1D<double> *offset = new array1D<double>(nMaxTotalPx);
+	array1D<double> *photonGain = new array1D<double>(nMaxTotalPx);
+	int nFound = p_histogram.fit( p_photonMinSeparation, p_photonMinCounts, offset, photonGain, p_pool );
+	MsgLog(name(), info, "found zero- and one-photon peaks in " << nFound << " of " << nMaxTotalPx << " pixels" );
+	
+	//gain relative to the median ADU per photon, so that kitty.correct can divide by it,
+	//pixels without a one-photon peak keep a gain of 1
+	std::vector<double> fitted;
+	fitted.reserve( nFound );
+	for (unsigned int i = 0; i < photonGain->size(); i++){
+		if (photonGain->get(i) > 0){
+			fitted.push_back( photonGain->get(i) );
 		}
 	}
+	double median = 0;
+	if (!fitted.empty()){
+		std::nth_element( fitted.begin(), fitted.begin() + fitted.size()/2, fitted.end() );
+		median = fitted[fitted.size()/2];
+	}
+	MsgLog(name(), info, "median one-photon signal: " << median << " ADU" );
 	
+	array1D<double> *gain = new array1D<double>(nMaxTotalPx);
+	for (unsigned int i = 0; i < gain->size(); i++){
+		gain->set( i, (median > 0 && photonGain->get(i) > 0) ? photonGain->get(i)/median : 1. );
+	}
+	MsgLog(name(), info, "---histogram of relative gain---\n" << gain->getHistogramInBoundariesASCII(50, 0, 2) );
 	
-	//----------------------------model output
-	array2D<double> *model_raw2D = 0;
-	createRawImageCSPAD( expected, model_raw2D );
-	io->writeToHDF5( p_outputPrefix+"_model_raw2D.h5", model_raw2D );
-
-	//assemble ASICs
-	array2D<double> *model_asm2D = 0;
-	createAssembledImageCSPAD( expected, p_pixX_int_sp.get(), p_pixY_int_sp.get(), model_asm2D );	
-	io->writeToHDF5( p_outputPrefix+"_model_asm2D.h5", model_asm2D );	
+	writeImages( offset, "_offset" );
+	writeImages( photonGain, "_photongain" );
+	writeImages( gain, "_gain" );
 	
-	//----------------------------gain output
-	array2D<double> *gain_raw2D = 0;
-	createRawImageCSPAD( gain, gain_raw2D );
-	io->writeToHDF5( p_outputPrefix+"_gain_raw2D.h5", gain_raw2D );
-
-	//assemble ASICs
-	array2D<double> *gain_asm2D = 0;
-	createAssembledImageCSPAD( gain, p_pixX_int_sp.get(), p_pixY_int_sp.get(), gain_asm2D );
-	io->writeToHDF5( p_outputPrefix+"_gain_asm2D.h5", gain_asm2D );
-
-	delete model_raw2D;
-	delete model_asm2D;
-	delete gain_raw2D;
-	delete gain_asm2D;
-	delete cc;	
+	delete offset;
+	delete photonGain;
 	delete gain;
-	delete expected;
 }
 
 
@@ -18,6 +18,8 @@
 //-----------------
 // C/C++ Headers --
 //-----------------
+#include <cstdlib>
+#include <sstream>
 
 //-------------------------------
 // Collaborating Class Headers --
@@ -25,9 +27,9 @@
 #include "MsgLogger/MsgLogger.h"
 #include "PSEvt/EventId.h"
 
+#include "kitty/calibrationfile.h"
 #include "kitty/constants.h"
 #include "kitty/util.h"
-using ns_cspad_util::create1DFromRawImageCSPAD;
 using ns_cspad_util::createAssembledImageCSPAD;
 using ns_cspad_util::createRawImageCSPAD;
 
@@ -57,29 +59,62 @@ makemask::makemask (const std::string& name)
 	: Module(name)
 	, p_badPixelLowerBoundary(0)
 	, p_badPixelUpperBoundary(0)
+	, p_deadPixelMaxStdDev(0)
+	, p_noisyPixelMinStdDev(0)
 	, p_outputPrefix("")
 	, p_mask_fn("")
 	, p_useMask(0)
 	, p_takeOutThirteenthRow(0)
 	, p_takeOutASICFrame(0)
 	, p_takeOutWholeSection(-1)
+	, p_robustBadPixels(0)
+	, p_badPixelNMAD(0)
+	, p_hotPixelThreshold(0)
+	, p_hotPixelMinFraction(0)
+	, p_stuckPixelTolerance(0)
+	, p_stuckPixelMinEvents(0)
+	, p_finder()
+	, p_finderCheckpoint()
+	, p_resumeEvent(-1)
 	, io(0)
 	, p_mask(0)
-	, p_sum_sp()
+	, p_stage("")
+	, p_acc_sp()
+	, p_checkpoint()
+	, p_checkpointEvents(0)
+	, p_checkpointSeconds(0)
+	, p_resume(0)
+	, p_hitThreshold(0)
+	, p_hitMaxFraction(0)
+	, p_mergeCheckpoints("")
 	, p_count(0)
 {
   // get the values from configuration or use defaults
 	
 	p_badPixelLowerBoundary	= config   ("badPixelLowerBoundary", 	0);
 	p_badPixelUpperBoundary	= config   ("badPixelUpperBoundary", 	1500);
+	p_deadPixelMaxStdDev	= config   ("deadPixelMaxStdDev", 		0);
+	p_noisyPixelMinStdDev	= config   ("noisyPixelMinStdDev", 		0);
 	p_mask_fn				= configStr("mask", 					"");
 	p_useMask				= config   ("useMask", 					0);
 	p_takeOutThirteenthRow	= config   ("takeOutThirteenthRow", 	1);
 	p_takeOutASICFrame		= config   ("takeOutASICFrame", 		1);
 	p_takeOutWholeSection		= config   ("takeOutWholeSection", 		-1);
+	p_robustBadPixels		= config   ("robustBadPixels",			0);
+	p_badPixelNMAD			= config   ("badPixelNMAD",				5.);
+	p_hotPixelThreshold		= config   ("hotPixelThreshold",		0.);
+	p_hotPixelMinFraction	= config   ("hotPixelMinFraction",		0.01);
+	p_stuckPixelTolerance	= config   ("stuckPixelTolerance",		0.);
+	p_stuckPixelMinEvents	= config   ("stuckPixelMinEvents",		10);
+	p_stage					= configStr("accumulateStage",			STAGE_CORRECTED);
+	p_checkpointEvents		= config   ("checkpointEvents",			0);
+	p_checkpointSeconds		= config   ("checkpointSeconds",		0);
+	p_resume				= config   ("resume",						0);
+	p_hitThreshold			= config   ("hitThreshold",				0.);
+	p_hitMaxFraction		= config   ("hitMaxFraction",			0.);
+	p_mergeCheckpoints		= configStr("mergeCheckpoints",			"");
 			
 	io = new arraydataIO();
-	p_sum_sp = shared_ptr<array1D<double> >( new array1D<double>(nMaxTotalPx) );
 }
 
 //--------------
@@ -100,22 +135,42 @@ makemask::beginJob(Event& evt, Env& env)
 	MsgLog(name(), debug, "beginJob()" );
 	MsgLog(name(), info, "badPixelLowerBoundary = '" << p_badPixelLowerBoundary << "'" );	
 	MsgLog(name(), info, "badPixelUpperBoundary = '" << p_badPixelUpperBoundary << "'" );
+	MsgLog(name(), info, "deadPixelMaxStdDev = '" << p_deadPixelMaxStdDev << "'" );
+	MsgLog(name(), info, "noisyPixelMinStdDev = '" << p_noisyPixelMinStdDev << "'" );
 	MsgLog(name(), info, "mask file = '" << p_mask_fn << "'" );
 	MsgLog(name(), info, "use mask correction = '" << p_useMask << "'" );
 	MsgLog(name(), info, "takeOutThirteenthRow = '" << p_takeOutThirteenthRow << "'" );
 	MsgLog(name(), info, "takeOutASICFrame = '" << p_takeOutASICFrame << "'" );
+	MsgLog(name(), info, "robustBadPixels = '" << p_robustBadPixels << "'" );
+	MsgLog(name(), info, "badPixelNMAD = '" << p_badPixelNMAD << "'" );
+	MsgLog(name(), info, "hotPixelThreshold = '" << p_hotPixelThreshold << "'" );
+	MsgLog(name(), info, "hotPixelMinFraction = '" << p_hotPixelMinFraction << "'" );
+	MsgLog(name(), info, "stuckPixelTolerance = '" << p_stuckPixelTolerance << "'" );
+	MsgLog(name(), info, "stuckPixelMinEvents = '" << p_stuckPixelMinEvents << "'" );
+	MsgLog(name(), info, "accumulateStage = '" << p_stage << "'" );
+	MsgLog(name(), info, "checkpointEvents = '" << p_checkpointEvents << "'" );
+	MsgLog(name(), info, "checkpointSeconds = '" << p_checkpointSeconds << "'" );
+	MsgLog(name(), info, "resume = '" << p_resume << "'" );
+	MsgLog(name(), info, "hitThreshold = '" << p_hitThreshold << "'" );
+	MsgLog(name(), info, "hitMaxFraction = '" << p_hitMaxFraction << "'" );
+	MsgLog(name(), info, "mergeCheckpoints = '" << p_mergeCheckpoints << "'" );
+	
+	p_acc_sp = AccumulatorService::instance().subscribe( name(), p_stage );
+	if (p_hitThreshold > 0){
+		p_acc_sp->setThreshold( p_hitThreshold );
+	}
+	if (p_robustBadPixels){
+		p_finder.create( nMaxTotalPx, p_hotPixelThreshold, p_stuckPixelTolerance );
+	}
 
 	//read mask, if a file was specified
 	if (p_useMask){
 		if (p_mask_fn != ""){
 			delete p_mask;
 			p_mask = new array1D<double>;
-						
-			array2D<double> *img2D = 0;
-			int fail = io->readFromFile( p_mask_fn, img2D );
-			create1DFromRawImageCSPAD( img2D, p_mask );
-			delete img2D;
 			
+			//kitty calibration file or raw 2D image
+			int fail = CalibrationFile::load( p_mask_fn, p_mask, io );
 			
 			MsgLog(name(), info, "histogram of mask read\n" << p_mask->getHistogramASCII(2) );
 			if (fail){
@@ -138,6 +193,23 @@ makemask::beginRun(Event& evt, Env& env)
 	MsgLog(name(), debug,  "beginRun()" );
 	
 	p_outputPrefix = *( (shared_ptr<std::string>) evt.get(IDSTRING_OUTPUT_PREFIX) ).get();
+	
+	//all subscribers of a stage use the same file, so each checkpoint is written only once
+	p_checkpoint.configure( p_outputPrefix+"_checkpoint_"+p_stage+".bin", p_checkpointEvents, p_checkpointSeconds );
+	if (p_resume){
+		AccumulatorService::instance().resume( p_stage, p_checkpoint.filename() );
+	}
+	
+	//the bad pixel counters are this module's own, they go to a file of their own
+	p_finderCheckpoint.configure( p_outputPrefix+"_checkpoint_"+name()+".bin", 0, 0 );
+	if (p_resume && p_robustBadPixels && p_resumeEvent < 0){
+		if ( p_finderCheckpoint.load() || p_finder.restore( p_finderCheckpoint, "badpix_" ) ){
+			MsgLog(name(), warning, "could not resume the bad pixel counters from '" << p_finderCheckpoint.filename() << "', starting from scratch");
+		}else{
+			p_resumeEvent = p_finderCheckpoint.lastEvent();
+			MsgLog(name(), info, "bad pixel counters resumed with " << p_finder.count() << " events");
+		}
+	}
 }
 
 
@@ -158,10 +230,25 @@ makemask::event(Event& evt, Env& env)
 {
 	MsgLog(name(), debug,  "event()" );
 	shared_ptr<array1D<double> > data_sp = evt.get(IDSTRING_CSPAD_DATA);
+	string eventname_str = *( (shared_ptr<string>) evt.get(IDSTRING_CUSTOM_EVENTNAME) ).get();
 	
 	if (data_sp){
-		p_sum_sp->addArrayElementwise( data_sp.get() );	
+		// the raw stage is fed by kitty.discriminate only, this module's data is already corrected
+		if (p_stage != STAGE_RAW){
+			AccumulatorService::instance().accumulate( p_stage, eventname_str, data_sp.get() );
+		}
+		if (p_robustBadPixels && atoi(eventname_str.c_str()) > p_resumeEvent){
+			p_finder.add( data_sp.get() );
+		}
 		p_count++;
+		if (p_checkpoint.due( p_count )){
+			AccumulatorService::instance().checkpoint( p_stage, p_checkpoint.filename(), eventname_str );
+			if (p_robustBadPixels){
+				p_finderCheckpoint.begin( atoi(eventname_str.c_str()) );
+				p_finder.save( p_finderCheckpoint, "badpix_" );
+				p_finderCheckpoint.commit();
+			}
+		}
 	}
 }
   
@@ -198,25 +285,101 @@ makemask::endJob(Event& evt, Env& env)
 	}else{
 		//allocate a mask. Initially, all pixels are GOOD
 		mask = new array1D<double>( nMaxTotalPx );
-		for (unsigned int i = 0; i<p_sum_sp->size(); i++){
+		for (unsigned int i = 0; i<mask->size(); i++){
 			mask->set(i, GOOD);
 		}
 	}
 
-	if ( p_count != 0 ){	
+	//partial results of other jobs (e.g. other parts of the run), combined exactly with this job's
+	std::istringstream merge_iss( p_mergeCheckpoints );
+	string merge_fn;
+	while (merge_iss >> merge_fn){
+		AccumulatorService::instance().merge( p_stage, merge_fn );
+	}
+
+	if ( p_acc_sp->count() != 0 ){	
 		//create average out of raw sum
-		p_sum_sp->divideByValue( p_count );
+		shared_ptr<array1D<double> > avg_sp = p_acc_sp->mean();
 
-		//	MsgLog(name(), info, "---complete histogram of averaged data---\n" << p_sum_sp->getHistogramASCII(50) );
-		MsgLog(name(), info, "---partial histogram of averaged data---\n" << p_sum_sp->getHistogramInBoundariesASCII(100, -100, 400) );
+		//	MsgLog(name(), info, "---complete histogram of averaged data---\n" << avg_sp->getHistogramASCII(50) );
+		MsgLog(name(), info, "---partial histogram of averaged data---\n" << avg_sp->getHistogramInBoundariesASCII(100, -100, 400) );
 			
 		//set mask to 1 if pixel is valid, otherwise, leave 0
-		for (unsigned int i = 0; i<p_sum_sp->size(); i++){
-			if ( (p_sum_sp->get(i) < p_badPixelLowerBoundary) || (p_sum_sp->get(i) > p_badPixelUpperBoundary) ){
+		for (unsigned int i = 0; i<avg_sp->size(); i++){
+			if ( (avg_sp->get(i) < p_badPixelLowerBoundary) || (avg_sp->get(i) > p_badPixelUpperBoundary) ){
 				//pixel seems bad: exclude this pixel
 				mask->set(i, BAD);
 			}
 		}
+		
+		//dead pixels hardly fluctuate, noisy pixels fluctuate too much
+		shared_ptr<array1D<double> > stddev_sp = p_acc_sp->stddev();
+		MsgLog(name(), info, "---histogram of pixel standard deviation---\n" << stddev_sp->getHistogramASCII(50) );
+		if (p_acc_sp->count() > 1 && (p_deadPixelMaxStdDev > 0 || p_noisyPixelMinStdDev > 0)){
+			int nDead = 0;
+			int nNoisy = 0;
+			for (unsigned int i = 0; i<stddev_sp->size(); i++){
+				if ( p_deadPixelMaxStdDev > 0 && stddev_sp->get(i) <= p_deadPixelMaxStdDev ){
+					mask->set(i, BAD);
+					nDead++;
+				}else if ( p_noisyPixelMinStdDev > 0 && stddev_sp->get(i) >= p_noisyPixelMinStdDev ){
+					mask->set(i, BAD);
+					nNoisy++;
+				}
+			}
+			MsgLog(name(), info, "masked " << nDead << " dead and " << nNoisy << " noisy pixels" );
+		}
+		
+		//fraction of the events in which a pixel was above hitThreshold
+		if (p_hitThreshold > 0){
+			shared_ptr<array1D<double> > hits_sp = p_acc_sp->countAbove();
+			hits_sp->divideByValue( p_acc_sp->count() );
+			if (p_hitMaxFraction > 0){
+				int nHot = 0;
+				for (unsigned int i = 0; i<hits_sp->size(); i++){
+					if ( hits_sp->get(i) > p_hitMaxFraction ){
+						mask->set(i, BAD);
+						nHot++;
+					}
+				}
+				MsgLog(name(), info, "masked " << nHot << " pixels above " << p_hitThreshold << " ADU in more than " 
+					<< 100*p_hitMaxFraction << "% of the events" );
+			}
+			array2D<double> *hits2D = 0;
+			createRawImageCSPAD( hits_sp.get(), hits2D );
+			io->writeToFile( p_outputPrefix+"_hits_raw2D.h5", hits2D );
+			delete hits2D;
+		}
+		
+		array2D<double> *stddev2D = 0;
+		createRawImageCSPAD( stddev_sp.get(), stddev2D );
+		io->writeToFile( p_outputPrefix+"_stddev_raw2D.h5", stddev2D );
+		delete stddev2D;
+		
+		//outliers relative to the other pixels of the same ASIC, no thresholds in ADU needed
+		if (p_robustBadPixels && p_finder.count() > 1){
+			array1D<double> *flags = new array1D<double>( nMaxTotalPx );
+			p_finder.classify( stddev_sp.get(), mask, p_badPixelNMAD, p_hotPixelMinFraction, p_stuckPixelMinEvents, flags );
+			int nFlagged[4] = { 0, 0, 0, 0 };
+			for (unsigned int i = 0; i<flags->size(); i++){
+				int f = (int)flags->get(i);
+				if (f){
+					mask->set(i, BAD);
+				}
+				for (int k = 0; k < 4; k++){
+					nFlagged[k] += (f >> k) & 1;
+				}
+			}
+			MsgLog(name(), info, "robust thresholds (" << p_badPixelNMAD << " MAD from the ASIC median) masked "
+				<< nFlagged[0] << " dead, " << nFlagged[1] << " noisy, " << nFlagged[2] << " hot and " << nFlagged[3] << " stuck pixels" );
+			
+			//flags: 1 dead, 2 noisy, 4 hot, 8 stuck
+			array2D<double> *flags2D = 0;
+			createRawImageCSPAD( flags, flags2D );
+			io->writeToFile( p_outputPrefix+"_badpix_raw2D.h5", flags2D );
+			delete flags2D;
+			delete flags;
+		}
 	}else{
 		MsgLog( name(), warning, "No events. No data-dependent masking (thresholding) possible." );
 	}
@@ -0,0 +1,222 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class MaskCorrelation...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/maskcorrelation.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <cmath>
+
+using std::vector;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.MaskCorrelation";
+
+	/// M is a number of bin pairs, the transform only adds rounding noise to it
+	inline double factor( double m, int nPhi ){
+		m = floor( m + 0.5 );
+		return (m > 0) ? nPhi/m : 0;
+	}
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+MaskCorrelation::MaskCorrelation()
+	: p_nQ(0)
+	, p_nPhi(0)
+	, p_nLag(0)
+	, p_generation(-1)
+	, p_factors()
+	, p_spec()
+	, p_ringBins()
+	, p_in(0)
+	, p_out(0)
+	, p_plan(0)
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+MaskCorrelation::~MaskCorrelation()
+{
+	destroy();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+MaskCorrelation::create( const PolarRemap &remap )
+{
+	destroy();
+	const int nQ = remap.nQ();
+	const int nPhi = remap.nPhi();
+	if (nQ <= 0 || nPhi <= 0){
+		MsgLog(logger, error, "polar remap not created");
+		return 1;
+	}
+	p_nQ = nQ;
+	p_nPhi = nPhi;
+	p_nLag = nPhi/2 + 1;
+	p_generation = remap.generation();
+
+	//spectra of the binary ring masks, made only once per geometry, so no measured plans
+	double *mask = (double*) fftw_malloc( sizeof(double)*nPhi );
+	fftw_complex *spec = (fftw_complex*) fftw_malloc( sizeof(fftw_complex)*p_nLag );
+	fftw_plan fwd = fftw_plan_dft_r2c_1d( nPhi, mask, spec, FFTW_ESTIMATE );
+	p_in = (fftw_complex*) fftw_malloc( sizeof(fftw_complex)*p_nLag );
+	p_out = (double*) fftw_malloc( sizeof(double)*nPhi );
+	p_plan = fftw_plan_dft_c2r_1d( nPhi, p_in, p_out, FFTW_ESTIMATE );
+
+	p_spec.assign( 2*nQ*p_nLag, 0. );
+	p_factors.assign( nQ*p_nLag, 0. );
+	p_ringBins.assign( nQ, 0 );
+	unsigned int nPartial = 0;
+	for (int iq = 0; iq < nQ; iq++){
+		for (int iphi = 0; iphi < nPhi; iphi++){
+			mask[iphi] = (remap.binPixels( iq, iphi ) > 0) ? 1. : 0.;
+		}
+		p_ringBins[iq] = remap.ringBins( iq );
+		if (p_ringBins[iq] > 0 && p_ringBins[iq] < nPhi){
+			nPartial++;
+		}
+		fftw_execute( fwd );
+
+		//autocorrelation of the mask: |F(m)|^2 transformed back
+		for (int k = 0; k < p_nLag; k++){
+			p_spec[2*(iq*p_nLag + k)] = spec[k][0];
+			p_spec[2*(iq*p_nLag + k)+1] = spec[k][1];
+			p_in[k][0] = spec[k][0]*spec[k][0] + spec[k][1]*spec[k][1];
+			p_in[k][1] = 0;
+		}
+		fftw_execute( p_plan );
+		for (int lag = 0; lag < p_nLag; lag++){
+			p_factors[iq*p_nLag + lag] = factor( p_out[lag]/nPhi, nPhi );
+		}
+	}
+	fftw_destroy_plan( fwd );
+	fftw_free( mask );
+	fftw_free( spec );
+
+	MsgLog(logger, info, "mask correlation for geometry generation " << p_generation << ": "
+		<< nPartial << " of " << nQ << " rings partially masked");
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+MaskCorrelation::destroy()
+{
+	if (p_plan) fftw_destroy_plan( p_plan );
+	fftw_free( p_in );
+	fftw_free( p_out );
+	p_plan = 0;
+	p_in = 0;
+	p_out = 0;
+	p_factors.clear();
+	p_spec.clear();
+	p_ringBins.clear();
+	p_nQ = 0;
+	p_nPhi = 0;
+	p_nLag = 0;
+	p_generation = -1;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+MaskCorrelation::isCurrent( const PolarRemap &remap ) const
+{
+	return ( p_plan && remap.nQ() == p_nQ && remap.nPhi() == p_nPhi && remap.generation() == p_generation );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+MaskCorrelation::nQ() const
+{
+	return p_nQ;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+MaskCorrelation::nLag() const
+{
+	return p_nLag;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+MaskCorrelation::normalize( array2D<double> *corr, int begin, int end ) const
+{
+	if (!corr || (int)corr->dim1() != p_nQ || (int)corr->dim2() != p_nLag){
+		MsgLog(logger, error, "correlation array does not match the mask correlation (" << p_nQ << " x " << p_nLag << ")");
+		return;
+	}
+	for (int iq = begin; iq < end; iq++){
+		const double *f = &p_factors[iq*p_nLag];
+		for (int lag = 0; lag < p_nLag; lag++){
+			corr->set( iq, lag, corr->get(iq, lag)*f[lag] );
+		}
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+MaskCorrelation::pairFactors( int q1, int q2, double *factors ) const
+{
+	//cross-correlation of the masks: conj(F(m1)) F(m2) transformed back
+	const double *s1 = &p_spec[2*q1*p_nLag];
+	const double *s2 = &p_spec[2*q2*p_nLag];
+	for (int k = 0; k < p_nLag; k++){
+		p_in[k][0] = s1[2*k]*s2[2*k] + s1[2*k+1]*s2[2*k+1];
+		p_in[k][1] = s1[2*k]*s2[2*k+1] - s1[2*k+1]*s2[2*k];
+	}
+	fftw_execute( p_plan );
+	for (int lag = 0; lag < p_nPhi; lag++){
+		factors[lag] = factor( p_out[lag]/p_nPhi, p_nPhi );
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+MaskCorrelation::ringBins( int iq ) const
+{
+	return p_ringBins[iq];
+}
+
+
+} // namespace kitty
@@ -0,0 +1,363 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class PixelHistogram...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/pixelhistogram.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <cmath>
+
+using std::vector;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.PixelHistogram";
+
+	const unsigned short maxCount = 65535;
+
+	/// one event into the histograms of the pixels of one part
+	class FillTask : public kitty::WorkerTask {
+	public:
+		const double *data;
+		unsigned short *counts;
+		unsigned char *shift;
+		unsigned int size;
+		int nBins;
+		double minADU;
+		double invBinWidth;
+		unsigned int event;				// number of events added before this one
+		unsigned long *outside;			// per part
+		unsigned long *halved;			// per part
+
+		virtual void execute( int part, int nParts ){
+			int begin = 0;
+			int end = 0;
+			kitty::WorkerPool::split( size, part, nParts, begin, end );
+			unsigned long out = 0;
+			unsigned long half = 0;
+			for (int i = begin; i < end; i++){
+				const double x = (data[i] - minADU) * invBinWidth;
+				if (!(x >= 0 && x < nBins)){		// also NaN
+					out++;
+					continue;
+				}
+				//a histogram halved s times takes only every 2^s-th event, so all its counts keep the same weight
+				const unsigned int s = shift[i];
+				if (event & ((1u << s) - 1)){
+					continue;
+				}
+				unsigned short *h = counts + (size_t)i*nBins;
+				unsigned short &c = h[(int)x];
+				if (c == maxCount && s < 31){
+					for (int b = 0; b < nBins; b++){
+						h[b] >>= 1;
+					}
+					shift[i]++;
+					half++;
+					if (event & ((2u << s) - 1)){
+						continue;
+					}
+				}
+				if (c < maxCount){
+					c++;
+				}
+			}
+			outside[part] += out;
+			halved[part] += half;
+		}
+	};
+
+	/// peak position with sub-bin precision, from a Gaussian (or a parabola) through the bin and its neighbours
+	double refinePeak( const unsigned short *h, int b, int nBins ){
+		if (b <= 0 || b >= nBins-1){
+			return b;
+		}
+		const double ym = h[b-1];
+		const double y0 = h[b];
+		const double yp = h[b+1];
+		if (ym > 0 && yp > 0){
+			const double lm = std::log( ym );
+			const double l0 = std::log( y0 );
+			const double lp = std::log( yp );
+			const double den = lm - 2*l0 + lp;
+			if (den < 0){
+				return b + 0.5*(lm - lp)/den;
+			}
+		}
+		const double den = ym - 2*y0 + yp;
+		return (den < 0) ? b + 0.5*(ym - yp)/den : b;
+	}
+
+	/// zero- and one-photon peaks of the pixels of one part
+	class FitTask : public kitty::WorkerTask {
+	public:
+		const unsigned short *counts;
+		const unsigned char *shift;
+		unsigned int size;
+		int nBins;
+		double minADU;
+		double binWidth;
+		int minSeparation;				// in bins
+		unsigned int minCounts;
+		double *offset;
+		double *gain;
+		vector<int> *found;				// per part
+
+		virtual void execute( int part, int nParts ){
+			int begin = 0;
+			int end = 0;
+			kitty::WorkerPool::split( size, part, nParts, begin, end );
+			int n = 0;
+			for (int i = begin; i < end; i++){
+				const unsigned short *h = counts + (size_t)i*nBins;
+				const double weight = (double)(1u << shift[i]);		// events per count
+				int zero = 0;
+				for (int b = 1; b < nBins; b++){
+					if (h[b] > h[zero]){
+						zero = b;
+					}
+				}
+				int one = -1;
+				for (int b = zero + minSeparation; b < nBins-1; b++){
+					if (h[b]*weight >= minCounts && h[b] >= h[b-1] && h[b] >= h[b+1] && (one < 0 || h[b] > h[one])){
+						one = b;
+					}
+				}
+				if (h[zero] == 0){
+					offset[i] = 0;
+					gain[i] = 0;
+					continue;
+				}
+				const double zeroPos = refinePeak( h, zero, nBins );
+				offset[i] = minADU + (zeroPos + 0.5)*binWidth;
+				if (one < 0){
+					gain[i] = 0;
+					continue;
+				}
+				gain[i] = (refinePeak( h, one, nBins ) - zeroPos)*binWidth;
+				n++;
+			}
+			(*found)[part] = n;
+		}
+	};
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+PixelHistogram::PixelHistogram()
+	: p_counts()
+	, p_size(0)
+	, p_nBins(0)
+	, p_minADU(0)
+	, p_binWidth(1)
+	, p_count(0)
+	, p_shift()
+	, p_outside()
+	, p_halved()
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+PixelHistogram::~PixelHistogram()
+{
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PixelHistogram::create( unsigned int size, double minADU, double binWidth, int nBins )
+{
+	if (size == 0 || nBins <= 2 || nBins > 65535 || binWidth <= 0){
+		MsgLog(logger, error, "invalid histogram: " << size << " pixels, " << nBins << " bins of width " << binWidth);
+		return 1;
+	}
+	p_counts.clear();
+	p_counts.resize( (size_t)size*nBins, 0 );
+	p_size = size;
+	p_nBins = nBins;
+	p_minADU = minADU;
+	p_binWidth = binWidth;
+	p_count = 0;
+	p_shift.clear();
+	p_shift.resize( size, 0 );
+	p_outside.clear();
+	p_halved.clear();
+	MsgLog(logger, info, "histograms of " << nBins << " bins from " << minADU << " to " << minADU + nBins*binWidth
+		<< " ADU for " << size << " pixels (" << p_counts.size()*sizeof(unsigned short)/1048576 << " MB)");
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+PixelHistogram::isCreated() const
+{
+	return p_size > 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+PixelHistogram::add( const array1D<double> *data, WorkerPool &pool )
+{
+	if (!data || data->size() != p_size){
+		MsgLog(logger, error, "data size does not match, event not added");
+		return;
+	}
+	const unsigned int nParts = pool.nThreads() > 1 ? pool.nThreads() : 1;
+	if (p_outside.size() < nParts){
+		p_outside.resize( nParts, 0 );
+		p_halved.resize( nParts, 0 );
+	}
+	FillTask task;
+	task.data = data->data();
+	task.counts = &p_counts[0];
+	task.shift = &p_shift[0];
+	task.size = p_size;
+	task.nBins = p_nBins;
+	task.minADU = p_minADU;
+	task.invBinWidth = 1./p_binWidth;
+	task.event = p_count;
+	task.outside = &p_outside[0];
+	task.halved = &p_halved[0];
+	pool.run( task );
+	p_count++;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+PixelHistogram::count() const
+{
+	return p_count;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned long
+PixelHistogram::outside() const
+{
+	unsigned long sum = 0;
+	for (unsigned int i = 0; i < p_outside.size(); i++){
+		sum += p_outside[i];
+	}
+	return sum;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned long
+PixelHistogram::halved() const
+{
+	unsigned long sum = 0;
+	for (unsigned int i = 0; i < p_halved.size(); i++){
+		sum += p_halved[i];
+	}
+	return sum;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PixelHistogram::fit( double minSeparation, unsigned int minCounts, array1D<double> *offset, array1D<double> *gain, WorkerPool &pool ) const
+{
+	if (!isCreated() || !offset || !gain || offset->size() != p_size || gain->size() != p_size){
+		MsgLog(logger, error, "cannot fit, histograms not created or sizes do not match");
+		return 0;
+	}
+	const int nParts = pool.nThreads() > 1 ? pool.nThreads() : 1;
+	vector<int> found( nParts, 0 );
+	FitTask task;
+	task.counts = &p_counts[0];
+	task.shift = &p_shift[0];
+	task.size = p_size;
+	task.nBins = p_nBins;
+	task.minADU = p_minADU;
+	task.binWidth = p_binWidth;
+	task.minSeparation = (int)std::ceil( minSeparation/p_binWidth );
+	if (task.minSeparation < 2){
+		task.minSeparation = 2;				// the neighbours of the zero-photon peak are part of it
+	}
+	task.minCounts = minCounts ? minCounts : 1;
+	task.offset = offset->data();
+	task.gain = gain->data();
+	task.found = &found;
+	pool.run( task );
+
+	int n = 0;
+	for (int part = 0; part < nParts; part++){
+		n += found[part];
+	}
+	return n;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+PixelHistogram::pixel( unsigned int i, array1D<double> *histogram ) const
+{
+	if (i >= p_size || !histogram || histogram->size() != (unsigned int)p_nBins){
+		MsgLog(logger, error, "cannot get histogram of pixel " << i);
+		return;
+	}
+	const double weight = (double)(1u << p_shift[i]);
+	for (int b = 0; b < p_nBins; b++){
+		histogram->set( b, p_counts[(size_t)i*p_nBins + b]*weight );
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+PixelHistogram::size() const
+{
+	return p_size;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PixelHistogram::nBins() const
+{
+	return p_nBins;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+double
+PixelHistogram::binCenter( double bin ) const
+{
+	return p_minADU + (bin + 0.5)*p_binWidth;
+}
+
+
+} // namespace kitty
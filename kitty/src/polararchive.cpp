@@ -0,0 +1,676 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class PolarArchive...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/polararchive.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+using std::string;
+using std::vector;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.PolarArchive";
+
+	/// IEEE half precision, converted from and to float by the HDF5 library
+	hid_t createHalfType(){
+		hid_t type = H5Tcopy( H5T_IEEE_F32LE );
+		H5Tset_fields( type, 15, 10, 5, 0, 10 );
+		H5Tset_size( type, 2 );
+		H5Tset_ebias( type, 15 );
+		return type;
+	}
+
+	string geometryGroup( int generation ){
+		std::ostringstream osst;
+		osst << "geometry_" << generation;
+		return osst.str();
+	}
+
+	/// dataset access with a chunk cache that holds at least two chunks of 'chunkBytes',
+	/// so that appending or reading event by event does not recompress a chunk for every event
+	hid_t createChunkCacheAccess( size_t chunkBytes ){
+		const size_t defaultBytes = 1048576;
+		hid_t plist = H5Pcreate( H5P_DATASET_ACCESS );
+		H5Pset_chunk_cache( plist, 521, std::max( 2*chunkBytes, defaultBytes ), 1.0 );
+		return plist;
+	}
+
+	int writeVector( hid_t group, const char *name, const array1D<double> *vec ){
+		if (!vec){
+			return 0;
+		}
+		hsize_t dims[1] = {vec->size()};
+		hid_t space = H5Screate_simple( 1, dims, NULL );
+		hid_t dataset = H5Dcreate2( group, name, H5T_NATIVE_DOUBLE, space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
+		herr_t status = H5Dwrite( dataset, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, vec->data() );
+		H5Dclose( dataset );
+		H5Sclose( space );
+		return (status < 0);
+	}
+
+	/// vector 'name' of 'group' into a new array, 0 if there is no such dataset
+	array1D<double>* readVector( hid_t group, const char *name ){
+		if (H5Lexists( group, name, H5P_DEFAULT ) <= 0){
+			return 0;
+		}
+		hid_t dataset = H5Dopen2( group, name, H5P_DEFAULT );
+		hid_t space = H5Dget_space( dataset );
+		hsize_t n = H5Sget_simple_extent_npoints( space );
+		array1D<double> *vec = new array1D<double>( n );
+		herr_t status = H5Dread( dataset, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, vec->data() );
+		H5Sclose( space );
+		H5Dclose( dataset );
+		if (status < 0){
+			delete vec;
+			return 0;
+		}
+		return vec;
+	}
+
+	/// strings as one fixed-length string dataset
+	int writeStrings( hid_t file, const char *name, const vector<string> &strings ){
+		size_t length = 1;
+		for (unsigned int i = 0; i < strings.size(); i++){
+			length = std::max( length, strings[i].size()+1 );
+		}
+		vector<char> buffer( std::max(strings.size(), (size_t)1)*length, 0 );
+		for (unsigned int i = 0; i < strings.size(); i++){
+			memcpy( &buffer[i*length], strings[i].c_str(), strings[i].size() );
+		}
+		hid_t type = H5Tcopy( H5T_C_S1 );
+		H5Tset_size( type, length );
+		hsize_t dims[1] = {strings.size()};
+		hid_t space = H5Screate_simple( 1, dims, NULL );
+		hid_t dataset = H5Dcreate2( file, name, type, space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
+		herr_t status = (strings.size() > 0) ? H5Dwrite( dataset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, &buffer[0] ) : 0;
+		H5Dclose( dataset );
+		H5Sclose( space );
+		H5Tclose( type );
+		return (dataset < 0 || status < 0);
+	}
+
+	int readStrings( hid_t file, const char *name, vector<string> &strings ){
+		strings.clear();
+		hid_t dataset = H5Dopen2( file, name, H5P_DEFAULT );
+		if (dataset < 0){
+			return 1;
+		}
+		hid_t type = H5Dget_type( dataset );
+		size_t length = H5Tget_size( type );
+		hid_t space = H5Dget_space( dataset );
+		hsize_t n = H5Sget_simple_extent_npoints( space );
+		vector<char> buffer( std::max(n, (hsize_t)1)*length + 1, 0 );
+		herr_t status = (n > 0) ? H5Dread( dataset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, &buffer[0] ) : 0;
+		for (hsize_t i = 0; i < n; i++){
+			strings.push_back( string( &buffer[i*length], strnlen( &buffer[i*length], length ) ) );
+		}
+		H5Sclose( space );
+		H5Tclose( type );
+		H5Dclose( dataset );
+		return (status < 0);
+	}
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+PolarArchive::PolarArchive()
+	: p_filename("")
+	, p_file(-1)
+	, p_polar(-1)
+	, p_event(-1)
+	, p_eventType(-1)
+	, p_pv(-1)
+	, p_nQ(0)
+	, p_nPhi(0)
+	, p_startQ(0)
+	, p_stopQ(0)
+	, p_units(0)
+	, p_bits(32)
+	, p_nEvents(0)
+	, p_generations()
+	, p_pvNames()
+	, p_buffer()
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+PolarArchive::~PolarArchive()
+{
+	close();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarArchive::create( const string &filename, int nQ, int nPhi, double startQ, double stopQ, int units,
+	int bits, int compression, unsigned int chunkEvents )
+{
+	close();
+	if (bits != 16 && bits != 32){
+		MsgLog(logger, warning, "archive precision of " << bits << " bits not available, using 32");
+		bits = 32;
+	}
+	p_file = H5Fcreate( filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT );
+	if (p_file < 0){
+		MsgLog(logger, error, "could not create polar archive '" << filename << "'");
+		p_file = -1;
+		return 1;
+	}
+	p_filename = filename;
+	p_nQ = nQ;
+	p_nPhi = nPhi;
+	p_startQ = startQ;
+	p_stopQ = stopQ;
+	p_units = units;
+	p_bits = bits;
+	p_nEvents = 0;
+	p_generations.clear();
+
+	writeAttribute( "nQ", nQ );
+	writeAttribute( "nPhi", nPhi );
+	writeAttribute( "startQ", startQ );
+	writeAttribute( "stopQ", stopQ );
+	writeAttribute( "units", units );
+	writeAttribute( "bits", bits );
+
+	//polar images, growing along the event axis
+	hsize_t dims[3] = {0, nQ, nPhi};
+	hsize_t maxdims[3] = {H5S_UNLIMITED, nQ, nPhi};
+	hsize_t chunk[3] = {chunkEvents ? chunkEvents : 1, nQ, nPhi};
+	hid_t space = H5Screate_simple( 3, dims, maxdims );
+	hid_t plist = H5Pcreate( H5P_DATASET_CREATE );
+	H5Pset_chunk( plist, 3, chunk );
+	if (compression > 0){
+		H5Pset_shuffle( plist );
+		H5Pset_deflate( plist, compression );
+	}
+	hid_t type = (bits == 16) ? createHalfType() : H5Tcopy( H5T_IEEE_F32LE );
+	hid_t access = createChunkCacheAccess( chunk[0]*chunk[1]*chunk[2]*H5Tget_size(type) );
+	p_polar = H5Dcreate2( p_file, "polar", type, space, H5P_DEFAULT, plist, access );
+	H5Pclose( access );
+	H5Tclose( type );
+	H5Pclose( plist );
+	H5Sclose( space );
+
+	//event information
+	p_eventType = H5Tcreate( H5T_COMPOUND, sizeof(PolarArchiveEvent) );
+	H5Tinsert( p_eventType, "index", HOFFSET(PolarArchiveEvent, index), H5T_NATIVE_UINT );
+	H5Tinsert( p_eventType, "sec", HOFFSET(PolarArchiveEvent, sec), H5T_NATIVE_UINT );
+	H5Tinsert( p_eventType, "nsec", HOFFSET(PolarArchiveEvent, nsec), H5T_NATIVE_UINT );
+	H5Tinsert( p_eventType, "fiducials", HOFFSET(PolarArchiveEvent, fiducials), H5T_NATIVE_UINT );
+	H5Tinsert( p_eventType, "generation", HOFFSET(PolarArchiveEvent, generation), H5T_NATIVE_INT );
+	H5Tinsert( p_eventType, "pvChanged", HOFFSET(PolarArchiveEvent, pvChanged), H5T_NATIVE_INT );
+	hsize_t edims[1] = {0};
+	hsize_t emaxdims[1] = {H5S_UNLIMITED};
+	hsize_t echunk[1] = {1024};
+	space = H5Screate_simple( 1, edims, emaxdims );
+	plist = H5Pcreate( H5P_DATASET_CREATE );
+	H5Pset_chunk( plist, 1, echunk );
+	p_event = H5Dcreate2( p_file, "event", p_eventType, space, H5P_DEFAULT, plist, H5P_DEFAULT );
+	H5Pclose( plist );
+	H5Sclose( space );
+
+	if (p_polar < 0 || p_event < 0){
+		MsgLog(logger, error, "could not create datasets in '" << filename << "'");
+		close();
+		return 1;
+	}
+	MsgLog(logger, info, "archiving polar images (" << nQ << " x " << nPhi << ", float" << bits << ") to '" << filename << "'");
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarArchive::open( const string &filename )
+{
+	close();
+	p_file = H5Fopen( filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT );
+	if (p_file < 0){
+		MsgLog(logger, error, "could not open polar archive '" << filename << "'");
+		p_file = -1;
+		return 1;
+	}
+	p_filename = filename;
+	p_nQ = (int) readAttribute( "nQ" );
+	p_nPhi = (int) readAttribute( "nPhi" );
+	p_startQ = readAttribute( "startQ" );
+	p_stopQ = readAttribute( "stopQ" );
+	p_units = (int) readAttribute( "units" );
+	p_bits = (int) readAttribute( "bits" );
+
+	//the chunk cache is set when the dataset is opened, so the chunk size is looked up first
+	p_polar = H5Dopen2( p_file, "polar", H5P_DEFAULT );
+	if (p_polar >= 0){
+		hid_t plist = H5Dget_create_plist( p_polar );
+		hid_t type = H5Dget_type( p_polar );
+		hsize_t chunk[3] = {0, 0, 0};
+		if (H5Pget_chunk( plist, 3, chunk ) == 3){
+			hid_t access = createChunkCacheAccess( chunk[0]*chunk[1]*chunk[2]*H5Tget_size(type) );
+			H5Dclose( p_polar );
+			p_polar = H5Dopen2( p_file, "polar", access );
+			H5Pclose( access );
+		}
+		H5Tclose( type );
+		H5Pclose( plist );
+	}
+	p_event = H5Dopen2( p_file, "event", H5P_DEFAULT );
+	if (p_polar < 0 || p_event < 0){
+		MsgLog(logger, error, "'" << filename << "' is not a polar archive");
+		close();
+		return 1;
+	}
+	p_eventType = H5Dget_type( p_event );
+	hid_t nativeType = H5Tcreate( H5T_COMPOUND, sizeof(PolarArchiveEvent) );
+	H5Tinsert( nativeType, "index", HOFFSET(PolarArchiveEvent, index), H5T_NATIVE_UINT );
+	H5Tinsert( nativeType, "sec", HOFFSET(PolarArchiveEvent, sec), H5T_NATIVE_UINT );
+	H5Tinsert( nativeType, "nsec", HOFFSET(PolarArchiveEvent, nsec), H5T_NATIVE_UINT );
+	H5Tinsert( nativeType, "fiducials", HOFFSET(PolarArchiveEvent, fiducials), H5T_NATIVE_UINT );
+	H5Tinsert( nativeType, "generation", HOFFSET(PolarArchiveEvent, generation), H5T_NATIVE_INT );
+	H5Tinsert( nativeType, "pvChanged", HOFFSET(PolarArchiveEvent, pvChanged), H5T_NATIVE_INT );
+	H5Tclose( p_eventType );
+	p_eventType = nativeType;
+
+	//PV values, in archives that have them
+	if (H5Lexists( p_file, "pv", H5P_DEFAULT ) > 0 && !readStrings( p_file, "pvName", p_pvNames )){
+		p_pv = H5Dopen2( p_file, "pv", H5P_DEFAULT );
+	}
+
+	hid_t space = H5Dget_space( p_polar );
+	hsize_t dims[3] = {0, 0, 0};
+	H5Sget_simple_extent_dims( space, dims, NULL );
+	H5Sclose( space );
+	p_nEvents = dims[0];
+	if ((int)dims[1] != p_nQ || (int)dims[2] != p_nPhi){
+		MsgLog(logger, warning, "polar dataset (" << dims[1] << " x " << dims[2] << ") does not match the attributes nQ="
+			<< p_nQ << ", nPhi=" << p_nPhi);
+		p_nQ = dims[1];
+		p_nPhi = dims[2];
+	}
+	MsgLog(logger, info, "opened '" << filename << "': " << p_nEvents << " polar images (" << p_nQ << " x " << p_nPhi
+		<< ", float" << p_bits << "), startQ=" << p_startQ << ", stopQ=" << p_stopQ << ", units=" << p_units);
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+PolarArchive::close()
+{
+	if (p_polar >= 0) H5Dclose( p_polar );
+	if (p_event >= 0) H5Dclose( p_event );
+	if (p_eventType >= 0) H5Tclose( p_eventType );
+	if (p_pv >= 0) H5Dclose( p_pv );
+	if (p_file >= 0) H5Fclose( p_file );
+	p_polar = -1;
+	p_event = -1;
+	p_eventType = -1;
+	p_pv = -1;
+	p_file = -1;
+	p_nEvents = 0;
+	p_generations.clear();
+	p_pvNames.clear();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+PolarArchive::isOpen() const
+{
+	return p_file >= 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+string
+PolarArchive::filename() const
+{
+	return p_filename;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarArchive::writeGeometry( int generation, const array1D<double> *pix1, const array1D<double> *pix2, const array1D<double> *mask )
+{
+	if (!isOpen() || hasGeometry( generation )){
+		return 0;
+	}
+	hid_t group = H5Gcreate2( p_file, geometryGroup(generation).c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
+	if (group < 0){
+		MsgLog(logger, error, "could not create group for geometry generation " << generation << " in '" << p_filename << "'");
+		return 1;
+	}
+	int fail = writeVector( group, "pix1", pix1 );
+	fail |= writeVector( group, "pix2", pix2 );
+	fail |= writeVector( group, "mask", mask );
+	H5Gclose( group );
+	p_generations.push_back( generation );
+	return fail;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+PolarArchive::hasGeometry( int generation ) const
+{
+	return std::find( p_generations.begin(), p_generations.end(), generation ) != p_generations.end();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarArchive::readGeometry( int generation, array1D<double> *&pix1, array1D<double> *&pix2, array1D<double> *&mask )
+{
+	delete pix1;
+	delete pix2;
+	delete mask;
+	pix1 = 0;
+	pix2 = 0;
+	mask = 0;
+	if (!isOpen() || H5Lexists( p_file, geometryGroup(generation).c_str(), H5P_DEFAULT ) <= 0){
+		MsgLog(logger, error, "no geometry generation " << generation << " in '" << p_filename << "'");
+		return 1;
+	}
+	hid_t group = H5Gopen2( p_file, geometryGroup(generation).c_str(), H5P_DEFAULT );
+	pix1 = readVector( group, "pix1" );
+	pix2 = readVector( group, "pix2" );
+	mask = readVector( group, "mask" );
+	H5Gclose( group );
+	if (!pix1 || !pix2){
+		MsgLog(logger, error, "could not read the pixel arrays of geometry generation " << generation << " from '" << p_filename << "'");
+		return 1;
+	}
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarArchive::setPVs( const vector<string> &names )
+{
+	if (!isOpen() || p_nEvents > 0 || p_pv >= 0){
+		MsgLog(logger, error, "PVs can only be set once, before the first event of '" << p_filename << "'");
+		return 1;
+	}
+	if (names.empty()){
+		return 0;
+	}
+	hsize_t dims[2] = {0, names.size()};
+	hsize_t maxdims[2] = {H5S_UNLIMITED, names.size()};
+	hsize_t chunk[2] = {1024, names.size()};
+	hid_t space = H5Screate_simple( 2, dims, maxdims );
+	hid_t plist = H5Pcreate( H5P_DATASET_CREATE );
+	H5Pset_chunk( plist, 2, chunk );
+	double fill = std::numeric_limits<double>::quiet_NaN();
+	H5Pset_fill_value( plist, H5T_NATIVE_DOUBLE, &fill );
+	p_pv = H5Dcreate2( p_file, "pv", H5T_NATIVE_DOUBLE, space, H5P_DEFAULT, plist, H5P_DEFAULT );
+	H5Pclose( plist );
+	H5Sclose( space );
+	if (p_pv < 0 || writeStrings( p_file, "pvName", names )){
+		MsgLog(logger, error, "could not create the PV datasets in '" << p_filename << "'");
+		return 1;
+	}
+	p_pvNames = names;
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+const vector<string>&
+PolarArchive::pvNames() const
+{
+	return p_pvNames;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarArchive::append( const array2D<double> *polar, const PolarArchiveEvent &event, const double *pvValues )
+{
+	if (!isOpen() || !polar || (int)polar->dim1() != p_nQ || (int)polar->dim2() != p_nPhi){
+		MsgLog(logger, error, "polar image does not match the archive (" << p_nQ << " x " << p_nPhi << ")");
+		return 1;
+	}
+	p_buffer.resize( p_nQ*p_nPhi );
+	for (int iq = 0; iq < p_nQ; iq++){
+		for (int iphi = 0; iphi < p_nPhi; iphi++){
+			p_buffer[iq*p_nPhi + iphi] = polar->get( iq, iphi );
+		}
+	}
+
+	hsize_t dims[3] = {p_nEvents+1, p_nQ, p_nPhi};
+	hsize_t edims[1] = {p_nEvents+1};
+	if (H5Dset_extent( p_polar, dims ) < 0 || H5Dset_extent( p_event, edims ) < 0){
+		MsgLog(logger, error, "could not extend '" << p_filename << "' to " << p_nEvents+1 << " events");
+		return 1;
+	}
+
+	hsize_t start[3] = {p_nEvents, 0, 0};
+	hsize_t count[3] = {1, p_nQ, p_nPhi};
+	hid_t space = H5Dget_space( p_polar );
+	H5Sselect_hyperslab( space, H5S_SELECT_SET, start, NULL, count, NULL );
+	hid_t memspace = H5Screate_simple( 3, count, NULL );
+	herr_t status = H5Dwrite( p_polar, H5T_NATIVE_FLOAT, memspace, space, H5P_DEFAULT, &p_buffer[0] );
+	H5Sclose( memspace );
+	H5Sclose( space );
+
+	space = H5Dget_space( p_event );
+	H5Sselect_hyperslab( space, H5S_SELECT_SET, start, NULL, count, NULL );
+	memspace = H5Screate_simple( 1, count, NULL );
+	status |= H5Dwrite( p_event, p_eventType, memspace, space, H5P_DEFAULT, &event );
+	H5Sclose( memspace );
+	H5Sclose( space );
+
+	//rows of events without values keep the fill value NaN
+	if (p_pv >= 0){
+		hsize_t pdims[2] = {p_nEvents+1, p_pvNames.size()};
+		status |= H5Dset_extent( p_pv, pdims );
+		if (pvValues){
+			hsize_t pstart[2] = {p_nEvents, 0};
+			hsize_t pcount[2] = {1, p_pvNames.size()};
+			space = H5Dget_space( p_pv );
+			H5Sselect_hyperslab( space, H5S_SELECT_SET, pstart, NULL, pcount, NULL );
+			memspace = H5Screate_simple( 2, pcount, NULL );
+			status |= H5Dwrite( p_pv, H5T_NATIVE_DOUBLE, memspace, space, H5P_DEFAULT, pvValues );
+			H5Sclose( memspace );
+			H5Sclose( space );
+		}
+	}
+
+	if (status < 0){
+		MsgLog(logger, error, "could not write event " << p_nEvents << " to '" << p_filename << "'");
+		return 1;
+	}
+	p_nEvents++;
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarArchive::read( unsigned int i, array2D<double> *polar, PolarArchiveEvent &event, int iqBegin, int iqEnd )
+{
+	if (iqEnd < 0){
+		iqEnd = p_nQ;
+	}
+	const int nRings = iqEnd - iqBegin;
+	if (!isOpen() || i >= p_nEvents || iqBegin < 0 || iqEnd > p_nQ || nRings <= 0
+		|| !polar || (int)polar->dim1() != nRings || (int)polar->dim2() != p_nPhi){
+		MsgLog(logger, error, "cannot read event " << i << ", rings " << iqBegin << "..." << iqEnd << " from '" << p_filename << "'");
+		return 1;
+	}
+	p_buffer.resize( nRings*p_nPhi );
+	hsize_t start[3] = {i, iqBegin, 0};
+	hsize_t count[3] = {1, nRings, p_nPhi};
+	hid_t space = H5Dget_space( p_polar );
+	H5Sselect_hyperslab( space, H5S_SELECT_SET, start, NULL, count, NULL );
+	hid_t memspace = H5Screate_simple( 3, count, NULL );
+	herr_t status = H5Dread( p_polar, H5T_NATIVE_FLOAT, memspace, space, H5P_DEFAULT, &p_buffer[0] );
+	H5Sclose( memspace );
+	H5Sclose( space );
+
+	space = H5Dget_space( p_event );
+	H5Sselect_hyperslab( space, H5S_SELECT_SET, start, NULL, count, NULL );
+	memspace = H5Screate_simple( 1, count, NULL );
+	status |= H5Dread( p_event, p_eventType, memspace, space, H5P_DEFAULT, &event );
+	H5Sclose( memspace );
+	H5Sclose( space );
+
+	if (status < 0){
+		MsgLog(logger, error, "could not read event " << i << " from '" << p_filename << "'");
+		return 1;
+	}
+	for (int iq = 0; iq < nRings; iq++){
+		for (int iphi = 0; iphi < p_nPhi; iphi++){
+			polar->set( iq, iphi, p_buffer[iq*p_nPhi + iphi] );
+		}
+	}
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarArchive::readPVs( unsigned int i, vector<double> &values )
+{
+	values.assign( p_pvNames.size(), std::numeric_limits<double>::quiet_NaN() );
+	if (p_pv < 0 || i >= p_nEvents){
+		return (p_pv < 0) ? 0 : 1;
+	}
+	hsize_t start[2] = {i, 0};
+	hsize_t count[2] = {1, p_pvNames.size()};
+	hid_t space = H5Dget_space( p_pv );
+	H5Sselect_hyperslab( space, H5S_SELECT_SET, start, NULL, count, NULL );
+	hid_t memspace = H5Screate_simple( 2, count, NULL );
+	herr_t status = H5Dread( p_pv, H5T_NATIVE_DOUBLE, memspace, space, H5P_DEFAULT, &values[0] );
+	H5Sclose( memspace );
+	H5Sclose( space );
+	if (status < 0){
+		MsgLog(logger, error, "could not read the PVs of event " << i << " from '" << p_filename << "'");
+		return 1;
+	}
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+PolarArchive::nEvents() const
+{
+	return p_nEvents;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarArchive::nQ() const
+{
+	return p_nQ;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarArchive::nPhi() const
+{
+	return p_nPhi;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+double
+PolarArchive::startQ() const
+{
+	return p_startQ;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+double
+PolarArchive::stopQ() const
+{
+	return p_stopQ;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarArchive::units() const
+{
+	return p_units;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarArchive::bits() const
+{
+	return p_bits;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+PolarArchive::writeAttribute( const char *name, double value )
+{
+	hid_t space = H5Screate( H5S_SCALAR );
+	hid_t attr = H5Acreate2( p_file, name, H5T_NATIVE_DOUBLE, space, H5P_DEFAULT, H5P_DEFAULT );
+	H5Awrite( attr, H5T_NATIVE_DOUBLE, &value );
+	H5Aclose( attr );
+	H5Sclose( space );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+double
+PolarArchive::readAttribute( const char *name ) const
+{
+	double value = 0;
+	if (H5Aexists( p_file, name ) > 0){
+		hid_t attr = H5Aopen( p_file, name, H5P_DEFAULT );
+		H5Aread( attr, H5T_NATIVE_DOUBLE, &value );
+		H5Aclose( attr );
+	}else{
+		MsgLog(logger, warning, "attribute '" << name << "' missing in '" << p_filename << "'");
+	}
+	return value;
+}
+
+
+} // namespace kitty
@@ -0,0 +1,305 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class PolarRemap...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/polarremap.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <cmath>
+#include <algorithm>
+
+using std::vector;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.PolarRemap";
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+PolarRemap::PolarRemap()
+	: p_rowStart()
+	, p_col()
+	, p_weight()
+	, p_nQ(0)
+	, p_nPhi(0)
+	, p_startQ(0)
+	, p_stopQ(0)
+	, p_generation(-1)
+	, p_units(0)
+	, p_nPixels(0)
+	, p_ringPixels()
+	, p_ringBins()
+	, p_ringInvBins()
+	, p_polar()
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+PolarRemap::~PolarRemap()
+{
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarRemap::create( const array1D<double> *pix1, const array1D<double> *pix2, const array1D<double> *mask,
+	int nQ, int nPhi, double startQ, double stopQ, int generation, int units )
+{
+	p_rowStart.clear();
+	p_col.clear();
+	p_weight.clear();
+	p_generation = -1;
+	if (!pix1 || !pix2 || pix1->size() != pix2->size() || nQ <= 0 || nPhi <= 0 || stopQ <= startQ){
+		MsgLog(logger, error, "cannot create polar remap with nQ=" << nQ << ", nPhi=" << nPhi
+			<< ", startQ=" << startQ << ", stopQ=" << stopQ);
+		return 1;
+	}
+	if (mask && mask->size() != pix1->size()){
+		MsgLog(logger, warning, "mask size " << mask->size() << " does not match " << pix1->size() << " pixels, ignoring mask");
+		mask = 0;
+	}
+
+	const unsigned int n = pix1->size();
+	const unsigned int nRows = nQ*nPhi;
+	const double dq = (stopQ - startQ)/nQ;
+	const double dphi = 2*M_PI/nPhi;
+
+	//polar bin of every valid pixel
+	vector<int> row( n, -1 );
+	p_rowStart.assign( nRows+1, 0 );
+	for (unsigned int i = 0; i < n; i++){
+		if (mask && mask->get(i) == 0){
+			continue;
+		}
+		double x = pix1->get(i);
+		double y = pix2->get(i);
+		int iq = (int)floor( (sqrt(x*x + y*y) - startQ)/dq );
+		if (iq < 0 || iq >= nQ){
+			continue;
+		}
+		double phi = atan2( y, x );
+		if (phi < 0){
+			phi += 2*M_PI;
+		}
+		int iphi = std::min( (int)(phi/dphi), nPhi-1 );
+		row[i] = iq*nPhi + iphi;
+		p_rowStart[row[i]+1]++;
+	}
+
+	//counts to offsets, then fill rows in ascending pixel order
+	for (unsigned int r = 0; r < nRows; r++){
+		p_rowStart[r+1] += p_rowStart[r];
+	}
+	p_col.resize( p_rowStart[nRows] );
+	p_weight.resize( p_rowStart[nRows] );
+	vector<unsigned int> next( p_rowStart.begin(), p_rowStart.end()-1 );
+	for (unsigned int i = 0; i < n; i++){
+		if (row[i] >= 0){
+			p_col[next[row[i]]++] = i;
+		}
+	}
+	for (unsigned int r = 0; r < nRows; r++){
+		unsigned int nPx = p_rowStart[r+1] - p_rowStart[r];
+		for (unsigned int k = p_rowStart[r]; k < p_rowStart[r+1]; k++){
+			p_weight[k] = 1.f/nPx;
+		}
+	}
+
+	p_nQ = nQ;
+	p_nPhi = nPhi;
+	p_startQ = startQ;
+	p_stopQ = stopQ;
+	p_generation = generation;
+	p_units = units;
+	p_nPixels = n;
+	p_polar.assign( nRows, 0. );
+	updateRingCounts();
+	unsigned int nEmpty = 0;
+	for (int iq = 0; iq < nQ; iq++){
+		nEmpty += nPhi - p_ringBins[iq];
+	}
+
+	MsgLog(logger, info, "polar remap (" << nQ << " x " << nPhi << ") for geometry generation " << generation
+		<< ": " << nonZeros() << " of " << n << " pixels used, " << nEmpty << " empty polar bins");
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+PolarRemap::isCurrent( int nQ, int nPhi, double startQ, double stopQ, int generation, int units ) const
+{
+	return ( !p_rowStart.empty()
+		&& nQ == p_nQ && nPhi == p_nPhi
+		&& startQ == p_startQ && stopQ == p_stopQ
+		&& generation == p_generation && units == p_units );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarRemap::apply( const array1D<double> *data, array2D<double> *polar, array1D<double> *qAvg, array1D<double> *iAvg ) const
+{
+	return apply( data, polar, qAvg, iAvg, 0, p_nQ );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarRemap::apply( const array1D<double> *data, array2D<double> *polar, array1D<double> *qAvg, array1D<double> *iAvg,
+	int iqBegin, int iqEnd ) const
+{
+	if (p_rowStart.empty() || !data || data->size() < p_nPixels){
+		MsgLog(logger, error, "polar remap not created or data does not match");
+		return 1;
+	}
+	iqBegin = std::max( iqBegin, 0 );
+	iqEnd = std::min( iqEnd, p_nQ );
+
+	//sparse matrix-vector product
+	const double *d = data->data();
+	const unsigned int *rowStart = &p_rowStart[0];
+	const unsigned int *col = p_col.empty() ? 0 : &p_col[0];
+	const float *weight = p_weight.empty() ? 0 : &p_weight[0];
+	double *pol = &p_polar[0];
+	const unsigned int rowEnd = iqEnd*p_nPhi;
+	for (unsigned int r = iqBegin*p_nPhi; r < rowEnd; r++){
+		double sum = 0;
+		for (unsigned int k = rowStart[r]; k < rowStart[r+1]; k++){
+			sum += weight[k] * d[col[k]];
+		}
+		pol[r] = sum;
+	}
+
+	//ring averages, empty bins get the average of their ring
+	const double dq = (p_stopQ - p_startQ)/p_nQ;
+	for (int iq = iqBegin; iq < iqEnd; iq++){
+		double sum = 0;
+		for (int iphi = 0; iphi < p_nPhi; iphi++){
+			sum += pol[iq*p_nPhi + iphi];		// empty bins are 0
+		}
+		double ringAvg = sum*p_ringInvBins[iq];
+		for (int iphi = 0; iphi < p_nPhi; iphi++){
+			unsigned int r = iq*p_nPhi + iphi;
+			if (rowStart[r+1] == rowStart[r]){
+				pol[r] = ringAvg;
+			}
+			if (polar) polar->set( iq, iphi, pol[r] );
+		}
+		if (qAvg) qAvg->set( iq, p_startQ + (iq+0.5)*dq );
+		if (iAvg) iAvg->set( iq, ringAvg );
+	}
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarRemap::nQ() const
+{
+	return p_nQ;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarRemap::nPhi() const
+{
+	return p_nPhi;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarRemap::generation() const
+{
+	return p_generation;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+PolarRemap::nonZeros() const
+{
+	return p_col.size();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+PolarRemap::binPixels( int iq, int iphi ) const
+{
+	unsigned int r = iq*p_nPhi + iphi;
+	return p_rowStart[r+1] - p_rowStart[r];
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+PolarRemap::ringPixels( int iq ) const
+{
+	return p_ringPixels[iq];
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarRemap::ringBins( int iq ) const
+{
+	return p_ringBins[iq];
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+PolarRemap::updateRingCounts()
+{
+	p_ringPixels.assign( p_nQ, 0 );
+	p_ringBins.assign( p_nQ, 0 );
+	p_ringInvBins.assign( p_nQ, 0. );
+	for (int iq = 0; iq < p_nQ; iq++){
+		for (int iphi = 0; iphi < p_nPhi; iphi++){
+			unsigned int n = binPixels( iq, iphi );
+			p_ringPixels[iq] += n;
+			if (n > 0){
+				p_ringBins[iq]++;
+			}
+		}
+		if (p_ringBins[iq] > 0){
+			p_ringInvBins[iq] = 1./p_ringBins[iq];
+		}
+	}
+}
+
+
+} // namespace kitty
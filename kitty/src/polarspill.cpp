@@ -0,0 +1,211 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class PolarSpill...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/polarspill.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+using std::string;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.PolarSpill";
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+PolarSpill::PolarSpill()
+	: p_filename("")
+	, p_fd(-1)
+	, p_map(0)
+	, p_mapBytes(0)
+	, p_nQ(0)
+	, p_nPhi(0)
+	, p_recordBytes(0)
+	, p_growRecords(0)
+	, p_capacity(0)
+	, p_count(0)
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+PolarSpill::~PolarSpill()
+{
+	close();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarSpill::open( const string &filename, int nQ, int nPhi, unsigned int growRecords )
+{
+	close();
+	p_fd = ::open( filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+	if (p_fd < 0){
+		MsgLog(logger, error, "could not create polar spill file '" << filename << "'");
+		return 1;
+	}
+	p_filename = filename;
+	p_nQ = nQ;
+	p_nPhi = nPhi;
+	p_recordBytes = sizeof(PolarSpillRecord) + (size_t)nQ*nPhi*sizeof(float);
+	p_growRecords = growRecords ? growRecords : 1;
+	p_capacity = 0;
+	p_count = 0;
+	if (grow()){
+		close();
+		return 1;
+	}
+	MsgLog(logger, info, "spilling polar images (" << nQ << " x " << nPhi << ") to '" << filename << "'");
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+PolarSpill::close()
+{
+	if (p_map){
+		munmap( p_map, p_mapBytes );
+	}
+	if (p_fd >= 0){
+		::close( p_fd );
+		remove( p_filename.c_str() );
+	}
+	p_map = 0;
+	p_mapBytes = 0;
+	p_fd = -1;
+	p_capacity = 0;
+	p_count = 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+PolarSpill::isOpen() const
+{
+	return p_map != 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+string
+PolarSpill::filename() const
+{
+	return p_filename;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarSpill::append( const array2D<double> *polar, const PolarSpillRecord &record )
+{
+	if (!isOpen() || !polar || (int)polar->dim1() != p_nQ || (int)polar->dim2() != p_nPhi){
+		MsgLog(logger, error, "polar image does not match the spill file (" << p_nQ << " x " << p_nPhi << ")");
+		return 1;
+	}
+	if (p_count == p_capacity && grow()){
+		return 1;
+	}
+	char *rec = p_map + p_count*p_recordBytes;
+	memcpy( rec, &record, sizeof(PolarSpillRecord) );
+	float *values = (float*)(rec + sizeof(PolarSpillRecord));
+	for (int iq = 0; iq < p_nQ; iq++){
+		for (int iphi = 0; iphi < p_nPhi; iphi++){
+			values[iq*p_nPhi + iphi] = polar->get( iq, iphi );
+		}
+	}
+	p_count++;
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+PolarSpill::count() const
+{
+	return p_count;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarSpill::read( unsigned int i, array2D<double> *polar, PolarSpillRecord &record ) const
+{
+	if (i >= p_count || !polar || (int)polar->dim1() != p_nQ || (int)polar->dim2() != p_nPhi){
+		MsgLog(logger, error, "cannot read record " << i << " of " << p_count << " from '" << p_filename << "'");
+		return 1;
+	}
+	const char *rec = p_map + i*p_recordBytes;
+	memcpy( &record, rec, sizeof(PolarSpillRecord) );
+	const float *values = (const float*)(rec + sizeof(PolarSpillRecord));
+	for (int iq = 0; iq < p_nQ; iq++){
+		for (int iphi = 0; iphi < p_nPhi; iphi++){
+			polar->set( iq, iphi, values[iq*p_nPhi + iphi] );
+		}
+	}
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarSpill::grow()
+{
+	if (p_map){
+		munmap( p_map, p_mapBytes );
+		p_map = 0;
+	}
+	size_t bytes = (size_t)(p_capacity + p_growRecords)*p_recordBytes;
+	if (ftruncate( p_fd, bytes ) != 0){
+		MsgLog(logger, error, "could not grow '" << p_filename << "' to " << bytes/1048576. << " MB");
+		return 1;
+	}
+	void *map = mmap( 0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, p_fd, 0 );
+	if (map == MAP_FAILED){
+		MsgLog(logger, error, "could not map '" << p_filename << "'");
+		return 1;
+	}
+	p_map = (char*) map;
+	p_mapBytes = bytes;
+	p_capacity += p_growRecords;
+	return 0;
+}
+
+
+} // namespace kitty
@@ -0,0 +1,275 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class PolarSplitRemap...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/polarsplitremap.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <cmath>
+#include <algorithm>
+
+using std::vector;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.PolarSplitRemap";
+
+	const int maxVertices = 16;			// a quadrilateral clipped by a rectangle has at most 8
+
+	/// clip polygon (q, phi) at value 'bound' of coordinate 'axis' (0: q, 1: phi), keeping the side above or below
+	int clip( const double *in, int n, double *out, int axis, double bound, bool keepAbove ){
+		int m = 0;
+		for (int k = 0; k < n; k++){
+			const double *a = &in[2*k];
+			const double *b = &in[2*((k+1)%n)];
+			bool aIn = keepAbove ? (a[axis] >= bound) : (a[axis] <= bound);
+			bool bIn = keepAbove ? (b[axis] >= bound) : (b[axis] <= bound);
+			if (aIn){
+				out[2*m] = a[0];
+				out[2*m+1] = a[1];
+				m++;
+			}
+			if (aIn != bIn){
+				double t = (bound - a[axis])/(b[axis] - a[axis]);
+				out[2*m] = a[0] + t*(b[0] - a[0]);
+				out[2*m+1] = a[1] + t*(b[1] - a[1]);
+				m++;
+			}
+		}
+		return m;
+	}
+
+	/// detector area of a polygon in (q, phi), the integral of q dq dphi (first moment in q by the shoelace formula)
+	double area( const double *p, int n ){
+		double a = 0;
+		for (int k = 0; k < n; k++){
+			int l = (k+1)%n;
+			a += (p[2*k] + p[2*l])*(p[2*k]*p[2*l+1] - p[2*l]*p[2*k+1]);
+		}
+		return fabs( a )/6;
+	}
+
+	/// detector area of polygon 'p' inside the rectangle [q0, q1] x [phi0, phi1]
+	double overlap( const double *p, int n, double q0, double q1, double phi0, double phi1 ){
+		double a[2*maxVertices];
+		double b[2*maxVertices];
+		n = clip( p, n, a, 0, q0, true );
+		n = clip( a, n, b, 0, q1, false );
+		n = clip( b, n, a, 1, phi0, true );
+		n = clip( a, n, b, 1, phi1, false );
+		return (n >= 3) ? area( b, n ) : 0;
+	}
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+PolarSplitRemap::PolarSplitRemap( double pixelSize )
+	: PolarRemap()
+	, p_pixelSize(pixelSize)
+	, p_usedPixelSize(0)
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+PolarSplitRemap::~PolarSplitRemap()
+{
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PolarSplitRemap::create( const array1D<double> *pix1, const array1D<double> *pix2, const array1D<double> *mask,
+	int nQ, int nPhi, double startQ, double stopQ, int generation, int units )
+{
+	p_rowStart.clear();
+	p_col.clear();
+	p_weight.clear();
+	p_generation = -1;
+	if (!pix1 || !pix2 || pix1->size() != pix2->size() || pix1->size() < 2 || nQ <= 0 || nPhi <= 0 || stopQ <= startQ){
+		MsgLog(logger, error, "cannot create polar remap with nQ=" << nQ << ", nPhi=" << nPhi
+			<< ", startQ=" << startQ << ", stopQ=" << stopQ);
+		return 1;
+	}
+	if (mask && mask->size() != pix1->size()){
+		MsgLog(logger, warning, "mask size " << mask->size() << " does not match " << pix1->size() << " pixels, ignoring mask");
+		mask = 0;
+	}
+
+	const unsigned int n = pix1->size();
+	const unsigned int nRows = nQ*nPhi;
+	const double dq = (stopQ - startQ)/nQ;
+	const double dphi = 2*M_PI/nPhi;
+
+	//pixel size from the distance of neighbouring pixels, the jumps between ASIC rows are outliers
+	double h = p_pixelSize;
+	if (h <= 0){
+		vector<double> dist;
+		dist.reserve( n-1 );
+		for (unsigned int i = 0; i+1 < n; i++){
+			double d = hypot( pix1->get(i+1) - pix1->get(i), pix2->get(i+1) - pix2->get(i) );
+			if (d > 0){
+				dist.push_back( d );
+			}
+		}
+		if (dist.empty()){
+			MsgLog(logger, error, "cannot find the pixel size from the pixel arrays");
+			return 1;
+		}
+		std::nth_element( dist.begin(), dist.begin() + dist.size()/2, dist.end() );
+		h = dist[dist.size()/2];
+	}
+	const double h2 = h/2;
+
+	//shares of every valid pixel in the polar bins it overlaps, in ascending pixel order
+	vector<unsigned int> row;
+	vector<unsigned int> col;
+	vector<float> share;
+	row.reserve( 4*n );
+	col.reserve( 4*n );
+	share.reserve( 4*n );
+	double poly[2*4];
+	for (unsigned int i = 0; i < n; i++){
+		if (mask && mask->get(i) == 0){
+			continue;
+		}
+		double x = pix1->get(i);
+		double y = pix2->get(i);
+		double phic = atan2( y, x );
+		if (phic < 0){
+			phic += 2*M_PI;
+		}
+
+		//a pixel around the origin covers all angles, it is not split
+		if (fabs(x) < h2 && fabs(y) < h2){
+			int iq = (int)floor( (sqrt(x*x + y*y) - startQ)/dq );
+			if (iq >= 0 && iq < nQ){
+				row.push_back( iq*nPhi + std::min( (int)(phic/dphi), nPhi-1 ) );
+				col.push_back( i );
+				share.push_back( 1.f );
+			}
+			continue;
+		}
+
+		//corners in (q, phi), phi unwrapped around the pixel center
+		const double cx[4] = { x-h2, x+h2, x+h2, x-h2 };
+		const double cy[4] = { y-h2, y-h2, y+h2, y+h2 };
+		double qMin = stopQ;
+		double qMax = startQ;
+		double phiMin = 4*M_PI;
+		double phiMax = -4*M_PI;
+		for (int k = 0; k < 4; k++){
+			double d = atan2( cy[k], cx[k] ) - phic;
+			while (d > M_PI) d -= 2*M_PI;
+			while (d < -M_PI) d += 2*M_PI;
+			poly[2*k] = sqrt( cx[k]*cx[k] + cy[k]*cy[k] );
+			poly[2*k+1] = phic + d;
+			qMin = std::min( qMin, poly[2*k] );
+			qMax = std::max( qMax, poly[2*k] );
+			phiMin = std::min( phiMin, poly[2*k+1] );
+			phiMax = std::max( phiMax, poly[2*k+1] );
+		}
+		const double total = area( poly, 4 );
+		int iqBegin = std::max( (int)floor( (qMin - startQ)/dq ), 0 );
+		int iqEnd = std::min( (int)floor( (qMax - startQ)/dq ) + 1, nQ );
+		if (total <= 0 || iqBegin >= iqEnd){
+			continue;
+		}
+		int iphiBegin = (int)floor( phiMin/dphi );
+		int iphiEnd = (int)floor( phiMax/dphi ) + 1;
+		for (int iq = iqBegin; iq < iqEnd; iq++){
+			for (int iphi = iphiBegin; iphi < iphiEnd; iphi++){
+				double a = overlap( poly, 4, startQ + iq*dq, startQ + (iq+1)*dq, iphi*dphi, (iphi+1)*dphi );
+				if (a > 1e-6*total){
+					row.push_back( iq*nPhi + ((iphi % nPhi) + nPhi) % nPhi );
+					col.push_back( i );
+					share.push_back( a/total );
+				}
+			}
+		}
+	}
+
+	//CSR by rows, every row keeps the ascending pixel order, weights are the normalized shares
+	p_rowStart.assign( nRows+1, 0 );
+	for (unsigned int k = 0; k < row.size(); k++){
+		p_rowStart[row[k]+1]++;
+	}
+	for (unsigned int r = 0; r < nRows; r++){
+		p_rowStart[r+1] += p_rowStart[r];
+	}
+	p_col.resize( p_rowStart[nRows] );
+	p_weight.resize( p_rowStart[nRows] );
+	vector<unsigned int> next( p_rowStart.begin(), p_rowStart.end()-1 );
+	for (unsigned int k = 0; k < row.size(); k++){
+		unsigned int j = next[row[k]]++;
+		p_col[j] = col[k];
+		p_weight[j] = share[k];
+	}
+	for (unsigned int r = 0; r < nRows; r++){
+		double sum = 0;
+		for (unsigned int k = p_rowStart[r]; k < p_rowStart[r+1]; k++){
+			sum += p_weight[k];
+		}
+		for (unsigned int k = p_rowStart[r]; k < p_rowStart[r+1]; k++){
+			p_weight[k] /= sum;
+		}
+	}
+
+	p_nQ = nQ;
+	p_nPhi = nPhi;
+	p_startQ = startQ;
+	p_stopQ = stopQ;
+	p_generation = generation;
+	p_units = units;
+	p_nPixels = n;
+	p_usedPixelSize = h;
+	p_polar.assign( nRows, 0. );
+	updateRingCounts();
+	unsigned int nEmpty = 0;
+	for (int iq = 0; iq < nQ; iq++){
+		nEmpty += nPhi - p_ringBins[iq];
+	}
+
+	MsgLog(logger, info, "split polar remap (" << nQ << " x " << nPhi << ") for geometry generation " << generation
+		<< ": pixel size " << h << ", " << nonZeros() << " pixel shares, " << nEmpty << " empty polar bins");
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+double
+PolarSplitRemap::pixelSize() const
+{
+	return p_usedPixelSize;
+}
+
+
+} // namespace kitty
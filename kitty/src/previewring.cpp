@@ -0,0 +1,223 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class PreviewRing...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/previewring.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+using std::string;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.PreviewRing";
+	const char magic[8] = {'K','T','Y','P','R','V','W','1'};
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+PreviewRing::PreviewRing()
+	: p_filename("")
+	, p_fd(-1)
+	, p_map(0)
+	, p_mapBytes(0)
+	, p_header(0)
+	, p_lastTime()
+	, p_first(true)
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+PreviewRing::~PreviewRing()
+{
+	close();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PreviewRing::open( const string &filename, unsigned int nSlots, unsigned int nx, unsigned int ny,
+	unsigned int nq, unsigned int binning, const float *q )
+{
+	close();
+	if (nSlots == 0){
+		MsgLog(logger, error, "preview ring buffer needs at least one slot");
+		return 1;
+	}
+
+	//slots start at multiples of 8 bytes, for the 64 bit sequence numbers
+	const size_t headerBytes = (sizeof(PreviewRingHeader) + nq*sizeof(float) + 7)/8*8;
+	const size_t slotBytes = (sizeof(PreviewSlotHeader) + ((size_t)nx*ny + nq)*sizeof(float) + 7)/8*8;
+	p_mapBytes = headerBytes + nSlots*slotBytes;
+
+	p_fd = ::open( filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+	if (p_fd < 0 || ftruncate( p_fd, p_mapBytes ) != 0){
+		MsgLog(logger, error, "could not create preview ring buffer '" << filename << "'");
+		close();
+		return 1;
+	}
+	void *map = mmap( 0, p_mapBytes, PROT_READ | PROT_WRITE, MAP_SHARED, p_fd, 0 );
+	if (map == MAP_FAILED){
+		MsgLog(logger, error, "could not map preview ring buffer '" << filename << "'");
+		close();
+		return 1;
+	}
+	p_map = (char*)map;
+	p_filename = filename;
+
+	p_header = (PreviewRingHeader*)p_map;
+	p_header->nSlots = nSlots;
+	p_header->nx = nx;
+	p_header->ny = ny;
+	p_header->nq = nq;
+	p_header->binning = binning;
+	p_header->headerBytes = headerBytes;
+	p_header->slotBytes = slotBytes;
+	p_header->written = 0;
+	if (q && nq){
+		memcpy( p_map + sizeof(PreviewRingHeader), q, nq*sizeof(float) );
+	}
+	//the magic goes in last, viewers ignore the file until the header is complete
+	__sync_synchronize();
+	memcpy( p_header->magic, magic, sizeof(magic) );
+
+	p_first = true;
+	MsgLog(logger, info, "preview ring buffer '" << filename << "': " << nSlots << " slots of " << nx << " x " << ny
+		<< " images and " << nq << " bin profiles");
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+PreviewRing::close()
+{
+	if (p_map){
+		munmap( p_map, p_mapBytes );
+	}
+	if (p_fd >= 0){
+		::close( p_fd );
+	}
+	p_map = 0;
+	p_header = 0;
+	p_fd = -1;
+	p_mapBytes = 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+PreviewRing::isOpen() const
+{
+	return (p_map != 0);
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+string
+PreviewRing::filename() const
+{
+	return p_filename;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+PreviewRing::due( double interval )
+{
+	struct timeval now;
+	gettimeofday( &now, 0 );
+	double elapsed = (now.tv_sec - p_lastTime.tv_sec) + 1e-6*(now.tv_usec - p_lastTime.tv_usec);
+	if (p_first || elapsed >= interval){
+		p_lastTime = now;
+		p_first = false;
+		return true;
+	}
+	return false;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+PreviewSlotHeader *
+PreviewRing::slot()
+{
+	uint64_t n = p_header->written % p_header->nSlots;
+	return (PreviewSlotHeader*)( p_map + p_header->headerBytes + n*p_header->slotBytes );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+PreviewRing::begin( unsigned int index, unsigned int sec, unsigned int nsec )
+{
+	PreviewSlotHeader *s = slot();
+	s->sequence = 2*p_header->written + 1;		// odd: being written
+	__sync_synchronize();
+	s->index = index;
+	s->sec = sec;
+	s->nsec = nsec;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+float *
+PreviewRing::image()
+{
+	return (float*)( (char*)slot() + sizeof(PreviewSlotHeader) );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+float *
+PreviewRing::profile()
+{
+	return image() + p_header->nx*p_header->ny;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+PreviewRing::commit()
+{
+	PreviewSlotHeader *s = slot();
+	__sync_synchronize();
+	s->sequence = 2*(p_header->written + 1);
+	__sync_synchronize();
+	p_header->written++;
+}
+
+
+} // namespace kitty
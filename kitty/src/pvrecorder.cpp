@@ -0,0 +1,364 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class PvRecorder...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/pvrecorder.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+using std::string;
+using std::vector;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.PvRecorder";
+
+	/// equal values, or both not available
+	bool same( double a, double b ){
+		return a == b || (a != a && b != b);
+	}
+
+	int writeColumn( hid_t group, const char *name, hid_t type, hsize_t n, const void *values ){
+		hsize_t dims[1] = {n};
+		hid_t space = H5Screate_simple( 1, dims, NULL );
+		hid_t dataset = H5Dcreate2( group, name, type, space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
+		herr_t status = (n > 0) ? H5Dwrite( dataset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, values ) : 0;
+		H5Dclose( dataset );
+		H5Sclose( space );
+		return (dataset < 0 || status < 0);
+	}
+
+	/// strings as one fixed-length string dataset
+	int writeStrings( hid_t group, const char *name, const vector<string> &strings ){
+		size_t length = 1;
+		for (unsigned int i = 0; i < strings.size(); i++){
+			length = std::max( length, strings[i].size()+1 );
+		}
+		vector<char> buffer( std::max(strings.size(), (size_t)1)*length, 0 );
+		for (unsigned int i = 0; i < strings.size(); i++){
+			memcpy( &buffer[i*length], strings[i].c_str(), strings[i].size() );
+		}
+		hid_t type = H5Tcopy( H5T_C_S1 );
+		H5Tset_size( type, length );
+		int fail = writeColumn( group, name, type, strings.size(), &buffer[0] );
+		H5Tclose( type );
+		return fail;
+	}
+
+	int readStrings( hid_t file, const char *name, vector<string> &strings ){
+		hid_t dataset = H5Dopen2( file, name, H5P_DEFAULT );
+		if (dataset < 0){
+			return 1;
+		}
+		hid_t type = H5Dget_type( dataset );
+		size_t length = H5Tget_size( type );
+		hid_t space = H5Dget_space( dataset );
+		hsize_t n = H5Sget_simple_extent_npoints( space );
+		vector<char> buffer( std::max(n, (hsize_t)1)*length + 1, 0 );
+		herr_t status = (n > 0) ? H5Dread( dataset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, &buffer[0] ) : 0;
+		strings.clear();
+		for (hsize_t i = 0; i < n; i++){
+			strings.push_back( string( &buffer[i*length], strnlen( &buffer[i*length], length ) ) );
+		}
+		H5Sclose( space );
+		H5Tclose( type );
+		H5Dclose( dataset );
+		return (status < 0);
+	}
+
+	/// 'count' values from 'offset' on
+	int readColumn( hid_t file, const char *name, hid_t type, hsize_t offset, hsize_t count, void *values ){
+		hid_t dataset = H5Dopen2( file, name, H5P_DEFAULT );
+		if (dataset < 0){
+			return 1;
+		}
+		hsize_t start[1] = {offset};
+		hsize_t size[1] = {count};
+		hid_t space = H5Dget_space( dataset );
+		H5Sselect_hyperslab( space, H5S_SELECT_SET, start, NULL, size, NULL );
+		hid_t memspace = H5Screate_simple( 1, size, NULL );
+		herr_t status = H5Dread( dataset, type, memspace, space, H5P_DEFAULT, values );
+		H5Sclose( memspace );
+		H5Sclose( space );
+		H5Dclose( dataset );
+		return (status < 0);
+	}
+
+	void writeAttribute( hid_t file, const char *name, double value ){
+		hid_t space = H5Screate( H5S_SCALAR );
+		hid_t attr = H5Acreate2( file, name, H5T_NATIVE_DOUBLE, space, H5P_DEFAULT, H5P_DEFAULT );
+		H5Awrite( attr, H5T_NATIVE_DOUBLE, &value );
+		H5Aclose( attr );
+		H5Sclose( space );
+	}
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+PvRecorder::PvRecorder()
+	: p_names()
+	, p_descriptions()
+	, p_records()
+	, p_nEvents(0)
+	, p_nRecords(0)
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+PvRecorder::~PvRecorder()
+{
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+PvRecorder::begin( const vector<string> &names, const vector<string> &descriptions )
+{
+	p_names = names;
+	p_descriptions = descriptions;
+	p_descriptions.resize( names.size() );
+	p_records.clear();
+	p_records.resize( names.size() );
+	p_nEvents = 0;
+	p_nRecords = 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+PvRecorder::add( const string &name, const string &description )
+{
+	p_names.push_back( name );
+	p_descriptions.push_back( description );
+	p_records.push_back( vector<PvRecord>() );
+	return p_names.size() - 1;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+PvRecorder::record( unsigned int handle, double value, unsigned int index, unsigned int sec, unsigned int nsec )
+{
+	if (handle >= p_records.size()){
+		return;
+	}
+	vector<PvRecord> &series = p_records[handle];
+	if (!series.empty() && same( series.back().value, value )){
+		return;
+	}
+	PvRecord r;
+	r.index = index;
+	r.sec = sec;
+	r.nsec = nsec;
+	r.value = value;
+	series.push_back( r );
+	p_nRecords++;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+PvRecorder::recordMissing( unsigned int handle, unsigned int index, unsigned int sec, unsigned int nsec )
+{
+	//a PV that was never available needs no record
+	if (handle < p_records.size() && !p_records[handle].empty()){
+		record( handle, std::numeric_limits<double>::quiet_NaN(), index, sec, nsec );
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+PvRecorder::endEvent()
+{
+	p_nEvents++;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+PvRecorder::nPVs() const
+{
+	return p_names.size();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+PvRecorder::nEvents() const
+{
+	return p_nEvents;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned long
+PvRecorder::nRecords() const
+{
+	return p_nRecords;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PvRecorder::write( const string &filename, int run ) const
+{
+	hid_t file = H5Fcreate( filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT );
+	if (file < 0){
+		MsgLog(logger, error, "could not create PV file '" << filename << "'");
+		return 1;
+	}
+	writeAttribute( file, "run", run );
+	writeAttribute( file, "nEvents", p_nEvents );
+
+	//columns, sorted by PV
+	const unsigned int nPV = p_names.size();
+	vector<unsigned long> offset( nPV );
+	vector<unsigned long> count( nPV );
+	vector<unsigned int> index, sec, nsec;
+	vector<double> value;
+	index.reserve( p_nRecords );
+	sec.reserve( p_nRecords );
+	nsec.reserve( p_nRecords );
+	value.reserve( p_nRecords );
+	for (unsigned int h = 0; h < nPV; h++){
+		offset[h] = index.size();
+		count[h] = p_records[h].size();
+		for (unsigned int k = 0; k < p_records[h].size(); k++){
+			index.push_back( p_records[h][k].index );
+			sec.push_back( p_records[h][k].sec );
+			nsec.push_back( p_records[h][k].nsec );
+			value.push_back( p_records[h][k].value );
+		}
+	}
+	const hsize_t n = index.size();
+
+	int fail = 0;
+	hid_t group = H5Gcreate2( file, "pv", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
+	fail += writeStrings( group, "name", p_names );
+	fail += writeStrings( group, "description", p_descriptions );
+	H5Gclose( group );
+	group = H5Gcreate2( file, "index", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
+	fail += writeColumn( group, "offset", H5T_NATIVE_ULONG, nPV, nPV ? &offset[0] : 0 );
+	fail += writeColumn( group, "count", H5T_NATIVE_ULONG, nPV, nPV ? &count[0] : 0 );
+	H5Gclose( group );
+	group = H5Gcreate2( file, "record", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
+	fail += writeColumn( group, "index", H5T_NATIVE_UINT, n, n ? &index[0] : 0 );
+	fail += writeColumn( group, "sec", H5T_NATIVE_UINT, n, n ? &sec[0] : 0 );
+	fail += writeColumn( group, "nsec", H5T_NATIVE_UINT, n, n ? &nsec[0] : 0 );
+	fail += writeColumn( group, "value", H5T_NATIVE_DOUBLE, n, n ? &value[0] : 0 );
+	H5Gclose( group );
+	H5Fclose( file );
+
+	if (fail){
+		MsgLog(logger, error, "could not write PV file '" << filename << "'");
+		return 1;
+	}
+	MsgLog(logger, info, "wrote " << n << " changes of " << nPV << " PVs in " << p_nEvents << " events to '" << filename << "'");
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+PvRecorder::read( const string &filename, const string &name, vector<PvRecord> &series )
+{
+	series.clear();
+	hid_t file = H5Fopen( filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT );
+	if (file < 0){
+		MsgLog(logger, error, "could not open PV file '" << filename << "'");
+		return 1;
+	}
+	vector<string> names;
+	int fail = readStrings( file, "pv/name", names );
+	unsigned int h = 0;
+	while (h < names.size() && names[h] != name){
+		h++;
+	}
+	if (fail || h == names.size()){
+		MsgLog(logger, warning, "PV '" << name << "' not in '" << filename << "'");
+		H5Fclose( file );
+		return 1;
+	}
+
+	unsigned long offset = 0;
+	unsigned long count = 0;
+	fail += readColumn( file, "index/offset", H5T_NATIVE_ULONG, h, 1, &offset );
+	fail += readColumn( file, "index/count", H5T_NATIVE_ULONG, h, 1, &count );
+	if (!fail && count > 0){
+		vector<unsigned int> index( count ), sec( count ), nsec( count );
+		vector<double> value( count );
+		fail += readColumn( file, "record/index", H5T_NATIVE_UINT, offset, count, &index[0] );
+		fail += readColumn( file, "record/sec", H5T_NATIVE_UINT, offset, count, &sec[0] );
+		fail += readColumn( file, "record/nsec", H5T_NATIVE_UINT, offset, count, &nsec[0] );
+		fail += readColumn( file, "record/value", H5T_NATIVE_DOUBLE, offset, count, &value[0] );
+		series.resize( count );
+		for (unsigned long k = 0; k < count; k++){
+			series[k].index = index[k];
+			series[k].sec = sec[k];
+			series[k].nsec = nsec[k];
+			series[k].value = value[k];
+		}
+	}
+	H5Fclose( file );
+	if (fail){
+		MsgLog(logger, error, "could not read PV '" << name << "' from '" << filename << "'");
+		series.clear();
+		return 1;
+	}
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+double
+PvRecorder::valueAt( const vector<PvRecord> &series, unsigned int index )
+{
+	//last record at or before 'index'
+	unsigned int lo = 0;
+	unsigned int hi = series.size();
+	while (lo < hi){
+		unsigned int mid = (lo + hi)/2;
+		if (series[mid].index <= index){
+			lo = mid + 1;
+		}else{
+			hi = mid;
+		}
+	}
+	return lo ? series[lo-1].value : std::numeric_limits<double>::quiet_NaN();
+}
+
+
+} // namespace kitty
@@ -0,0 +1,210 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class RadialIntegrator...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/radialintegrator.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <cmath>
+#include <algorithm>
+
+using std::vector;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.RadialIntegrator";
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+RadialIntegrator::RadialIntegrator()
+	: p_bin()
+	, p_binPixels()
+	, p_invPixels()
+	, p_center()
+	, p_nQ(0)
+	, p_startQ(0)
+	, p_stopQ(0)
+	, p_binning(LINEAR)
+	, p_generation(-1)
+	, p_units(0)
+	, p_sum()
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+RadialIntegrator::~RadialIntegrator()
+{
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+RadialIntegrator::create( const array1D<double> *pix1, const array1D<double> *pix2, const array1D<double> *mask,
+	int nQ, double startQ, double stopQ, int binning, int generation, int units )
+{
+	p_bin.clear();
+	p_generation = -1;
+	if (!pix1 || !pix2 || pix1->size() != pix2->size() || nQ <= 0 || stopQ <= startQ
+		|| (binning == LOGARITHMIC && startQ <= 0)){
+		MsgLog(logger, error, "cannot create radial bins with nQ=" << nQ << ", startQ=" << startQ
+			<< ", stopQ=" << stopQ << ", binning=" << binning);
+		return 1;
+	}
+	if (mask && mask->size() != pix1->size()){
+		MsgLog(logger, warning, "mask size " << mask->size() << " does not match " << pix1->size() << " pixels, ignoring mask");
+		mask = 0;
+	}
+
+	const unsigned int n = pix1->size();
+	const double dq = (stopQ - startQ)/nQ;
+	const double logStart = (binning == LOGARITHMIC) ? log(startQ) : 0;
+	const double dlogq = (binning == LOGARITHMIC) ? (log(stopQ) - logStart)/nQ : 0;
+
+	p_bin.assign( n, nQ );
+	p_binPixels.assign( nQ+1, 0 );
+	for (unsigned int i = 0; i < n; i++){
+		if (mask && mask->get(i) == 0){
+			continue;
+		}
+		double x = pix1->get(i);
+		double y = pix2->get(i);
+		double q = sqrt( x*x + y*y );
+		if (q < startQ || q >= stopQ){
+			continue;
+		}
+		int iq = (binning == LOGARITHMIC) ? (int)floor( (log(q) - logStart)/dlogq ) : (int)floor( (q - startQ)/dq );
+		iq = std::max( 0, std::min( iq, nQ-1 ) );
+		p_bin[i] = iq;
+		p_binPixels[iq]++;
+	}
+	p_binPixels.resize( nQ );
+
+	p_invPixels.assign( nQ, 0. );
+	p_center.assign( nQ, 0. );
+	unsigned int nUsed = 0;
+	for (int iq = 0; iq < nQ; iq++){
+		if (p_binPixels[iq] > 0){
+			p_invPixels[iq] = 1./p_binPixels[iq];
+		}
+		nUsed += p_binPixels[iq];
+		if (binning == LOGARITHMIC){
+			p_center[iq] = exp( logStart + (iq+0.5)*dlogq );
+		}else{
+			p_center[iq] = startQ + (iq+0.5)*dq;
+		}
+	}
+
+	p_nQ = nQ;
+	p_startQ = startQ;
+	p_stopQ = stopQ;
+	p_binning = binning;
+	p_generation = generation;
+	p_units = units;
+	p_sum.assign( nQ+1, 0. );
+
+	MsgLog(logger, info, "radial bins (" << nQ << (binning == LOGARITHMIC ? ", logarithmic" : ", linear")
+		<< ") for geometry generation " << generation << ": " << nUsed << " of " << n << " pixels used");
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+RadialIntegrator::isCurrent( int nQ, double startQ, double stopQ, int binning, int generation, int units ) const
+{
+	return ( !p_bin.empty()
+		&& nQ == p_nQ && startQ == p_startQ && stopQ == p_stopQ
+		&& binning == p_binning && generation == p_generation && units == p_units );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+RadialIntegrator::integrate( const array1D<double> *data, array1D<double> *qAvg, array1D<double> *iAvg ) const
+{
+	if (p_bin.empty() || !data || data->size() < p_bin.size()){
+		MsgLog(logger, error, "radial bins not created or data does not match");
+		return 1;
+	}
+
+	//histogram of the intensities, unused pixels go to the overflow bin p_nQ
+	std::fill( p_sum.begin(), p_sum.end(), 0. );
+	const double *d = data->data();
+	const unsigned int *bin = &p_bin[0];
+	double *sum = &p_sum[0];
+	const unsigned int n = p_bin.size();
+	for (unsigned int i = 0; i < n; i++){
+		sum[bin[i]] += d[i];
+	}
+
+	for (int iq = 0; iq < p_nQ; iq++){
+		if (qAvg) qAvg->set( iq, p_center[iq] );
+		if (iAvg) iAvg->set( iq, sum[iq]*p_invPixels[iq] );
+	}
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+RadialIntegrator::nQ() const
+{
+	return p_nQ;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+RadialIntegrator::generation() const
+{
+	return p_generation;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+double
+RadialIntegrator::binCenter( int iq ) const
+{
+	return p_center[iq];
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+RadialIntegrator::binPixels( int iq ) const
+{
+	return p_binPixels[iq];
+}
+
+
+} // namespace kitty
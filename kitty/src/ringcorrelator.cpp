@@ -0,0 +1,438 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Classes RingCorrelator and RingPowerSum...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/ringcorrelator.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <algorithm>
+
+using std::string;
+using std::vector;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+#include "kitty/workerpool.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.RingCorrelator";
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+RingCorrelator::RingCorrelator()
+	: p_nQ(0)
+	, p_nPhi(0)
+	, p_nLag(0)
+	, p_real(0)
+	, p_spec(0)
+	, p_power(0)
+	, p_partBegin()
+	, p_forwardPlans()
+	, p_backwardPlans()
+	, p_mean()
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+RingCorrelator::~RingCorrelator()
+{
+	destroy();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+RingCorrelator::create( int nQ, int nPhi, int nParts )
+{
+	nParts = std::max( 1, std::min( nParts, nQ ) );
+	if (nQ == p_nQ && nPhi == p_nPhi && nParts == this->nParts()){
+		return 0;				// plans can be reused as they are
+	}
+	destroy();
+	if (nQ <= 0 || nPhi <= 0){
+		MsgLog(logger, error, "cannot create ring correlator for nQ=" << nQ << ", nPhi=" << nPhi);
+		return 1;
+	}
+	p_nQ = nQ;
+	p_nPhi = nPhi;
+	p_nLag = nPhi/2 + 1;
+
+	p_real = (double*) fftw_malloc( sizeof(double)*nQ*nPhi );
+	p_spec = (fftw_complex*) fftw_malloc( sizeof(fftw_complex)*nQ*p_nLag );
+	p_power = (fftw_complex*) fftw_malloc( sizeof(fftw_complex)*nQ*p_nLag );
+
+	//one plan per block of rings, FFTW_MEASURE overwrites the buffers, so this is done before any data is there
+	int n[] = {nPhi};
+	p_partBegin.resize( nParts+1 );
+	for (int part = 0; part < nParts; part++){
+		int begin = 0;
+		int end = 0;
+		WorkerPool::split( nQ, part, nParts, begin, end );
+		p_partBegin[part] = begin;
+		p_partBegin[part+1] = end;
+		int howmany = end - begin;
+		fftw_plan fwd = fftw_plan_many_dft_r2c( 1, n, howmany, p_real + begin*nPhi, 0, 1, nPhi, 
+			p_spec + begin*p_nLag, 0, 1, p_nLag, FFTW_MEASURE );
+		fftw_plan bwd = fftw_plan_many_dft_c2r( 1, n, howmany, p_power + begin*p_nLag, 0, 1, p_nLag, 
+			p_real + begin*nPhi, 0, 1, nPhi, FFTW_MEASURE );
+		p_forwardPlans.push_back( fwd );
+		p_backwardPlans.push_back( bwd );
+		if (!fwd || !bwd){
+			MsgLog(logger, error, "could not create FFTW plans for " << howmany << " rings of " << nPhi << " points");
+			destroy();
+			return 1;
+		}
+	}
+	p_mean.assign( nQ, 0. );
+
+	MsgLog(logger, info, "FFT plans for " << nQ << " rings of " << nPhi << " points in " << nParts << " part(s), " 
+		<< p_nLag << " lags");
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+RingCorrelator::destroy()
+{
+	for (unsigned int i = 0; i < p_forwardPlans.size(); i++){
+		if (p_forwardPlans[i]) fftw_destroy_plan( p_forwardPlans[i] );
+	}
+	for (unsigned int i = 0; i < p_backwardPlans.size(); i++){
+		if (p_backwardPlans[i]) fftw_destroy_plan( p_backwardPlans[i] );
+	}
+	fftw_free( p_real );
+	fftw_free( p_spec );
+	fftw_free( p_power );
+	p_forwardPlans.clear();
+	p_backwardPlans.clear();
+	p_partBegin.clear();
+	p_real = 0;
+	p_spec = 0;
+	p_power = 0;
+	p_nQ = 0;
+	p_nPhi = 0;
+	p_nLag = 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+RingCorrelator::nQ() const
+{
+	return p_nQ;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+RingCorrelator::nPhi() const
+{
+	return p_nPhi;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+RingCorrelator::nLag() const
+{
+	return p_nLag;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+RingCorrelator::nParts() const
+{
+	return p_forwardPlans.size();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+RingCorrelator::partRange( int part, int &begin, int &end ) const
+{
+	if (part < 0){
+		begin = 0;
+		end = p_nQ;
+	}else{
+		begin = p_partBegin[part];
+		end = p_partBegin[part+1];
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+RingCorrelator::forward( const array2D<double> *polar, int part )
+{
+	if (p_forwardPlans.empty() || !polar || (int)polar->dim1() != p_nQ || (int)polar->dim2() != p_nPhi){
+		MsgLog(logger, error, "polar image does not match the ring correlator (" << p_nQ << " x " << p_nPhi << ")");
+		return 1;
+	}
+	if (part < 0){
+		for (int p = 0; p < nParts(); p++){
+			forward( polar, p );
+		}
+		return 0;
+	}
+
+	int begin = 0;
+	int end = 0;
+	partRange( part, begin, end );
+	for (int iq = begin; iq < end; iq++){
+		double *ring = p_real + iq*p_nPhi;
+		double sum = 0;
+		for (int iphi = 0; iphi < p_nPhi; iphi++){
+			ring[iphi] = polar->get( iq, iphi );
+			sum += ring[iphi];
+		}
+		p_mean[iq] = sum/p_nPhi;
+		for (int iphi = 0; iphi < p_nPhi; iphi++){
+			ring[iphi] -= p_mean[iq];
+		}
+	}
+	fftw_execute( p_forwardPlans[part] );
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+const fftw_complex *
+RingCorrelator::spectrum( int iq ) const
+{
+	return p_spec + iq*p_nLag;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+double
+RingCorrelator::ringMean( int iq ) const
+{
+	return p_mean[iq];
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+RingCorrelator::autoCorrelate( const array2D<double> *polar, array2D<double> *corr, int part )
+{
+	if (part < 0){
+		int fail = 0;
+		for (int p = 0; p < nParts(); p++){
+			fail |= autoCorrelate( polar, corr, p );
+		}
+		return fail;
+	}
+	if (forward( polar, part )){
+		return 1;
+	}
+	int begin = 0;
+	int end = 0;
+	partRange( part, begin, end );
+	vector<double> norm( p_nQ, 0. );
+	for (int iq = begin; iq < end; iq++){
+		norm[iq] = p_mean[iq]*p_mean[iq];
+	}
+	//the power spectrum goes straight into the backward buffer
+	for (int k = begin*p_nLag; k < end*p_nLag; k++){
+		p_power[k][0] = p_spec[k][0]*p_spec[k][0] + p_spec[k][1]*p_spec[k][1];
+		p_power[k][1] = 0;
+	}
+	return backward( norm, corr, part );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+RingCorrelator::inverse( const double *power, const vector<double> &norm, array2D<double> *corr )
+{
+	if (p_backwardPlans.empty()){
+		MsgLog(logger, error, "ring correlator not created");
+		return 1;
+	}
+	for (int k = 0; k < p_nQ*p_nLag; k++){
+		p_power[k][0] = power[k];
+		p_power[k][1] = 0;
+	}
+	int fail = 0;
+	for (int part = 0; part < nParts(); part++){
+		fail |= backward( norm, corr, part );
+	}
+	return fail;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+RingCorrelator::backward( const vector<double> &norm, array2D<double> *corr, int part )
+{
+	if (!corr || (int)corr->dim1() != p_nQ || (int)corr->dim2() != p_nLag || (int)norm.size() != p_nQ){
+		MsgLog(logger, error, "correlation array does not match the ring correlator (" << p_nQ << " x " << p_nLag << ")");
+		return 1;
+	}
+	fftw_execute( p_backwardPlans[part] );
+
+	//unnormalized FFTW: backward(forward(f)) = nPhi*f, the correlation sum needs another 1/nPhi for the average over phi
+	const double scale = 1./((double)p_nPhi*p_nPhi);
+	int begin = 0;
+	int end = 0;
+	partRange( part, begin, end );
+	for (int iq = begin; iq < end; iq++){
+		const double *ring = p_real + iq*p_nPhi;
+		const double n = (norm[iq] != 0) ? scale/norm[iq] : 0;
+		for (int lag = 0; lag < p_nLag; lag++){
+			corr->set( iq, lag, ring[lag]*n );
+		}
+	}
+	return 0;
+}
+
+
+
+//----------------
+// Constructors --
+//----------------
+RingPowerSum::RingPowerSum()
+	: p_nQ(0)
+	, p_nLag(0)
+	, p_sum()
+	, p_count(0)
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+RingPowerSum::~RingPowerSum()
+{
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+RingPowerSum::create( int nQ, int nLag )
+{
+	p_nQ = nQ;
+	p_nLag = nLag;
+	p_sum.assign( nQ*nLag, 0. );
+	p_count = 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+RingPowerSum::add( const RingCorrelator &rc )
+{
+	addRings( rc, 0, p_nQ );
+	addEvent();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+RingPowerSum::addRings( const RingCorrelator &rc, int begin, int end )
+{
+	if (rc.nQ() != p_nQ || rc.nLag() != p_nLag){
+		MsgLog(logger, error, "ring correlator does not match the power sum (" << p_nQ << " x " << p_nLag << ")");
+		return;
+	}
+	for (int iq = begin; iq < end; iq++){
+		const double mean = rc.ringMean( iq );
+		if (mean == 0){
+			continue;
+		}
+		const double w = 1./(mean*mean);
+		const fftw_complex *spec = rc.spectrum( iq );
+		double *sum = &p_sum[iq*p_nLag];
+		for (int k = 0; k < p_nLag; k++){
+			sum[k] += w*(spec[k][0]*spec[k][0] + spec[k][1]*spec[k][1]);
+		}
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+RingPowerSum::addEvent()
+{
+	p_count++;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+RingPowerSum::count() const
+{
+	return p_count;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+RingPowerSum::correlation( RingCorrelator &rc, array2D<double> *corr ) const
+{
+	if (p_sum.empty() || rc.nQ() != p_nQ || rc.nLag() != p_nLag){
+		MsgLog(logger, error, "power sum does not match the ring correlator");
+		return 1;
+	}
+	//each spectrum is already normalized by its ring mean, so only the number of events remains
+	vector<double> norm( p_nQ, (double)p_count );
+	return rc.inverse( &p_sum[0], norm, corr );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+RingPowerSum::save( Checkpoint &cp, const string &prefix ) const
+{
+	cp.add( prefix+"count", (double)p_count );
+	cp.add( prefix+"sum", p_sum );
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+RingPowerSum::restore( const Checkpoint &cp, const string &prefix )
+{
+	double count = 0;
+	vector<double> sum;
+	if ( !cp.get( prefix+"count", count ) || !cp.get( prefix+"sum", sum ) || sum.size() != p_sum.size() ){
+		return 1;
+	}
+	p_count = (unsigned int)count;
+	p_sum = sum;
+	return 0;
+}
+
+
+} // namespace kitty
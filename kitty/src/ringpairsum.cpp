@@ -0,0 +1,489 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class RingPairSum...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/ringpairsum.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "hdf5/hdf5.h"
+
+using std::string;
+using std::vector;
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.RingPairSum";
+	const unsigned int writeBlock = 256;			// pairs transformed and written at once
+	const hsize_t outputChunk = 64;					// rows per HDF5 chunk
+
+	/// sum s plus error c, the addition is exact in double and the new rounding error is kept in c
+	inline void addCompensated( float &s, float &c, double x ){
+		double t = (double)s + (double)c + x;
+		s = (float)t;
+		c = (float)(t - (double)s);
+	}
+
+	/// the pairs of the tile in memory, split over the threads
+	class PairTask : public kitty::WorkerTask {
+	public:
+		kitty::RingPairSum *sum;
+		unsigned int begin;
+		unsigned int end;
+
+		virtual void execute( int part, int nParts ){
+			int b = 0;
+			int e = 0;
+			kitty::WorkerPool::split( end-begin, part, nParts, b, e );
+			sum->updatePairs( begin+b, begin+e );
+		}
+	};
+
+	hid_t createDataset( hid_t file, const char *name, hid_t type, hsize_t rows, hsize_t cols, int compression ){
+		hsize_t dims[2] = {rows, cols};
+		hsize_t chunk[2] = {std::min(rows, outputChunk), cols};
+		hid_t space = H5Screate_simple( 2, dims, NULL );
+		hid_t plist = H5Pcreate( H5P_DATASET_CREATE );
+		H5Pset_chunk( plist, 2, chunk );
+		if (compression > 0){
+			H5Pset_shuffle( plist );
+			H5Pset_deflate( plist, compression );
+		}
+		hid_t dataset = H5Dcreate2( file, name, type, space, H5P_DEFAULT, plist, H5P_DEFAULT );
+		H5Pclose( plist );
+		H5Sclose( space );
+		return dataset;
+	}
+
+	herr_t writeRows( hid_t dataset, hid_t memtype, hsize_t firstRow, hsize_t nRows, hsize_t cols, const void *buf ){
+		hsize_t start[2] = {firstRow, 0};
+		hsize_t count[2] = {nRows, cols};
+		hid_t space = H5Dget_space( dataset );
+		H5Sselect_hyperslab( space, H5S_SELECT_SET, start, NULL, count, NULL );
+		hid_t memspace = H5Screate_simple( 2, count, NULL );
+		herr_t status = H5Dwrite( dataset, memtype, memspace, space, H5P_DEFAULT, buf );
+		H5Sclose( memspace );
+		H5Sclose( space );
+		return status;
+	}
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+RingPairSum::RingPairSum()
+	: p_nQ(0)
+	, p_nPhi(0)
+	, p_nLag(0)
+	, p_nPairs(0)
+	, p_nValues(0)
+	, p_q1()
+	, p_q2()
+	, p_sum()
+	, p_tilePairs(0)
+	, p_nTiles(0)
+	, p_tile(0)
+	, p_spillFilename("")
+	, p_spillFile(-1)
+	, p_batch()
+	, p_batchEvents(1)
+	, p_batchCount(0)
+	, p_count(0)
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+RingPairSum::~RingPairSum()
+{
+	destroy();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+RingPairSum::create( int nQ, int nPhi, double memoryBytes, const string &spillFilename, int batchEvents )
+{
+	destroy();
+	if (nQ <= 0 || nPhi <= 0){
+		MsgLog(logger, error, "cannot create ring pair sum for nQ=" << nQ << ", nPhi=" << nPhi);
+		return 1;
+	}
+	p_nQ = nQ;
+	p_nPhi = nPhi;
+	p_nLag = nPhi/2 + 1;
+	p_nValues = 2*p_nLag;
+	p_nPairs = nQ*(nQ+1)/2;
+	for (int q1 = 0; q1 < nQ; q1++){
+		for (int q2 = q1; q2 < nQ; q2++){
+			p_q1.push_back( q1 );
+			p_q2.push_back( q2 );
+		}
+	}
+
+	//everything in memory, if it fits, tiles in a spill file otherwise
+	const double pairBytes = 2.*p_nValues*sizeof(float);
+	if (p_nPairs*pairBytes <= memoryBytes){
+		p_tilePairs = p_nPairs;
+	}else{
+		p_tilePairs = std::max( 1., memoryBytes/pairBytes );
+		p_spillFilename = spillFilename;
+		p_spillFile = open( spillFilename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+		if (p_spillFile < 0 || ftruncate( p_spillFile, (off_t)(p_nPairs*pairBytes) ) != 0){
+			MsgLog(logger, error, "could not create spill file '" << spillFilename << "' of "
+				<< p_nPairs*pairBytes/1048576. << " MB");
+			destroy();
+			return 1;
+		}
+	}
+	p_nTiles = (p_nPairs + p_tilePairs - 1)/p_tilePairs;
+	p_tile = 0;
+	p_sum.assign( (size_t)p_tilePairs*p_nValues*2, 0.f );
+
+	p_batchEvents = std::max( batchEvents, 1 );
+	p_batch.assign( (size_t)p_batchEvents*nQ*p_nValues, 0. );
+	p_batchCount = 0;
+	p_count = 0;
+
+	MsgLog(logger, info, p_nPairs << " ring pairs, " << p_nLag << " complex values each, "
+		<< p_nPairs*pairBytes/1048576. << " MB of sums"
+		<< (spilled() ? " in a spill file, " : " in memory, ") << p_nTiles << " tile(s)");
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+RingPairSum::destroy()
+{
+	if (p_spillFile >= 0){
+		close( p_spillFile );
+		remove( p_spillFilename.c_str() );
+	}
+	p_spillFile = -1;
+	p_spillFilename = "";
+	p_q1.clear();
+	p_q2.clear();
+	p_sum.clear();
+	p_batch.clear();
+	p_nQ = 0;
+	p_nPairs = 0;
+	p_nTiles = 0;
+	p_count = 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+RingPairSum::nQ() const
+{
+	return p_nQ;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+RingPairSum::nPairs() const
+{
+	return p_nPairs;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+RingPairSum::count() const
+{
+	return p_count;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+bool
+RingPairSum::spilled() const
+{
+	return p_spillFile >= 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+unsigned int
+RingPairSum::pairIndex( int q1, int q2 ) const
+{
+	return q1*p_nQ - q1*(q1-1)/2 + (q2-q1);
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+RingPairSum::add( const RingCorrelator &rc, WorkerPool &pool )
+{
+	if (rc.nQ() != p_nQ || rc.nLag() != p_nLag){
+		MsgLog(logger, error, "ring correlator does not match the pair sum (" << p_nQ << " x " << p_nLag << ")");
+		return;
+	}
+	//spectra divided by the ring means, rings without intensity do not contribute
+	double *batch = &p_batch[(size_t)p_batchCount*p_nQ*p_nValues];
+	for (int iq = 0; iq < p_nQ; iq++){
+		const double mean = rc.ringMean( iq );
+		const double w = (mean != 0) ? 1./mean : 0;
+		const fftw_complex *spec = rc.spectrum( iq );
+		double *f = batch + iq*p_nValues;
+		for (int k = 0; k < p_nLag; k++){
+			f[2*k] = w*spec[k][0];
+			f[2*k+1] = w*spec[k][1];
+		}
+	}
+	p_batchCount++;
+	p_count++;
+	if (p_batchCount == p_batchEvents){
+		flush( pool );
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+RingPairSum::flush( WorkerPool &pool )
+{
+	if (p_batchCount == 0){
+		return;
+	}
+	//start with the tile that is already in memory
+	for (unsigned int i = 0; i < p_nTiles; i++){
+		unsigned int tile = (p_tile + i) % p_nTiles;
+		if (loadTile( tile )){
+			break;
+		}
+		PairTask task;
+		task.sum = this;
+		task.begin = tile*p_tilePairs;
+		task.end = std::min( task.begin + p_tilePairs, p_nPairs );
+		pool.run( task );
+	}
+	p_batchCount = 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+RingPairSum::updatePairs( unsigned int begin, unsigned int end )
+{
+	const unsigned int tileBegin = p_tile*p_tilePairs;
+	for (unsigned int p = begin; p < end; p++){
+		float *acc = &p_sum[(size_t)(p - tileBegin)*p_nValues*2];
+		for (int e = 0; e < p_batchCount; e++){
+			const double *f1 = &p_batch[((size_t)e*p_nQ + p_q1[p])*p_nValues];
+			const double *f2 = &p_batch[((size_t)e*p_nQ + p_q2[p])*p_nValues];
+			for (int k = 0; k < p_nLag; k++){
+				//conj(F1) F2
+				double re = f1[2*k]*f2[2*k] + f1[2*k+1]*f2[2*k+1];
+				double im = f1[2*k]*f2[2*k+1] - f1[2*k+1]*f2[2*k];
+				addCompensated( acc[4*k], acc[4*k+1], re );
+				addCompensated( acc[4*k+2], acc[4*k+3], im );
+			}
+		}
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+RingPairSum::write( const string &filename, const array1D<double> *q, int compression, const MaskCorrelation *mask )
+{
+	if (p_nPairs == 0 || p_count == 0){
+		MsgLog(logger, warning, "no cross-correlations to write to '" << filename << "'");
+		return 1;
+	}
+	if (p_batchCount > 0){
+		MsgLog(logger, warning, p_batchCount << " events not yet added to the sums, call flush() first");
+	}
+	hid_t file = H5Fcreate( filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT );
+	if (file < 0){
+		MsgLog(logger, error, "could not create '" << filename << "'");
+		return 1;
+	}
+
+	//diagonal: nQ x nLag, pairs q1 < q2: nOff x nPhi, with their ring indices
+	const unsigned int nOff = p_nPairs - p_nQ;
+	hid_t diagonal = createDataset( file, "diagonal", H5T_NATIVE_FLOAT, p_nQ, p_nLag, compression );
+	hid_t pairs = nOff ? createDataset( file, "pairs", H5T_NATIVE_FLOAT, nOff, p_nPhi, compression ) : -1;
+	vector<int> q1, q2;
+	for (unsigned int p = 0; p < p_nPairs; p++){
+		if (p_q1[p] != p_q2[p]){
+			q1.push_back( p_q1[p] );
+			q2.push_back( p_q2[p] );
+		}
+	}
+	if (nOff){
+		hid_t ds = createDataset( file, "q1", H5T_NATIVE_INT, nOff, 1, 0 );
+		writeRows( ds, H5T_NATIVE_INT, 0, nOff, 1, &q1[0] );
+		H5Dclose( ds );
+		ds = createDataset( file, "q2", H5T_NATIVE_INT, nOff, 1, 0 );
+		writeRows( ds, H5T_NATIVE_INT, 0, nOff, 1, &q2[0] );
+		H5Dclose( ds );
+	}
+	if (q && (int)q->size() == p_nQ){
+		hid_t ds = createDataset( file, "q", H5T_NATIVE_DOUBLE, p_nQ, 1, 0 );
+		writeRows( ds, H5T_NATIVE_DOUBLE, 0, p_nQ, 1, q->data() );
+		H5Dclose( ds );
+	}
+	double n = p_count;
+	hid_t ds = createDataset( file, "count", H5T_NATIVE_DOUBLE, 1, 1, 0 );
+	writeRows( ds, H5T_NATIVE_DOUBLE, 0, 1, 1, &n );
+	H5Dclose( ds );
+
+	//inverse transform pair by pair, written in blocks of consecutive pairs
+	fftw_complex *in = (fftw_complex*) fftw_malloc( sizeof(fftw_complex)*p_nLag );
+	double *out = (double*) fftw_malloc( sizeof(double)*p_nPhi );
+	fftw_plan plan = fftw_plan_dft_c2r_1d( p_nPhi, in, out, FFTW_ESTIMATE );
+	const double scale = 1./((double)p_nPhi*p_nPhi*p_count);
+	if (mask && mask->nQ() != p_nQ){
+		MsgLog(logger, warning, "mask correlation does not match, writing without mask normalization");
+		mask = 0;
+	}
+	vector<double> factors( p_nPhi, 1. );
+	vector<float> diagBuf( writeBlock*p_nLag );
+	vector<float> offBuf( writeBlock*p_nPhi );
+	int fail = 0;
+	for (unsigned int tile = 0; tile < p_nTiles && !fail; tile++){
+		fail = loadTile( tile );
+		const unsigned int tileBegin = tile*p_tilePairs;
+		const unsigned int tileEnd = std::min( tileBegin + p_tilePairs, p_nPairs );
+		for (unsigned int b = tileBegin; b < tileEnd && !fail; b += writeBlock){
+			const unsigned int e = std::min( b + writeBlock, tileEnd );
+			hsize_t firstDiag = 0, nDiag = 0, firstOff = 0, nOffBlock = 0;
+			for (unsigned int p = b; p < e; p++){
+				const float *acc = &p_sum[(size_t)(p - tileBegin)*p_nValues*2];
+				for (int k = 0; k < p_nLag; k++){
+					in[k][0] = (double)acc[4*k] + acc[4*k+1];
+					in[k][1] = (double)acc[4*k+2] + acc[4*k+3];
+				}
+				fftw_execute( plan );
+				if (mask){
+					mask->pairFactors( p_q1[p], p_q2[p], &factors[0] );
+				}
+				for (int lag = 0; lag < p_nPhi; lag++){
+					out[lag] *= scale*factors[lag];
+				}
+				if (p_q1[p] == p_q2[p]){
+					if (nDiag == 0) firstDiag = p_q1[p];
+					for (int lag = 0; lag < p_nLag; lag++){
+						diagBuf[nDiag*p_nLag + lag] = out[lag];
+					}
+					nDiag++;
+				}else{
+					//pairs before p: p_q1[p]+1 of them are on the diagonal
+					if (nOffBlock == 0) firstOff = p - (p_q1[p] + 1);
+					for (int lag = 0; lag < p_nPhi; lag++){
+						offBuf[nOffBlock*p_nPhi + lag] = out[lag];
+					}
+					nOffBlock++;
+				}
+			}
+			if (nDiag && writeRows( diagonal, H5T_NATIVE_FLOAT, firstDiag, nDiag, p_nLag, &diagBuf[0] ) < 0){
+				fail = 1;
+			}
+			if (nOffBlock && writeRows( pairs, H5T_NATIVE_FLOAT, firstOff, nOffBlock, p_nPhi, &offBuf[0] ) < 0){
+				fail = 1;
+			}
+		}
+	}
+	fftw_destroy_plan( plan );
+	fftw_free( in );
+	fftw_free( out );
+
+	H5Dclose( diagonal );
+	if (pairs >= 0) H5Dclose( pairs );
+	H5Fclose( file );
+
+	if (fail){
+		MsgLog(logger, error, "could not write cross-correlations to '" << filename << "'");
+	}else{
+		MsgLog(logger, info, "wrote cross-correlations of " << p_nPairs << " ring pairs (" << p_count
+			<< " events) to '" << filename << "'");
+	}
+	return fail;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+RingPairSum::loadTile( unsigned int tile )
+{
+	if (tile == p_tile){
+		return 0;
+	}
+	if (storeTile( p_tile )){
+		return 1;
+	}
+	const size_t tileBytes = p_sum.size()*sizeof(float);
+	const unsigned int nPairs = std::min( p_tilePairs, p_nPairs - tile*p_tilePairs );
+	const size_t bytes = (size_t)nPairs*p_nValues*2*sizeof(float);
+	char *buf = (char*) &p_sum[0];
+	off_t offset = (off_t)tile*tileBytes;
+	for (size_t done = 0; done < bytes; ){
+		ssize_t n = pread( p_spillFile, buf + done, bytes - done, offset + done );
+		if (n <= 0){
+			MsgLog(logger, error, "could not read tile " << tile << " from '" << p_spillFilename << "'");
+			return 1;
+		}
+		done += n;
+	}
+	p_tile = tile;
+	return 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+RingPairSum::storeTile( unsigned int tile )
+{
+	const size_t tileBytes = p_sum.size()*sizeof(float);
+	const unsigned int nPairs = std::min( p_tilePairs, p_nPairs - tile*p_tilePairs );
+	const size_t bytes = (size_t)nPairs*p_nValues*2*sizeof(float);
+	const char *buf = (const char*) &p_sum[0];
+	off_t offset = (off_t)tile*tileBytes;
+	for (size_t done = 0; done < bytes; ){
+		ssize_t n = pwrite( p_spillFile, buf + done, bytes - done, offset + done );
+		if (n <= 0){
+			MsgLog(logger, error, "could not write tile " << tile << " to '" << p_spillFilename << "'");
+			return 1;
+		}
+		done += n;
+	}
+	return 0;
+}
+
+
+} // namespace kitty
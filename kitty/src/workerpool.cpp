@@ -0,0 +1,181 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Class WorkerPool...
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "kitty/workerpool.h"
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <boost/bind.hpp>
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "MsgLogger/MsgLogger.h"
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const char *logger = "kitty.WorkerPool";
+}
+
+//		----------------------------------------
+// 		-- Public Function Member Definitions --
+//		----------------------------------------
+
+namespace kitty {
+
+//----------------
+// Constructors --
+//----------------
+WorkerPool::WorkerPool()
+	: p_nThreads(1)
+	, p_threads()
+	, p_mutex()
+	, p_start()
+	, p_done()
+	, p_task(0)
+	, p_generation(0)
+	, p_pending(0)
+	, p_quit(false)
+{
+}
+
+//--------------
+// Destructor --
+//--------------
+WorkerPool::~WorkerPool()
+{
+	destroy();
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+WorkerPool::create( int nThreads )
+{
+	destroy();
+	unsigned int generation = 0;
+	{
+		boost::mutex::scoped_lock lock( p_mutex );
+		p_nThreads = (nThreads > 1) ? nThreads : 1;
+		p_quit = false;
+		p_task = 0;
+		generation = p_generation;
+	}
+	//the workers start at the current generation, so only tasks run after this wake them
+	for (int part = 1; part < p_nThreads; part++){
+		p_threads.push_back( new boost::thread( boost::bind( &WorkerPool::work, this, part, generation ) ) );
+	}
+	MsgLog(logger, info, "using " << p_nThreads << " thread(s)");
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+WorkerPool::destroy()
+{
+	{
+		boost::mutex::scoped_lock lock( p_mutex );
+		p_quit = true;
+		p_generation++;
+	}
+	p_start.notify_all();
+	for (unsigned int i = 0; i < p_threads.size(); i++){
+		p_threads[i]->join();
+		delete p_threads[i];
+	}
+	p_threads.clear();
+	p_nThreads = 1;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+int
+WorkerPool::nThreads() const
+{
+	return p_nThreads;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+WorkerPool::run( WorkerTask &task )
+{
+	if (p_nThreads == 1){
+		task.execute( 0, 1 );
+		return;
+	}
+	{
+		boost::mutex::scoped_lock lock( p_mutex );
+		p_task = &task;
+		p_pending = p_nThreads - 1;
+		p_generation++;
+	}
+	p_start.notify_all();
+
+	task.execute( 0, p_nThreads );
+
+	boost::mutex::scoped_lock lock( p_mutex );
+	while (p_pending > 0){
+		p_done.wait( lock );
+	}
+	p_task = 0;
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+WorkerPool::work( int part, unsigned int generation )
+{
+	unsigned int seen = generation;
+	while (true){
+		WorkerTask *task = 0;
+		{
+			boost::mutex::scoped_lock lock( p_mutex );
+			while (p_generation == seen){
+				p_start.wait( lock );
+			}
+			seen = p_generation;
+			if (p_quit){
+				return;
+			}
+			task = p_task;
+		}
+		if (!task){
+			continue;
+		}
+
+		task->execute( part, p_nThreads );
+
+		boost::mutex::scoped_lock lock( p_mutex );
+		if (--p_pending == 0){
+			p_done.notify_one();
+		}
+	}
+}
+
+
+/// ------------------------------------------------------------------------------------------------
+void
+WorkerPool::split( int n, int part, int nParts, int &begin, int &end )
+{
+	begin = (int)( (long)n*part/nParts );
+	end = (int)( (long)n*(part+1)/nParts );
+}
+
+
+} // namespace kitty
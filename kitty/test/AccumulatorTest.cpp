@@ -0,0 +1,116 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Test suite case for PixelAccumulator.
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <cmath>
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "kitty/accumulator.h"
+
+using namespace kitty;
+
+#define BOOST_TEST_MODULE AccumulatorTest
+#include <boost/test/included/unit_test.hpp>
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const unsigned int nPixels = 3;
+	const int nEvents = 11;
+
+	/// event 'e' of a made-up run, with an offset per pixel so that the pixels differ
+	void fillEvent( int e, array1D<double> *data ){
+		for (unsigned int i = 0; i < nPixels; i++){
+			data->set( i, 100.*i + ((e*7) % 5) + 0.25*e );
+		}
+	}
+
+	void checkEqual( const shared_ptr<array1D<double> > &a, const shared_ptr<array1D<double> > &b ){
+		BOOST_REQUIRE_EQUAL( a->size(), b->size() );
+		for (unsigned int i = 0; i < a->size(); i++){
+			BOOST_CHECK_SMALL( a->get(i) - b->get(i), 1e-9*(1 + fabs(a->get(i))) );
+		}
+	}
+}
+
+// ==============================================================
+
+BOOST_AUTO_TEST_SUITE( AccumulatorTest )
+
+// ==============================================================
+
+/// merging the accumulators of two parts of a run gives the statistics of the whole run
+BOOST_AUTO_TEST_CASE( merge_equals_add )
+{
+	array1D<double> data( nPixels );
+	PixelAccumulator all( nPixels );
+	PixelAccumulator a( nPixels );
+	PixelAccumulator b( nPixels );
+	all.setThreshold( 102. );
+	a.setThreshold( 102. );
+	b.setThreshold( 102. );
+	for (int e = 0; e < nEvents; e++){
+		fillEvent( e, &data );
+		all.add( &data );
+		if (e < 4){
+			a.add( &data );
+		}else{
+			b.add( &data );
+		}
+	}
+
+	BOOST_REQUIRE_EQUAL( a.merge( b ), 0 );
+	BOOST_CHECK_EQUAL( a.count(), all.count() );
+	checkEqual( a.sum(), all.sum() );
+	checkEqual( a.mean(), all.mean() );
+	checkEqual( a.variance(), all.variance() );
+	checkEqual( a.min(), all.min() );
+	checkEqual( a.max(), all.max() );
+	checkEqual( a.countAbove(), all.countAbove() );
+}
+
+/// an empty accumulator is neutral on both sides of merge
+BOOST_AUTO_TEST_CASE( merge_empty )
+{
+	array1D<double> data( nPixels );
+	PixelAccumulator a( nPixels );
+	PixelAccumulator empty( nPixels );
+	PixelAccumulator c( nPixels );
+	for (int e = 0; e < nEvents; e++){
+		fillEvent( e, &data );
+		a.add( &data );
+	}
+	BOOST_REQUIRE_EQUAL( c.merge( a ), 0 );
+	BOOST_REQUIRE_EQUAL( a.merge( empty ), 0 );
+	BOOST_CHECK_EQUAL( a.count(), (unsigned int)nEvents );
+	BOOST_CHECK_EQUAL( c.count(), (unsigned int)nEvents );
+	checkEqual( c.mean(), a.mean() );
+	checkEqual( c.variance(), a.variance() );
+	checkEqual( c.min(), a.min() );
+}
+
+/// accumulators of different sizes are not merged
+BOOST_AUTO_TEST_CASE( merge_size_mismatch )
+{
+	PixelAccumulator a( nPixels );
+	PixelAccumulator b( nPixels+1 );
+	BOOST_CHECK_NE( a.merge( b ), 0 );
+}
+
+// ==============================================================
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,110 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Test suite case for BlockAccumulator.
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <cmath>
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "kitty/blockaccumulator.h"
+
+using namespace kitty;
+
+#define BOOST_TEST_MODULE BlockAccumulatorTest
+#include <boost/test/included/unit_test.hpp>
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	/// add the single-pixel events 'values' to 'acc'
+	void addEvents( BlockAccumulator &acc, const double *values, int n ){
+		array1D<double> data( 1 );
+		for (int e = 0; e < n; e++){
+			data.set( 0, values[e] );
+			acc.add( &data );
+		}
+	}
+}
+
+// ==============================================================
+
+BOOST_AUTO_TEST_SUITE( BlockAccumulatorTest )
+
+// ==============================================================
+
+/// 1, 2, 3, 4 in two blocks: {1, 2} and {3, 4} after one merge of the blocks
+///   mean 2.5, jackknife means (3+4)/2 = 3.5 and (1+2)/2 = 1.5,
+///   error^2 = (2-1)/2 * ((3.5-2.5)^2 + (1.5-2.5)^2) = 1,
+///   per-event variance 30/4 - 2.5^2 = 1.25
+BOOST_AUTO_TEST_CASE( jackknife_full_blocks )
+{
+	const double values[] = { 1, 2, 3, 4 };
+	BlockAccumulator acc;
+	acc.create( 1, 2 );
+	addEvents( acc, values, 4 );
+	BOOST_CHECK_EQUAL( acc.count(), 4u );
+	BOOST_CHECK_EQUAL( acc.blocksUsed(), 2u );
+
+	array1D<double> mean( 1 );
+	array1D<double> error( 1 );
+	array1D<double> stddev( 1 );
+	BOOST_REQUIRE_EQUAL( acc.result( &mean, &error, BlockAccumulator::JACKKNIFE, &stddev ), 0 );
+	BOOST_CHECK_CLOSE( mean.get(0), 2.5, 1e-9 );
+	BOOST_CHECK_CLOSE( error.get(0), 1., 1e-9 );
+	BOOST_CHECK_CLOSE( stddev.get(0), sqrt(1.25), 1e-9 );
+
+	//batch means of equal blocks: block means 1.5 and 3.5, error^2 = 2/(1*4^2) * ((3-5)^2 + (7-5)^2) = 1
+	BOOST_REQUIRE_EQUAL( acc.result( &mean, &error, BlockAccumulator::BATCH_MEANS ), 0 );
+	BOOST_CHECK_CLOSE( error.get(0), 1., 1e-9 );
+}
+
+/// 1, 2, 3 in two blocks: {1, 2} and the incomplete {3}
+///   mean 2, jackknife means 3/1 = 3 and 3/2 = 1.5, their average 2.25,
+///   error^2 = (2-1)/2 * (0.75^2 + 0.75^2) = 0.5625
+BOOST_AUTO_TEST_CASE( jackknife_incomplete_block )
+{
+	const double values[] = { 1, 2, 3 };
+	BlockAccumulator acc;
+	acc.create( 1, 2 );
+	addEvents( acc, values, 3 );
+	BOOST_CHECK_EQUAL( acc.blocksUsed(), 2u );
+
+	array1D<double> mean( 1 );
+	array1D<double> error( 1 );
+	BOOST_REQUIRE_EQUAL( acc.result( &mean, &error, BlockAccumulator::JACKKNIFE ), 0 );
+	BOOST_CHECK_CLOSE( mean.get(0), 2., 1e-9 );
+	BOOST_CHECK_CLOSE( error.get(0), 0.75, 1e-9 );
+}
+
+/// a constant has no error, however the blocks were merged
+BOOST_AUTO_TEST_CASE( constant_values )
+{
+	const double values[] = { 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5 };
+	BlockAccumulator acc;
+	acc.create( 1, 4 );
+	addEvents( acc, values, 11 );
+	BOOST_CHECK_EQUAL( acc.blocksUsed(), 3u );
+
+	array1D<double> mean( 1 );
+	array1D<double> error( 1 );
+	BOOST_REQUIRE_EQUAL( acc.result( &mean, &error, BlockAccumulator::JACKKNIFE ), 0 );
+	BOOST_CHECK_CLOSE( mean.get(0), 5., 1e-9 );
+	BOOST_CHECK_SMALL( error.get(0), 1e-12 );
+}
+
+// ==============================================================
+
+BOOST_AUTO_TEST_SUITE_END()
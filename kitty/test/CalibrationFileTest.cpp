@@ -0,0 +1,147 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Test suite case for CalibrationFile.
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "kitty/calibrationfile.h"
+
+using namespace kitty;
+using std::string;
+
+#define BOOST_TEST_MODULE CalibrationFileTest
+#include <boost/test/included/unit_test.hpp>
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	const unsigned int nPixels = 21;		// not a multiple of 8, the last byte of a bit mask is partly used
+
+	/// calibration file in the working directory, removed at the end of the test case
+	struct TempFile {
+		string name;
+		TempFile( const string &base ){
+			char pid[32];
+			sprintf( pid, "%d", (int)getpid() );
+			name = base + "_" + pid + ".kcal";
+		}
+		~TempFile(){
+			remove( name.c_str() );
+		}
+	};
+}
+
+// ==============================================================
+
+BOOST_AUTO_TEST_SUITE( CalibrationFileTest )
+
+// ==============================================================
+
+/// float values come back as they were written, to float precision
+BOOST_AUTO_TEST_CASE( float32_round_trip )
+{
+	TempFile file( "CalibrationFileTest_float" );
+	array1D<double> data( nPixels );
+	for (unsigned int i = 0; i < nPixels; i++){
+		data.set( i, 1000. - 37.25*i );
+	}
+	BOOST_REQUIRE_EQUAL( CalibrationFile::write( file.name, &data, CalibrationFile::FLOAT32, "background.h5" ), 0 );
+	BOOST_CHECK( CalibrationFile::isCalibrationFile( file.name ) );
+
+	CalibrationFile in;
+	BOOST_REQUIRE_EQUAL( in.open( file.name ), 0 );
+	BOOST_CHECK_EQUAL( in.payload(), CalibrationFile::FLOAT32 );
+	BOOST_CHECK_EQUAL( in.size(), nPixels );
+	BOOST_CHECK_EQUAL( in.source(), "background.h5" );
+	BOOST_REQUIRE( in.values() );
+	BOOST_CHECK( !in.bits() );
+	for (unsigned int i = 0; i < nPixels; i++){
+		BOOST_CHECK_EQUAL( in.get(i), (double)(float)data.get(i) );
+		BOOST_CHECK_EQUAL( in.values()[i], (float)data.get(i) );
+	}
+
+	//load() reads the same values into a new array
+	array1D<double> *loaded = 0;
+	BOOST_REQUIRE_EQUAL( CalibrationFile::load( file.name, loaded, 0 ), 0 );
+	BOOST_REQUIRE( loaded );
+	BOOST_REQUIRE_EQUAL( loaded->size(), nPixels );
+	for (unsigned int i = 0; i < nPixels; i++){
+		BOOST_CHECK_EQUAL( loaded->get(i), (double)(float)data.get(i) );
+	}
+	delete loaded;
+}
+
+/// every value != 0 is a good pixel (1), all others are bad (0)
+BOOST_AUTO_TEST_CASE( bitmask_round_trip )
+{
+	TempFile file( "CalibrationFileTest_mask" );
+	array1D<double> data( nPixels );
+	for (unsigned int i = 0; i < nPixels; i++){
+		data.set( i, (i % 3 == 0) ? 0. : 0.5*i );
+	}
+	BOOST_REQUIRE_EQUAL( CalibrationFile::write( file.name, &data, CalibrationFile::BITMASK, "mask.edf" ), 0 );
+
+	CalibrationFile in;
+	BOOST_REQUIRE_EQUAL( in.open( file.name ), 0 );
+	BOOST_CHECK_EQUAL( in.payload(), CalibrationFile::BITMASK );
+	BOOST_CHECK_EQUAL( in.size(), nPixels );
+	BOOST_REQUIRE( in.bits() );
+	BOOST_CHECK( !in.values() );
+	array1D<double> *copy = 0;
+	in.copyTo( copy );
+	BOOST_REQUIRE( copy );
+	for (unsigned int i = 0; i < nPixels; i++){
+		const double expected = (i % 3 == 0) ? 0. : 1.;
+		BOOST_CHECK_EQUAL( in.get(i), expected );
+		BOOST_CHECK_EQUAL( copy->get(i), expected );
+	}
+	delete copy;
+}
+
+/// a changed payload fails the checksum, a file of the wrong size fails the header check
+BOOST_AUTO_TEST_CASE( corrupt_file )
+{
+	TempFile file( "CalibrationFileTest_corrupt" );
+	array1D<double> data( nPixels );
+	for (unsigned int i = 0; i < nPixels; i++){
+		data.set( i, i );
+	}
+	BOOST_REQUIRE_EQUAL( CalibrationFile::write( file.name, &data, CalibrationFile::FLOAT32, "" ), 0 );
+
+	//flip a bit of the last value
+	FILE *f = fopen( file.name.c_str(), "r+b" );
+	BOOST_REQUIRE( f );
+	fseek( f, -1, SEEK_END );
+	int c = fgetc( f );
+	fseek( f, -1, SEEK_END );
+	fputc( c ^ 1, f );
+	fclose( f );
+	CalibrationFile in;
+	BOOST_CHECK_NE( in.open( file.name ), 0 );
+	BOOST_CHECK( !in.isOpen() );
+
+	//cut off the last value
+	BOOST_REQUIRE_EQUAL( truncate( file.name.c_str(), 256 + 4*(nPixels-1) ), 0 );
+	BOOST_CHECK_NE( in.open( file.name ), 0 );
+}
+
+// ==============================================================
+
+BOOST_AUTO_TEST_SUITE_END()
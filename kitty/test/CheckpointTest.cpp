@@ -0,0 +1,162 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Test suite case for Checkpoint.
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "kitty/accumulator.h"
+#include "kitty/checkpoint.h"
+
+using namespace kitty;
+using std::string;
+using std::vector;
+
+#define BOOST_TEST_MODULE CheckpointTest
+#include <boost/test/included/unit_test.hpp>
+
+//-----------------------------------------------------------------------
+// Local Macros, Typedefs, Structures, Unions and Forward Declarations --
+//-----------------------------------------------------------------------
+namespace {
+	/// checkpoint file in the working directory, removed at the end of the test case
+	struct TempFile {
+		string name;
+		TempFile( const string &base ){
+			char pid[32];
+			sprintf( pid, "%d", (int)getpid() );
+			name = base + "_" + pid + ".bin";
+		}
+		~TempFile(){
+			remove( name.c_str() );
+		}
+	};
+}
+
+// ==============================================================
+
+BOOST_AUTO_TEST_SUITE( CheckpointTest )
+
+// ==============================================================
+
+/// all kinds of blocks come back from the file as they were added
+BOOST_AUTO_TEST_CASE( write_and_load )
+{
+	TempFile file( "CheckpointTest" );
+	vector<double> values;
+	values.push_back( 1.5 );
+	values.push_back( -2e300 );
+	values.push_back( 0 );
+	array1D<double> arr( 4 );
+	for (unsigned int i = 0; i < 4; i++){
+		arr.set( i, 0.1*i );
+	}
+
+	Checkpoint out;
+	out.configure( file.name, 0, 0 );
+	out.begin( 42 );
+	out.add( "vector", values );
+	out.add( "array", &arr );
+	out.add( "scalar", 3.25 );
+	out.add( "empty", vector<double>() );
+	BOOST_REQUIRE_EQUAL( out.commit(), 0 );
+
+	Checkpoint in;
+	in.configure( file.name, 0, 0 );
+	BOOST_REQUIRE_EQUAL( in.load(), 0 );
+	BOOST_CHECK_EQUAL( in.lastEvent(), 42u );
+
+	vector<double> v;
+	BOOST_REQUIRE( in.get( "vector", v ) );
+	BOOST_CHECK_EQUAL_COLLECTIONS( v.begin(), v.end(), values.begin(), values.end() );
+
+	array1D<double> a( 4 );
+	BOOST_REQUIRE( in.get( "array", &a ) );
+	for (unsigned int i = 0; i < 4; i++){
+		BOOST_CHECK_EQUAL( a.get(i), arr.get(i) );
+	}
+
+	double s = 0;
+	BOOST_REQUIRE( in.get( "scalar", s ) );
+	BOOST_CHECK_EQUAL( s, 3.25 );
+
+	BOOST_REQUIRE( in.get( "empty", v ) );
+	BOOST_CHECK( v.empty() );
+	BOOST_CHECK( !in.get( "missing", s ) );
+}
+
+/// a resumed accumulator continues exactly where the saved one stopped
+BOOST_AUTO_TEST_CASE( accumulator_round_trip )
+{
+	TempFile file( "CheckpointTest_acc" );
+	array1D<double> data( 2 );
+	PixelAccumulator acc( 2 );
+	acc.setThreshold( 1. );
+	for (int e = 0; e < 5; e++){
+		data.set( 0, e );
+		data.set( 1, 0.5*e*e );
+		acc.add( &data );
+	}
+
+	Checkpoint out;
+	out.configure( file.name, 0, 0 );
+	out.begin( 5 );
+	acc.save( out, "raw_" );
+	BOOST_REQUIRE_EQUAL( out.commit(), 0 );
+
+	Checkpoint in;
+	in.configure( file.name, 0, 0 );
+	BOOST_REQUIRE_EQUAL( in.load(), 0 );
+	PixelAccumulator restored( 2 );
+	BOOST_REQUIRE_EQUAL( restored.restore( in, "raw_" ), 0 );
+	BOOST_CHECK_EQUAL( restored.count(), acc.count() );
+	BOOST_CHECK_EQUAL( restored.threshold(), acc.threshold() );
+	for (unsigned int i = 0; i < 2; i++){
+		BOOST_CHECK_EQUAL( restored.mean()->get(i), acc.mean()->get(i) );
+		BOOST_CHECK_EQUAL( restored.variance()->get(i), acc.variance()->get(i) );
+		BOOST_CHECK_EQUAL( restored.max()->get(i), acc.max()->get(i) );
+		BOOST_CHECK_EQUAL( restored.countAbove()->get(i), acc.countAbove()->get(i) );
+	}
+
+	//blocks of another size are not restored
+	PixelAccumulator other( 3 );
+	BOOST_CHECK_NE( other.restore( in, "raw_" ), 0 );
+}
+
+/// a file that is not a checkpoint is rejected
+BOOST_AUTO_TEST_CASE( load_foreign_file )
+{
+	TempFile file( "CheckpointTest_foreign" );
+	FILE *f = fopen( file.name.c_str(), "wb" );
+	BOOST_REQUIRE( f );
+	fputs( "not a checkpoint, just some text", f );
+	fclose( f );
+
+	Checkpoint in;
+	in.configure( file.name, 0, 0 );
+	BOOST_CHECK_NE( in.load(), 0 );
+
+	Checkpoint none;
+	none.configure( file.name + ".missing", 0, 0 );
+	BOOST_CHECK_NE( none.load(), 0 );
+}
+
+// ==============================================================
+
+BOOST_AUTO_TEST_SUITE_END()
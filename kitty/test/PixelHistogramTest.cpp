@@ -0,0 +1,93 @@
+//--------------------------------------------------------------------------
+// File and Version Information:
+// 	$Id$
+//
+// Description:
+//	Test suite case for PixelHistogram.
+//
+// Author List:
+//      Jan Moritz Feldkamp
+//
+//------------------------------------------------------------------------
+
+//-----------------
+// C/C++ Headers --
+//-----------------
+#include <cmath>
+#include <limits>
+
+//-------------------------------
+// Collaborating Class Headers --
+//-------------------------------
+#include "kitty/pixelhistogram.h"
+#include "kitty/workerpool.h"
+
+using namespace kitty;
+
+#define BOOST_TEST_MODULE PixelHistogramTest
+#include <boost/test/included/unit_test.hpp>
+
+// ==============================================================
+
+BOOST_AUTO_TEST_SUITE( PixelHistogramTest )
+
+// ==============================================================
+
+/// below 65535 counts, every value lands in its bin, values outside the window (and NaN) only in the total
+BOOST_AUTO_TEST_CASE( exact_counts )
+{
+	WorkerPool pool;
+	pool.create( 2 );
+	PixelHistogram h;
+	BOOST_REQUIRE_EQUAL( h.create( 3, -10., 5., 4 ), 0 );
+	array1D<double> data( 3 );
+	for (int e = 0; e < 1000; e++){
+		data.set( 0, -7.5 + 5*(e % 4) );							// one quarter in every bin
+		data.set( 1, (e % 2) ? 9.99 : 10. );						// the upper edge is outside
+		data.set( 2, std::numeric_limits<double>::quiet_NaN() );
+		h.add( &data, pool );
+	}
+	BOOST_CHECK_EQUAL( h.count(), 1000u );
+	BOOST_CHECK_EQUAL( h.halved(), 0ul );
+	BOOST_CHECK_EQUAL( h.outside(), 1500ul );
+
+	array1D<double> bins( 4 );
+	h.pixel( 0, &bins );
+	for (int b = 0; b < 4; b++){
+		BOOST_CHECK_EQUAL( bins.get(b), 250. );
+	}
+	h.pixel( 1, &bins );
+	BOOST_CHECK_EQUAL( bins.get(3), 500. );
+	h.pixel( 2, &bins );
+	BOOST_CHECK_EQUAL( bins.get(0) + bins.get(1) + bins.get(2) + bins.get(3), 0. );
+}
+
+/// a full bin halves the histogram, which then takes every second event: shape and scale are kept
+BOOST_AUTO_TEST_CASE( halving_keeps_shape )
+{
+	WorkerPool pool;
+	pool.create( 2 );
+	PixelHistogram h;
+	BOOST_REQUIRE_EQUAL( h.create( 1, 0., 1., 4 ), 0 );
+	array1D<double> data( 1 );
+	const int nEvents = 300000;
+	for (int e = 0; e < nEvents; e++){
+		data.set( 0, (e % 3 == 0) ? 2.5 : 1.5 );		// bins 2 and 1 in the ratio 1:2
+		h.add( &data, pool );
+	}
+	BOOST_CHECK_GE( h.halved(), 1ul );
+	BOOST_CHECK_EQUAL( h.outside(), 0ul );
+
+	array1D<double> bins( 4 );
+	h.pixel( 0, &bins );
+	BOOST_CHECK_EQUAL( bins.get(0), 0. );
+	BOOST_CHECK_EQUAL( bins.get(3), 0. );
+	//the counts come back scaled by the events skipped since the halvings
+	BOOST_CHECK_CLOSE( bins.get(1), 2.*nEvents/3, 1. );
+	BOOST_CHECK_CLOSE( bins.get(2), 1.*nEvents/3, 1. );
+	BOOST_CHECK_CLOSE( bins.get(1)/bins.get(2), 2., 1. );
+}
+
+// ==============================================================
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,80 @@
+#!/usr/bin/python
+
+# Usage:
+#    ./viewPreview.py -f img_preview.bin
+# shows the live preview written by kitty.assemble (previewOut = 1) while psana is running.
+# The file is polled, every newly published event replaces the displayed image and SAXS profile.
+#
+
+import os
+import sys
+import time
+from optparse import OptionParser
+
+parser = OptionParser()
+parser.add_option("-f", "--file", action="store", type="string", dest="previewFile",
+					help="preview ring buffer file (previewFile in psana.cfg)", metavar="FILE", default="img_preview.bin")
+parser.add_option("-p", "--poll", action="store", type="float", dest="pollInterval",
+					help="polling interval in seconds (default: 0.5)", metavar="SEC", default=0.5)
+
+(options, args) = parser.parse_args()
+
+import numpy as N
+
+import matplotlib
+import matplotlib.pyplot as P
+
+########################################################
+# Layout of the ring buffer, see kitty/include/previewring.h
+########################################################
+header_t = N.dtype([('magic', 'S8'), ('nSlots', 'u4'), ('nx', 'u4'), ('ny', 'u4'), ('nq', 'u4'),
+					('binning', 'u4'), ('headerBytes', 'u4'), ('slotBytes', 'u8'), ('written', 'u8')])
+slot_t = N.dtype([('sequence', 'u8'), ('index', 'u4'), ('sec', 'u4'), ('nsec', 'u4'), ('reserved', 'u4')])
+
+while not os.path.exists(options.previewFile):
+	print "waiting for "+options.previewFile+" ..."
+	time.sleep(1)
+
+m = N.memmap(options.previewFile, dtype='u1', mode='r')
+hdr = m[:header_t.itemsize].view(header_t)[0]
+while hdr['magic'] != "KTYPRVW1":
+	time.sleep(options.pollInterval)
+	m = N.memmap(options.previewFile, dtype='u1', mode='r')
+	hdr = m[:header_t.itemsize].view(header_t)[0]
+
+nx = int(hdr['nx'])
+ny = int(hdr['ny'])
+nq = int(hdr['nq'])
+q = m[header_t.itemsize:header_t.itemsize+4*nq].view('f4')
+print "preview: %d x %d image (binning %d), %d q bins, %d slots"%(nx, ny, hdr['binning'], nq, hdr['nSlots'])
+
+def readSlot(n):
+	start = int(hdr['headerBytes']) + n*int(hdr['slotBytes'])
+	info = m[start:start+slot_t.itemsize].view(slot_t)[0].copy()
+	data = m[start+slot_t.itemsize:start+int(hdr['slotBytes'])].view('f4').copy()
+	#the writer may have started to overwrite the slot while it was copied
+	if m[start:start+slot_t.itemsize].view(slot_t)[0]['sequence'] != info['sequence']:
+		info['sequence'] = 0
+	return info, data[:nx*ny].reshape(ny, nx), data[nx*ny:nx*ny+nq]
+
+P.ion()
+fig = P.figure()
+canvas_img = fig.add_subplot(121)
+canvas_saxs = fig.add_subplot(122)
+shown = 0
+while True:
+	written = int(m[:header_t.itemsize].view(header_t)[0]['written'])
+	if written > shown:
+		info, img, saxs = readSlot((written-1) % int(hdr['nSlots']))
+		#skip slots that were incomplete or overwritten while reading
+		if info['sequence'] == 2*written:
+			canvas_img.cla()
+			canvas_img.imshow(img, origin='lower')
+			canvas_img.set_title("event %d"%(info['index']))
+			canvas_saxs.cla()
+			if nq > 0:
+				canvas_saxs.plot(q, saxs)
+				canvas_saxs.set_xlabel("q")
+			fig.canvas.draw()
+			shown = written
+	P.pause(options.pollInterval)
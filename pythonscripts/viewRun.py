@@ -30,6 +30,8 @@ parser.add_option("-r", "--run", action="store", type="string", dest="runNumber"
 					help="run number you wish to view", metavar="XXXX", default="")
 parser.add_option("-t", "--tag", action="store", type="string", dest="fileTag",
 					help="file tag for run (default: img)", metavar="FILETAG", default="img")
+parser.add_option("-s", "--stack", action="store_true", dest="useStack",
+					help="read single events from the run's event stack file (stackOut = 1)", default=False)
 parser.add_option("-i", "--input_dir", action="store", type="string", dest="source_dir",
 					help="input directory", metavar="INPUTDIR", default=source_dir_default)
 parser.add_option("-o", "--output_dir", action="store", type="string", dest="write_dir",
@@ -54,11 +56,18 @@ runtag = "r%s"%(options.runNumber)
 
 ########################################################
 # Search specified directory for *.h5 files
+# (not needed when reading from the event stack)
 ########################################################
-searchstring = options.fileTag+'_'+"evt"+"[a-z0-9\_]+_polar.h5"
-h5pattern = re.compile(searchstring)
-h5files = [h5pattern.findall(x) for x in os.listdir(source_dir+runtag)]
-h5files = [items for sublists in h5files for items in sublists]
+stackfile = source_dir+runtag+"/"+options.fileTag+"_evtstack_correlate.h5"
+h5files = []
+if not options.useStack:
+	searchstring = options.fileTag+'_'+"evt"+"[a-z0-9\_]+_polar.h5"
+	h5pattern = re.compile(searchstring)
+	h5files = [h5pattern.findall(x) for x in os.listdir(source_dir+runtag)]
+	h5files = [items for sublists in h5files for items in sublists]
+elif not os.path.exists(stackfile):
+	print "Event stack file "+stackfile+" not found, aborting script."
+	sys.exit(1)
 
 colmax = 100
 colmin = 0
@@ -144,9 +153,18 @@ print "Hit Ctl-\ or close all windows (Alt-F4) to terminate viewing program."
 ########################################################
 # Loop to display all H5 files found. 
 ########################################################
-for fname in h5files:
-	f = H.File(source_dir+runtag+"/"+fname, 'r')
-	d = N.array(f['/data/data'])
+if options.useStack:
+	f = H.File(stackfile, 'r')
+	polar = f['/polar']
+	events = N.array(f['/event'])
+	for n in range(polar.shape[0]):
+		currImg = img_class(N.array(polar[n]), options.fileTag+"_evt%010d_polar"%(events['index'][n]))
+		currImg.draw_img()
 	f.close()
-	currImg = img_class(d, fname)
-	currImg.draw_img()
+else:
+	for fname in h5files:
+		f = H.File(source_dir+runtag+"/"+fname, 'r')
+		d = N.array(f['/data/data'])
+		f.close()
+		currImg = img_class(d, fname)
+		currImg.draw_img()